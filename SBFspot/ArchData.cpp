@@ -40,201 +40,605 @@ using namespace boost::date_time;
 using namespace boost::posix_time;
 using namespace boost::gregorian;
 
-E_SBFSPOT ArchiveDayData(InverterData *inverters[], time_t startTime)
+/*
+ * Midnight of the day given by startTime
+ */
+static time_t archDayStart(time_t startTime, struct tm *start_tm)
 {
-    if (VERBOSE_NORMAL)
-    {
-        puts("********************");
-        puts("* ArchiveDayData() *");
-        puts("********************");
-    }
+	startTime -= 86400;		// fix Issue CP23: to overcome problem with DST transition - RB@20140330
 
-	bool hasMultigate = false;
+    memcpy(start_tm, localtime(&startTime), sizeof(struct tm));
 
-	startTime -= 86400;		// fix Issue CP23: to overcome problem with DST transition - RB@20140330
+    start_tm->tm_hour = 0;
+    start_tm->tm_min = 0;
+    start_tm->tm_sec = 0;
+    start_tm->tm_mday++;		// fix Issue CP23: to overcome problem with DST transition - RB@20140330
+	return mktime(start_tm);
+}
 
-    E_SBFSPOT rc = E_OK;
-    struct tm start_tm;
-    memcpy(&start_tm, localtime(&startTime), sizeof(start_tm));
+static bool hasArchiveDayData(const InverterData *inv)
+{
+	return (inv->DevClass != CommunicationProduct) && (inv->SUSyID != SID_MULTIGATE);
+}
 
-    start_tm.tm_hour = 0;
-    start_tm.tm_min = 0;
-    start_tm.tm_sec = 0;
-    start_tm.tm_mday++;		// fix Issue CP23: to overcome problem with DST transition - RB@20140330
-	startTime = mktime(&start_tm);
+/*
+ * Number of days (from startTime back) a device has to be asked
+ * With -sync the days before its latest record in the database are skipped
+ */
+static int archDayCount(const InverterData *inv, time_t startTime, int days)
+{
+	if (!hasArchiveDayData(inv)) return 0;
+	if (inv->archDaySince == 0) return days;
+
+	int count = 0;
+	struct tm start_tm;
+	while ((count < days) && (archDayStart(startTime - count * 86400, &start_tm) + 86100 >= inv->archDaySince))
+		count++;
+	return count;
+}
 
-    if (VERBOSE_NORMAL)
-        printf("startTime = %08lX -> %s\n", startTime, strftime_t("%d/%m/%Y %H:%M:%S", startTime));
+/*
+ * Request the 5 minute records of the days from firstDay to lastDay (both midnight)
+ * The record before midnight is needed to calculate the power of the first interval
+ * With -sync the records before the latest one in the database are not asked
+ */
+static void writeArchiveDayRequest(const InverterData *inv, time_t firstDay, time_t lastDay)
+{
+	writePacketHeader(pcktBuf, 0x01, inv->BTAddress);
+	writePacket(pcktBuf, 0x09, 0xE0, 0, inv->SUSyID, inv->Serial);
+	writeLong(pcktBuf, 0x70000200);
+	writeLong(pcktBuf, std::max(firstDay - 300, inv->archDaySince));
+	writeLong(pcktBuf, lastDay + 86100);
+	writePacketTrailer(pcktBuf);
+	writePacketLength(pcktBuf);
+}
+
+/*
+ * Append the 5 minute records of the fragment in pcktBuf
+ */
+static void readDayRecords(std::vector<ArchDayRecord> &records)
+{
+	const int recordsize = 12;
 
-    for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
+	for(int x = 41; x < (packetposition - 3); x += recordsize)
 	{
-		if (inverters[inv]->SUSyID == SID_MULTIGATE) hasMultigate = true;
-		inverters[inv]->hasDayData = false;
-        for(unsigned int i=0; i<sizeof(inverters[inv]->dayData)/sizeof(DayData); i++)
-		{
-			DayData *pdayData = &inverters[inv]->dayData[i];
-            pdayData->datetime = 0;
-			pdayData->totalWh = 0;
-			pdayData->watt = 0;
-		}
+		ArchDayRecord rec;
+		rec.datetime = (time_t)get_long(pcktBuf + x);
+		rec.totalWh = (unsigned long long)get_longlong(pcktBuf + x + 4);
+		records.push_back(rec);
 	}
+}
 
-    int packetcount = 0;
-    int validPcktID = 0;
+/*
+ * Get the 5 minute records of a number of days up to the day of startTime in one request
+ * The fragments of the reply are collected in records, see splitDayRecords()
+ */
+E_SBFSPOT ArchiveDayRecords(InverterData *inverter, time_t startTime, int days, std::vector<ArchDayRecord> &records)
+{
+	struct tm start_tm;
+	time_t lastDay = archDayStart(startTime, &start_tm);
+	time_t firstDay = archDayStart(startTime - (days - 1) * 86400, &start_tm);
 
-    E_SBFSPOT hasData = E_ARCHNODATA;
+	if (VERBOSE_HIGH)
+		printf("Day records %s -> %s (SN: %lu)\n", strftime_t("%d/%m/%Y", firstDay), strftime_t("%d/%m/%Y", lastDay), inverter->Serial);
 
-    for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
-    {
-		if ((inverters[inv]->DevClass != CommunicationProduct) && (inverters[inv]->SUSyID != SID_MULTIGATE))
-		{
-			do
-			{
-				pcktID++;
-				writePacketHeader(pcktBuf, 0x01, inverters[inv]->BTAddress);
-				writePacket(pcktBuf, 0x09, 0xE0, 0, inverters[inv]->SUSyID, inverters[inv]->Serial);
-				writeLong(pcktBuf, 0x70000200);
-				writeLong(pcktBuf, startTime - 300);
-				writeLong(pcktBuf, startTime + 86100);
-				writePacketTrailer(pcktBuf);
-				writePacketLength(pcktBuf);
-			}
-			while (!isCrcValid(pcktBuf[packetposition-3], pcktBuf[packetposition-2]));
+	records.clear();
+
+	pcktID++;
+	writeArchiveDayRequest(inverter, firstDay, lastDay);
+
+	if (ConnType == CT_BLUETOOTH)
+		bthSend(pcktBuf);
+	else
+		ethSend(pcktBuf, inverter->IPAddress);
 
+	E_SBFSPOT rc = E_OK;
+	int packetcount = 0;
+	int validPcktID = 0;
+
+	do
+	{
+		do
+		{
 			if (ConnType == CT_BLUETOOTH)
-				bthSend(pcktBuf);
+				rc = getPacket(inverter->BTAddress, 1);
 			else
-				ethSend(pcktBuf, inverters[inv]->IPAddress);
+				rc = ethGetPacket();
 
-			do
-			{
-				unsigned long long totalWh = 0;
-				unsigned long long totalWh_prev = 0;
-				time_t datetime = 0;
-				time_t datetime_prev = 0;
-				time_t datetime_next = 0;
-				bool dblrecord = false;		// Flag for double records (twins)
+			if (rc != E_OK) return rc;
 
-				const int recordsize = 12;
+			packetcount = pcktBuf[25];
 
-				do
+			//TODO: Move checksum validation to getPacket
+			if ((ConnType == CT_BLUETOOTH) && (!validateChecksum()))
+				return E_CHKSUM;
+			else
+			{
+				unsigned short rcvpcktID = get_short(pcktBuf+27) & 0x7FFF;
+				if ((validPcktID == 1) || (pcktID == rcvpcktID))
 				{
-					if (ConnType == CT_BLUETOOTH)
-						rc = getPacket(inverters[inv]->BTAddress, 1);
-					else
-						rc = ethGetPacket();
+					validPcktID = 1;
+					readDayRecords(records);
+				}
+				else
+				{
+					if (DEBUG_HIGHEST) printf("Packet ID mismatch. Expected %d, received %d\n", pcktID, rcvpcktID);
+					validPcktID = 0;
+					packetcount = 0;
+				}
+			}
+		}
+		while (packetcount > 0);
+	}
+	while (validPcktID == 0);
 
-					if (rc != E_OK) return rc;
+	return E_OK;
+}
+
+/*
+ * Split a stream of 5 minute records into the 288 records of each day
+ * Records of other days are skipped
+ */
+void splitDayRecords(const std::vector<ArchDayRecord> &records, std::vector<ArchDay> &days)
+{
+	unsigned long long totalWh = 0;
+	unsigned long long totalWh_prev = 0;
+	time_t datetime = 0;
+	time_t datetime_prev = 0;
+	bool dblrecord = false;		// Flag for double records (twins)
+
+	std::vector<struct tm> start_tm(days.size());
+	for (unsigned int d = 0; d < days.size(); d++)
+	{
+		memcpy(&start_tm[d], localtime(&days[d].startTime), sizeof(struct tm));
+		days[d].hasDayData = false;
+		days[d].hasData = false;
+	}
 
-					packetcount = pcktBuf[25];
+	for (std::vector<ArchDayRecord>::const_iterator it = records.begin(); it != records.end(); ++it)
+	{
+		if (0 != (it->datetime - datetime)) // Fix Issue 108: sbfspot v307 crashes for daily export (-adnn)
+		{
+			totalWh_prev = totalWh;
+			datetime_prev = datetime;
+			datetime = it->datetime;
+			dblrecord = false;
+		}
+		else
+			dblrecord = true;
 
-					//TODO: Move checksum validation to getPacket
-					if ((ConnType == CT_BLUETOOTH) && (!validateChecksum()))
-						return E_CHKSUM;
-					else
+		totalWh = it->totalWh;
+		if (totalWh != NaN_U64) // Fix Issue 109: Bad request 400: Power value too high for system size
+		{
+			if (totalWh > 0)
+			{
+				// Same as a request for this day only
+				for (unsigned int d = 0; d < days.size(); d++)
+					if ((datetime >= days[d].startTime - 300) && (datetime <= days[d].startTime + 86100))
+						days[d].hasData = true;
+			}
+
+			if (totalWh_prev != 0)
+			{
+				struct tm timeinfo;
+				localtime_t(datetime, &timeinfo);
+				for (unsigned int d = 0; d < days.size(); d++)
+				{
+					if ((start_tm[d].tm_mday != timeinfo.tm_mday) || (start_tm[d].tm_mon != timeinfo.tm_mon) || (start_tm[d].tm_year != timeinfo.tm_year))
+						continue;
+
+					unsigned int idx = (timeinfo.tm_hour * 12) + (timeinfo.tm_min / 5);
+					if (idx < ARCH_DAYRECORDS)
 					{
-						unsigned short rcvpcktID = get_short(pcktBuf+27) & 0x7FFF;
-						if ((validPcktID == 1) || (pcktID == rcvpcktID))
+						DayData *pdayData = &days[d].dayData[idx];
+						if (VERBOSE_HIGHEST && dblrecord)
 						{
-							validPcktID = 1;
-							for(int x = 41; x < (packetposition - 3); x += recordsize)
-							{
-								datetime_next = (time_t)get_long(pcktBuf + x);
-								if (0 != (datetime_next - datetime)) // Fix Issue 108: sbfspot v307 crashes for daily export (-adnn)
-								{
-									totalWh_prev = totalWh;
-									datetime_prev = datetime;
-									datetime = datetime_next;
-									dblrecord = false;
-								}
-								else
-									dblrecord = true;
-
-								totalWh = (unsigned long long)get_longlong(pcktBuf + x + 4);
-								if (totalWh != NaN_U64) // Fix Issue 109: Bad request 400: Power value too high for system size
-								{
-									if (totalWh > 0) hasData = E_OK;
-									if (totalWh_prev != 0)
-									{
-										struct tm timeinfo;
-										memcpy(&timeinfo, localtime(&datetime), sizeof(timeinfo));
-										if (start_tm.tm_mday == timeinfo.tm_mday)
-										{
-											unsigned int idx = (timeinfo.tm_hour * 12) + (timeinfo.tm_min / 5);
-											if (idx < sizeof(inverters[inv]->dayData)/sizeof(DayData))
-											{
-												if (VERBOSE_HIGHEST && dblrecord)
-												{
-													std::cout << "Overwriting existing record: " << strftime_t("%d/%m/%Y %H:%M:%S", datetime);
-													std::cout << " - " << std::fixed << std::setprecision(3) << (double)inverters[inv]->dayData[idx].totalWh/1000 << "kWh";
-													std::cout << " - " << std::fixed << std::setprecision(0) << inverters[inv]->dayData[idx].watt << "W" << std::endl;
-												}
-												if (VERBOSE_HIGHEST && ((datetime - datetime_prev) > 300))
-												{
-													std::cout << "Missing records in datastream " << strftime_t("%d/%m/%Y %H:%M:%S", datetime_prev);
-													std::cout << " -> " << strftime_t("%H:%M:%S", datetime) << std::endl;
-												}
-												inverters[inv]->dayData[idx].datetime = datetime;
-												inverters[inv]->dayData[idx].totalWh = totalWh;
-												//inverters[inv]->dayData[idx].watt = (totalWh - totalWh_prev) * 12;	// 60:5
-												// Fix Issue 105 - Don't assume each interval is 5 mins
-												// This is also a bug in SMA's Sunny Explorer V1.07.17 and before
-												inverters[inv]->dayData[idx].watt = (totalWh - totalWh_prev) * 3600 / (datetime - datetime_prev);
-												inverters[inv]->hasDayData = true;
-											}
-										}
-									}
-								}
-							} //for
+							std::cout << "Overwriting existing record: " << strftime_t("%d/%m/%Y %H:%M:%S", datetime);
+							std::cout << " - " << std::fixed << std::setprecision(3) << (double)pdayData->totalWh/1000 << "kWh";
+							std::cout << " - " << std::fixed << std::setprecision(0) << pdayData->watt << "W" << std::endl;
 						}
-						else
+						if (VERBOSE_HIGHEST && ((datetime - datetime_prev) > 300))
 						{
-							if (DEBUG_HIGHEST) printf("Packet ID mismatch. Expected %d, received %d\n", pcktID, rcvpcktID);
-							validPcktID = 0;
-							packetcount = 0;
+							std::cout << "Missing records in datastream " << strftime_t("%d/%m/%Y %H:%M:%S", datetime_prev);
+							std::cout << " -> " << strftime_t("%H:%M:%S", datetime) << std::endl;
 						}
+						pdayData->datetime = datetime;
+						pdayData->totalWh = totalWh;
+						//pdayData->watt = (totalWh - totalWh_prev) * 12;	// 60:5
+						// Fix Issue 105 - Don't assume each interval is 5 mins
+						// This is also a bug in SMA's Sunny Explorer V1.07.17 and before
+						pdayData->watt = (totalWh - totalWh_prev) * 3600 / (datetime - datetime_prev);
+						days[d].hasDayData = true;
 					}
+					break;
 				}
-				while (packetcount > 0);
 			}
-			while (validPcktID == 0);
 		}
-    }
+	}
+}
 
-	if (hasMultigate)
-	{
-		/*
-		 *	Consolidate micro-inverter daydata into multigate
-		 *	For each multigate search its connected devices
-		 *	Add totalWh and power of each device to multigate daydata
-		 */
-		
-		if (VERBOSE_HIGHEST) std::cout << "Consolidating daydata of micro-inverters into multigate..." << std::endl;
+/*
+ * Consolidate micro-inverter daydata into multigate
+ * For each multigate search its connected devices
+ * Add totalWh and power of each device to multigate daydata
+ */
+static void consolidateMultigateDayData(InverterData *inverters[])
+{
+	if (VERBOSE_HIGHEST) std::cout << "Consolidating daydata of micro-inverters into multigate..." << std::endl;
 
-		for (int mg=0; inverters[mg]!=NULL && mg<MAX_INVERTERS; mg++)
+	for (int mg=0; inverters[mg]!=NULL; mg++)
+	{
+		InverterData *pmg = inverters[mg];
+		if (pmg->SUSyID == SID_MULTIGATE)
 		{
-			InverterData *pmg = inverters[mg];
-			if (pmg->SUSyID == SID_MULTIGATE)
+			pmg->hasDayData = true;
+			for (int sb240=0; inverters[sb240]!=NULL; sb240++)
 			{
-				pmg->hasDayData = true;
-				for (int sb240=0; inverters[sb240]!=NULL && sb240<MAX_INVERTERS; sb240++)
+				InverterData *psb = inverters[sb240];
+				if ((psb->SUSyID == SID_SB240) && (psb->multigateID == mg))
 				{
-					InverterData *psb = inverters[sb240];
-					if ((psb->SUSyID == SID_SB240) && (psb->multigateID == mg))
+					for (unsigned int dd=0; dd < ARCH_DAYRECORDS; dd++)
 					{
-						for (unsigned int dd=0; dd < ARRAYSIZE(inverters[0]->dayData); dd++)
-						{
-							pmg->dayData[dd].datetime = psb->dayData[dd].datetime;
-							pmg->dayData[dd].totalWh += psb->dayData[dd].totalWh;
-							pmg->dayData[dd].watt += psb->dayData[dd].watt;
-						}
+						pmg->dayData[dd].datetime = psb->dayData[dd].datetime;
+						pmg->dayData[dd].totalWh += psb->dayData[dd].totalWh;
+						pmg->dayData[dd].watt += psb->dayData[dd].watt;
 					}
 				}
 			}
 		}
 	}
+}
 
-    return hasData;
+/*
+ * One archived day of all devices, waiting for the devices that still have to answer
+ */
+struct ArchDayBuffer
+{
+	time_t startTime;
+	int remaining;					// Devices still to answer
+	bool hasData;
+	std::vector<DayData> dayData;	// ARCH_DAYRECORDS per device
+	std::vector<char> hasDayData;	// One per device
+};
+
+typedef std::map<int, ArchDayBuffer> ArchDayBuffers;	// day -> buffer
+
+/*
+ * Open the buffers of days firstDay up to firstDay+count (day 0 = startTime, 1 = the day before, ...)
+ * dayCount holds the number of days each device has to be asked
+ */
+static void openDayBuffers(ArchDayBuffers &openDays, time_t startTime, int firstDay, int count, const std::vector<int> &dayCount)
+{
+	int devcount = (int)dayCount.size();
+
+	for (int day = firstDay; day < firstDay + count; day++)
+	{
+		if (openDays.find(day) != openDays.end()) continue;
+
+		int remaining = 0;
+		for (int i=0; i<devcount; i++)
+			if (dayCount[i] > day) remaining++;
+		if (remaining == 0) continue;
+
+		ArchDayBuffer &buf = openDays[day];
+		struct tm start_tm;
+		buf.startTime = archDayStart(startTime - day * 86400, &start_tm);
+		buf.remaining = remaining;
+		buf.hasData = false;
+		buf.dayData.assign(devcount * ARCH_DAYRECORDS, DayData());
+		buf.hasDayData.assign(devcount, 0);
+
+		if (VERBOSE_NORMAL)
+			printf("startTime = %08lX -> %s\n", buf.startTime, strftime_t("%d/%m/%Y %H:%M:%S", buf.startTime));
+	}
+}
+
+/*
+ * Split the records of one device into the buffers of days firstDay up to firstDay+count
+ */
+static void storeDayRecords(ArchDayBuffers &openDays, int inv, int firstDay, int count, const std::vector<ArchDayRecord> &records)
+{
+	std::vector<ArchDay> days(count);
+	for (int d = 0; d < count; d++)
+	{
+		ArchDayBuffer &buf = openDays[firstDay + d];
+		days[d].startTime = buf.startTime;
+		days[d].dayData = &buf.dayData[inv * ARCH_DAYRECORDS];
+	}
+
+	splitDayRecords(records, days);
+
+	for (int d = 0; d < count; d++)
+	{
+		ArchDayBuffer &buf = openDays[firstDay + d];
+		if (days[d].hasData) buf.hasData = true;
+		buf.hasDayData[inv] = days[d].hasDayData;
+	}
+}
+
+/*
+ * Copy a completed day back into the device list and pass it on
+ */
+static void flushDayBuffer(InverterData *inverters[], ArchDayBuffer &buf, bool hasMultigate, DayDataHandler handler, void *param)
+{
+	for (int inv=0; inverters[inv]!=NULL; inv++)
+	{
+		memcpy(inverters[inv]->dayData, &buf.dayData[inv * ARCH_DAYRECORDS], sizeof(inverters[inv]->dayData));
+		inverters[inv]->hasDayData = (buf.hasDayData[inv] != 0);
+	}
+
+	if (hasMultigate)
+		consolidateMultigateDayData(inverters);
+
+	if (buf.hasData)
+		handler(inverters, buf.startTime, param);
+}
+
+/*
+ * A device has answered (or given up) for days firstDay up to firstDay+count
+ * Pass on the days that are complete now, returns true if one of them has data
+ */
+static bool completeDays(InverterData *inverters[], ArchDayBuffers &openDays, int firstDay, int count, bool hasMultigate, DayDataHandler handler, void *param)
+{
+	bool hasData = false;
+
+	for (int day = firstDay; day < firstDay + count; day++)
+	{
+		ArchDayBuffers::iterator it = openDays.find(day);
+		if (--it->second.remaining == 0)
+		{
+			if (it->second.hasData) hasData = true;
+			flushDayBuffer(inverters, it->second, hasMultigate, handler, param);
+			openDays.erase(it);
+		}
+	}
+
+	return hasData;
+}
+
+/*
+ * Outstanding archived day request of one device
+ */
+struct ArchDayRequest
+{
+	int inv;
+	int firstDay;
+	int count;
+	int retries;
+	boost::posix_time::ptime deadline;
+	std::vector<ArchDayRecord> records;
+};
+
+typedef boost::unordered_map<unsigned short, ArchDayRequest> ArchDayPending;	// pcktID -> request
+
+static void ethSendArchiveDayRequest(InverterData *inverters[], int inv, int firstDay, int count, int retries, ArchDayBuffers &openDays, ArchDayPending &pending)
+{
+	pcktID++;
+	// Day numbers go back in time
+	writeArchiveDayRequest(inverters[inv], openDays[firstDay + count - 1].startTime, openDays[firstDay].startTime);
+	ethSend(pcktBuf, inverters[inv]->IPAddress);
+
+	ArchDayRequest &req = pending[pcktID & 0x7FFF];
+	req.inv = inv;
+	req.firstDay = firstDay;
+	req.count = count;
+	req.retries = retries;
+	req.deadline = boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(ETH_TIMEOUT);
+	req.records.clear();
+}
+
+/*
+ * Speedwire: Keep requests for several (device, range of days) pairs in flight at once
+ * Each request asks up to ARCH_DAYSPERREQUEST days and gets its own pcktID and deadline,
+ * fragments are matched on pcktID as they arrive
+ * No more than maxPerDevice requests are pending per IP address (devices behind a multigate share one)
+ * Devices run at most 2*maxPerDevice requests ahead of the oldest incomplete day to bound the buffers
+ */
+static E_SBFSPOT ethBackfillDayData(InverterData *inverters[], time_t startTime, int days, int maxPerDevice, DayDataHandler handler, void *param)
+{
+	bool hasMultigate = false;
+	std::vector<int> dayCount;
+	for (int inv=0; inverters[inv]!=NULL; inv++)
+	{
+		if (inverters[inv]->SUSyID == SID_MULTIGATE) hasMultigate = true;
+		dayCount.push_back(archDayCount(inverters[inv], startTime, days));
+	}
+
+	int devcount = (int)dayCount.size();
+	if (std::count(dayCount.begin(), dayCount.end(), 0) == devcount) return E_ARCHNODATA;
+
+	const int maxOpenDays = 2 * maxPerDevice * ARCH_DAYSPERREQUEST;
+	std::vector<int> nextDay(devcount, 0);
+	std::map<std::string, int> busyIP;						// IP address -> pending requests
+	ArchDayBuffers openDays;
+	ArchDayPending pending;
+	E_SBFSPOT rc = E_ARCHNODATA;
+	E_SBFSPOT err = E_OK;
+	// Only look at all devices or all requests when something has changed,
+	// doing so for every fragment made the backfill of large plants CPU bound
+	bool refill = true;				// A request has finished, there may be room for the next ones
+	ptime nextDeadline = boost::posix_time::microsec_clock::universal_time();	// No request expires before this
+
+	for (;;)
+	{
+		if (refill)
+		{
+			refill = false;
+
+			// Oldest day that is not complete yet
+			int firstDay = openDays.empty() ? days : openDays.begin()->first;
+			for (int i=0; i<devcount; i++)
+				if ((nextDay[i] < dayCount[i]) && (nextDay[i] < firstDay))
+					firstDay = nextDay[i];
+
+			if (firstDay >= days) break;
+
+			// Send the next days to each device whose IP address has room for another request
+			for (int i=0; i<devcount; i++)
+			{
+				InverterData *pinv = inverters[i];
+				if (nextDay[i] >= dayCount[i]) continue;
+
+				int &busy = busyIP[pinv->IPAddress];
+				while ((busy < maxPerDevice) && (nextDay[i] < dayCount[i]) && (nextDay[i] < firstDay + maxOpenDays))
+				{
+					int count = std::min(ARCH_DAYSPERREQUEST, dayCount[i] - nextDay[i]);
+					openDayBuffers(openDays, startTime, nextDay[i], count, dayCount);
+					ethSendArchiveDayRequest(inverters, i, nextDay[i], count, 0, openDays, pending);
+					nextDay[i] += count;
+					busy++;
+				}
+			}
+		}
+
+		// Wait no longer than the first deadline
+		ptime now = boost::posix_time::microsec_clock::universal_time();
+		long timeout_ms = (nextDeadline > now) ? (long)(nextDeadline - now).total_milliseconds() : 0;
+
+		std::vector<unsigned short> finished;
+
+		if (ethGetPacket((int)timeout_ms) == E_OK)
+		{
+			unsigned short rcvpcktID = get_short(pcktBuf+27) & 0x7FFF;
+			ArchDayPending::iterator it = pending.find(rcvpcktID);
+
+			if (it == pending.end())
+			{
+				if (DEBUG_HIGHEST) printf("Unexpected packet ID %d\n", rcvpcktID);
+			}
+			else
+			{
+				// Error 0x0017: Not logged on (session timed out)
+				if (get_short(pcktBuf + 23) == 0x0017)
+				{
+					if (DEBUG_NORMAL) printf("Session expired (SUSyID: %d - SN: %lu)\n", inverters[it->second.inv]->SUSyID, inverters[it->second.inv]->Serial);
+					return E_NOLOGON;
+				}
+
+				readDayRecords(it->second.records);
+
+				if (pcktBuf[25] == 0)	// Last fragment
+				{
+					storeDayRecords(openDays, it->second.inv, it->second.firstDay, it->second.count, it->second.records);
+					finished.push_back(rcvpcktID);
+				}
+				else
+					it->second.deadline = boost::posix_time::microsec_clock::universal_time() + milliseconds(ETH_TIMEOUT);
+			}
+		}
+
+		// Ask once more or give up on requests that missed their deadline
+		// A lost fragment can't be requested on its own, so the whole range is asked again
+		// Deadlines only move forward, nothing can have expired before nextDeadline
+		std::vector<unsigned short> expired;
+		now = boost::posix_time::microsec_clock::universal_time();
+		if (nextDeadline <= now)
+		{
+			nextDeadline = now + milliseconds(ETH_TIMEOUT);
+			for (ArchDayPending::iterator it = pending.begin(); it != pending.end(); ++it)
+			{
+				if (it->second.deadline > now)
+				{
+					if (it->second.deadline < nextDeadline)
+						nextDeadline = it->second.deadline;
+					continue;
+				}
+
+				InverterData *pinv = inverters[it->second.inv];
+				const char *day = strftime_t("%d/%m/%Y", openDays[it->second.firstDay].startTime);
+				if (it->second.retries < ARCH_RETRIES)
+				{
+					if (DEBUG_NORMAL) printf("Retry %s (SN: %lu) for %s\n", pinv->IPAddress, pinv->Serial, day);
+					expired.push_back(it->first);
+				}
+				else
+				{
+					if (VERBOSE_NORMAL) printf("No reply from %s (SN: %lu) for %s\n", pinv->IPAddress, pinv->Serial, day);
+					finished.push_back(it->first);
+					err = E_NODATA;
+				}
+			}
+		}
+
+		for (std::vector<unsigned short>::iterator ite = expired.begin(); ite != expired.end(); ++ite)
+		{
+			ArchDayRequest &req = pending[*ite];
+			int inv = req.inv, firstDay = req.firstDay, count = req.count, retries = req.retries;
+			pending.erase(*ite);
+			ethSendArchiveDayRequest(inverters, inv, firstDay, count, retries + 1, openDays, pending);
+		}
+
+		for (std::vector<unsigned short>::iterator itf = finished.begin(); itf != finished.end(); ++itf)
+		{
+			ArchDayRequest &req = pending[*itf];
+			busyIP[inverters[req.inv]->IPAddress]--;
+			if (completeDays(inverters, openDays, req.firstDay, req.count, hasMultigate, handler, param))
+				rc = E_OK;
+			pending.erase(*itf);
+			refill = true;
+		}
+	}
+
+	return (err != E_OK) ? err : rc;
+}
+
+/*
+ * Bluetooth: One device after the other, ARCH_DAYSPERREQUEST days at a time
+ */
+static E_SBFSPOT bthBackfillDayData(InverterData *inverters[], time_t startTime, int days, DayDataHandler handler, void *param)
+{
+	bool hasMultigate = false;
+	std::vector<int> dayCount;
+	for (int inv=0; inverters[inv]!=NULL; inv++)
+	{
+		if (inverters[inv]->SUSyID == SID_MULTIGATE) hasMultigate = true;
+		dayCount.push_back(archDayCount(inverters[inv], startTime, days));
+	}
+
+	int maxDays = dayCount.empty() ? 0 : *std::max_element(dayCount.begin(), dayCount.end());
+	if (maxDays == 0) return E_ARCHNODATA;
+
+	ArchDayBuffers openDays;
+	std::vector<ArchDayRecord> records;
+	E_SBFSPOT rc = E_ARCHNODATA;
+	E_SBFSPOT err = E_OK;
+
+	for (int firstDay = 0; firstDay < maxDays; firstDay += ARCH_DAYSPERREQUEST)
+	{
+		openDayBuffers(openDays, startTime, firstDay, std::min(ARCH_DAYSPERREQUEST, maxDays - firstDay), dayCount);
+
+		for (int inv=0; inverters[inv]!=NULL; inv++)
+		{
+			if (firstDay >= dayCount[inv]) continue;
+
+			int count = std::min(ARCH_DAYSPERREQUEST, dayCount[inv] - firstDay);
+			E_SBFSPOT invrc = ArchiveDayRecords(inverters[inv], openDays[firstDay].startTime, count, records);
+			if (invrc == E_OK)
+				storeDayRecords(openDays, inv, firstDay, count, records);
+			else
+				err = invrc;
+
+			if (completeDays(inverters, openDays, firstDay, count, hasMultigate, handler, param))
+				rc = E_OK;
+		}
+	}
+
+	return (err != E_OK) ? err : rc;
+}
+
+E_SBFSPOT BackfillDayData(InverterData *inverters[], time_t startTime, int days, int maxPerDevice, DayDataHandler handler, void *param)
+{
+    if (VERBOSE_NORMAL)
+    {
+        puts("*********************");
+        puts("* BackfillDayData() *");
+        puts("*********************");
+    }
+
+	if (ConnType == CT_ETHERNET)
+		return ethBackfillDayData(inverters, startTime, days, (maxPerDevice < 1) ? 1 : maxPerDevice, handler, param);
+	else
+		return bthBackfillDayData(inverters, startTime, days, handler, param);
 }
 
 E_SBFSPOT ArchiveMonthData(InverterData *inverters[], tm *start_tm)
@@ -260,7 +664,7 @@ E_SBFSPOT ArchiveMonthData(InverterData *inverters[], tm *start_tm)
     if (VERBOSE_NORMAL)
         printf("startTime = %08lX -> %s\n", startTime, strftime_t("%d/%m/%Y %H:%M:%S", startTime));
 
-    for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
+    for (int inv=0; inverters[inv]!=NULL; inv++)
 	{
 		if (inverters[inv]->SUSyID == SID_MULTIGATE) hasMultigate = true;
 		inverters[inv]->hasMonthData = false;
@@ -275,22 +679,18 @@ E_SBFSPOT ArchiveMonthData(InverterData *inverters[], tm *start_tm)
     int packetcount = 0;
     int validPcktID = 0;
 
-    for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
+    for (int inv=0; inverters[inv]!=NULL; inv++)
     {
 		if ((inverters[inv]->DevClass != CommunicationProduct) && (inverters[inv]->SUSyID != SID_MULTIGATE))
 		{
-			do
-			{
-				pcktID++;
-				writePacketHeader(pcktBuf, 0x01, inverters[inv]->BTAddress);
-				writePacket(pcktBuf, 0x09, 0xE0, 0, inverters[inv]->SUSyID, inverters[inv]->Serial);
-				writeLong(pcktBuf, 0x70200200);
-				writeLong(pcktBuf, startTime - 86400 - 86400);
-				writeLong(pcktBuf, startTime + 86400 * (sizeof(inverters[inv]->monthData)/sizeof(MonthData) +1));
-				writePacketTrailer(pcktBuf);
-				writePacketLength(pcktBuf);
-			}
-			while (!isCrcValid(pcktBuf[packetposition-3], pcktBuf[packetposition-2]));
+			pcktID++;
+			writePacketHeader(pcktBuf, 0x01, inverters[inv]->BTAddress);
+			writePacket(pcktBuf, 0x09, 0xE0, 0, inverters[inv]->SUSyID, inverters[inv]->Serial);
+			writeLong(pcktBuf, 0x70200200);
+			writeLong(pcktBuf, startTime - 86400 - 86400);
+			writeLong(pcktBuf, startTime + 86400 * (sizeof(inverters[inv]->monthData)/sizeof(MonthData) +1));
+			writePacketTrailer(pcktBuf);
+			writePacketLength(pcktBuf);
 
 			if (ConnType == CT_BLUETOOTH)
 				bthSend(pcktBuf);
@@ -377,13 +777,13 @@ E_SBFSPOT ArchiveMonthData(InverterData *inverters[], tm *start_tm)
 
 		if (VERBOSE_HIGHEST) std::cout << "Consolidating monthdata of micro-inverters into multigate..." << std::endl;
 
-		for (int mg=0; inverters[mg]!=NULL && mg<MAX_INVERTERS; mg++)
+		for (int mg=0; inverters[mg]!=NULL; mg++)
 		{
 			InverterData *pmg = inverters[mg];
 			if (pmg->SUSyID == SID_MULTIGATE)
 			{
 				pmg->hasMonthData = true;
-				for (int sb240=0; inverters[sb240]!=NULL && sb240<MAX_INVERTERS; sb240++)
+				for (int sb240=0; inverters[sb240]!=NULL; sb240++)
 				{
 					InverterData *psb = inverters[sb240];
 					if ((psb->SUSyID == SID_SB240) && (psb->multigateID == mg))
@@ -413,20 +813,16 @@ E_SBFSPOT ArchiveEventData(InverterData *inverters[], boost::gregorian::date sta
 	time_t startTime = to_time_t(startDate);
 	time_t endTime = startTime + 86400 * startDate.end_of_month().day();
 
-    for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
+    for (int inv=0; inverters[inv]!=NULL; inv++)
     {
-        do
-        {
-            pcktID++;
-            writePacketHeader(pcktBuf, 0x01, inverters[inv]->BTAddress);
-            writePacket(pcktBuf, 0x09, 0xE0, 0, inverters[inv]->SUSyID, inverters[inv]->Serial);
-			writeLong(pcktBuf, UserGroup == UG_USER ? 0x70100200 : 0x70120200);
-			writeLong(pcktBuf, startTime);
-            writeLong(pcktBuf, endTime);
-            writePacketTrailer(pcktBuf);
-            writePacketLength(pcktBuf);
-        }
-        while (!isCrcValid(pcktBuf[packetposition-3], pcktBuf[packetposition-2]));
+        pcktID++;
+        writePacketHeader(pcktBuf, 0x01, inverters[inv]->BTAddress);
+        writePacket(pcktBuf, 0x09, 0xE0, 0, inverters[inv]->SUSyID, inverters[inv]->Serial);
+		writeLong(pcktBuf, UserGroup == UG_USER ? 0x70100200 : 0x70120200);
+		writeLong(pcktBuf, startTime);
+        writeLong(pcktBuf, endTime);
+        writePacketTrailer(pcktBuf);
+        writePacketLength(pcktBuf);
 
         if (ConnType == CT_BLUETOOTH)
             bthSend(pcktBuf);
@@ -503,7 +899,7 @@ E_SBFSPOT getMonthDataOffset(InverterData *inverters[])
 
 	if (rc == E_OK)
 	{
-	    for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
+	    for (int inv=0; inverters[inv]!=NULL; inv++)
 		{
 			inverters[inv]->monthDataOffset = 0;
 			if (inverters[inv]->hasMonthData)
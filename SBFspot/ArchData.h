@@ -43,8 +43,35 @@ DISCLAIMER:
 #include "boost/date_time/local_time/local_time.hpp"
 #include "boost/date_time/gregorian/gregorian.hpp"
 #include "boost/format.hpp"
+#include "boost/unordered_map.hpp"
+#include <map>
 
-E_SBFSPOT ArchiveDayData(InverterData *inverters[], time_t startTime);
+#define ARCH_DAYRECORDS		288		// 5 minute records per day (InverterData::dayData)
+#define ARCH_DAYSPERREQUEST	7		// Backfill: days asked in one request
+#define ARCH_RETRIES		1		// Backfill: requests of a day without (complete) reply
+
+// 5 minute record as received from the device
+typedef struct
+{
+	time_t datetime;
+	unsigned long long totalWh;
+} ArchDayRecord;
+
+// Destination of one day for splitDayRecords()
+typedef struct
+{
+	time_t startTime;			// Midnight
+	DayData *dayData;			// ARCH_DAYRECORDS records
+	bool hasDayData;			// At least one record stored
+	bool hasData;				// At least one record with totalWh > 0
+} ArchDay;
+
+// Called by BackfillDayData for each day with data, inverters[]->dayData holds the records of that day
+typedef void (*DayDataHandler)(InverterData *inverters[], time_t day, void *param);
+
+E_SBFSPOT ArchiveDayRecords(InverterData *inverter, time_t startTime, int days, std::vector<ArchDayRecord> &records);
+void splitDayRecords(const std::vector<ArchDayRecord> &records, std::vector<ArchDay> &days);
+E_SBFSPOT BackfillDayData(InverterData *inverters[], time_t startTime, int days, int maxPerDevice, DayDataHandler handler, void *param);
 E_SBFSPOT ArchiveEventData(InverterData *inverters[], boost::gregorian::date startDate, unsigned long UserGroup);
 E_SBFSPOT ArchiveMonthData(InverterData *invData[], tm *start_tm);
 E_SBFSPOT getMonthDataOffset(InverterData *inverters[]);
@@ -34,6 +34,7 @@ DISCLAIMER:
 
 #include "CSVexport.h"
 #include "EventData.h"
+#include <limits.h>
 
 using namespace std;
 
@@ -81,6 +82,435 @@ char *FormatDouble(char *str, double value, int width, int precision, char decim
 	return str;
 }
 
+// Format value/divisor with a fixed number of decimals, e.g. (23045, 100, 3) -> 230.450
+// Integer scaled values are written straight from the integer, without a float round trip
+// and independent of the C locale. Rounding is half away from zero.
+// str must hold at least 32 chars
+char *FormatFixed(char *str, long long value, long long divisor, int precision, char decimalpoint)
+{
+	static const unsigned long long pow10[] = { 1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL, 1000000000ULL };
+
+	unsigned long long magnitude = (value < 0) ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+
+	if ((divisor <= 0) || (precision < 0) || (precision > 9) || (magnitude > ULLONG_MAX / pow10[precision] / 2))
+		return FormatDouble(str, (divisor > 0) ? (double)value / divisor : (double)value, 0, precision, decimalpoint);
+
+	unsigned long long scaled = magnitude * pow10[precision];
+	unsigned long long q = scaled / (unsigned long long)divisor;
+	if ((scaled % (unsigned long long)divisor) * 2 >= (unsigned long long)divisor)
+		q++;
+
+	// Digits in reverse order, at least one before the decimal point
+	char digits[24];
+	int len = 0;
+	do
+	{
+		digits[len++] = '0' + (char)(q % 10);
+		q /= 10;
+	} while ((q != 0) || (len <= precision));
+
+	char *p = str;
+	if (value < 0) *p++ = '-';
+	while (len > precision) *p++ = digits[--len];
+	if (precision > 0)
+	{
+		*p++ = decimalpoint;
+		while (len > 0) *p++ = digits[--len];
+	}
+	*p = 0;
+
+	return str;
+}
+
+// Row builders for the CSV exports: each appends a delimiter and one formatted value
+// The complete row is written with a single fwrite()
+static void AppendText(std::string &row, char delimiter, const char *text)
+{
+	row += delimiter;
+	row += text;
+}
+
+static void AppendFixed(std::string &row, const Config *cfg, long long value, long long divisor)
+{
+	char FormattedFixed[32];
+	row += cfg->delimiter;
+	row += FormatFixed(FormattedFixed, value, divisor, cfg->precision, cfg->decimalpoint);
+}
+
+static void AppendDouble(std::string &row, const Config *cfg, double value)
+{
+	char FormattedFloat[32];
+	row += cfg->delimiter;
+	row += FormatDouble(FormattedFloat, value, 0, cfg->precision, cfg->decimalpoint);
+}
+
+static void AppendUnsigned(std::string &row, char delimiter, unsigned long value)
+{
+	char digits[24];
+	int len = 0;
+	do
+	{
+		digits[len++] = '0' + (char)(value % 10);
+		value /= 10;
+	} while (value != 0);
+
+	row += delimiter;
+	while (len > 0) row += digits[--len];
+}
+
+static void WriteRow(FILE *csv, const std::string &row)
+{
+	fwrite(row.data(), 1, row.size(), csv);
+}
+
+static CSVSink csvSink;
+
+// Returns the open file of an export, isnew is true when the header must be written
+FILE *CSVSink::open(const std::string &key, const std::string &folder, const std::string &filename, bool &isnew)
+{
+	std::string path = folder + FOLDER_SEP + filename;
+	isnew = false;
+
+	std::map<std::string, CSVFile>::iterator it = m_files.find(key);
+	if (it != m_files.end())
+	{
+		if (it->second.path == path)
+			return it->second.fp;
+
+		// Date rotation: close the file of the previous period
+		fclose(it->second.fp);
+		m_files.erase(it);
+	}
+
+	createPath(folder);
+
+	FILE *csv = fopen(path.c_str(), "a+");
+	if (csv == NULL)
+	{
+		// Folder may have been removed since it was created
+		m_folders.erase(folder);
+		createPath(folder);
+		if ((csv = fopen(path.c_str(), "a+")) == NULL)
+			return NULL;
+	}
+
+	fseek(csv, 0, SEEK_END);
+	isnew = (ftell(csv) == 0);
+
+	CSVFile file;
+	file.path = path;
+	file.fp = csv;
+	m_files[key] = file;
+
+	return csv;
+}
+
+// Create folder, unless already done by a previous export
+int CSVSink::createPath(const std::string &folder)
+{
+	if (m_folders.find(folder) != m_folders.end())
+		return 0;
+
+	int rc = CreatePath(folder.c_str());
+	m_folders.insert(folder);
+	return rc;
+}
+
+// Inverse of strftime_t() for the specifiers of DateTimeFormat: %d %m %Y %y %H %M %S
+// Returns false if str doesn't start with a date/time in that format
+static bool parseDateTime(const char *format, const char *str, time_t &datetime)
+{
+	struct tm tm_dt;
+	memset(&tm_dt, 0, sizeof(tm_dt));
+	tm_dt.tm_mday = 1;
+
+	for (; *format != 0; format++)
+	{
+		if (*format != '%')
+		{
+			if (*str++ != *format) return false;
+			continue;
+		}
+
+		int *field;
+		int digits = 2;
+		int offset = 0;
+		switch (*++format)
+		{
+		case 'd': field = &tm_dt.tm_mday; break;
+		case 'm': field = &tm_dt.tm_mon; offset = -1; break;
+		case 'Y': field = &tm_dt.tm_year; digits = 4; offset = -1900; break;
+		case 'y': field = &tm_dt.tm_year; offset = 100; break;
+		case 'H': field = &tm_dt.tm_hour; break;
+		case 'M': field = &tm_dt.tm_min; break;
+		case 'S': field = &tm_dt.tm_sec; break;
+		case '%':
+			if (*str++ != '%') return false;
+			continue;
+		default:
+			return false;
+		}
+
+		int value = 0;
+		for (int i = 0; i < digits; i++, str++)
+		{
+			if ((*str < '0') || (*str > '9')) return false;
+			value = value * 10 + (*str - '0');
+		}
+		*field = value + offset;
+	}
+
+	tm_dt.tm_isdst = -1;
+	datetime = mktime(&tm_dt);
+	return datetime != -1;
+}
+
+// True if parseDateTime() reads the date back from what strftime_t() writes with this format
+// The month day data file needs it to find the rows of each day
+bool CSVparsableDateTime(const char *format)
+{
+	struct tm tm_dt;
+	memset(&tm_dt, 0, sizeof(tm_dt));
+	tm_dt.tm_year = 2021 - 1900;
+	tm_dt.tm_mon = 10;
+	tm_dt.tm_mday = 23;
+	tm_dt.tm_hour = 14;
+	tm_dt.tm_min = 35;
+	tm_dt.tm_sec = 56;
+	tm_dt.tm_isdst = -1;
+	time_t sample = mktime(&tm_dt);
+
+	time_t datetime;
+	return parseDateTime(format, strftime_t(format, sample), datetime) && (dayStart(datetime) == dayStart(sample));
+}
+
+// Read one line, including the linefeed
+static bool readLine(FILE *fp, std::string &line)
+{
+	char buf[1024];
+	line.clear();
+	while (fgets(buf, sizeof(buf), fp) != NULL)
+	{
+		line += buf;
+		if (line[line.size() - 1] == '\n')
+			break;
+	}
+	return !line.empty();
+}
+
+// Store the rows of one day in the month file, replacing the rows of that day already in it
+int CSVSink::putDay(const std::string &folder, const std::string &filename, const char *dtformat, time_t day, const std::string &header, const std::string &rows)
+{
+	int rc = 0;
+	std::string path = folder + FOLDER_SEP + filename;
+
+	std::map<std::string, DayDataFile>::iterator it = m_dayFiles.find(path);
+	if (it == m_dayFiles.end())
+	{
+		// The backfill goes back in time, the least recently used month is done
+		if (m_dayFiles.size() >= CSV_DAYDATAFILES)
+		{
+			std::map<std::string, DayDataFile>::iterator lru = m_dayFiles.begin();
+			for (std::map<std::string, DayDataFile>::iterator df = m_dayFiles.begin(); df != m_dayFiles.end(); ++df)
+				if (df->second.lastUse < lru->second.lastUse)
+					lru = df;
+
+			rc = writeDayDataFile(lru->first, lru->second, false);
+			m_dayFiles.erase(lru);
+		}
+
+		it = m_dayFiles.insert(std::make_pair(path, DayDataFile())).first;
+		createPath(folder);
+		loadDayDataFile(path, dtformat, it->second);
+		if (it->second.header.empty() && it->second.days.empty())
+			it->second.header = header;
+	}
+
+	DayDataFile &file = it->second;
+	std::map<time_t, std::string>::const_iterator old = file.days.find(day);
+
+	// Today's rows usually start with the ones already in the file, only the new rows are appended
+	bool isLast = file.days.empty() || (day >= file.days.rbegin()->first);
+	if (!isLast || ((file.appendDay != 0) && (file.appendDay != day)))
+		file.rewrite = true;
+	else if (old == file.days.end())
+	{
+		file.appendDay = day;
+		file.appendFrom = 0;
+	}
+	else if (rows.compare(0, old->second.size(), old->second) != 0)
+		file.rewrite = true;
+	else if (file.appendDay == 0)
+	{
+		file.appendDay = day;
+		file.appendFrom = old->second.size();
+	}
+
+	file.days[day] = rows;
+	file.changed = true;
+	file.lastUse = ++m_useCount;
+
+	return rc;
+}
+
+// Split an existing month file in header and rows per day
+void CSVSink::loadDayDataFile(const std::string &path, const char *dtformat, DayDataFile &file)
+{
+	file.changed = false;
+	file.rewrite = false;
+	file.appendDay = 0;
+	file.appendFrom = 0;
+
+	FILE *csv = fopen(path.c_str(), "r");
+	if (csv == NULL)
+	{
+		file.rewrite = true;	// New file
+		return;
+	}
+
+	std::string line;
+	time_t day = 0;
+	while (readLine(csv, line))
+	{
+		time_t datetime;
+		if (parseDateTime(dtformat, line.c_str(), datetime))
+			day = dayStart(datetime);
+
+		if (day == 0)
+			file.header += line;
+		else
+			file.days[day] += line;	// Lines that are no row stay with the previous one
+	}
+
+	fclose(csv);
+}
+
+// Flush (and sync) before closing, returns false when the file isn't written completely
+static bool closeFile(FILE *csv, bool sync)
+{
+	bool ok = (fflush(csv) == 0);
+	#ifdef WIN32
+	if (ok && sync) ok = (_commit(_fileno(csv)) == 0);
+	#else
+	if (ok && sync) ok = (fsync(fileno(csv)) == 0);
+	#endif
+	if (fclose(csv) != 0) ok = false;
+	return ok;
+}
+
+int CSVSink::writeDayDataFile(const std::string &path, DayDataFile &file, bool sync)
+{
+	if (!file.changed)
+		return 0;
+
+	bool ok;
+	if (!file.rewrite)
+	{
+		FILE *csv = fopen(path.c_str(), "a");
+		if (csv == NULL)
+			return -1;
+
+		const std::string &rows = file.days[file.appendDay];
+		fwrite(rows.data() + file.appendFrom, 1, rows.size() - file.appendFrom, csv);
+
+		ok = closeFile(csv, sync);
+	}
+	else
+	{
+		// Replace the file by a new one, a crash can't leave a truncated month behind
+		std::string tmppath = path + ".tmp";
+		FILE *csv = fopen(tmppath.c_str(), "w");
+		if (csv == NULL)
+			return -1;
+
+		WriteRow(csv, file.header);
+		for (std::map<time_t, std::string>::const_iterator it = file.days.begin(); it != file.days.end(); ++it)
+			WriteRow(csv, it->second);
+
+		ok = closeFile(csv, sync);
+		#ifdef WIN32
+		if (ok) ok = (MoveFileExA(tmppath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0);
+		#else
+		if (ok) ok = (rename(tmppath.c_str(), path.c_str()) == 0);
+		#endif
+	}
+
+	if (ok)
+	{
+		file.changed = false;
+		file.rewrite = false;
+		file.appendDay = 0;
+	}
+	else
+		file.rewrite = true;	// Part of the rows may have been appended
+
+	return ok ? 0 : -1;
+}
+
+// Write buffered rows to the OS, and to disk when sync is set (CSV_Sync=1)
+// A file that can't be written is closed, it is reopened by the next export
+int CSVSink::flush(bool sync)
+{
+	int rc = 0;
+
+	for (std::map<std::string, DayDataFile>::iterator it = m_dayFiles.begin(); it != m_dayFiles.end(); ++it)
+		if (writeDayDataFile(it->first, it->second, sync) != 0)
+			rc = -1;
+
+	std::map<std::string, CSVFile>::iterator it = m_files.begin();
+	while (it != m_files.end())
+	{
+		bool ok = (fflush(it->second.fp) == 0);
+		#ifdef WIN32
+		if (ok && sync) ok = (_commit(_fileno(it->second.fp)) == 0);
+		#else
+		if (ok && sync) ok = (fsync(fileno(it->second.fp)) == 0);
+		#endif
+
+		if (ok)
+			++it;
+		else
+		{
+			rc = -1;
+			fclose(it->second.fp);
+			m_files.erase(it++);
+		}
+	}
+	return rc;
+}
+
+void CSVSink::close(void)
+{
+	for (std::map<std::string, DayDataFile>::iterator it = m_dayFiles.begin(); it != m_dayFiles.end(); ++it)
+		writeDayDataFile(it->first, it->second, false);
+	m_dayFiles.clear();
+
+	for (std::map<std::string, CSVFile>::iterator it = m_files.begin(); it != m_files.end(); ++it)
+		fclose(it->second.fp);
+	m_files.clear();
+	m_folders.clear();
+}
+
+// End of polling cycle
+int CSVflush(const Config *cfg)
+{
+	int rc = csvSink.flush(cfg->CSV_Sync == 1);
+	if ((rc != 0) && (cfg->quiet == 0))
+		print_error(stdout, PROC_ERROR, "Unable to write CSV file(s)\n");
+	return rc;
+}
+
+void CSVclose(void)
+{
+	csvSink.close();
+}
+
+// Create folder for other exports, unless already done
+int CSVcreatePath(const std::string &folder)
+{
+	return csvSink.createPath(folder);
+}
+
 // Convert format string like %d/%m/%Y %H:%M:%S to dd/mm/yyyy HH:mm:ss
 // Returns a pointer to DMY string
 // Caller is responsible to free the memory
@@ -144,7 +574,7 @@ int ExportMonthDataToCSV(const Config *cfg, InverterData *inverters[])
 			//Expand date specifiers in config::outputPath
 			std::stringstream csvpath;
 			csvpath << strftime_t(cfg->outputPath, inverters[0]->monthData[0].datetime);
-			CreatePath(csvpath.str().c_str());
+			csvSink.createPath(csvpath.str());
 
 			csvpath << FOLDER_SEP << cfg->plantname << "-" << strfgmtime_t("%Y%m", inverters[0]->monthData[0].datetime) << ".csv";
 			
@@ -163,19 +593,19 @@ int ExportMonthDataToCSV(const Config *cfg, InverterData *inverters[])
 				{
 					fprintf(csv, "sep=%c\n", cfg->delimiter);
 					fprintf(csv, "Version CSV1|Tool SBFspot%s (%s)|Linebreaks %s|Delimiter %s|Decimalpoint %s|Precision %d\n\n", cfg->prgVersion, OS, linebreak2txt(), delim2txt(cfg->delimiter), dp2txt(cfg->decimalpoint), cfg->precision);
-					for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
+					for (int inv=0; inverters[inv]!=NULL; inv++)
 						fprintf(csv, "%c%s%c%s", cfg->delimiter, inverters[inv]->DeviceName, cfg->delimiter, inverters[inv]->DeviceName);
 					fputs("\n", csv);
-					for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
+					for (int inv=0; inverters[inv]!=NULL; inv++)
 						fprintf(csv, "%c%s%c%s", cfg->delimiter, inverters[inv]->DeviceType, cfg->delimiter, inverters[inv]->DeviceType);
 					fputs("\n", csv);
-					for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
+					for (int inv=0; inverters[inv]!=NULL; inv++)
 						fprintf(csv, "%c%lu%c%lu", cfg->delimiter, inverters[inv]->Serial, cfg->delimiter, inverters[inv]->Serial);
 					fputs("\n", csv);
-					for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
+					for (int inv=0; inverters[inv]!=NULL; inv++)
 						fprintf(csv, "%cTotal yield%cDay yield", cfg->delimiter, cfg->delimiter);
 					fputs("\n", csv);
-					for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
+					for (int inv=0; inverters[inv]!=NULL; inv++)
 						fprintf(csv, "%cCounter%cAnalog", cfg->delimiter, cfg->delimiter);
 					fputs("\n", csv);
 				}
@@ -184,38 +614,142 @@ int ExportMonthDataToCSV(const Config *cfg, InverterData *inverters[])
 					char *DMY = DateTimeFormatToDMY(cfg->DateFormat);
 					fprintf(csv, "%s", DMY);
 					free(DMY);
-					for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
+					for (int inv=0; inverters[inv]!=NULL; inv++)
 						fprintf(csv, "%ckWh%ckWh", cfg->delimiter, cfg->delimiter);
 					fputs("\n", csv);
 				}
 			}
 
-			char FormattedFloat[16];
+			std::string row;
 
 			for (unsigned int idx=0; idx<sizeof(inverters[0]->monthData)/sizeof(MonthData); idx++)
 			{
 				time_t datetime = 0;
-				for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
+				for (int inv=0; inverters[inv]!=NULL; inv++)
 					if (inverters[inv]->monthData[idx].datetime > 0)
 						datetime = inverters[inv]->monthData[idx].datetime;
 
 				if (datetime > 0)
 				{
-					fprintf(csv, "%s", strfgmtime_t(cfg->DateFormat, datetime));
-					for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
+					row += strfgmtime_t(cfg->DateFormat, datetime);
+					for (int inv=0; inverters[inv]!=NULL; inv++)
 					{
-						fprintf(csv, "%c%s", cfg->delimiter, FormatDouble(FormattedFloat, (double)inverters[inv]->monthData[idx].totalWh/1000, 0, cfg->precision, cfg->decimalpoint));
-						fprintf(csv, "%c%s", cfg->delimiter, FormatDouble(FormattedFloat, (double)inverters[inv]->monthData[idx].dayWh/1000, 0, cfg->precision, cfg->decimalpoint));
+						AppendFixed(row, cfg, inverters[inv]->monthData[idx].totalWh, 1000);
+						AppendFixed(row, cfg, inverters[inv]->monthData[idx].dayWh, 1000);
 					}
-					fputs("\n", csv);
+					row += '\n';
 				}
 			}
+			WriteRow(csv, row);
 			fclose(csv);
 		}
 	}
     return 0;
 }
 
+// Header of the day data CSV: two columns per device
+static void DayDataHeader(const Config *cfg, InverterData *inverters[], std::string &header)
+{
+	if (cfg->CSV_ExtendedHeader == 1)
+	{
+		char line[256];
+		snprintf(line, sizeof(line), "sep=%c\nVersion CSV1|Tool SBFspot%s (%s)|Linebreaks %s|Delimiter %s|Decimalpoint %s|Precision %d\n\n", cfg->delimiter, cfg->prgVersion, OS, linebreak2txt(), delim2txt(cfg->delimiter), dp2txt(cfg->decimalpoint), cfg->precision);
+		header += line;
+		for (int inv=0; inverters[inv]!=NULL; inv++)
+		{
+			AppendText(header, cfg->delimiter, inverters[inv]->DeviceName);
+			AppendText(header, cfg->delimiter, inverters[inv]->DeviceName);
+		}
+		header += '\n';
+		for (int inv=0; inverters[inv]!=NULL; inv++)
+		{
+			AppendText(header, cfg->delimiter, inverters[inv]->DeviceType);
+			AppendText(header, cfg->delimiter, inverters[inv]->DeviceType);
+		}
+		header += '\n';
+		for (int inv=0; inverters[inv]!=NULL; inv++)
+		{
+			AppendUnsigned(header, cfg->delimiter, inverters[inv]->Serial);
+			AppendUnsigned(header, cfg->delimiter, inverters[inv]->Serial);
+		}
+		header += '\n';
+		for (int inv=0; inverters[inv]!=NULL; inv++)
+		{
+			AppendText(header, cfg->delimiter, "Total yield");
+			AppendText(header, cfg->delimiter, "Power");
+		}
+		header += '\n';
+		for (int inv=0; inverters[inv]!=NULL; inv++)
+		{
+			AppendText(header, cfg->delimiter, "Counter");
+			AppendText(header, cfg->delimiter, "Analog");
+		}
+		header += '\n';
+	}
+	if (cfg->CSV_Header == 1)
+	{
+		char *DMY = DateTimeFormatToDMY(cfg->DateTimeFormat);
+		header += DMY;
+		free(DMY);
+		for (int inv=0; inverters[inv]!=NULL; inv++)
+		{
+			AppendText(header, cfg->delimiter, "kWh");
+			AppendText(header, cfg->delimiter, "kW");
+		}
+		header += '\n';
+	}
+}
+
+// Rows of one archived day, the records of all devices are aligned on their timestamp
+// A device without a record at that time gets zero values
+static void DayDataRows(const Config *cfg, InverterData *inverters[], std::string &rows)
+{
+	const unsigned int records = sizeof(inverters[0]->dayData)/sizeof(DayData);
+
+	std::vector<time_t> timestamps;
+	int devices = 0;
+	for (; inverters[devices]!=NULL; devices++)
+		for (unsigned int dd = 0; dd < records; dd++)
+			if (inverters[devices]->dayData[dd].datetime > 0)
+				timestamps.push_back(inverters[devices]->dayData[dd].datetime);
+
+	std::sort(timestamps.begin(), timestamps.end());
+	timestamps.erase(std::unique(timestamps.begin(), timestamps.end()), timestamps.end());
+
+	// Records of a device are in ascending time order, pos[] is the next one to merge
+	std::vector<unsigned int> pos(devices, 0);
+	std::vector<const DayData *> row(devices);
+
+	for (std::vector<time_t>::const_iterator ts = timestamps.begin(); ts != timestamps.end(); ++ts)
+	{
+		long long totalPower = 0;
+		for (int inv=0; inv<devices; inv++)
+		{
+			const DayData *dayData = inverters[inv]->dayData;
+			while ((pos[inv] < records) && (dayData[pos[inv]].datetime < *ts))
+				pos[inv]++;
+
+			row[inv] = NULL;
+			if ((pos[inv] < records) && (dayData[pos[inv]].datetime == *ts))
+			{
+				row[inv] = &dayData[pos[inv]++];
+				totalPower += row[inv]->watt;
+			}
+		}
+
+		if ((cfg->CSV_SaveZeroPower == 1) || (totalPower > 0))
+		{
+			rows += strftime_t(cfg->DateTimeFormat, *ts);
+			for (int inv=0; inv<devices; inv++)
+			{
+				AppendFixed(rows, cfg, (row[inv] != NULL) ? row[inv]->totalWh : 0, 1000);
+				AppendFixed(rows, cfg, (row[inv] != NULL) ? row[inv]->watt : 0, 1000);
+			}
+			rows += '\n';
+		}
+	}
+}
+
 int ExportDayDataToCSV(const Config *cfg, InverterData *inverters[])
 {
 	char msg[80 + MAX_PATH];
@@ -224,93 +758,55 @@ int ExportDayDataToCSV(const Config *cfg, InverterData *inverters[])
 	FILE *csv;
 
 	//fix 1.3.1 for inverters with BT piggyback (missing interval data in the dark)
-	//need to find first valid date in array
-	time_t date;
-	unsigned int idx = 0;
-	do
-	{
-		date = inverters[0]->dayData[idx++].datetime;
-	} while ((idx < sizeof(inverters[0]->dayData)/sizeof(DayData)) && (date == 0));
+	//need to find first valid date of any device
+	time_t date = 0;
+	for (int inv=0; (inverters[inv]!=NULL) && (date == 0); inv++)
+		for (unsigned int idx = 0; (idx < sizeof(inverters[inv]->dayData)/sizeof(DayData)) && (date == 0); idx++)
+			date = inverters[inv]->dayData[idx].datetime;
 
 	// Fix Issue 90: SBFspot still creating 1970 .csv files
 	if (date == 0) return 0;	// Nothing to export! Silently exit.
 
-	//Expand date specifiers in config::outputPath
-	std::stringstream csvpath;
-	csvpath << strftime_t(cfg->outputPath, date);
-	CreatePath(csvpath.str().c_str());
+	std::string header;
+	DayDataHeader(cfg, inverters, header);
 
-	csvpath << FOLDER_SEP << cfg->plantname << "-" << strftime_t("%Y%m%d", date) << ".csv";
+	std::string rows;
+	DayDataRows(cfg, inverters, rows);
 
-	if ((csv = fopen(csvpath.str().c_str(), "w+")) == NULL)
-	{
-		if (cfg->quiet == 0)
-		{
-			snprintf(msg, sizeof(msg), "Unable to open output file %s\n", csvpath.str().c_str());
-			print_error(stdout, PROC_ERROR, msg);
-		}
-		return -1;
-	}
-	else
+	//Expand date specifiers in config::outputPath
+	std::string folder = strftime_t(cfg->outputPath, date);
+
+	if (cfg->CSV_DayDataFile == 1)
 	{
-		if (cfg->CSV_ExtendedHeader == 1)
-		{
-			fprintf(csv, "sep=%c\n", cfg->delimiter);
-			fprintf(csv, "Version CSV1|Tool SBFspot%s (%s)|Linebreaks %s|Delimiter %s|Decimalpoint %s|Precision %d\n\n", cfg->prgVersion, OS, linebreak2txt(), delim2txt(cfg->delimiter), dp2txt(cfg->decimalpoint), cfg->precision);
-			for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
-				fprintf(csv, "%c%s%c%s", cfg->delimiter, inverters[inv]->DeviceName, cfg->delimiter, inverters[inv]->DeviceName);
-			fputs("\n", csv);
-			for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
-				fprintf(csv, "%c%s%c%s", cfg->delimiter, inverters[inv]->DeviceType, cfg->delimiter, inverters[inv]->DeviceType);
-			fputs("\n", csv);
-			for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
-				fprintf(csv, "%c%lu%c%lu", cfg->delimiter, inverters[inv]->Serial, cfg->delimiter, inverters[inv]->Serial);
-			fputs("\n", csv);
-			for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
-				fprintf(csv, "%cTotal yield%cPower", cfg->delimiter, cfg->delimiter);
-			fputs("\n", csv);
-			for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
-				fprintf(csv, "%cCounter%cAnalog", cfg->delimiter, cfg->delimiter);
-			fputs("\n", csv);
-		}
-		if (cfg->CSV_Header == 1)
+		// One file per month, written when the backfill moves on to other months or at the end of the cycle
+		std::string filename = std::string(cfg->plantname) + "-DayData-" + strftime_t("%Y%m", date) + ".csv";
+		if (csvSink.putDay(folder, filename, cfg->DateTimeFormat, dayStart(date), header, rows) != 0)
 		{
-			char *DMY = DateTimeFormatToDMY(cfg->DateTimeFormat);
-			fputs(DMY, csv);
-			free(DMY);
-			for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
-				fprintf(csv, "%ckWh%ckW", cfg->delimiter, cfg->delimiter);
-			fputs("\n", csv);
+			if (cfg->quiet == 0)
+			{
+				snprintf(msg, sizeof(msg), "Unable to write output file %s\n", (folder + FOLDER_SEP + filename).c_str());
+				print_error(stdout, PROC_ERROR, msg);
+			}
+			return -1;
 		}
+		return 0;
 	}
 
-	char FormattedFloat[16];
+	std::string csvpath = folder + FOLDER_SEP + cfg->plantname + "-" + strftime_t("%Y%m%d", date) + ".csv";
+	csvSink.createPath(folder);
 
-	for (unsigned int dd = 0; dd < sizeof(inverters[0]->dayData)/sizeof(DayData); dd++)
+	if ((csv = fopen(csvpath.c_str(), "w+")) == NULL)
 	{
-		time_t datetime = 0;
-		unsigned long long totalPower = 0;
-		for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
-			if (inverters[inv]->dayData[dd].datetime > 0)
-			{
-				datetime = inverters[inv]->dayData[dd].datetime;
-				totalPower += inverters[inv]->dayData[dd].watt;
-			}
-
-		if (datetime > 0)
+		if (cfg->quiet == 0)
 		{
-			if ((cfg->CSV_SaveZeroPower == 1) || (totalPower > 0))
-			{
-				fprintf(csv, "%s", strftime_t(cfg->DateTimeFormat, datetime));
-				for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
-				{
-					fprintf(csv, "%c%s", cfg->delimiter, FormatDouble(FormattedFloat, (double)inverters[inv]->dayData[dd].totalWh/1000, 0, cfg->precision, cfg->decimalpoint));
-					fprintf(csv, "%c%s", cfg->delimiter, FormatDouble(FormattedFloat, (double)inverters[inv]->dayData[dd].watt/1000, 0, cfg->precision, cfg->decimalpoint));
-				}
-				fputs("\n", csv);
-			}
+			snprintf(msg, sizeof(msg), "Unable to open output file %s\n", csvpath.c_str());
+			print_error(stdout, PROC_ERROR, msg);
 		}
+		return -1;
 	}
+
+	WriteRow(csv, header);
+	WriteRow(csv, rows);
 	fclose(csv);
     return 0;
 }
@@ -398,17 +894,17 @@ int WriteWebboxHeader(FILE *csv, const Config *cfg, InverterData *inverters[])
 				colcnt++;
 			}
 
-		for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
+		for (int inv=0; inverters[inv]!=NULL; inv++)
 			for (int i = 0; i<colcnt; i++)
 				fprintf(csv, "%c%s", cfg->delimiter, inverters[inv]->DeviceName);
 		fputs("\n", csv);
 
-		for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
+		for (int inv=0; inverters[inv]!=NULL; inv++)
 			for (int i = 0; i < colcnt; i++)
 				fprintf(csv, "%c%s", cfg->delimiter, inverters[inv]->DeviceType);
 		fputs("\n", csv);
 
-		for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
+		for (int inv=0; inverters[inv]!=NULL; inv++)
 			for (int i = 0; i < colcnt; i++)
 				fprintf(csv, "%c%lu", cfg->delimiter, inverters[inv]->Serial);
 		fputs("\n", csv);
@@ -417,7 +913,7 @@ int WriteWebboxHeader(FILE *csv, const Config *cfg, InverterData *inverters[])
 	if (cfg->CSV_Header == 1)
 	{
 		fputs("TimeStamp", csv);
-		for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
+		for (int inv=0; inverters[inv]!=NULL; inv++)
 			fputs(Header1, csv);
 		fputs("\n", csv);
 	}
@@ -428,7 +924,7 @@ int WriteWebboxHeader(FILE *csv, const Config *cfg, InverterData *inverters[])
 		for (int i=0; Header2[i]!=0; i++)
 			if (Header2[i]=='|') Header2[i]=cfg->delimiter;
 
-		for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
+		for (int inv=0; inverters[inv]!=NULL; inv++)
 			fputs(Header2, csv);
 		fputs("\n", csv);
 
@@ -438,7 +934,7 @@ int WriteWebboxHeader(FILE *csv, const Config *cfg, InverterData *inverters[])
 
 		for (int i=0; Header3[i]!=0; i++)
 			if (Header3[i]=='|') Header3[i]=cfg->delimiter;
-		for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
+		for (int inv=0; inverters[inv]!=NULL; inv++)
 			fputs(Header3, csv);
 		fputs("\n", csv);
 	}
@@ -461,17 +957,16 @@ int ExportSpotDataToCSV(const Config *cfg, InverterData *inverters[])
 	time_t spottime = cfg->SpotTimeSource == 0 ? inverters[0]->InverterDatetime : time(NULL);
 
 	//Expand date specifiers in config::outputPath
-	std::stringstream csvpath;
-	csvpath << strftime_t(cfg->outputPath, spottime);
-	CreatePath(csvpath.str().c_str());
-
-	csvpath << FOLDER_SEP << cfg->plantname << "-Spot-" << strftime_t("%Y%m%d", spottime) << ".csv";
+	std::string folder = strftime_t(cfg->outputPath, spottime);
+	std::string filename = std::string(cfg->plantname) + "-Spot-" + strftime_t("%Y%m%d", spottime) + ".csv";
 
-	if ((csv = fopen(csvpath.str().c_str(), "a+")) == NULL)
+	//The file remains open until CSVclose(), a new one is opened at date change
+	bool isnew;
+	if ((csv = csvSink.open("Spot", folder, filename, isnew)) == NULL)
 	{
 		if (cfg->quiet == 0)
 		{
-			snprintf(msg, sizeof(msg), "Unable to open output file %s\n", csvpath.str().c_str());
+			snprintf(msg, sizeof(msg), "Unable to open output file %s\n", (folder + FOLDER_SEP + filename).c_str());
 			print_error(stdout, PROC_ERROR, msg);
 		}
 		return -1;
@@ -479,13 +974,7 @@ int ExportSpotDataToCSV(const Config *cfg, InverterData *inverters[])
 	else
 	{
 		//Write header when new file has been created
-		#ifdef WIN32
-		if (filelength(fileno(csv)) == 0)
-		#else
-		struct stat fStat;
-		stat(csvpath.str().c_str(), &fStat);
-		if (fStat.st_size == 0)
-		#endif
+		if (isnew)
 		{
 			if (cfg->SpotWebboxHeader == 0)
 				WriteStandardHeader(csv, cfg, SolarInverter);
@@ -493,57 +982,56 @@ int ExportSpotDataToCSV(const Config *cfg, InverterData *inverters[])
 				WriteWebboxHeader(csv, cfg, inverters);
 		}
 
-		char FormattedFloat[32];
-		const char *strout = "%c%s";
+		std::string row;
 
 		if (cfg->SpotWebboxHeader == 1)
-			fputs(strftime_t(cfg->DateTimeFormat, spottime), csv);
+			row += strftime_t(cfg->DateTimeFormat, spottime);
 
-		for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
+		for (int inv=0; inverters[inv]!=NULL; inv++)
 		{
 			if (cfg->SpotWebboxHeader == 0)
 			{
-				fputs(strftime_t(cfg->DateTimeFormat, spottime), csv);
-				fprintf(csv, strout, cfg->delimiter, inverters[inv]->DeviceName);
-				fprintf(csv, strout, cfg->delimiter, inverters[inv]->DeviceType);
-				fprintf(csv, "%c%lu", cfg->delimiter, inverters[inv]->Serial);
+				row += strftime_t(cfg->DateTimeFormat, spottime);
+				AppendText(row, cfg->delimiter, inverters[inv]->DeviceName);
+				AppendText(row, cfg->delimiter, inverters[inv]->DeviceType);
+				AppendUnsigned(row, cfg->delimiter, inverters[inv]->Serial);
 			}
 
-			fprintf(csv, strout, cfg->delimiter, FormatFloat(FormattedFloat, (float)inverters[inv]->Pdc1, 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatFloat(FormattedFloat, (float)inverters[inv]->Pdc2, 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatFloat(FormattedFloat, (float)inverters[inv]->Idc1/1000, 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatFloat(FormattedFloat, (float)inverters[inv]->Idc2/1000, 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatFloat(FormattedFloat, (float)inverters[inv]->Udc1/100, 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatFloat(FormattedFloat, (float)inverters[inv]->Udc2/100, 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatFloat(FormattedFloat, (float)inverters[inv]->Pac1, 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatFloat(FormattedFloat, (float)inverters[inv]->Pac2, 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatFloat(FormattedFloat, (float)inverters[inv]->Pac3, 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatFloat(FormattedFloat, (float)inverters[inv]->Iac1/1000, 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatFloat(FormattedFloat, (float)inverters[inv]->Iac2/1000, 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatFloat(FormattedFloat, (float)inverters[inv]->Iac3/1000, 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatFloat(FormattedFloat, (float)inverters[inv]->Uac1/100, 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatFloat(FormattedFloat, (float)inverters[inv]->Uac2/100, 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatFloat(FormattedFloat, (float)inverters[inv]->Uac3/100, 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatFloat(FormattedFloat, (float)inverters[inv]->calPdcTot, 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatFloat(FormattedFloat, (float)inverters[inv]->TotalPac, 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatFloat(FormattedFloat, inverters[inv]->calEfficiency, 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatDouble(FormattedFloat, (double)inverters[inv]->EToday/1000, 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatDouble(FormattedFloat, (double)inverters[inv]->ETotal/1000, 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatFloat(FormattedFloat, (float)inverters[inv]->GridFreq/100, 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatDouble(FormattedFloat, (double)inverters[inv]->OperationTime/3600, 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatDouble(FormattedFloat, (double)inverters[inv]->FeedInTime/3600, 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatDouble(FormattedFloat, inverters[inv]->BT_Signal, 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, tagdefs.getDesc(inverters[inv]->DeviceStatus, "?").c_str());
-			fprintf(csv, strout, cfg->delimiter, tagdefs.getDesc(inverters[inv]->GridRelayStatus, "?").c_str());
-			fprintf(csv, strout, cfg->delimiter, FormatFloat(FormattedFloat, (float)inverters[inv]->Temperature/100, 0, cfg->precision, cfg->decimalpoint));
+			AppendFixed(row, cfg, inverters[inv]->Pdc1, 1);
+			AppendFixed(row, cfg, inverters[inv]->Pdc2, 1);
+			AppendFixed(row, cfg, inverters[inv]->Idc1, 1000);
+			AppendFixed(row, cfg, inverters[inv]->Idc2, 1000);
+			AppendFixed(row, cfg, inverters[inv]->Udc1, 100);
+			AppendFixed(row, cfg, inverters[inv]->Udc2, 100);
+			AppendFixed(row, cfg, inverters[inv]->Pac1, 1);
+			AppendFixed(row, cfg, inverters[inv]->Pac2, 1);
+			AppendFixed(row, cfg, inverters[inv]->Pac3, 1);
+			AppendFixed(row, cfg, inverters[inv]->Iac1, 1000);
+			AppendFixed(row, cfg, inverters[inv]->Iac2, 1000);
+			AppendFixed(row, cfg, inverters[inv]->Iac3, 1000);
+			AppendFixed(row, cfg, inverters[inv]->Uac1, 100);
+			AppendFixed(row, cfg, inverters[inv]->Uac2, 100);
+			AppendFixed(row, cfg, inverters[inv]->Uac3, 100);
+			AppendFixed(row, cfg, inverters[inv]->calPdcTot, 1);
+			AppendFixed(row, cfg, inverters[inv]->TotalPac, 1);
+			AppendDouble(row, cfg, inverters[inv]->calEfficiency);
+			AppendFixed(row, cfg, inverters[inv]->EToday, 1000);
+			AppendFixed(row, cfg, inverters[inv]->ETotal, 1000);
+			AppendFixed(row, cfg, inverters[inv]->GridFreq, 100);
+			AppendFixed(row, cfg, inverters[inv]->OperationTime, 3600);
+			AppendFixed(row, cfg, inverters[inv]->FeedInTime, 3600);
+			AppendDouble(row, cfg, inverters[inv]->BT_Signal);
+			AppendText(row, cfg->delimiter, tagdefs.getDesc(inverters[inv]->DeviceStatus, "?").c_str());
+			AppendText(row, cfg->delimiter, tagdefs.getDesc(inverters[inv]->GridRelayStatus, "?").c_str());
+			AppendFixed(row, cfg, inverters[inv]->Temperature, 100);
 			if (cfg->SpotWebboxHeader == 0)
-				fputs("\n", csv);
+				row += '\n';
 		}
 
 		if (cfg->SpotWebboxHeader == 1)
-			fputs("\n", csv);
+			row += '\n';
 
-		fclose(csv);
+		WriteRow(csv, row);
 	}
 	return 0;
 }
@@ -558,7 +1046,7 @@ int ExportEventsToCSV(const Config *cfg, InverterData *inverters[], std::string
 	//Expand date specifiers in config::outputPath_Events
 	std::stringstream csvpath;
 	csvpath << strftime_t(cfg->outputPath_Events, time(NULL));
-	CreatePath(csvpath.str().c_str());
+	csvSink.createPath(csvpath.str());
 
 	csvpath << FOLDER_SEP << cfg->plantname << "-" << (cfg->userGroup == UG_USER ? "User" : "Installer") << "-Events-" << dt_range_csv.c_str() << ".csv";
 
@@ -597,7 +1085,7 @@ int ExportEventsToCSV(const Config *cfg, InverterData *inverters[], std::string
 			}
 		}
 
-		for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
+		for (int inv=0; inverters[inv]!=NULL; inv++)
 		{
 			// Sort events on ascending Entry_ID
 			std::sort(inverters[inv]->eventData.begin(), inverters[inv]->eventData.end(), SortEntryID_Asc);
@@ -674,17 +1162,16 @@ int ExportBatteryDataToCSV(Config *cfg, InverterData *inverters[])
 	time_t spottime = time(NULL);
 
 	//Expand date specifiers in config::outputPath
-	std::stringstream csvpath;
-	csvpath << strftime_t(cfg->outputPath, spottime);
-	CreatePath(csvpath.str().c_str());
-
-	csvpath << FOLDER_SEP << cfg->plantname << "-Battery-" << strftime_t("%Y%m%d", spottime) << ".csv";
+	std::string folder = strftime_t(cfg->outputPath, spottime);
+	std::string filename = std::string(cfg->plantname) + "-Battery-" + strftime_t("%Y%m%d", spottime) + ".csv";
 
-	if ((csv = fopen(csvpath.str().c_str(), "a+")) == NULL)
+	//The file remains open until CSVclose(), a new one is opened at date change
+	bool isnew;
+	if ((csv = csvSink.open("Battery", folder, filename, isnew)) == NULL)
 	{
 		if (cfg->quiet == 0)
 		{
-			snprintf(msg, sizeof(msg), "Unable to open output file %s\n", csvpath.str().c_str());
+			snprintf(msg, sizeof(msg), "Unable to open output file %s\n", (folder + FOLDER_SEP + filename).c_str());
 			print_error(stdout, PROC_ERROR, msg);
 		}
 		return -1;
@@ -692,13 +1179,7 @@ int ExportBatteryDataToCSV(Config *cfg, InverterData *inverters[])
 	else
 	{
 		//Write header when new file has been created
-		#ifdef WIN32
-		if (filelength(fileno(csv)) == 0)
-		#else
-		struct stat fStat;
-		stat(csvpath.str().c_str(), &fStat);
-		if (fStat.st_size == 0)
-		#endif
+		if (isnew)
 		{
 			if (cfg->SpotWebboxHeader == 0)
 				WriteStandardHeader(csv, cfg, BatteryInverter);
@@ -706,51 +1187,50 @@ int ExportBatteryDataToCSV(Config *cfg, InverterData *inverters[])
 				WriteWebboxHeader(csv, cfg, inverters);
 		}
 
-		char FormattedFloat[32];
-		const char *strout = "%c%s";
+		std::string row;
 
 		if (cfg->SpotWebboxHeader == 1)
-			fputs(strftime_t(cfg->DateTimeFormat, spottime), csv);
+			row += strftime_t(cfg->DateTimeFormat, spottime);
 
-		for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
+		for (int inv=0; inverters[inv]!=NULL; inv++)
 		{
 			if (cfg->SpotWebboxHeader == 0)
 			{
-				fputs(strftime_t(cfg->DateTimeFormat, spottime), csv);
-				fprintf(csv, strout, cfg->delimiter, inverters[inv]->DeviceName);
-				fprintf(csv, strout, cfg->delimiter, inverters[inv]->DeviceType);
-				fprintf(csv, "%c%lu", cfg->delimiter, inverters[inv]->Serial);
+				row += strftime_t(cfg->DateTimeFormat, spottime);
+				AppendText(row, cfg->delimiter, inverters[inv]->DeviceName);
+				AppendText(row, cfg->delimiter, inverters[inv]->DeviceType);
+				AppendUnsigned(row, cfg->delimiter, inverters[inv]->Serial);
 			}
 
-			fprintf(csv, strout, cfg->delimiter, FormatFloat(FormattedFloat, ((float)inverters[inv]->Pac1), 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatFloat(FormattedFloat, ((float)inverters[inv]->Pac2), 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatFloat(FormattedFloat, ((float)inverters[inv]->Pac3), 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatFloat(FormattedFloat, ((float)inverters[inv]->Uac1)/100, 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatFloat(FormattedFloat, ((float)inverters[inv]->Uac2)/100, 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatFloat(FormattedFloat, ((float)inverters[inv]->Uac3)/100, 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatFloat(FormattedFloat, ((float)inverters[inv]->Iac1)/1000, 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatFloat(FormattedFloat, ((float)inverters[inv]->Iac2)/1000, 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatFloat(FormattedFloat, ((float)inverters[inv]->Iac3)/1000, 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatFloat(FormattedFloat, ((float)inverters[inv]->TotalPac), 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatDouble(FormattedFloat, ((double)inverters[inv]->EToday)/1000, 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatDouble(FormattedFloat, ((double)inverters[inv]->ETotal)/1000, 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatDouble(FormattedFloat, ((double)inverters[inv]->GridFreq)/100, 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatDouble(FormattedFloat, ((double)inverters[inv]->OperationTime)/3600, 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatFloat(FormattedFloat, ((float)inverters[inv]->FeedInTime)/3600, 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, tagdefs.getDesc(inverters[inv]->DeviceStatus, "?").c_str());
-			fprintf(csv, strout, cfg->delimiter, FormatFloat(FormattedFloat, ((float)inverters[inv]->BatChaStt), 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatFloat(FormattedFloat, ((float)inverters[inv]->BatTmpVal)/10, 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatFloat(FormattedFloat, ((float)inverters[inv]->BatVol)/100, 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatFloat(FormattedFloat, ((float)inverters[inv]->BatAmp)/1000, 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatFloat(FormattedFloat, ((float)inverters[inv]->MeteringGridMsTotWOut), 0, cfg->precision, cfg->decimalpoint));
-			fprintf(csv, strout, cfg->delimiter, FormatFloat(FormattedFloat, ((float)inverters[inv]->MeteringGridMsTotWIn), 0, cfg->precision, cfg->decimalpoint));
+			AppendFixed(row, cfg, inverters[inv]->Pac1, 1);
+			AppendFixed(row, cfg, inverters[inv]->Pac2, 1);
+			AppendFixed(row, cfg, inverters[inv]->Pac3, 1);
+			AppendFixed(row, cfg, inverters[inv]->Uac1, 100);
+			AppendFixed(row, cfg, inverters[inv]->Uac2, 100);
+			AppendFixed(row, cfg, inverters[inv]->Uac3, 100);
+			AppendFixed(row, cfg, inverters[inv]->Iac1, 1000);
+			AppendFixed(row, cfg, inverters[inv]->Iac2, 1000);
+			AppendFixed(row, cfg, inverters[inv]->Iac3, 1000);
+			AppendFixed(row, cfg, inverters[inv]->TotalPac, 1);
+			AppendFixed(row, cfg, inverters[inv]->EToday, 1000);
+			AppendFixed(row, cfg, inverters[inv]->ETotal, 1000);
+			AppendFixed(row, cfg, inverters[inv]->GridFreq, 100);
+			AppendFixed(row, cfg, inverters[inv]->OperationTime, 3600);
+			AppendFixed(row, cfg, inverters[inv]->FeedInTime, 3600);
+			AppendText(row, cfg->delimiter, tagdefs.getDesc(inverters[inv]->DeviceStatus, "?").c_str());
+			AppendFixed(row, cfg, inverters[inv]->BatChaStt, 1);
+			AppendFixed(row, cfg, inverters[inv]->BatTmpVal, 10);
+			AppendFixed(row, cfg, inverters[inv]->BatVol, 100);
+			AppendFixed(row, cfg, inverters[inv]->BatAmp, 1000);
+			AppendFixed(row, cfg, inverters[inv]->MeteringGridMsTotWOut, 1);
+			AppendFixed(row, cfg, inverters[inv]->MeteringGridMsTotWIn, 1);
 			if (cfg->SpotWebboxHeader == 0)
-				fputs("\n", csv);
+				row += '\n';
 		}
 		if (cfg->SpotWebboxHeader == 1)
-			fputs("\n", csv);
+			row += '\n';
 
-		fclose(csv);
+		WriteRow(csv, row);
 	}
 	return 0;
 }
@@ -790,38 +1270,39 @@ int ExportSpotDataToWSL(const Config *cfg, InverterData *inverters[])
 		time(&spottime);
 
 
-	char FormattedFloat[32];
-	const char *strout = "%s%c";
-
-	printf(strout,"WSL_START", cfg->delimiter);
-	printf(strout, strftime_t(cfg->DateTimeFormat, spottime), cfg->delimiter);
-	printf(strout, FormatFloat(FormattedFloat, (float)inverters[0]->Pdc1, 0, cfg->precision, cfg->decimalpoint), cfg->delimiter);
-	printf(strout, FormatFloat(FormattedFloat, (float)inverters[0]->Pdc2, 0, cfg->precision, cfg->decimalpoint), cfg->delimiter);
-	printf(strout, FormatFloat(FormattedFloat, (float)inverters[0]->Idc1/1000, 0, cfg->precision, cfg->decimalpoint), cfg->delimiter);
-	printf(strout, FormatFloat(FormattedFloat, (float)inverters[0]->Idc2/1000, 0, cfg->precision, cfg->decimalpoint), cfg->delimiter);
-	printf(strout, FormatFloat(FormattedFloat, (float)inverters[0]->Udc1/100, 0, cfg->precision, cfg->decimalpoint), cfg->delimiter);
-	printf(strout, FormatFloat(FormattedFloat, (float)inverters[0]->Udc2/100, 0, cfg->precision, cfg->decimalpoint), cfg->delimiter);
-	printf(strout, FormatFloat(FormattedFloat, (float)inverters[0]->Pac1, 0, cfg->precision, cfg->decimalpoint), cfg->delimiter);
-	printf(strout, FormatFloat(FormattedFloat, (float)inverters[0]->Pac2, 0, cfg->precision, cfg->decimalpoint), cfg->delimiter);
-	printf(strout, FormatFloat(FormattedFloat, (float)inverters[0]->Pac3, 0, cfg->precision, cfg->decimalpoint), cfg->delimiter);
-	printf(strout, FormatFloat(FormattedFloat, (float)inverters[0]->Iac1/1000, 0, cfg->precision, cfg->decimalpoint), cfg->delimiter);
-	printf(strout, FormatFloat(FormattedFloat, (float)inverters[0]->Iac2/1000, 0, cfg->precision, cfg->decimalpoint), cfg->delimiter);
-	printf(strout, FormatFloat(FormattedFloat, (float)inverters[0]->Iac3/1000, 0, cfg->precision, cfg->decimalpoint), cfg->delimiter);
-	printf(strout, FormatFloat(FormattedFloat, (float)inverters[0]->Uac1/100, 0, cfg->precision, cfg->decimalpoint), cfg->delimiter);
-	printf(strout, FormatFloat(FormattedFloat, (float)inverters[0]->Uac2/100, 0, cfg->precision, cfg->decimalpoint), cfg->delimiter);
-	printf(strout, FormatFloat(FormattedFloat, (float)inverters[0]->Uac3/100, 0, cfg->precision, cfg->decimalpoint), cfg->delimiter);
-	printf(strout, FormatFloat(FormattedFloat, (float)inverters[0]->calPdcTot, 0, cfg->precision, cfg->decimalpoint), cfg->delimiter);
-	printf(strout, FormatFloat(FormattedFloat, (float)inverters[0]->TotalPac, 0, cfg->precision, cfg->decimalpoint), cfg->delimiter);
-	printf(strout, FormatFloat(FormattedFloat, inverters[0]->calEfficiency, 0, cfg->precision, cfg->decimalpoint), cfg->delimiter);
-	printf(strout, FormatDouble(FormattedFloat, (double)inverters[0]->EToday/1000, 0, cfg->precision, cfg->decimalpoint), cfg->delimiter);
-	printf(strout, FormatDouble(FormattedFloat, (double)inverters[0]->ETotal/1000, 0, cfg->precision, cfg->decimalpoint), cfg->delimiter);
-	printf(strout, FormatFloat(FormattedFloat, (float)inverters[0]->GridFreq/100, 0, cfg->precision, cfg->decimalpoint), cfg->delimiter);
-	printf(strout, FormatDouble(FormattedFloat, (double)inverters[0]->OperationTime/3600, 0, cfg->precision, cfg->decimalpoint), cfg->delimiter);
-	printf(strout, FormatDouble(FormattedFloat, (double)inverters[0]->FeedInTime/3600, 0, cfg->precision, cfg->decimalpoint), cfg->delimiter);
-	printf(strout, FormatDouble(FormattedFloat, inverters[0]->BT_Signal, 0, cfg->precision, cfg->decimalpoint), cfg->delimiter);
-	printf(strout, tagdefs.getDesc(inverters[0]->DeviceStatus, "?").c_str(), cfg->delimiter);
-	printf(strout, tagdefs.getDesc(inverters[0]->GridRelayStatus, "?").c_str(), cfg->delimiter);
-	printf("%s\n", "WSL_END");
+	// Same layout as the spot CSV row, but every value is followed by the delimiter
+	std::string row = "WSL_START";
+	row += cfg->delimiter;
+	row += strftime_t(cfg->DateTimeFormat, spottime);
+	AppendFixed(row, cfg, inverters[0]->Pdc1, 1);
+	AppendFixed(row, cfg, inverters[0]->Pdc2, 1);
+	AppendFixed(row, cfg, inverters[0]->Idc1, 1000);
+	AppendFixed(row, cfg, inverters[0]->Idc2, 1000);
+	AppendFixed(row, cfg, inverters[0]->Udc1, 100);
+	AppendFixed(row, cfg, inverters[0]->Udc2, 100);
+	AppendFixed(row, cfg, inverters[0]->Pac1, 1);
+	AppendFixed(row, cfg, inverters[0]->Pac2, 1);
+	AppendFixed(row, cfg, inverters[0]->Pac3, 1);
+	AppendFixed(row, cfg, inverters[0]->Iac1, 1000);
+	AppendFixed(row, cfg, inverters[0]->Iac2, 1000);
+	AppendFixed(row, cfg, inverters[0]->Iac3, 1000);
+	AppendFixed(row, cfg, inverters[0]->Uac1, 100);
+	AppendFixed(row, cfg, inverters[0]->Uac2, 100);
+	AppendFixed(row, cfg, inverters[0]->Uac3, 100);
+	AppendFixed(row, cfg, inverters[0]->calPdcTot, 1);
+	AppendFixed(row, cfg, inverters[0]->TotalPac, 1);
+	AppendDouble(row, cfg, inverters[0]->calEfficiency);
+	AppendFixed(row, cfg, inverters[0]->EToday, 1000);
+	AppendFixed(row, cfg, inverters[0]->ETotal, 1000);
+	AppendFixed(row, cfg, inverters[0]->GridFreq, 100);
+	AppendFixed(row, cfg, inverters[0]->OperationTime, 3600);
+	AppendFixed(row, cfg, inverters[0]->FeedInTime, 3600);
+	AppendDouble(row, cfg, inverters[0]->BT_Signal);
+	AppendText(row, cfg->delimiter, tagdefs.getDesc(inverters[0]->DeviceStatus, "?").c_str());
+	AppendText(row, cfg->delimiter, tagdefs.getDesc(inverters[0]->GridRelayStatus, "?").c_str());
+	row += cfg->delimiter;
+	row += "WSL_END\n";
+	WriteRow(stdout, row);
 	return 0;
 }
 
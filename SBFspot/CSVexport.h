@@ -37,12 +37,57 @@ DISCLAIMER:
 #include "osselect.h"
 #include "SBFspot.h"
 #include "EventData.h"
+#include <map>
+#include <set>
+
+#define CSV_DAYDATAFILES	2	// Month files of the day data kept in memory (CSV_DayDataFile=Month)
+
+// CSV files of the spot and battery exports, kept open between polling cycles (-daemon)
+// A new file is opened when the expanded path changes (date rotation)
+// Buffered rows are written to disk by flush() at the end of each cycle
+// Month files of the day data are kept in memory, so that a backfill writes each of them once
+class CSVSink
+{
+public:
+	CSVSink() : m_useCount(0) {}
+	~CSVSink() { close(); }
+	FILE *open(const std::string &key, const std::string &folder, const std::string &filename, bool &isnew);
+	int putDay(const std::string &folder, const std::string &filename, const char *dtformat, time_t day, const std::string &header, const std::string &rows);
+	int createPath(const std::string &folder);
+	int flush(bool sync);
+	void close(void);
+
+private:
+	struct CSVFile
+	{
+		std::string path;
+		FILE *fp;
+	};
+	struct DayDataFile
+	{
+		std::string header;					// Lines before the first row
+		std::map<time_t, std::string> days;	// Rows per day (local midnight)
+		bool changed;
+		bool rewrite;						// Not only rows added to the last day: the whole file is written
+		time_t appendDay;					// Day with rows to append (0 = none)
+		std::string::size_type appendFrom;	// First row of appendDay that isn't in the file yet
+		unsigned long lastUse;
+	};
+	void loadDayDataFile(const std::string &path, const char *dtformat, DayDataFile &file);
+	int writeDayDataFile(const std::string &path, DayDataFile &file, bool sync);
+
+	std::map<std::string, CSVFile> m_files;			// Open file per export ("Spot", "Battery")
+	std::map<std::string, DayDataFile> m_dayFiles;	// Month files of the day data, by path
+	std::set<std::string> m_folders;				// Folders already created
+	unsigned long m_useCount;
+};
 
 const char *delim2txt(const char delim);
 const char *dp2txt(char dp);
 const char *linebreak2txt(void);
 char *FormatFloat(char *str, float value, int width, int precision, char decimalpoint);
 char *FormatDouble(char *str, double value, int width, int precision, char decimalpoint);
+char *FormatFixed(char *str, long long value, long long divisor, int precision, char decimalpoint);
 char *DateTimeFormatToDMY(const char *dtf);
 int ExportDayDataToCSV(const Config *cfg, InverterData *inverters[]);
 int ExportEventsToCSV(const Config *cfg, InverterData *inverters[], std::string dt_range_csv);
@@ -53,4 +98,8 @@ int	ExportSpotDataTo123s(Config *cfg, InverterData *inverters[]);
 int	ExportInformationDataTo123s(Config *cfg, InverterData *inverters[]);
 int	ExportStateDataTo123s(Config *cfg, InverterData *inverters[]);
 int ExportBatteryDataToCSV(Config *cfg, InverterData *inverters[]);
+int CSVflush(const Config *cfg);
+void CSVclose(void);
+int CSVcreatePath(const std::string &folder);
+bool CSVparsableDateTime(const char *format);
 
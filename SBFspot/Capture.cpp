@@ -0,0 +1,226 @@
+/************************************************************************************************
+SBFspot - Yet another tool to read power production of SMA solar inverters
+(c)2012-2020, SBF
+
+Latest version found at https://github.com/SBFspot/SBFspot
+
+License: Attribution-NonCommercial-ShareAlike 3.0 Unported (CC BY-NC-SA 3.0)
+http://creativecommons.org/licenses/by-nc-sa/3.0/
+
+You are free:
+to Share  to copy, distribute and transmit the work
+to Remix  to adapt the work
+Under the following conditions:
+Attribution:
+You must attribute the work in the manner specified by the author or licensor
+(but not in any way that suggests that they endorse you or your use of the work).
+Noncommercial:
+You may not use this work for commercial purposes.
+Share Alike:
+If you alter, transform, or build upon this work, you may distribute the resulting work
+only under the same or similar license to this one.
+
+DISCLAIMER:
+A user of SBFspot software acknowledges that he or she is receiving this
+software on an "as is" basis and the user is not relying on the accuracy
+or functionality of the software for any purpose. The user further
+acknowledges that any use of this software will be at his own risk
+and the copyright owner accepts no responsibility whatsoever arising from
+the use or application of the software.
+
+SMA is a registered trademark of SMA Solar Technology AG
+
+************************************************************************************************/
+
+#include "Capture.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include <map>
+#include "misc.h"
+
+// Offset of the packet ID in a Speedwire datagram (14 bytes L1 header + 26)
+#define CAP_PCKTID_OFFSET	40
+
+extern int debug;
+extern int verbose;
+
+CAPTUREMODE captureMode = CAP_NONE;
+
+typedef struct
+{
+	char direction;		// '>' = sent, '<' = received
+	std::string IP;
+	std::vector<unsigned char> data;
+} CaptureRecord;
+
+static FILE *capFile = NULL;
+static std::vector<CaptureRecord> capRecords;
+static size_t nextSend = 0;
+static size_t nextRecv = 0;
+static std::map<unsigned short, unsigned short> pcktIDmap;	// Recorded packet ID => Packet ID sent
+
+static int hex2nibble(char ch)
+{
+	if ((ch >= '0') && (ch <= '9')) return ch - '0';
+	if ((ch >= 'A') && (ch <= 'F')) return ch - 'A' + 10;
+	if ((ch >= 'a') && (ch <= 'f')) return ch - 'a' + 10;
+	return -1;
+}
+
+static unsigned short getPacketID(const unsigned char *buf, int len)
+{
+	if (len < CAP_PCKTID_OFFSET + 2) return 0;
+	return (buf[CAP_PCKTID_OFFSET] | (buf[CAP_PCKTID_OFFSET + 1] << 8)) & 0x7FFF;
+}
+
+static int loadCapture(FILE *fp)
+{
+	char line[8192];
+	int lineno = 0;
+
+	while (fgets(line, sizeof(line), fp) != NULL)
+	{
+		lineno++;
+		if ((line[0] != '>') && (line[0] != '<')) continue;	// Comment or empty line
+
+		CaptureRecord rec;
+		rec.direction = line[0];
+
+		char *p = line + 1;
+		while (*p == ' ') p++;
+		char *ip = p;
+		while ((*p != ' ') && (*p != 0)) p++;
+		rec.IP.assign(ip, p - ip);
+		while (*p == ' ') p++;
+
+		while ((hex2nibble(p[0]) >= 0) && (hex2nibble(p[1]) >= 0))
+		{
+			rec.data.push_back((unsigned char)((hex2nibble(p[0]) << 4) | hex2nibble(p[1])));
+			p += 2;
+		}
+
+		if (rec.data.empty() || rec.IP.empty())
+		{
+			printf("Capture file: invalid record at line %d\n", lineno);
+			return -1;
+		}
+
+		capRecords.push_back(rec);
+	}
+
+	return 0;
+}
+
+int capOpen(const char *filename, CAPTUREMODE mode)
+{
+	capClose();
+
+	if (mode == CAP_RECORD)
+	{
+		if ((capFile = fopen(filename, "w")) == NULL)
+		{
+			printf("Unable to create capture file %s\n", filename);
+			return -1;
+		}
+
+		time_t now = time(NULL);
+		fprintf(capFile, "# SBFspot capture %s", ctime(&now));
+	}
+	else if (mode == CAP_REPLAY)
+	{
+		FILE *fp = fopen(filename, "r");
+		if (fp == NULL)
+		{
+			printf("Unable to open capture file %s\n", filename);
+			return -1;
+		}
+
+		int rc = loadCapture(fp);
+		fclose(fp);
+		if (rc != 0) return rc;
+
+		if (VERBOSE_NORMAL) printf("Replaying %u packets from %s\n", (unsigned int)capRecords.size(), filename);
+	}
+
+	captureMode = mode;
+	return 0;
+}
+
+void capClose(void)
+{
+	if (capFile != NULL)
+	{
+		fclose(capFile);
+		capFile = NULL;
+	}
+
+	capRecords.clear();
+	pcktIDmap.clear();
+	nextSend = nextRecv = 0;
+	captureMode = CAP_NONE;
+}
+
+void capWrite(char direction, const char *IP, const unsigned char *buf, int len)
+{
+	if ((capFile == NULL) || (len <= 0)) return;
+
+	fprintf(capFile, "%c %s ", direction, IP);
+	for (int i = 0; i < len; i++)
+		fprintf(capFile, "%02X", buf[i]);
+	fputc('\n', capFile);
+	fflush(capFile);
+}
+
+// Replay: Consume the next recorded request
+int capSend(const unsigned char *buf, int len)
+{
+	while ((nextSend < capRecords.size()) && (capRecords[nextSend].direction != '>'))
+		nextSend++;
+
+	if (nextSend < capRecords.size())
+	{
+		const CaptureRecord &rec = capRecords[nextSend++];
+		unsigned short recID = getPacketID(&rec.data[0], (int)rec.data.size());
+		if (recID != 0)
+			pcktIDmap[recID] = getPacketID(buf, len);
+	}
+	else if (DEBUG_NORMAL)
+		puts("Capture replay: no more requests recorded");
+
+	return len;
+}
+
+// Replay: Get the next recorded reply
+// Returns -1 when no more replies are available (same as a timeout)
+int capRead(unsigned char *buf, unsigned int bufsize, char *fromIP, unsigned int IPsize)
+{
+	while ((nextRecv < capRecords.size()) && (capRecords[nextRecv].direction != '<'))
+		nextRecv++;
+
+	if (nextRecv >= capRecords.size())
+	{
+		if (DEBUG_HIGHEST) puts("Capture replay: no more replies recorded");
+		return -1;
+	}
+
+	const CaptureRecord &rec = capRecords[nextRecv++];
+	unsigned int len = (unsigned int)rec.data.size();
+	if (len > bufsize) len = bufsize;
+	memcpy(buf, &rec.data[0], len);
+
+	snprintf(fromIP, IPsize, "%s", rec.IP.c_str());
+
+	unsigned short recID = getPacketID(buf, len);
+	std::map<unsigned short, unsigned short>::iterator it = pcktIDmap.find(recID);
+	if ((recID != 0) && (it != pcktIDmap.end()))
+	{
+		buf[CAP_PCKTID_OFFSET] = it->second & 0xFF;
+		buf[CAP_PCKTID_OFFSET + 1] = (buf[CAP_PCKTID_OFFSET + 1] & 0x80) | ((it->second >> 8) & 0x7F);
+	}
+
+	return (int)len;
+}
@@ -0,0 +1,65 @@
+/************************************************************************************************
+SBFspot - Yet another tool to read power production of SMA solar inverters
+(c)2012-2020, SBF
+
+Latest version found at https://github.com/SBFspot/SBFspot
+
+License: Attribution-NonCommercial-ShareAlike 3.0 Unported (CC BY-NC-SA 3.0)
+http://creativecommons.org/licenses/by-nc-sa/3.0/
+
+You are free:
+to Share  to copy, distribute and transmit the work
+to Remix  to adapt the work
+Under the following conditions:
+Attribution:
+You must attribute the work in the manner specified by the author or licensor
+(but not in any way that suggests that they endorse you or your use of the work).
+Noncommercial:
+You may not use this work for commercial purposes.
+Share Alike:
+If you alter, transform, or build upon this work, you may distribute the resulting work
+only under the same or similar license to this one.
+
+DISCLAIMER:
+A user of SBFspot software acknowledges that he or she is receiving this
+software on an "as is" basis and the user is not relying on the accuracy
+or functionality of the software for any purpose. The user further
+acknowledges that any use of this software will be at his own risk
+and the copyright owner accepts no responsibility whatsoever arising from
+the use or application of the software.
+
+SMA is a registered trademark of SMA Solar Technology AG
+
+************************************************************************************************/
+
+#pragma once
+
+/*
+ * Speedwire packet capture
+ *
+ * -record:file  Writes all UDP packets sent and received to file
+ * -replay:file  Feeds a recorded file to SBFspot instead of the network
+ *
+ * The file is plain text, one packet per line:
+ *   > 192.168.1.10 534D4100...   (sent to 192.168.1.10)
+ *   < 192.168.1.10 534D4100...   (received from 192.168.1.10)
+ * Lines starting with # are comments
+ *
+ * When replaying, packets are read in the order of the file and the packet ID
+ * of each received packet is patched to the ID of the matching request sent
+ */
+
+typedef enum
+{
+	CAP_NONE = 0,
+	CAP_RECORD = 1,
+	CAP_REPLAY = 2
+} CAPTUREMODE;
+
+extern CAPTUREMODE captureMode;
+
+int capOpen(const char *filename, CAPTUREMODE mode);
+void capClose(void);
+void capWrite(char direction, const char *IP, const unsigned char *buf, int len);
+int capSend(const unsigned char *buf, int len);
+int capRead(unsigned char *buf, unsigned int bufsize, char *fromIP, unsigned int IPsize);
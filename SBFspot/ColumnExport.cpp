@@ -0,0 +1,957 @@
+/************************************************************************************************
+SBFspot - Yet another tool to read power production of SMA solar inverters
+(c)2012-2020, SBF
+
+Latest version found at https://github.com/SBFspot/SBFspot
+
+License: Attribution-NonCommercial-ShareAlike 3.0 Unported (CC BY-NC-SA 3.0)
+http://creativecommons.org/licenses/by-nc-sa/3.0/
+
+You are free:
+to Share  to copy, distribute and transmit the work
+to Remix  to adapt the work
+Under the following conditions:
+Attribution:
+You must attribute the work in the manner specified by the author or licensor
+(but not in any way that suggests that they endorse you or your use of the work).
+Noncommercial:
+You may not use this work for commercial purposes.
+Share Alike:
+If you alter, transform, or build upon this work, you may distribute the resulting work
+only under the same or similar license to this one.
+
+DISCLAIMER:
+A user of SBFspot software acknowledges that he or she is receiving this
+software on an "as is" basis and the user is not relying on the accuracy
+or functionality of the software for any purpose. The user further
+acknowledges that any use of this software will be at his own risk
+and the copyright owner accepts no responsibility whatsoever arising from
+the use or application of the software.
+
+SMA is a registered trademark of SMA Solar Technology AG
+
+************************************************************************************************/
+
+#include "ColumnExport.h"
+#include "CSVexport.h"	// CSVcreatePath()
+
+#include <map>
+#include <set>
+#include <limits.h>
+
+// Spot data, same values as the spot CSV
+static const ColumnDef spotColumns[] =
+{
+	{ "TimeStamp",		SBFC_DELTA, 1 },
+	{ "Pdc1",			SBFC_DELTA, 1 },
+	{ "Pdc2",			SBFC_DELTA, 1 },
+	{ "Idc1",			SBFC_DELTA, 1000 },
+	{ "Idc2",			SBFC_DELTA, 1000 },
+	{ "Udc1",			SBFC_DELTA, 100 },
+	{ "Udc2",			SBFC_DELTA, 100 },
+	{ "Pac1",			SBFC_DELTA, 1 },
+	{ "Pac2",			SBFC_DELTA, 1 },
+	{ "Pac3",			SBFC_DELTA, 1 },
+	{ "Iac1",			SBFC_DELTA, 1000 },
+	{ "Iac2",			SBFC_DELTA, 1000 },
+	{ "Iac3",			SBFC_DELTA, 1000 },
+	{ "Uac1",			SBFC_DELTA, 100 },
+	{ "Uac2",			SBFC_DELTA, 100 },
+	{ "Uac3",			SBFC_DELTA, 100 },
+	{ "PdcTot",			SBFC_DELTA, 1 },
+	{ "PacTot",			SBFC_DELTA, 1 },
+	{ "Efficiency",		SBFC_FLOAT, 1 },
+	{ "EToday",			SBFC_DELTA, 1000 },
+	{ "ETotal",			SBFC_DELTA, 1000 },
+	{ "Frequency",		SBFC_DELTA, 100 },
+	{ "OperatingTime",	SBFC_DELTA, 3600 },
+	{ "FeedInTime",		SBFC_DELTA, 3600 },
+	{ "BT_Signal",		SBFC_FLOAT, 1 },
+	{ "Condition",		SBFC_DICT, 1 },
+	{ "GridRelay",		SBFC_DICT, 1 },
+	{ "Temperature",	SBFC_DELTA, 100 }
+};
+
+// Archived day data (5 minute records)
+static const ColumnDef dayColumns[] =
+{
+	{ "TimeStamp",		SBFC_DELTA, 1 },
+	{ "TotalYield",		SBFC_DELTA, 1000 },
+	{ "Power",			SBFC_DELTA, 1000 }
+};
+
+#define SBFC_HEADERSIZE		8
+#define SBFC_TRAILERSIZE	16
+
+/*
+ * Little endian and varint encoding
+ */
+static void putU8(std::string &buf, unsigned int value)
+{
+	buf += (char)(value & 0xFF);
+}
+
+static void putU32(std::string &buf, unsigned long value)
+{
+	for (int i = 0; i < 4; i++, value >>= 8)
+		buf += (char)(value & 0xFF);
+}
+
+static void putU64(std::string &buf, unsigned long long value)
+{
+	for (int i = 0; i < 8; i++, value >>= 8)
+		buf += (char)(value & 0xFF);
+}
+
+static void putVarint(std::string &buf, unsigned long long value)
+{
+	while (value >= 0x80)
+	{
+		buf += (char)((value & 0x7F) | 0x80);
+		value >>= 7;
+	}
+	buf += (char)value;
+}
+
+// Small differences, positive or negative, give small numbers
+static unsigned long long zigzag(long long value)
+{
+	return ((unsigned long long)value << 1) ^ (unsigned long long)(value >> 63);
+}
+
+static long long unzigzag(unsigned long long value)
+{
+	return (long long)(value >> 1) ^ -(long long)(value & 1);
+}
+
+// Bounds checked reader of a footer or column chunk
+class ByteReader
+{
+public:
+	ByteReader(const std::string &buf) : m_buf((const unsigned char *)buf.data()), m_size(buf.size()), m_pos(0) {}
+	bool eof(void) const { return m_pos >= m_size; }
+
+	bool get(unsigned long long &value, int bytes)
+	{
+		if (m_pos + bytes > m_size) return false;
+		value = 0;
+		for (int i = bytes - 1; i >= 0; i--)
+			value = (value << 8) | m_buf[m_pos + i];
+		m_pos += bytes;
+		return true;
+	}
+
+	bool getVarint(unsigned long long &value)
+	{
+		value = 0;
+		for (int shift = 0; (shift < 64) && (m_pos < m_size); shift += 7)
+		{
+			unsigned char b = m_buf[m_pos++];
+			value |= (unsigned long long)(b & 0x7F) << shift;
+			if ((b & 0x80) == 0) return true;
+		}
+		return false;
+	}
+
+	bool getString(std::string &value, size_t length)
+	{
+		if (m_pos + length > m_size) return false;
+		value.assign((const char *)m_buf + m_pos, length);
+		m_pos += length;
+		return true;
+	}
+
+private:
+	const unsigned char *m_buf;
+	size_t m_size;
+	size_t m_pos;
+};
+
+static bool readBytes(FILE *fp, unsigned long long offset, size_t size, std::string &buf)
+{
+	buf.resize(size);
+	if (size == 0) return true;
+	return (fseek(fp, (long)offset, SEEK_SET) == 0) && (fread(&buf[0], 1, size, fp) == size);
+}
+
+static bool sortByTime(const ColumnGroup &a, const ColumnGroup &b)
+{
+	if (a.serial != b.serial) return a.serial < b.serial;
+	return a.tmin < b.tmin;
+}
+
+/*
+ * ColumnFile
+ */
+ColumnFile::ColumnFile(const ColumnDef *columns, int count) : m_columns(columns, columns + count), m_fp(NULL), m_end(0), m_footerSize(0), m_day(0), m_merge(false)
+{
+}
+
+// Open an existing column file and read its footer, or create a new one
+int ColumnFile::open(const std::string &path)
+{
+	close();
+	m_path = path;
+
+	if ((m_fp = fopen(path.c_str(), "r+b")) == NULL)
+		m_fp = fopen(path.c_str(), "w+b");
+	if (m_fp == NULL)
+		return -1;
+
+	fseek(m_fp, 0, SEEK_END);
+	unsigned long long size = ftell(m_fp);
+
+	if (size == 0)
+	{
+		std::string header = SBFC_MAGIC;
+		putU32(header, SBFC_VERSION);
+		fseek(m_fp, 0, SEEK_SET);
+		fwrite(header.data(), 1, header.size(), m_fp);
+		m_end = SBFC_HEADERSIZE;
+		return 0;
+	}
+
+	std::string header;
+	if (!readBytes(m_fp, 0, SBFC_HEADERSIZE, header) || (header.compare(0, 4, SBFC_MAGIC) != 0))
+		return -1;
+
+	unsigned long long version = 0;
+	ByteReader hdr(header);
+	hdr.get(version, 4);	// Skip magic
+	hdr.get(version, 2);
+	if (version != SBFC_VERSION)
+		return -1;
+
+	int rc = readFooter(size);
+	if (rc <= 0)
+		return rc;
+
+	// Save was interrupted: the file ends with an incomplete write, go back to the last complete trailer
+	std::string data;
+	if (!readBytes(m_fp, 0, (size_t)size, data))
+		return -1;
+
+	m_end = SBFC_HEADERSIZE;	// No trailer at all: nothing was saved yet
+	for (size_t pos = data.rfind(SBFC_MAGIC); (pos != std::string::npos) && (pos + 4 >= SBFC_HEADERSIZE + SBFC_TRAILERSIZE); pos = data.rfind(SBFC_MAGIC, pos - 1))
+	{
+		if ((rc = readFooter(pos + 4)) <= 0)
+			break;
+	}
+
+	if (rc < 0)
+		return -1;
+
+	#ifdef WIN32
+	_chsize_s(_fileno(m_fp), m_end);
+	#else
+	if (ftruncate(fileno(m_fp), m_end) != 0)
+		return -1;
+	#endif
+
+	return 0;
+}
+
+// Read the trailer that ends at 'end' and the footer it points to
+// Returns 0 when found, 1 when there's no valid trailer, -1 when the columns aren't the ones of this export
+int ColumnFile::readFooter(unsigned long long end)
+{
+	m_groups.clear();
+	m_day = 0;
+
+	std::string trailer;
+	if ((end < SBFC_HEADERSIZE + SBFC_TRAILERSIZE) || !readBytes(m_fp, end - SBFC_TRAILERSIZE, SBFC_TRAILERSIZE, trailer) || (trailer.compare(12, 4, SBFC_MAGIC) != 0))
+		return 1;
+
+	unsigned long long footerOffset = 0, footerSize = 0;
+	ByteReader trl(trailer);
+	trl.get(footerOffset, 8);
+	trl.get(footerSize, 4);
+	if ((footerOffset < SBFC_HEADERSIZE) || (footerOffset + footerSize + SBFC_TRAILERSIZE != end))
+		return 1;
+
+	std::string footer;
+	if (!readBytes(m_fp, footerOffset, (size_t)footerSize, footer))
+		return 1;
+
+	// Layout must be the one of this export
+	ByteReader ftr(footer);
+	unsigned long long columns, value;
+	if (!ftr.get(columns, 4))
+		return 1;
+	if (columns != m_columns.size())
+		return -1;
+	for (unsigned int col = 0; col < columns; col++)
+	{
+		unsigned long long encoding, scale, length;
+		std::string name;
+		if (!ftr.get(encoding, 1) || !ftr.get(scale, 4) || !ftr.get(length, 1) || !ftr.getString(name, (size_t)length))
+			return 1;
+		if ((name != m_columns[col].name) || (encoding != (unsigned long long)m_columns[col].encoding) || (scale != m_columns[col].scale))
+			return -1;
+	}
+
+	unsigned long long groups;
+	if (!ftr.get(groups, 4))
+		return 1;
+	for (unsigned int g = 0; g < groups; g++)
+	{
+		ColumnGroup group;
+		bool ok = ftr.get(value, 4);
+		group.serial = (unsigned long)value;
+		ok = ok && ftr.get(value, 4);
+		group.rows = (unsigned long)value;
+		ok = ok && ftr.get(value, 8);
+		group.tmin = (time_t)(long long)value;
+		ok = ok && ftr.get(value, 8);
+		group.tmax = (time_t)(long long)value;
+		ok = ok && ftr.get(group.offset, 8);
+		unsigned long long size = 0;
+		for (unsigned int col = 0; ok && (col < columns); col++)
+		{
+			ok = ftr.get(value, 4);
+			group.sizes.push_back((unsigned long)value);
+			size += value;
+		}
+		if (!ok || (group.offset < SBFC_HEADERSIZE) || (group.offset + size > footerOffset))
+		{
+			m_groups.clear();
+			return 1;
+		}
+		group.modified = false;
+		m_groups.push_back(group);
+
+		// A put() of a later day (e.g. the first run of the next day) merges the groups of this one
+		if (dayStart(group.tmin) > m_day)
+			m_day = dayStart(group.tmin);
+	}
+
+	m_end = end;
+	m_footerSize = (unsigned long)footerSize;
+
+	return 0;
+}
+
+// Read the column chunks of a group
+int ColumnFile::read(ColumnGroup &group)
+{
+	size_t size = 0;
+	for (unsigned int col = 0; col < group.sizes.size(); col++)
+		size += group.sizes[col];
+
+	std::string raw;
+	if ((m_fp == NULL) || !readBytes(m_fp, group.offset, size, raw) || !decode(group, raw))
+		return -1;
+
+	return 0;
+}
+
+// Add rows of one device and one day, rows with a timestamp already in the file are skipped
+// The new rows are kept in a group of their own until they're saved, the saved groups aren't touched
+void ColumnFile::put(unsigned long serial, const std::vector<ColumnData> &rows)
+{
+	const std::vector<long long> &timestamps = rows[0].ints;
+	if (timestamps.empty())
+		return;
+
+	time_t day = dayStart((time_t)timestamps[0]);
+
+	// Day closed: the next save merges its groups
+	if ((m_day != 0) && (day != m_day))
+		m_merge = true;
+	m_day = day;
+
+	// Timestamps of the device and day in the file, read once while the file is open
+	std::pair<unsigned long, time_t> key(serial, day);
+	std::map<std::pair<unsigned long, time_t>, std::set<long long> >::iterator known = m_known.find(key);
+	if (known == m_known.end())
+	{
+		known = m_known.insert(std::make_pair(key, std::set<long long>())).first;
+		for (std::vector<ColumnGroup>::const_iterator it = m_groups.begin(); it != m_groups.end(); ++it)
+		{
+			if ((it->serial != serial) || (dayStart(it->tmin) != day))
+				continue;
+
+			ColumnGroup saved = *it;
+			if (!saved.data.empty() || (read(saved) == 0))
+				known->second.insert(saved.data[0].ints.begin(), saved.data[0].ints.end());
+		}
+	}
+
+	std::vector<unsigned int> added;
+	for (unsigned int row = 0; row < timestamps.size(); row++)
+		if (known->second.insert(timestamps[row]).second)
+			added.push_back(row);
+
+	if (added.empty())
+		return;
+
+	std::vector<ColumnGroup>::iterator group = m_groups.begin();
+	while ((group != m_groups.end()) && ((group->serial != serial) || (dayStart(group->tmin) != day) || (group->offset != 0)))
+		++group;
+
+	if (group == m_groups.end())
+	{
+		ColumnGroup newgroup;
+		newgroup.serial = serial;
+		newgroup.rows = 0;
+		newgroup.tmin = newgroup.tmax = 0;
+		newgroup.offset = 0;
+		newgroup.data.resize(m_columns.size());
+		newgroup.modified = false;
+		group = m_groups.insert(m_groups.end(), newgroup);
+	}
+
+	for (unsigned int i = 0; i < added.size(); i++)
+		append(*group, rows, added[i]);
+
+	sort(*group);
+	group->modified = true;
+}
+
+void ColumnFile::append(ColumnGroup &group, const std::vector<ColumnData> &rows, unsigned int row) const
+{
+	for (unsigned int col = 0; col < m_columns.size(); col++)
+	{
+		switch (m_columns[col].encoding)
+		{
+		case SBFC_DELTA: group.data[col].ints.push_back(rows[col].ints[row]); break;
+		case SBFC_FLOAT: group.data[col].floats.push_back(rows[col].floats[row]); break;
+		case SBFC_DICT:	 group.data[col].strings.push_back(rows[col].strings[row]); break;
+		}
+	}
+}
+
+// Keep the rows in time order (backfill may add earlier rows)
+void ColumnFile::sort(ColumnGroup &group) const
+{
+	std::vector<long long> &ts = group.data[0].ints;
+	bool sorted = true;
+	for (unsigned int row = 1; row < ts.size(); row++)
+		if (ts[row] < ts[row - 1]) sorted = false;
+
+	if (!sorted)
+	{
+		std::vector<std::pair<long long, unsigned int> > order;
+		for (unsigned int row = 0; row < ts.size(); row++)
+			order.push_back(std::make_pair(ts[row], row));
+		std::sort(order.begin(), order.end());
+
+		ColumnGroup ordered;
+		ordered.data.resize(m_columns.size());
+		for (unsigned int row = 0; row < order.size(); row++)
+			append(ordered, group.data, order[row].second);
+		group.data = ordered.data;
+	}
+
+	group.rows = (unsigned long)ts.size();
+	group.tmin = (time_t)ts.front();
+	group.tmax = (time_t)ts.back();
+}
+
+/*
+ * Write the modified groups, the footer and the trailer behind the current trailer
+ * Until the new trailer is complete, the previous one is found by open(): a crash loses the last save only
+ * The file is compacted when a day is closed or when more than half of it is no longer used (old footers)
+ */
+int ColumnFile::save(void)
+{
+	if (m_fp == NULL)
+		return -1;
+
+	bool modified = false;
+	for (std::vector<ColumnGroup>::const_iterator it = m_groups.begin(); it != m_groups.end(); ++it)
+		if (it->modified) modified = true;
+
+	if (!modified)
+		return 0;
+
+	std::string out;
+	for (std::vector<ColumnGroup>::iterator group = m_groups.begin(); group != m_groups.end(); ++group)
+	{
+		if (!group->modified)
+			continue;
+
+		std::vector<std::string> chunks;
+		encode(*group, chunks);
+
+		group->offset = m_end + out.size();
+		group->sizes.clear();
+		for (unsigned int col = 0; col < chunks.size(); col++)
+		{
+			group->sizes.push_back((unsigned long)chunks[col].size());
+			out += chunks[col];
+		}
+	}
+
+	std::sort(m_groups.begin(), m_groups.end(), sortByTime);
+	unsigned long footerSize = writeFooter(m_groups, m_end + out.size(), out);
+
+	if ((fseek(m_fp, (long)m_end, SEEK_SET) != 0) || (fwrite(out.data(), 1, out.size(), m_fp) != out.size()) || (fflush(m_fp) != 0))
+		return -1;
+
+	m_end += out.size();
+	m_footerSize = footerSize;
+	for (std::vector<ColumnGroup>::iterator it = m_groups.begin(); it != m_groups.end(); ++it)
+	{
+		it->modified = false;
+		it->data.clear();	// Only the timestamps are needed, they're in m_known
+	}
+
+	// Drop what is left of an earlier failed save
+	#ifdef WIN32
+	_chsize_s(_fileno(m_fp), m_end);
+	#else
+	if (ftruncate(fileno(m_fp), m_end) != 0)
+		return -1;
+	#endif
+
+	if (needsCompact())
+		return compact();
+
+	return 0;
+}
+
+// Footer of the groups, followed by the trailer, returns the size of the footer
+unsigned long ColumnFile::writeFooter(const std::vector<ColumnGroup> &groups, unsigned long long footerOffset, std::string &out) const
+{
+	std::string footer;
+	putU32(footer, (unsigned long)m_columns.size());
+	for (unsigned int col = 0; col < m_columns.size(); col++)
+	{
+		size_t length = strlen(m_columns[col].name);
+		putU8(footer, m_columns[col].encoding);
+		putU32(footer, m_columns[col].scale);
+		putU8(footer, (unsigned int)length);
+		footer.append(m_columns[col].name, length);
+	}
+	putU32(footer, (unsigned long)groups.size());
+	for (std::vector<ColumnGroup>::const_iterator it = groups.begin(); it != groups.end(); ++it)
+	{
+		putU32(footer, it->serial);
+		putU32(footer, it->rows);
+		putU64(footer, (unsigned long long)(long long)it->tmin);
+		putU64(footer, (unsigned long long)(long long)it->tmax);
+		putU64(footer, it->offset);
+		for (unsigned int col = 0; col < it->sizes.size(); col++)
+			putU32(footer, it->sizes[col]);
+	}
+
+	out += footer;
+	putU64(out, footerOffset);
+	putU32(out, (unsigned long)footer.size());
+	out += SBFC_MAGIC;
+
+	return (unsigned long)footer.size();
+}
+
+// Bytes of the file in use: header, groups in the footer, footer and trailer
+unsigned long long ColumnFile::used(void) const
+{
+	unsigned long long size = SBFC_HEADERSIZE + m_footerSize + SBFC_TRAILERSIZE;
+	for (std::vector<ColumnGroup>::const_iterator it = m_groups.begin(); it != m_groups.end(); ++it)
+		for (unsigned int col = 0; col < it->sizes.size(); col++)
+			size += it->sizes[col];
+	return size;
+}
+
+/*
+ * Copy the groups in use to <file>.tmp, which then replaces the file
+ * The groups of one device and day are merged into one, the other groups are copied as they are
+ * The file must be saved first
+ */
+int ColumnFile::compact(void)
+{
+	if (m_fp == NULL)
+		return -1;
+
+	std::map<std::pair<unsigned long, time_t>, std::vector<unsigned int> > days;
+	for (unsigned int g = 0; g < m_groups.size(); g++)
+	{
+		if (m_groups[g].modified)
+			return -1;
+		days[std::make_pair(m_groups[g].serial, dayStart(m_groups[g].tmin))].push_back(g);
+	}
+
+	// Nothing to merge or to drop
+	if ((days.size() == m_groups.size()) && (m_end == used()))
+	{
+		m_merge = false;
+		return 0;
+	}
+
+	std::string out = SBFC_MAGIC;
+	putU32(out, SBFC_VERSION);
+
+	std::vector<ColumnGroup> groups;
+	for (std::map<std::pair<unsigned long, time_t>, std::vector<unsigned int> >::const_iterator day = days.begin(); day != days.end(); ++day)
+	{
+		ColumnGroup group = m_groups[day->second[0]];
+		std::vector<std::string> chunks;
+
+		if (day->second.size() == 1)
+		{
+			std::string raw;
+			size_t size = 0;
+			for (unsigned int col = 0; col < group.sizes.size(); col++)
+				size += group.sizes[col];
+			if (!readBytes(m_fp, group.offset, size, raw))
+				return -1;
+			chunks.push_back(raw);
+		}
+		else
+		{
+			group.data.clear();
+			group.data.resize(m_columns.size());
+			for (unsigned int i = 0; i < day->second.size(); i++)
+			{
+				ColumnGroup part = m_groups[day->second[i]];
+				if (read(part) != 0)
+					return -1;
+				for (unsigned int row = 0; row < part.rows; row++)
+					append(group, part.data, row);
+			}
+			sort(group);
+			encode(group, chunks);
+			group.data.clear();
+
+			group.sizes.clear();
+			for (unsigned int col = 0; col < chunks.size(); col++)
+				group.sizes.push_back((unsigned long)chunks[col].size());
+		}
+
+		group.offset = out.size();
+		for (unsigned int col = 0; col < chunks.size(); col++)
+			out += chunks[col];
+		groups.push_back(group);
+	}
+
+	unsigned long footerSize = writeFooter(groups, out.size(), out);
+
+	std::string tmppath = m_path + ".tmp";
+	FILE *fp = fopen(tmppath.c_str(), "wb");
+	if (fp == NULL)
+		return -1;
+
+	bool ok = (fwrite(out.data(), 1, out.size(), fp) == out.size()) && (fflush(fp) == 0);
+	#ifdef WIN32
+	if (ok) ok = (_commit(_fileno(fp)) == 0);
+	#else
+	if (ok) ok = (fsync(fileno(fp)) == 0);
+	#endif
+	if (fclose(fp) != 0) ok = false;
+
+	// Windows can't replace an open file
+	fclose(m_fp);
+	#ifdef WIN32
+	if (ok) ok = (MoveFileExA(tmppath.c_str(), m_path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0);
+	#else
+	if (ok) ok = (rename(tmppath.c_str(), m_path.c_str()) == 0);
+	#endif
+	if (!ok)
+		remove(tmppath.c_str());
+
+	if ((m_fp = fopen(m_path.c_str(), "r+b")) == NULL)
+	{
+		m_groups.clear();
+		return -1;
+	}
+
+	if (!ok)
+		return -1;
+
+	m_groups = groups;
+	m_end = out.size();
+	m_footerSize = footerSize;
+	m_merge = false;
+
+	return 0;
+}
+
+void ColumnFile::close(void)
+{
+	if (m_fp != NULL)
+		fclose(m_fp);
+	m_fp = NULL;
+	m_groups.clear();
+	m_known.clear();
+	m_end = 0;
+	m_footerSize = 0;
+	m_day = 0;
+	m_merge = false;
+}
+
+void ColumnFile::encode(const ColumnGroup &group, std::vector<std::string> &chunks) const
+{
+	chunks.resize(m_columns.size());
+	for (unsigned int col = 0; col < m_columns.size(); col++)
+	{
+		const ColumnData &data = group.data[col];
+		std::string &chunk = chunks[col];
+		chunk.clear();
+
+		switch (m_columns[col].encoding)
+		{
+		case SBFC_DELTA:
+		{
+			unsigned long long prev = 0;
+			for (std::vector<long long>::const_iterator it = data.ints.begin(); it != data.ints.end(); ++it)
+			{
+				putVarint(chunk, zigzag((long long)((unsigned long long)*it - prev)));
+				prev = (unsigned long long)*it;
+			}
+			break;
+		}
+
+		case SBFC_FLOAT:
+			for (std::vector<float>::const_iterator it = data.floats.begin(); it != data.floats.end(); ++it)
+			{
+				uint32_t bits;
+				memcpy(&bits, &*it, sizeof(bits));
+				putU32(chunk, bits);
+			}
+			break;
+
+		case SBFC_DICT:
+		{
+			std::vector<std::string> entries;
+			std::map<std::string, unsigned int> index;
+			std::vector<unsigned int> values;
+			for (std::vector<std::string>::const_iterator it = data.strings.begin(); it != data.strings.end(); ++it)
+			{
+				std::map<std::string, unsigned int>::iterator entry = index.find(*it);
+				if (entry == index.end())
+				{
+					entry = index.insert(std::make_pair(*it, (unsigned int)entries.size())).first;
+					entries.push_back(*it);
+				}
+				values.push_back(entry->second);
+			}
+
+			putVarint(chunk, entries.size());
+			for (std::vector<std::string>::const_iterator it = entries.begin(); it != entries.end(); ++it)
+			{
+				putVarint(chunk, it->size());
+				chunk += *it;
+			}
+			for (std::vector<unsigned int>::const_iterator it = values.begin(); it != values.end(); ++it)
+				putVarint(chunk, *it);
+			break;
+		}
+		}
+	}
+}
+
+bool ColumnFile::decode(ColumnGroup &group, const std::string &raw) const
+{
+	group.data.clear();
+	group.data.resize(m_columns.size());
+
+	size_t pos = 0;
+	for (unsigned int col = 0; col < m_columns.size(); col++)
+	{
+		std::string bytes = raw.substr(pos, group.sizes[col]);	// ByteReader doesn't copy
+		ByteReader chunk(bytes);
+		pos += group.sizes[col];
+		ColumnData &data = group.data[col];
+		unsigned long long value;
+
+		switch (m_columns[col].encoding)
+		{
+		case SBFC_DELTA:
+		{
+			unsigned long long prev = 0;
+			for (unsigned long row = 0; row < group.rows; row++)
+			{
+				if (!chunk.getVarint(value)) return false;
+				prev += (unsigned long long)unzigzag(value);
+				data.ints.push_back((long long)prev);
+			}
+			break;
+		}
+
+		case SBFC_FLOAT:
+			for (unsigned long row = 0; row < group.rows; row++)
+			{
+				if (!chunk.get(value, 4)) return false;
+				uint32_t bits = (uint32_t)value;
+				float f;
+				memcpy(&f, &bits, sizeof(f));
+				data.floats.push_back(f);
+			}
+			break;
+
+		case SBFC_DICT:
+		{
+			std::vector<std::string> entries;
+			unsigned long long count, length;
+			if (!chunk.getVarint(count)) return false;
+			for (unsigned long long i = 0; i < count; i++)
+			{
+				std::string entry;
+				if (!chunk.getVarint(length) || !chunk.getString(entry, (size_t)length)) return false;
+				entries.push_back(entry);
+			}
+			for (unsigned long row = 0; row < group.rows; row++)
+			{
+				if (!chunk.getVarint(value) || (value >= entries.size())) return false;
+				data.strings.push_back(entries[(size_t)value]);
+			}
+			break;
+		}
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Exports
+ */
+
+// Files stay open between the polling cycles (-daemon), a save only writes the new rows
+static ColumnFile spotFile(spotColumns, sizeof(spotColumns)/sizeof(ColumnDef));
+static ColumnFile dayFile(dayColumns, sizeof(dayColumns)/sizeof(ColumnDef));
+
+static int saveColumns(const Config *cfg, ColumnFile &file)
+{
+	int rc = file.save();
+	if (rc != 0)
+	{
+		if (cfg->quiet == 0)
+		{
+			char msg[80 + MAX_PATH];
+			snprintf(msg, sizeof(msg), "Unable to write output file %s\n", file.path().c_str());
+			print_error(stdout, PROC_ERROR, msg);
+		}
+		file.close();	// Reopened by the next export
+	}
+	return rc;
+}
+
+static int openColumns(const Config *cfg, ColumnFile &file, const std::string &folder, const std::string &filename)
+{
+	std::string path = folder + FOLDER_SEP + filename;
+	if (file.isopen() && (file.path() == path))
+		return 0;
+
+	// Date rotation: compact and close the file of the previous month
+	if (file.isopen())
+	{
+		file.compact();
+		file.close();
+	}
+
+	CSVcreatePath(folder);
+	int rc = file.open(path);
+	if (rc != 0)
+	{
+		if (cfg->quiet == 0)
+		{
+			char msg[80 + MAX_PATH];
+			snprintf(msg, sizeof(msg), "Unable to open output file %s (not a column file of this version?)\n", path.c_str());
+			print_error(stdout, PROC_ERROR, msg);
+		}
+		file.close();
+	}
+	return rc;
+}
+
+// End of program: the file is only compacted when save() would have done it
+// The groups of today are left for the readers to merge, a run every few minutes doesn't rewrite the month
+void ColumnClose(void)
+{
+	if (spotFile.isopen() && spotFile.needsCompact()) spotFile.compact();
+	spotFile.close();
+	if (dayFile.isopen() && dayFile.needsCompact()) dayFile.compact();
+	dayFile.close();
+}
+
+// Append the spot values of this cycle to <plant>-Spot-yyyymm.sbfc, one row per device
+int ExportSpotDataToColumns(const Config *cfg, InverterData *inverters[])
+{
+	if (VERBOSE_NORMAL) puts("ExportSpotDataToColumns()");
+
+	// Same time as in the spot CSV
+	time_t spottime = cfg->SpotTimeSource == 0 ? inverters[0]->InverterDatetime : time(NULL);
+
+	std::string folder = strftime_t(cfg->outputPath, spottime);
+	std::string filename = std::string(cfg->plantname) + "-Spot-" + strftime_t("%Y%m", spottime) + ".sbfc";
+
+	if (openColumns(cfg, spotFile, folder, filename) != 0)
+		return -1;
+
+	for (int inv=0; inverters[inv]!=NULL; inv++)
+	{
+		InverterData *pinv = inverters[inv];
+		std::vector<ColumnData> row(sizeof(spotColumns)/sizeof(ColumnDef));
+		int col = 0;
+		row[col++].ints.push_back(spottime);
+		row[col++].ints.push_back(pinv->Pdc1);
+		row[col++].ints.push_back(pinv->Pdc2);
+		row[col++].ints.push_back(pinv->Idc1);
+		row[col++].ints.push_back(pinv->Idc2);
+		row[col++].ints.push_back(pinv->Udc1);
+		row[col++].ints.push_back(pinv->Udc2);
+		row[col++].ints.push_back(pinv->Pac1);
+		row[col++].ints.push_back(pinv->Pac2);
+		row[col++].ints.push_back(pinv->Pac3);
+		row[col++].ints.push_back(pinv->Iac1);
+		row[col++].ints.push_back(pinv->Iac2);
+		row[col++].ints.push_back(pinv->Iac3);
+		row[col++].ints.push_back(pinv->Uac1);
+		row[col++].ints.push_back(pinv->Uac2);
+		row[col++].ints.push_back(pinv->Uac3);
+		row[col++].ints.push_back(pinv->calPdcTot);
+		row[col++].ints.push_back(pinv->TotalPac);
+		row[col++].floats.push_back(pinv->calEfficiency);
+		row[col++].ints.push_back(pinv->EToday);
+		row[col++].ints.push_back(pinv->ETotal);
+		row[col++].ints.push_back(pinv->GridFreq);
+		row[col++].ints.push_back(pinv->OperationTime);
+		row[col++].ints.push_back(pinv->FeedInTime);
+		row[col++].floats.push_back(pinv->BT_Signal);
+		row[col++].strings.push_back(tagdefs.getDesc(pinv->DeviceStatus, "?"));
+		row[col++].strings.push_back(tagdefs.getDesc(pinv->GridRelayStatus, "?"));
+		row[col++].ints.push_back(pinv->Temperature);
+		spotFile.put(pinv->Serial, row);
+	}
+
+	return saveColumns(cfg, spotFile);
+}
+
+// Add the archived day of all devices to <plant>-DayData-yyyymm.sbfc
+int ExportDayDataToColumns(const Config *cfg, InverterData *inverters[])
+{
+	if (VERBOSE_NORMAL) puts("ExportDayDataToColumns()");
+
+	time_t date = 0;
+	for (int inv=0; (inverters[inv]!=NULL) && (date == 0); inv++)
+		for (unsigned int idx = 0; (idx < sizeof(inverters[inv]->dayData)/sizeof(DayData)) && (date == 0); idx++)
+			date = inverters[inv]->dayData[idx].datetime;
+
+	if (date == 0) return 0;	// Nothing to export
+
+	std::string folder = strftime_t(cfg->outputPath, date);
+	std::string filename = std::string(cfg->plantname) + "-DayData-" + strftime_t("%Y%m", date) + ".sbfc";
+
+	if (openColumns(cfg, dayFile, folder, filename) != 0)
+		return -1;
+
+	for (int inv=0; inverters[inv]!=NULL; inv++)
+	{
+		std::vector<ColumnData> rows(sizeof(dayColumns)/sizeof(ColumnDef));
+		for (unsigned int idx = 0; idx < sizeof(inverters[inv]->dayData)/sizeof(DayData); idx++)
+		{
+			const DayData &dayData = inverters[inv]->dayData[idx];
+			if (dayData.datetime > 0)
+			{
+				rows[0].ints.push_back(dayData.datetime);
+				rows[1].ints.push_back(dayData.totalWh);
+				rows[2].ints.push_back(dayData.watt);
+			}
+		}
+		dayFile.put(inverters[inv]->Serial, rows);
+	}
+
+	return saveColumns(cfg, dayFile);
+}
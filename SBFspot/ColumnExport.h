@@ -0,0 +1,155 @@
+/************************************************************************************************
+SBFspot - Yet another tool to read power production of SMA solar inverters
+(c)2012-2020, SBF
+
+Latest version found at https://github.com/SBFspot/SBFspot
+
+License: Attribution-NonCommercial-ShareAlike 3.0 Unported (CC BY-NC-SA 3.0)
+http://creativecommons.org/licenses/by-nc-sa/3.0/
+
+You are free:
+to Share  to copy, distribute and transmit the work
+to Remix  to adapt the work
+Under the following conditions:
+Attribution:
+You must attribute the work in the manner specified by the author or licensor
+(but not in any way that suggests that they endorse you or your use of the work).
+Noncommercial:
+You may not use this work for commercial purposes.
+Share Alike:
+If you alter, transform, or build upon this work, you may distribute the resulting work
+only under the same or similar license to this one.
+
+DISCLAIMER:
+A user of SBFspot software acknowledges that he or she is receiving this
+software on an "as is" basis and the user is not relying on the accuracy
+or functionality of the software for any purpose. The user further
+acknowledges that any use of this software will be at his own risk
+and the copyright owner accepts no responsibility whatsoever arising from
+the use or application of the software.
+
+SMA is a registered trademark of SMA Solar Technology AG
+
+************************************************************************************************/
+
+#pragma once
+
+#include "SBFspot.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+
+/*
+ * Column files (*.sbfc) - Compact binary archive of the spot and day data for analytics
+ *
+ * One file per month: <plant>-Spot-yyyymm.sbfc and <plant>-DayData-yyyymm.sbfc in OutputPath
+ * The rows of one device and one day form a row group, stored column by column
+ * The rows added by each save are a group of their own, until the file is compacted:
+ * readers should merge the groups of a device and day
+ * All numbers are little endian, the file can be memory mapped and scanned without parsing text
+ *
+ *	Header	"SBFC" u16 version u16 reserved
+ *	Groups	column chunks of all row groups, back to back
+ *	Footer	u32 columns
+ *			per column: u8 encoding, u32 scale, u8 name length, name
+ *			u32 groups (sorted by serial and first timestamp)
+ *			per group: u32 serial, u32 rows, i64 first timestamp, i64 last timestamp, u64 offset,
+ *			u32 chunk size per column (chunks follow each other from offset on)
+ *	Trailer	u64 footer offset, u32 footer size, "SBFC"
+ *
+ * The file is only appended to: a save writes the modified groups, a new footer and trailer at the end
+ * The last complete trailer is the valid one, a file with an interrupted save goes back to it
+ * Old footers are dropped and groups of one day are merged when the file is compacted into a new file
+ *
+ * Column encodings
+ *	SBFC_DELTA	Integers: the first value and then the difference to the previous row, zigzag varint
+ *				Timestamps and counters (ETotal, totalWh) mostly take 1 or 2 bytes per row
+ *	SBFC_FLOAT	32 bit IEEE floats
+ *	SBFC_DICT	Strings: varint entries, per entry varint length and text, then varint entry index per row
+ *
+ * Integers are stored in device units, value = integer / scale (e.g. Udc1 scale 100 = Volt)
+ * Column 0 is always the TimeStamp (UTC)
+ * Rows already in a group (same timestamp) are skipped, exports can be repeated safely
+ */
+
+#define SBFC_MAGIC		"SBFC"
+#define SBFC_VERSION	1
+
+enum SBFC_ENCODING
+{
+	SBFC_DELTA	= 1,
+	SBFC_FLOAT	= 2,
+	SBFC_DICT	= 3
+};
+
+struct ColumnDef
+{
+	const char *name;
+	SBFC_ENCODING encoding;
+	unsigned int scale;
+};
+
+// Values of one column, depending on its encoding
+struct ColumnData
+{
+	std::vector<long long> ints;
+	std::vector<float> floats;
+	std::vector<std::string> strings;
+};
+
+// Rows of one device and one day
+struct ColumnGroup
+{
+	unsigned long serial;
+	unsigned long rows;
+	time_t tmin;
+	time_t tmax;
+	unsigned long long offset;			// 0 = not yet in the file
+	std::vector<unsigned long> sizes;	// Chunk size per column
+	std::vector<ColumnData> data;		// Decoded columns, empty until needed
+	bool modified;
+};
+
+class ColumnFile
+{
+public:
+	ColumnFile(const ColumnDef *columns, int count);
+	~ColumnFile() { close(); }
+	int open(const std::string &path);
+	void put(unsigned long serial, const std::vector<ColumnData> &rows);
+	int save(void);
+	int compact(void);
+	bool needsCompact(void) const { return m_merge || (m_end > 2 * used()); }
+	void close(void);
+	bool isopen(void) const { return m_fp != NULL; }
+	const std::string &path(void) const { return m_path; }
+
+	// Read access
+	const std::vector<ColumnGroup> &groups(void) const { return m_groups; }
+	int read(ColumnGroup &group);
+
+private:
+	std::vector<ColumnDef> m_columns;
+	std::vector<ColumnGroup> m_groups;
+	std::string m_path;
+	FILE *m_fp;
+	unsigned long long m_end;			// End of the trailer, the next save is written from here
+	unsigned long m_footerSize;
+	std::map<std::pair<unsigned long, time_t>, std::set<long long> > m_known;	// Timestamps in the file per device and day
+	time_t m_day;						// Day of the last put(), or the latest day in the file
+	bool m_merge;						// Day closed, compact after the next save
+
+	int readFooter(unsigned long long end);
+	void append(ColumnGroup &group, const std::vector<ColumnData> &rows, unsigned int row) const;
+	void sort(ColumnGroup &group) const;
+	unsigned long writeFooter(const std::vector<ColumnGroup> &groups, unsigned long long footerOffset, std::string &out) const;
+	unsigned long long used(void) const;
+	void encode(const ColumnGroup &group, std::vector<std::string> &chunks) const;
+	bool decode(ColumnGroup &group, const std::string &raw) const;
+};
+
+int ExportSpotDataToColumns(const Config *cfg, InverterData *inverters[]);
+int ExportDayDataToColumns(const Config *cfg, InverterData *inverters[]);
+void ColumnClose(void);
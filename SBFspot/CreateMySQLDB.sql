@@ -10,7 +10,7 @@ CREATE Table Config (
 	PRIMARY KEY (`Key`)
 );
 
-INSERT INTO Config VALUES('SchemaVersion','1');
+INSERT INTO Config VALUES('SchemaVersion','2');
 
 CREATE Table Inverters (
 	Serial int(4) NOT NULL,
@@ -176,35 +176,117 @@ CREATE VIEW vwConsumption AS
 	PowerUsed
 	FROM Consumption;
 
+-- SchemaVersion 2
+-- Sums of the SpotData, SpotDataX and Consumption values per Period, written at insert time
+-- Divide by Samples to get the averages
+-- Period 300: TimeStamp is the nearest 5 minutes (like Nearest5min), for SpotDataX the start of the 5 minutes
+-- Period 3600: TimeStamp is the start of the hour
+-- Period 86400: TimeStamp is local midnight
+CREATE Table SpotDataRollup (
+	Period int(4) NOT NULL,
+	TimeStamp int(4) NOT NULL,
+	Serial int(4) NOT NULL,
+	Samples int(4) NOT NULL,
+	Pdc1 bigint, Pdc2 bigint,
+	Idc1 double, Idc2 double,
+	Udc1 double, Udc2 double,
+	Pac1 bigint, Pac2 bigint, Pac3 bigint,
+	Iac1 double, Iac2 double, Iac3 double,
+	Uac1 double, Uac2 double, Uac3 double,
+	Temperature double,
+	PRIMARY KEY (Period, Serial, TimeStamp)
+);
+
+CREATE Table SpotDataXRollup (
+	Period int(4) NOT NULL,
+	`TimeStamp` int(4) NOT NULL,
+	`Serial` int(4) NOT NULL,
+	`Key` int(4) NOT NULL,
+	Samples int(4) NOT NULL,
+	`Value` bigint,
+	PRIMARY KEY (Period, `Serial`, `TimeStamp`, `Key`)
+);
+
+CREATE Table ConsumptionRollup (
+	Period int(4) NOT NULL,
+	TimeStamp int(4) NOT NULL,
+	Samples int(4) NOT NULL,
+	EnergyUsed bigint,
+	PowerUsed bigint,
+	PRIMARY KEY (Period, TimeStamp)
+);
+
+-- Consumption is written by other tools, so it is rolled up by a trigger
+-- Each row counts in Samples, a NULL EnergyUsed or PowerUsed is added as 0 (avg() would skip it)
+DELIMITER //
+CREATE TRIGGER trgConsumptionRollup AFTER INSERT ON Consumption
+	FOR EACH ROW
+BEGIN
+	INSERT INTO ConsumptionRollup VALUES(300, (NEW.TimeStamp + 150) DIV 300 * 300, 1, IFNULL(NEW.EnergyUsed, 0), IFNULL(NEW.PowerUsed, 0))
+	ON DUPLICATE KEY UPDATE Samples = Samples + 1, EnergyUsed = EnergyUsed + VALUES(EnergyUsed), PowerUsed = PowerUsed + VALUES(PowerUsed);
+	INSERT INTO ConsumptionRollup VALUES(3600, NEW.TimeStamp DIV 3600 * 3600, 1, IFNULL(NEW.EnergyUsed, 0), IFNULL(NEW.PowerUsed, 0))
+	ON DUPLICATE KEY UPDATE Samples = Samples + 1, EnergyUsed = EnergyUsed + VALUES(EnergyUsed), PowerUsed = PowerUsed + VALUES(PowerUsed);
+	INSERT INTO ConsumptionRollup VALUES(86400, UNIX_TIMESTAMP(DATE(FROM_UNIXTIME(NEW.TimeStamp))), 1, IFNULL(NEW.EnergyUsed, 0), IFNULL(NEW.PowerUsed, 0))
+	ON DUPLICATE KEY UPDATE Samples = Samples + 1, EnergyUsed = EnergyUsed + VALUES(EnergyUsed), PowerUsed = PowerUsed + VALUES(PowerUsed);
+END//
+DELIMITER ;
+
+-- DayData not yet uploaded to PVoutput (SBFspotUploadDaemon)
+CREATE INDEX idxDayDataPending ON DayData (Serial, PVoutput, TimeStamp);
+
 -- Fix 02-MAY-2016 See Issue 150
 CREATE VIEW vwAvgConsumption AS
-    SELECT Nearest5min,
-    cast(avg(EnergyUsed) As decimal(9)) As EnergyUsed,
-    cast(avg(PowerUsed) As decimal(9)) As PowerUsed
-    FROM vwConsumption
-    GROUP BY Nearest5Min;
+    SELECT From_UnixTime(TimeStamp) AS Nearest5min,
+    cast(EnergyUsed / Samples As decimal(9)) As EnergyUsed,
+    cast(PowerUsed / Samples As decimal(9)) As PowerUsed
+    FROM ConsumptionRollup
+    WHERE Period = 300;
 
 CREATE VIEW vwAvgSpotData AS
-       SELECT nearest5min,
+       SELECT From_UnixTime(TimeStamp) AS nearest5min,
               serial,
-              cast(avg(Pdc1) as decimal(9)) AS Pdc1,
-              cast(avg(Pdc2) as decimal(9)) AS Pdc2,
-              cast(avg(Idc1) as decimal(9,3)) AS Idc1,
-              cast(avg(Idc2) as decimal(9,3)) AS Idc2,
-              cast(avg(Udc1) as decimal(9,2)) AS Udc1,
-              cast(avg(Udc2) as decimal(9,2)) AS Udc2,
-              cast(avg(Pac1) as decimal(9)) AS Pac1,
-              cast(avg(Pac2) as decimal(9)) AS Pac2,
-              cast(avg(Pac3) as decimal(9)) AS Pac3,
-              cast(avg(Iac1) as decimal(9,3)) AS Iac1,
-              cast(avg(Iac2) as decimal(9,3)) AS Iac2,
-              cast(avg(Iac3) as decimal(9,3)) AS Iac3,
-              cast(avg(Uac1) as decimal(9,2)) AS Uac1,
-              cast(avg(Uac2) as decimal(9,2)) AS Uac2,
-              cast(avg(Uac3) as decimal(9,2)) AS Uac3,
-              cast(avg(Temperature) as decimal(9,2)) AS Temperature
-        FROM vwSpotData
-        GROUP BY serial, nearest5min;
+              cast(Pdc1 / Samples as decimal(9)) AS Pdc1,
+              cast(Pdc2 / Samples as decimal(9)) AS Pdc2,
+              cast(Idc1 / Samples as decimal(9,3)) AS Idc1,
+              cast(Idc2 / Samples as decimal(9,3)) AS Idc2,
+              cast(Udc1 / Samples as decimal(9,2)) AS Udc1,
+              cast(Udc2 / Samples as decimal(9,2)) AS Udc2,
+              cast(Pac1 / Samples as decimal(9)) AS Pac1,
+              cast(Pac2 / Samples as decimal(9)) AS Pac2,
+              cast(Pac3 / Samples as decimal(9)) AS Pac3,
+              cast(Iac1 / Samples as decimal(9,3)) AS Iac1,
+              cast(Iac2 / Samples as decimal(9,3)) AS Iac2,
+              cast(Iac3 / Samples as decimal(9,3)) AS Iac3,
+              cast(Uac1 / Samples as decimal(9,2)) AS Uac1,
+              cast(Uac2 / Samples as decimal(9,2)) AS Uac2,
+              cast(Uac3 / Samples as decimal(9,2)) AS Uac3,
+              cast(Temperature / Samples as decimal(9,2)) AS Temperature
+        FROM SpotDataRollup
+        WHERE Period = 300;
+
+-- Hourly (Period=3600) and daily (Period=86400) averages
+CREATE VIEW vwSpotDataRollup AS
+       SELECT Period,
+              From_UnixTime(TimeStamp) AS TimeStamp,
+              Serial,
+              Samples,
+              cast(Pdc1 / Samples as decimal(9)) AS Pdc1,
+              cast(Pdc2 / Samples as decimal(9)) AS Pdc2,
+              cast(Idc1 / Samples as decimal(9,3)) AS Idc1,
+              cast(Idc2 / Samples as decimal(9,3)) AS Idc2,
+              cast(Udc1 / Samples as decimal(9,2)) AS Udc1,
+              cast(Udc2 / Samples as decimal(9,2)) AS Udc2,
+              cast(Pac1 / Samples as decimal(9)) AS Pac1,
+              cast(Pac2 / Samples as decimal(9)) AS Pac2,
+              cast(Pac3 / Samples as decimal(9)) AS Pac3,
+              cast(Iac1 / Samples as decimal(9,3)) AS Iac1,
+              cast(Iac2 / Samples as decimal(9,3)) AS Iac2,
+              cast(Iac3 / Samples as decimal(9,3)) AS Iac3,
+              cast(Uac1 / Samples as decimal(9,2)) AS Uac1,
+              cast(Uac2 / Samples as decimal(9,2)) AS Uac2,
+              cast(Uac3 / Samples as decimal(9,2)) AS Uac3,
+              cast(Temperature / Samples as decimal(9,2)) AS Temperature
+        FROM SpotDataRollup;
 
 CREATE VIEW vwPvoData AS
        SELECT dd.Timestamp,
@@ -247,16 +329,22 @@ CREATE TABLE SpotDataX (
 DROP VIEW IF EXISTS vwBatteryData;
 
 CREATE VIEW vwBatteryData AS
-    SELECT FROM_UNIXTIME(sdx.`TimeStamp` - (sdx.`TimeStamp` % 300)) AS `5min`,
+    SELECT FROM_UNIXTIME(sdx.`TimeStamp`) AS `5min`,
            sdx.`Serial`,
            inv.`Name`,
-           AVG(CASE WHEN `Key` = 10586 THEN `Value` END) AS ChaStatus,
-           AVG(CASE WHEN `Key` = 18779 THEN CAST(`Value` AS DECIMAL(10,1)) / 10 END) AS Temperature,
-           AVG(CASE WHEN `Key` = 18781 THEN CAST(`Value` AS DECIMAL(10,3)) / 1000 END) AS ChaCurrent,
-           AVG(CASE WHEN `Key` = 18780 THEN CAST(`Value` AS DECIMAL(10,2)) / 100 END) AS ChaVoltage,
-           AVG(CASE WHEN `Key` = 17974 THEN `Value` END) AS GridMsTotWOut,
-           AVG(CASE WHEN `Key` = 17975 THEN `Value` END) AS GridMsTotWIn
-      FROM SpotDataX AS sdx
+           MAX(CASE WHEN `Key` = 10586 THEN `Value` / Samples END) AS ChaStatus,
+           MAX(CASE WHEN `Key` = 18779 THEN CAST(`Value` / Samples / 10 AS DECIMAL(10,1)) END) AS Temperature,
+           MAX(CASE WHEN `Key` = 18781 THEN CAST(`Value` / Samples / 1000 AS DECIMAL(10,3)) END) AS ChaCurrent,
+           MAX(CASE WHEN `Key` = 18780 THEN CAST(`Value` / Samples / 100 AS DECIMAL(10,2)) END) AS ChaVoltage,
+           MAX(CASE WHEN `Key` = 17974 THEN `Value` / Samples END) AS GridMsTotWOut,
+           MAX(CASE WHEN `Key` = 17975 THEN `Value` / Samples END) AS GridMsTotWIn
+      FROM SpotDataXRollup AS sdx
            INNER JOIN
-           Inverters AS inv ON sdx.Serial = inv.`Serial`
-     GROUP BY `5min`;
+           Inverters AS inv ON sdx.`Serial` = inv.`Serial`
+     WHERE sdx.Period = 300
+     GROUP BY sdx.`TimeStamp`, sdx.`Serial`;
+
+-- Optional: monthly partitions for SQL_RetentionDays (SBFspot.cfg)
+-- SBFspot splits the pMax partition per month and drops the expired months as a whole
+-- ALTER TABLE SpotData PARTITION BY RANGE (TimeStamp) (PARTITION pMax VALUES LESS THAN MAXVALUE);
+-- ALTER TABLE SpotDataX PARTITION BY RANGE (`TimeStamp`) (PARTITION pMax VALUES LESS THAN MAXVALUE);
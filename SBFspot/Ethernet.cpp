@@ -34,6 +34,7 @@ DISCLAIMER:
 
 #include "misc.h"
 #include "Ethernet.h"
+#include "Capture.h"
 
 const char *IP_Broadcast = "239.12.255.254";
 
@@ -41,6 +42,10 @@ int ethConnect(short port)
 {
     int ret = 0;
 
+	// No network needed when replaying a capture file
+	if (captureMode == CAP_REPLAY)
+		return 0;
+
 #ifdef WIN32
 	WSADATA wsa;
      
@@ -63,6 +68,12 @@ int ethConnect(short port)
     addr_out.sin_family = AF_INET;
     addr_out.sin_port = htons(port);
     addr_out.sin_addr.s_addr = htonl(INADDR_ANY);
+    // Allow other listeners on the same port (e.g. SBFspotSim on a loopback address)
+    int reuse = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (const char *)&reuse, sizeof(reuse));
+    // Room for the replies of all devices at once (archive backfill keeps many requests in flight)
+    int rcvbuf = ETH_RCVBUFSIZE;
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, (const char *)&rcvbuf, sizeof(rcvbuf));
     ret = bind(sock, (struct sockaddr*) &addr_out, sizeof(addr_out));
     // here is the destination IP
 	addr_out.sin_addr.s_addr = inet_addr(IP_Broadcast);
@@ -87,19 +98,30 @@ int ethConnect(short port)
     return 0; //OK
 }
 
-int ethRead(unsigned char *buf, unsigned int bufsize)
+int ethRead(unsigned char *buf, unsigned int bufsize, int timeout_ms)
 {
     int bytes_read;
-    short timeout = 5;
     socklen_t addr_in_len = sizeof(addr_in);
 
+	if (captureMode == CAP_REPLAY)
+	{
+		char IP[20];
+		bytes_read = capRead(buf, bufsize, IP, sizeof(IP));
+		if (bytes_read > 0)
+		{
+			addr_in.sin_addr.s_addr = inet_addr(IP);
+			if (DEBUG_NORMAL) printf("Replayed %d bytes from IP [%s]\n", bytes_read, IP);
+		}
+		return bytes_read;
+	}
+
     fd_set readfds;
 
 	do
 	{
 		struct timeval tv;
-		tv.tv_sec = timeout;     //set timeout of reading
-		tv.tv_usec = 0;
+		tv.tv_sec = timeout_ms / 1000;     //set timeout of reading
+		tv.tv_usec = (timeout_ms % 1000) * 1000;
 
 		FD_ZERO(&readfds);
 		FD_SET(sock, &readfds);
@@ -139,6 +161,9 @@ int ethRead(unsigned char *buf, unsigned int bufsize)
 
 	} while (bytes_read == 600 || bytes_read == 608); // keep on reading if data received from Energy Meter (600 bytes) or Sunny Home Manager (608 bytes)
 
+	if ((captureMode == CAP_RECORD) && (bytes_read > 0))
+		capWrite('<', inet_ntoa(addr_in.sin_addr), buf, bytes_read);
+
     return bytes_read;
 }
 
@@ -147,6 +172,13 @@ int ethSend(unsigned char *buffer, const char *toIP)
 	if (DEBUG_NORMAL) HexDump(buffer, packetposition, 10);
 
 	addr_out.sin_addr.s_addr = inet_addr(toIP);
+
+	if (captureMode == CAP_REPLAY)
+		return capSend(buffer, packetposition);
+
+	if (captureMode == CAP_RECORD)
+		capWrite('>', toIP, buffer, packetposition);
+
     size_t bytes_sent = sendto(sock, (const char*)buffer, packetposition, 0, (struct sockaddr *)&addr_out, sizeof(addr_out));
 
 	if (DEBUG_NORMAL) std::cout << bytes_sent << " Bytes sent to IP [" << inet_ntoa(addr_out.sin_addr) << "]" << std::endl;
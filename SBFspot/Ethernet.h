@@ -75,6 +75,8 @@ unsigned char hexbyte2dec(char *hex);
 
 #define BT_NUMRETRY 10
 #define BT_TIMEOUT  10
+#define ETH_TIMEOUT 5000	// Speedwire receive timeout (ms)
+#define ETH_RCVBUFSIZE (4 * 1024 * 1024)	// Speedwire socket receive buffer (bytes)
 
 extern int packetposition;
 extern int MAX_CommBuf;
@@ -90,6 +92,6 @@ int ethConnect(short port);
 int ethClose(void);
 int getLocalIP(unsigned char IPAddress[4]);
 int ethSend(unsigned char *buffer, const char *toIP);
-int ethRead(unsigned char *buf, unsigned int bufsize);
+int ethRead(unsigned char *buf, unsigned int bufsize, int timeout_ms = ETH_TIMEOUT);
 
 #endif /* _ETHERNET_H_ */
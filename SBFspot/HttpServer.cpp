@@ -0,0 +1,606 @@
+/************************************************************************************************
+SBFspot - Yet another tool to read power production of SMA solar inverters
+(c)2012-2020, SBF
+
+Latest version found at https://github.com/SBFspot/SBFspot
+
+License: Attribution-NonCommercial-ShareAlike 3.0 Unported (CC BY-NC-SA 3.0)
+http://creativecommons.org/licenses/by-nc-sa/3.0/
+
+You are free:
+to Share  to copy, distribute and transmit the work
+to Remix  to adapt the work
+Under the following conditions:
+Attribution:
+You must attribute the work in the manner specified by the author or licensor
+(but not in any way that suggests that they endorse you or your use of the work).
+Noncommercial:
+You may not use this work for commercial purposes.
+Share Alike:
+If you alter, transform, or build upon this work, you may distribute the resulting work
+only under the same or similar license to this one.
+
+DISCLAIMER:
+A user of SBFspot software acknowledges that he or she is receiving this
+software on an "as is" basis and the user is not relying on the accuracy
+or functionality of the software for any purpose. The user further
+acknowledges that any use of this software will be at his own risk
+and the copyright owner accepts no responsibility whatsoever arising from
+the use or application of the software.
+
+SMA is a registered trademark of SMA Solar Technology AG
+
+************************************************************************************************/
+#include "HttpServer.h"
+
+#include <string.h>
+#include "CSVexport.h" // FormatFixed(), FormatDouble()
+
+#if defined(WIN32)
+#define HTTP_SENDFLAGS		0
+#else
+#define HTTP_SENDFLAGS		MSG_NOSIGNAL	// A client that went away is an error, not a SIGPIPE
+#endif
+
+HttpSnapshotBuffer::HttpSnapshotBuffer() : m_back(0), m_front(1), m_latest(2)
+{
+	for (int i = 0; i < 3; i++)
+		m_buffer[i].time = 0;
+}
+
+// The back buffer becomes the latest snapshot, the previous latest one (read or not) is written next
+void HttpSnapshotBuffer::publish(void)
+{
+	m_back = m_latest.exchange(m_back | FRESH, boost::memory_order_acq_rel) & ~FRESH;
+}
+
+// Latest snapshot, valid until the next call
+const HttpSnapshot &HttpSnapshotBuffer::acquire(void)
+{
+	if (m_latest.load(boost::memory_order_acquire) & FRESH)
+		m_front = m_latest.exchange(m_front, boost::memory_order_acq_rel) & ~FRESH;
+
+	return m_buffer[m_front];
+}
+
+// Device values are scaled integers (e.g. Udc 23012 / 100 = 230.12V)
+static void appendValue(std::string &out, long long value, long long divisor, int precision)
+{
+	char str[32];
+	out += FormatFixed(str, value, divisor, precision, '.');
+}
+
+static void appendValue(std::string &out, long value, long long divisor, int precision)
+{
+	appendValue(out, (long long)value, divisor, precision);
+}
+
+static void appendValue(std::string &out, int value, long long divisor, int precision)
+{
+	appendValue(out, (long long)value, divisor, precision);
+}
+
+static void appendValue(std::string &out, float value, long long divisor, int precision)
+{
+	char str[32];
+	out += FormatDouble(str, (double)value / divisor, 0, precision, '.');
+}
+
+/*******
+* JSON *
+********/
+static void jsonString(std::string &out, const char *str)
+{
+	out += '"';
+	for (const unsigned char *p = (const unsigned char *)str; *p != 0; p++)
+	{
+		if ((*p == '"') || (*p == '\\'))
+		{
+			out += '\\';
+			out += (char)*p;
+		}
+		else if (*p < 0x20)
+		{
+			char esc[8];
+			snprintf(esc, sizeof(esc), "\\u%04x", *p);
+			out += esc;
+		}
+		else
+			out += (char)*p;
+	}
+	out += '"';
+}
+
+// "key": (comma separated, except for the first member)
+static void jsonKey(std::string &out, const char *key)
+{
+	char last = out[out.length() - 1];
+	if ((last != '{') && (last != '['))
+		out += ',';
+	out += '"';
+	out += key;
+	out += "\":";
+}
+
+static void jsonValue(std::string &out, const char *key, long long value, long long divisor, int precision)
+{
+	jsonKey(out, key);
+	appendValue(out, value, divisor, precision);
+}
+
+// Keywords and units are those of MQTT_Data, times are in seconds since 1970
+static void renderJson(std::string &out, const Config *cfg, InverterData *inverters[], time_t polltime)
+{
+	out.clear();
+	out += '{';
+	jsonValue(out, "Timestamp", polltime, 1, 0);
+	jsonKey(out, "PlantName");
+	jsonString(out, cfg->plantname);
+
+	jsonKey(out, "Devices");
+	out += '[';
+	for (int inv = 0; inverters[inv] != NULL; inv++)
+	{
+		const InverterData *pInv = inverters[inv];
+		if (inv > 0) out += ',';
+		out += '{';
+		jsonValue(out, "InvSerial", pInv->Serial, 1, 0);
+		jsonKey(out, "InvName");
+		jsonString(out, pInv->DeviceName);
+		jsonKey(out, "InvClass");
+		jsonString(out, pInv->DeviceClass);
+		jsonKey(out, "InvType");
+		jsonString(out, pInv->DeviceType);
+		jsonKey(out, "InvSwVer");
+		jsonString(out, pInv->SWVersion);
+		jsonValue(out, "InvTime", pInv->InverterDatetime, 1, 0);
+		jsonKey(out, "InvStatus");
+		jsonString(out, tagdefs.getDesc(pInv->DeviceStatus, "?").c_str());
+		jsonKey(out, "InvGridRelay");
+		jsonString(out, tagdefs.getDesc(pInv->GridRelayStatus, "?").c_str());
+		jsonValue(out, "InvTemperature", pInv->Temperature, 100, 2);
+		jsonValue(out, "PDC1", pInv->Pdc1, 1, 0);
+		jsonValue(out, "PDC2", pInv->Pdc2, 1, 0);
+		jsonValue(out, "UDC1", pInv->Udc1, 100, 2);
+		jsonValue(out, "UDC2", pInv->Udc2, 100, 2);
+		jsonValue(out, "IDC1", pInv->Idc1, 1000, 3);
+		jsonValue(out, "IDC2", pInv->Idc2, 1000, 3);
+		jsonValue(out, "PDCTot", pInv->calPdcTot, 1, 0);
+		jsonValue(out, "PAC1", pInv->Pac1, 1, 0);
+		jsonValue(out, "PAC2", pInv->Pac2, 1, 0);
+		jsonValue(out, "PAC3", pInv->Pac3, 1, 0);
+		jsonValue(out, "UAC1", pInv->Uac1, 100, 2);
+		jsonValue(out, "UAC2", pInv->Uac2, 100, 2);
+		jsonValue(out, "UAC3", pInv->Uac3, 100, 2);
+		jsonValue(out, "IAC1", pInv->Iac1, 1000, 3);
+		jsonValue(out, "IAC2", pInv->Iac2, 1000, 3);
+		jsonValue(out, "IAC3", pInv->Iac3, 1000, 3);
+		jsonValue(out, "PACTot", pInv->TotalPac, 1, 0);
+		jsonKey(out, "Efficiency");
+		appendValue(out, pInv->calEfficiency, 1, 2);
+		jsonValue(out, "GridFreq", pInv->GridFreq, 100, 2);
+		jsonValue(out, "EToday", pInv->EToday, 1000, 3);
+		jsonValue(out, "ETotal", pInv->ETotal, 1000, 3);
+		jsonValue(out, "OperTm", pInv->OperationTime, 3600, 3);
+		jsonValue(out, "FeedTm", pInv->FeedInTime, 3600, 3);
+		if (cfg->ConnectionType == CT_BLUETOOTH)
+		{
+			jsonKey(out, "BTSignal");
+			appendValue(out, pInv->BT_Signal, 1, 1);
+		}
+		if (pInv->hasBattery)
+		{
+			jsonValue(out, "BatTmpVal", pInv->BatTmpVal, 10, 1);
+			jsonValue(out, "BatVol", pInv->BatVol, 100, 2);
+			jsonValue(out, "BatAmp", pInv->BatAmp, 1000, 3);
+			jsonValue(out, "BatChaStt", pInv->BatChaStt, 1, 0);
+		}
+		out += '}';
+	}
+	out += ']';
+
+	long long pdc = 0, pac = 0, etoday = 0, etotal = 0;
+	for (int inv = 0; inverters[inv] != NULL; inv++)
+	{
+		pdc += inverters[inv]->calPdcTot;
+		pac += inverters[inv]->TotalPac;
+		etoday += inverters[inv]->EToday;
+		etotal += inverters[inv]->ETotal;
+	}
+	jsonKey(out, "PlantTotals");
+	out += '{';
+	jsonValue(out, "PDCTot", pdc, 1, 0);
+	jsonValue(out, "PACTot", pac, 1, 0);
+	jsonValue(out, "EToday", etoday, 1000, 3);
+	jsonValue(out, "ETotal", etotal, 1000, 3);
+	out += "}}\n";
+}
+
+/*************
+* Prometheus *
+**************/
+// Label value with backslash, double quote and line feed escaped
+static void labelValue(std::string &out, const char *name, const char *value)
+{
+	out += name;
+	out += "=\"";
+	for (const char *p = value; *p != 0; p++)
+	{
+		if (*p == '\n')
+			out += "\\n";
+		else
+		{
+			if ((*p == '"') || (*p == '\\')) out += '\\';
+			out += *p;
+		}
+	}
+	out += '"';
+}
+
+static void metricFamily(std::string &out, const char *name, const char *type, const char *help)
+{
+	out += "# HELP ";
+	out += name;
+	out += ' ';
+	out += help;
+	out += "\n# TYPE ";
+	out += name;
+	out += ' ';
+	out += type;
+	out += '\n';
+}
+
+// One sample per device: name{serial="...",name="..."[,extra]} value
+template<typename T>
+static void metricSamples(std::string &out, const char *name, const std::vector<std::string> &labels, const char *extra, InverterData *inverters[], T InverterData::*value, long long divisor, int precision)
+{
+	for (size_t inv = 0; inv < labels.size(); inv++)
+	{
+		out += name;
+		out += '{';
+		out += labels[inv];
+		if (extra != NULL)
+		{
+			out += ',';
+			out += extra;
+		}
+		out += "} ";
+		appendValue(out, inverters[inv]->*value, divisor, precision);
+		out += '\n';
+	}
+}
+
+template<typename T>
+static void metric(std::string &out, const char *name, const char *type, const char *help, const std::vector<std::string> &labels, InverterData *inverters[], T InverterData::*value, long long divisor, int precision)
+{
+	metricFamily(out, name, type, help);
+	metricSamples(out, name, labels, NULL, inverters, value, divisor, precision);
+}
+
+// Device condition and grid relay: the code is the value, its text a label
+static void metricStatus(std::string &out, const char *name, const char *help, const std::vector<std::string> &labels, InverterData *inverters[], int InverterData::*value)
+{
+	metricFamily(out, name, "gauge", help);
+	for (size_t inv = 0; inv < labels.size(); inv++)
+	{
+		int status = inverters[inv]->*value;
+		out += name;
+		out += '{';
+		out += labels[inv];
+		out += ',';
+		labelValue(out, "status", tagdefs.getDesc(status, "?").c_str());
+		out += "} ";
+		appendValue(out, status, 1, 0);
+		out += '\n';
+	}
+}
+
+// Base units (W, V, A, Hz, Wh, s), all values per device
+static void renderMetrics(std::string &out, const Config *cfg, InverterData *inverters[], const std::vector<std::string> &labels, time_t polltime)
+{
+	out.clear();
+
+	metricFamily(out, "sbfspot_device_info", "gauge", "Device type and software version");
+	for (size_t inv = 0; inv < labels.size(); inv++)
+	{
+		out += "sbfspot_device_info{";
+		out += labels[inv];
+		out += ',';
+		labelValue(out, "class", inverters[inv]->DeviceClass);
+		out += ',';
+		labelValue(out, "type", inverters[inv]->DeviceType);
+		out += ',';
+		labelValue(out, "version", inverters[inv]->SWVersion);
+		out += "} 1\n";
+	}
+
+	metricFamily(out, "sbfspot_dc_power_watts", "gauge", "DC power per string");
+	metricSamples(out, "sbfspot_dc_power_watts", labels, "string=\"1\"", inverters, &InverterData::Pdc1, 1, 0);
+	metricSamples(out, "sbfspot_dc_power_watts", labels, "string=\"2\"", inverters, &InverterData::Pdc2, 1, 0);
+	metricFamily(out, "sbfspot_dc_voltage_volts", "gauge", "DC voltage per string");
+	metricSamples(out, "sbfspot_dc_voltage_volts", labels, "string=\"1\"", inverters, &InverterData::Udc1, 100, 2);
+	metricSamples(out, "sbfspot_dc_voltage_volts", labels, "string=\"2\"", inverters, &InverterData::Udc2, 100, 2);
+	metricFamily(out, "sbfspot_dc_current_amperes", "gauge", "DC current per string");
+	metricSamples(out, "sbfspot_dc_current_amperes", labels, "string=\"1\"", inverters, &InverterData::Idc1, 1000, 3);
+	metricSamples(out, "sbfspot_dc_current_amperes", labels, "string=\"2\"", inverters, &InverterData::Idc2, 1000, 3);
+	metric(out, "sbfspot_dc_power_total_watts", "gauge", "Calculated total DC power", labels, inverters, &InverterData::calPdcTot, 1, 0);
+
+	metricFamily(out, "sbfspot_ac_power_watts", "gauge", "AC power per phase");
+	metricSamples(out, "sbfspot_ac_power_watts", labels, "phase=\"1\"", inverters, &InverterData::Pac1, 1, 0);
+	metricSamples(out, "sbfspot_ac_power_watts", labels, "phase=\"2\"", inverters, &InverterData::Pac2, 1, 0);
+	metricSamples(out, "sbfspot_ac_power_watts", labels, "phase=\"3\"", inverters, &InverterData::Pac3, 1, 0);
+	metricFamily(out, "sbfspot_ac_voltage_volts", "gauge", "AC voltage per phase");
+	metricSamples(out, "sbfspot_ac_voltage_volts", labels, "phase=\"1\"", inverters, &InverterData::Uac1, 100, 2);
+	metricSamples(out, "sbfspot_ac_voltage_volts", labels, "phase=\"2\"", inverters, &InverterData::Uac2, 100, 2);
+	metricSamples(out, "sbfspot_ac_voltage_volts", labels, "phase=\"3\"", inverters, &InverterData::Uac3, 100, 2);
+	metricFamily(out, "sbfspot_ac_current_amperes", "gauge", "AC current per phase");
+	metricSamples(out, "sbfspot_ac_current_amperes", labels, "phase=\"1\"", inverters, &InverterData::Iac1, 1000, 3);
+	metricSamples(out, "sbfspot_ac_current_amperes", labels, "phase=\"2\"", inverters, &InverterData::Iac2, 1000, 3);
+	metricSamples(out, "sbfspot_ac_current_amperes", labels, "phase=\"3\"", inverters, &InverterData::Iac3, 1000, 3);
+	metric(out, "sbfspot_ac_power_total_watts", "gauge", "Total AC power", labels, inverters, &InverterData::TotalPac, 1, 0);
+
+	metric(out, "sbfspot_efficiency_percent", "gauge", "Calculated efficiency (AC/DC power)", labels, inverters, &InverterData::calEfficiency, 1, 2);
+	metric(out, "sbfspot_grid_frequency_hertz", "gauge", "Grid frequency", labels, inverters, &InverterData::GridFreq, 100, 2);
+	metric(out, "sbfspot_energy_today_watthours", "gauge", "Energy produced today", labels, inverters, &InverterData::EToday, 1, 0);
+	metric(out, "sbfspot_energy_watthours_total", "counter", "Total energy produced", labels, inverters, &InverterData::ETotal, 1, 0);
+	metric(out, "sbfspot_operating_seconds_total", "counter", "Operating time", labels, inverters, &InverterData::OperationTime, 1, 0);
+	metric(out, "sbfspot_feedin_seconds_total", "counter", "Feed-in time", labels, inverters, &InverterData::FeedInTime, 1, 0);
+	metric(out, "sbfspot_temperature_celsius", "gauge", "Device temperature", labels, inverters, &InverterData::Temperature, 100, 2);
+	metricStatus(out, "sbfspot_device_status", "Device condition", labels, inverters, &InverterData::DeviceStatus);
+	metricStatus(out, "sbfspot_grid_relay_status", "Grid relay/contactor", labels, inverters, &InverterData::GridRelayStatus);
+	metric(out, "sbfspot_device_time_seconds", "gauge", "Device date/time", labels, inverters, &InverterData::InverterDatetime, 1, 0);
+	if (cfg->ConnectionType == CT_BLUETOOTH)
+		metric(out, "sbfspot_bt_signal_percent", "gauge", "Bluetooth signal strength", labels, inverters, &InverterData::BT_Signal, 1, 1);
+
+	metricFamily(out, "sbfspot_last_poll_timestamp_seconds", "gauge", "Time of the last polling cycle");
+	out += "sbfspot_last_poll_timestamp_seconds ";
+	appendValue(out, (long long)polltime, 1, 0);
+	out += '\n';
+}
+
+/**************
+* HTTP server *
+***************/
+HttpServer::HttpServer() : m_socket(HTTP_NOSOCKET), m_stop(false)
+{
+}
+
+HttpServer::~HttpServer()
+{
+	stop();
+}
+
+int HttpServer::start(const std::string &address, int port)
+{
+#if defined(WIN32)
+	WSADATA wsa;
+	WSAStartup(MAKEWORD(2,2), &wsa);
+#endif
+
+	char service[8];
+	snprintf(service, sizeof(service), "%d", port);
+
+	struct addrinfo hints;
+	struct addrinfo *result = NULL;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+
+	// No address: all interfaces
+	if (getaddrinfo(address.empty() ? NULL : address.c_str(), service, &hints, &result) != 0)
+	{
+		std::cout << "HTTP: Unknown address " << address << std::endl;
+		return -1;
+	}
+
+	for (struct addrinfo *ai = result; (ai != NULL) && !isrunning(); ai = ai->ai_next)
+	{
+		if ((m_socket = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol)) == HTTP_NOSOCKET)
+			continue;
+
+		// Don't wait for connections of a previous run to time out
+		int reuse = 1;
+		setsockopt(m_socket, SOL_SOCKET, SO_REUSEADDR, (const char *)&reuse, sizeof(reuse));
+
+		if ((bind(m_socket, ai->ai_addr, (socklen_t)ai->ai_addrlen) != 0) || (listen(m_socket, 8) != 0))
+			close(m_socket);
+	}
+
+	freeaddrinfo(result);
+
+	if (!isrunning())
+	{
+		std::cout << "HTTP: Unable to listen on " << address << ":" << port << std::endl;
+		return -1;
+	}
+
+	m_stop = false;
+	m_thread = boost::thread(&HttpServer::run, this);
+
+	if (VERBOSE_NORMAL) printf("HTTP server listening on port %d\n", port);
+
+	return 0;
+}
+
+void HttpServer::stop(void)
+{
+	if (isrunning())
+	{
+		m_stop = true;
+		m_thread.join();
+		close(m_socket);
+	}
+}
+
+void HttpServer::close(SOCKET &sock)
+{
+	if (sock != HTTP_NOSOCKET)
+	{
+#if defined(WIN32)
+		closesocket(sock);
+#else
+		::close(sock);
+#endif
+		sock = HTTP_NOSOCKET;
+	}
+}
+
+// Render the spot data of this polling cycle
+void HttpServer::update(const Config *cfg, InverterData *inverters[])
+{
+	int devcount = 0;
+	while (inverters[devcount] != NULL) devcount++;
+
+	// Device labels only change when the plant does, the strings are reused anyway
+	m_labels.resize(devcount);
+	for (int inv = 0; inv < devcount; inv++)
+	{
+		char serial[16];
+		snprintf(serial, sizeof(serial), "%lu", inverters[inv]->Serial);
+		m_labels[inv].clear();
+		labelValue(m_labels[inv], "serial", serial);
+		m_labels[inv] += ',';
+		labelValue(m_labels[inv], "name", inverters[inv]->DeviceName);
+	}
+
+	HttpSnapshot &snapshot = m_snapshot.back();
+	snapshot.time = time(NULL);
+	renderJson(snapshot.json, cfg, inverters, snapshot.time);
+	renderMetrics(snapshot.metrics, cfg, inverters, m_labels, snapshot.time);
+	m_snapshot.publish();
+}
+
+// HTTP thread: accept and serve one client at a time, until stop()
+void HttpServer::run(void)
+{
+	while (!m_stop)
+	{
+		fd_set readfds;
+		FD_ZERO(&readfds);
+		FD_SET(m_socket, &readfds);
+
+		// stop() is noticed within half a second
+		struct timeval tv;
+		tv.tv_sec = 0;
+		tv.tv_usec = 500000;
+
+		// Timeout or interrupted by a signal
+		if (select((int)m_socket + 1, &readfds, NULL, NULL, &tv) <= 0)
+			continue;
+
+		SOCKET client = accept(m_socket, NULL, NULL);
+		if (client == HTTP_NOSOCKET)
+			continue;
+
+		// A slow client doesn't hold up the next one forever
+#if defined(WIN32)
+		DWORD timeout = HTTP_TIMEOUT;
+#else
+		struct timeval timeout;
+		timeout.tv_sec = HTTP_TIMEOUT / 1000;
+		timeout.tv_usec = (HTTP_TIMEOUT % 1000) * 1000;
+#endif
+		setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, (const char *)&timeout, sizeof(timeout));
+		setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, (const char *)&timeout, sizeof(timeout));
+
+		serve(client);
+		close(client);
+	}
+}
+
+static bool sendAll(SOCKET sock, const char *data, size_t length)
+{
+	while (length > 0)
+	{
+		int bytes = send(sock, data, (int)length, HTTP_SENDFLAGS);
+		if (bytes <= 0)
+			return false;
+		data += bytes;
+		length -= bytes;
+	}
+	return true;
+}
+
+// Answer one request (HTTP/1.0 and 1.1, the connection is closed afterwards)
+void HttpServer::serve(SOCKET client)
+{
+	// Request header only, GET and HEAD have no body
+	std::string request;
+	char buf[1024];
+	while ((request.find("\r\n\r\n") == std::string::npos) && (request.length() < HTTP_MAXREQUEST))
+	{
+		int bytes = recv(client, buf, sizeof(buf), 0);
+		if (bytes <= 0)
+			return;
+		request.append(buf, bytes);
+	}
+
+	// Request line: method path[?query] version
+	std::string method;
+	std::string path;
+	size_t sp1 = request.find(' ');
+	size_t sp2 = (sp1 == std::string::npos) ? std::string::npos : request.find(' ', sp1 + 1);
+	if ((sp2 != std::string::npos) && (sp2 < request.find("\r\n")))
+	{
+		method = request.substr(0, sp1);
+		path = request.substr(sp1 + 1, sp2 - sp1 - 1);
+		path = path.substr(0, path.find('?'));
+	}
+
+	const HttpSnapshot &snapshot = m_snapshot.acquire();
+	const std::string *body = NULL;
+	const char *status = "200 OK";
+	const char *type = "text/plain; charset=utf-8";
+	const char *allow = "";
+
+	if (method.empty())
+		status = "400 Bad Request";
+	else if ((method != "GET") && (method != "HEAD"))
+	{
+		status = "405 Method Not Allowed";
+		allow = "Allow: GET, HEAD\r\n";
+	}
+	else if ((path == "/") || (path == "/json"))
+	{
+		body = &snapshot.json;
+		type = "application/json";
+	}
+	else if (path == "/metrics")
+	{
+		body = &snapshot.metrics;
+		type = "text/plain; version=0.0.4";
+	}
+	else
+		status = "404 Not Found";
+
+	// Nothing polled yet
+	if ((body != NULL) && (snapshot.time == 0))
+	{
+		body = NULL;
+		status = "503 Service Unavailable";
+		type = "text/plain; charset=utf-8";
+	}
+
+	// Errors have their status line as body
+	std::string error;
+	if (body == NULL)
+	{
+		error = std::string(status) + "\n";
+		body = &error;
+	}
+
+	char header[256];
+	int length = snprintf(header, sizeof(header),
+		"HTTP/1.1 %s\r\n"
+		"Content-Type: %s\r\n"
+		"Content-Length: %lu\r\n"
+		"%s"
+		"Cache-Control: no-cache\r\n"
+		"Connection: close\r\n"
+		"\r\n",
+		status, type, (unsigned long)body->length(), allow);
+
+	if (sendAll(client, header, length) && (method != "HEAD"))
+		sendAll(client, body->c_str(), body->length());
+}
@@ -0,0 +1,107 @@
+/************************************************************************************************
+SBFspot - Yet another tool to read power production of SMA solar inverters
+(c)2012-2020, SBF
+
+Latest version found at https://github.com/SBFspot/SBFspot
+
+License: Attribution-NonCommercial-ShareAlike 3.0 Unported (CC BY-NC-SA 3.0)
+http://creativecommons.org/licenses/by-nc-sa/3.0/
+
+You are free:
+to Share  to copy, distribute and transmit the work
+to Remix  to adapt the work
+Under the following conditions:
+Attribution:
+You must attribute the work in the manner specified by the author or licensor
+(but not in any way that suggests that they endorse you or your use of the work).
+Noncommercial:
+You may not use this work for commercial purposes.
+Share Alike:
+If you alter, transform, or build upon this work, you may distribute the resulting work
+only under the same or similar license to this one.
+
+DISCLAIMER:
+A user of SBFspot software acknowledges that he or she is receiving this
+software on an "as is" basis and the user is not relying on the accuracy
+or functionality of the software for any purpose. The user further
+acknowledges that any use of this software will be at his own risk
+and the copyright owner accepts no responsibility whatsoever arising from
+the use or application of the software.
+
+SMA is a registered trademark of SMA Solar Technology AG
+
+************************************************************************************************/
+#pragma once
+
+#include "SBFspot.h"
+
+#include <string>
+#include <vector>
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+
+#define HTTP_PORT			8080
+#define HTTP_TIMEOUT		2000	// Receive/send timeout of a request (ms)
+#define HTTP_MAXREQUEST		8192	// Max. size of a request header
+#define HTTP_NOSOCKET		((SOCKET)-1)
+
+// Latest spot data of the plant, rendered once per polling cycle
+struct HttpSnapshot
+{
+	time_t time;			// Polling time (0 = no data yet)
+	std::string json;		// application/json
+	std::string metrics;	// Prometheus text format 0.0.4
+};
+
+/*
+ * HttpSnapshotBuffer - Hands over the snapshots from the poller (one writer) to the
+ * HTTP thread (one reader) without a lock
+ * Of the three buffers, one is written, one is read and one holds the latest snapshot.
+ * publish() and acquire() swap their buffer with the latest one in a single atomic
+ * exchange, so neither side ever waits and a buffer is never written while it is read.
+ * The buffers are reused: after the first cycles, rendering doesn't allocate anymore.
+ */
+class HttpSnapshotBuffer
+{
+public:
+	HttpSnapshotBuffer();
+	HttpSnapshot &back(void) { return m_buffer[m_back]; }
+	void publish(void);
+	const HttpSnapshot &acquire(void);
+
+private:
+	enum { FRESH = 4 };		// Latest buffer hasn't been acquired yet
+	HttpSnapshot m_buffer[3];
+	int m_back;					// Poller
+	int m_front;				// HTTP thread
+	boost::atomic<int> m_latest;	// Buffer index | FRESH
+};
+
+/*
+ * HttpServer - Built-in HTTP server for the live spot data (HTTP_Port, -daemon only)
+ * GET /json     Spot values of all devices as JSON (MQTT_Data keywords and units)
+ * GET /metrics  Prometheus text exposition (base units)
+ * Requests are served one at a time by a thread of its own, from the snapshot of the
+ * last polling cycle: a scrape never waits for the poller nor the other way around.
+ */
+class HttpServer
+{
+public:
+	HttpServer();
+	~HttpServer();
+	int start(const std::string &address, int port);
+	void stop(void);
+	bool isrunning(void) const { return m_socket != HTTP_NOSOCKET; }
+	void update(const Config *cfg, InverterData *inverters[]);
+
+private:
+	void run(void);
+	void serve(SOCKET client);
+	void close(SOCKET &sock);
+
+	SOCKET m_socket;
+	boost::atomic<bool> m_stop;
+	boost::thread m_thread;
+	HttpSnapshotBuffer m_snapshot;
+	std::vector<std::string> m_labels;	// Device labels of the metrics (poller)
+};
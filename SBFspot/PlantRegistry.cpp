@@ -0,0 +1,114 @@
+/************************************************************************************************
+SBFspot - Yet another tool to read power production of SMA solar inverters
+(c)2012-2020, SBF
+
+Latest version found at https://github.com/SBFspot/SBFspot
+
+License: Attribution-NonCommercial-ShareAlike 3.0 Unported (CC BY-NC-SA 3.0)
+http://creativecommons.org/licenses/by-nc-sa/3.0/
+
+You are free:
+to Share  to copy, distribute and transmit the work
+to Remix  to adapt the work
+Under the following conditions:
+Attribution:
+You must attribute the work in the manner specified by the author or licensor
+(but not in any way that suggests that they endorse you or your use of the work).
+Noncommercial:
+You may not use this work for commercial purposes.
+Share Alike:
+If you alter, transform, or build upon this work, you may distribute the resulting work
+only under the same or similar license to this one.
+
+DISCLAIMER:
+A user of SBFspot software acknowledges that he or she is receiving this
+software on an "as is" basis and the user is not relying on the accuracy
+or functionality of the software for any purpose. The user further
+acknowledges that any use of this software will be at his own risk
+and the copyright owner accepts no responsibility whatsoever arising from
+the use or application of the software.
+
+SMA is a registered trademark of SMA Solar Technology AG
+
+************************************************************************************************/
+
+#include "PlantRegistry.h"
+
+uint64_t DeviceIndex::key(const unsigned char bt_addr[6])
+{
+	uint64_t k = 0;
+	for (int i = 0; i < 6; i++)
+		k = (k << 8) | bt_addr[i];
+	return k;
+}
+
+void DeviceIndex::build(InverterData *inverters[])
+{
+	clear();
+	for (int inv = 0; inverters[inv] != NULL; inv++)
+		add(inverters[inv], inv);
+}
+
+// Existing entries are kept, so lookups return the first matching device
+void DeviceIndex::add(const InverterData *inv, int idx)
+{
+	m_bySUSyIDSerial.insert(std::make_pair(key(inv->SUSyID, (uint32_t)inv->Serial), idx));
+	m_bySerial.insert(std::make_pair((uint32_t)inv->Serial, idx));
+	if (inv->IPAddress[0] != 0)
+		m_byIP.insert(std::make_pair(std::string(inv->IPAddress), idx));
+	m_byBTAddress.insert(std::make_pair(key(inv->BTAddress), idx));
+}
+
+void DeviceIndex::clear(void)
+{
+	m_bySUSyIDSerial.clear();
+	m_bySerial.clear();
+	m_byIP.clear();
+	m_byBTAddress.clear();
+}
+
+int DeviceIndex::bySerial(unsigned short SUSyID, uint32_t Serial) const
+{
+	boost::unordered_map<uint64_t, int>::const_iterator it = m_bySUSyIDSerial.find(key(SUSyID, Serial));
+	return (it == m_bySUSyIDSerial.end()) ? -1 : it->second;
+}
+
+int DeviceIndex::bySerial(uint32_t Serial) const
+{
+	boost::unordered_map<uint32_t, int>::const_iterator it = m_bySerial.find(Serial);
+	return (it == m_bySerial.end()) ? -1 : it->second;
+}
+
+int DeviceIndex::byIP(const char *IP) const
+{
+	boost::unordered_map<std::string, int>::const_iterator it = m_byIP.find(IP);
+	return (it == m_byIP.end()) ? -1 : it->second;
+}
+
+int DeviceIndex::byBTAddress(const unsigned char bt_addr[6]) const
+{
+	boost::unordered_map<uint64_t, int>::const_iterator it = m_byBTAddress.find(key(bt_addr));
+	return (it == m_byBTAddress.end()) ? -1 : it->second;
+}
+
+// Allocate a new device at the end of the list
+// It is not indexed yet: its SUSyID, Serial and address are unknown at this point
+InverterData *PlantRegistry::add(void)
+{
+	InverterData *inv = new InverterData;
+	resetInverterData(inv);
+
+	m_devices.back() = inv;
+	m_devices.push_back(NULL);
+
+	return inv;
+}
+
+void PlantRegistry::clear(void)
+{
+	for (std::vector<InverterData *>::iterator it = m_devices.begin(); it != m_devices.end(); ++it)
+		delete *it;
+
+	m_devices.assign(1, (InverterData *)NULL);
+	m_index.clear();
+}
@@ -0,0 +1,98 @@
+/************************************************************************************************
+SBFspot - Yet another tool to read power production of SMA solar inverters
+(c)2012-2020, SBF
+
+Latest version found at https://github.com/SBFspot/SBFspot
+
+License: Attribution-NonCommercial-ShareAlike 3.0 Unported (CC BY-NC-SA 3.0)
+http://creativecommons.org/licenses/by-nc-sa/3.0/
+
+You are free:
+to Share  to copy, distribute and transmit the work
+to Remix  to adapt the work
+Under the following conditions:
+Attribution:
+You must attribute the work in the manner specified by the author or licensor
+(but not in any way that suggests that they endorse you or your use of the work).
+Noncommercial:
+You may not use this work for commercial purposes.
+Share Alike:
+If you alter, transform, or build upon this work, you may distribute the resulting work
+only under the same or similar license to this one.
+
+DISCLAIMER:
+A user of SBFspot software acknowledges that he or she is receiving this
+software on an "as is" basis and the user is not relying on the accuracy
+or functionality of the software for any purpose. The user further
+acknowledges that any use of this software will be at his own risk
+and the copyright owner accepts no responsibility whatsoever arising from
+the use or application of the software.
+
+SMA is a registered trademark of SMA Solar Technology AG
+
+************************************************************************************************/
+
+#pragma once
+
+#include "SBFspot.h"
+
+#include <string>
+#include <vector>
+#include <boost/unordered_map.hpp>
+
+/*
+ * DeviceIndex - Lookup of devices in a NULL terminated InverterData array
+ * by (SUSyID, Serial), Serial, IP address or BT address in O(1)
+ * All lookups return the array index of the first matching device or -1 if not found
+ * Devices behind a multigate share its IP address: lookup by IP returns the first one
+ */
+class DeviceIndex
+{
+private:
+	boost::unordered_map<uint64_t, int> m_bySUSyIDSerial;
+	boost::unordered_map<uint32_t, int> m_bySerial;
+	boost::unordered_map<std::string, int> m_byIP;
+	boost::unordered_map<uint64_t, int> m_byBTAddress;
+
+	static uint64_t key(unsigned short SUSyID, uint32_t Serial) { return ((uint64_t)SUSyID << 32) | Serial; }
+	static uint64_t key(const unsigned char bt_addr[6]);
+
+public:
+	DeviceIndex() {}
+	DeviceIndex(InverterData *inverters[]) { build(inverters); }
+	void build(InverterData *inverters[]);
+	void add(const InverterData *inv, int idx);
+	void clear(void);
+	int bySerial(unsigned short SUSyID, uint32_t Serial) const;
+	int bySerial(uint32_t Serial) const;
+	int byIP(const char *IP) const;
+	int byBTAddress(const unsigned char bt_addr[6]) const;
+};
+
+/*
+ * PlantRegistry - Owns the devices of the plant (no limit on the number of devices)
+ * devices() returns a NULL terminated array for the functions taking an InverterData *inverters[]
+ * Adding devices can move the array: don't keep the pointer across add()
+ * Call reindex() once the devices are identified (SUSyID, Serial, IP or BT address changed)
+ */
+class PlantRegistry
+{
+private:
+	std::vector<InverterData *> m_devices;	// Last element is always NULL
+	DeviceIndex m_index;
+
+	// Devices are owned by the registry
+	PlantRegistry(const PlantRegistry &);
+	PlantRegistry &operator=(const PlantRegistry &);
+
+public:
+	PlantRegistry() : m_devices(1, (InverterData *)NULL) {}
+	~PlantRegistry() { clear(); }
+	InverterData *add(void);
+	void reindex(void) { m_index.build(devices()); }
+	void clear(void);
+	InverterData **devices(void) { return &m_devices[0]; }
+	InverterData *operator[](int idx) { return m_devices[idx]; }
+	int count(void) const { return (int)m_devices.size() - 1; }
+	const DeviceIndex &index(void) const { return m_index; }
+};
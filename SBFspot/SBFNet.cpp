@@ -52,11 +52,17 @@ const unsigned long anySerial = 0xFFFFFFFF;
 unsigned int cmdcode = 0;
 
 int packetposition = 0;
-int FCSChecksum = 0xffff;
+
+// Bluetooth frames are built unescaped, escaping is done once the FCS is known
+static int escapePosition = -1;		// First byte that still needs escaping (-1 = none)
+static int fcsPosition = 0;			// First byte of the L2 packet (covered by the FCS)
 
 unsigned short pcktID = 1;
 
-BYTE pcktBuf[maxpcktBufsize];
+// Speedwire datagrams are received in front of pcktBuf: the L1 header (minus the byte that
+// aligns with the Bluetooth 0x7E) precedes pcktBuf, so the L2 packet lands at pcktBuf+1 without copying
+static BYTE pcktStorage[sizeof(ethPacketHeaderL1) - 1 + maxpcktBufsize];
+BYTE *const pcktBuf = pcktStorage + sizeof(ethPacketHeaderL1) - 1;
 
 const unsigned short fcstab[256] =
 {
@@ -78,6 +84,77 @@ const unsigned short fcstab[256] =
     0xf78f, 0xe606, 0xd49d, 0xc514, 0xb1ab, 0xa022, 0x92b9, 0x8330, 0x7bc7, 0x6a4e, 0x58d5, 0x495c, 0x3de3, 0x2c6a, 0x1ef1, 0x0f78
 };
 
+// Slicing-by-8 tables: fcstab8[n][v] is the FCS contribution of byte v followed by n bytes
+static unsigned short fcstab8[8][256];
+static bool fcstab8_ready = false;
+
+static void initFcsTables(void)
+{
+	for (int v = 0; v < 256; v++)
+	{
+		fcstab8[0][v] = fcstab[v];
+		for (int n = 1; n < 8; n++)
+			fcstab8[n][v] = (fcstab8[n-1][v] >> 8) ^ fcstab[fcstab8[n-1][v] & 0xff];
+	}
+	fcstab8_ready = true;
+}
+
+// Update FCS16 over a buffer, 8 bytes at a time
+unsigned short fcs16(unsigned short fcs, const unsigned char *buf, int len)
+{
+	if (!fcstab8_ready) initFcsTables();
+
+	while (len >= 8)
+	{
+		unsigned short lo = fcs ^ (buf[0] | (buf[1] << 8));
+		fcs = fcstab8[7][lo & 0xff] ^ fcstab8[6][lo >> 8] ^
+			  fcstab8[5][buf[2]] ^ fcstab8[4][buf[3]] ^
+			  fcstab8[3][buf[4]] ^ fcstab8[2][buf[5]] ^
+			  fcstab8[1][buf[6]] ^ fcstab8[0][buf[7]];
+		buf += 8;
+		len -= 8;
+	}
+
+	while (len-- > 0)
+		fcs = (fcs >> 8) ^ fcstab[(fcs ^ *buf++) & 0xff];
+
+	return fcs;
+}
+
+static inline bool isEscapeChar(unsigned char v)
+{
+	return (v == 0x7d) || (v == 0x7e) || (v == 0x11) || (v == 0x12) || (v == 0x13);
+}
+
+// Escape btbuffer[start..packetposition) in place (0x7D, byte ^ 0x20)
+static void escapeFrame(unsigned char *btbuffer, int start)
+{
+	if (start < 0) return;
+
+	int count = 0;
+	for (int i = start; i < packetposition; i++)
+		if (isEscapeChar(btbuffer[i])) count++;
+
+	if (count == 0) return;
+
+	// Work backwards so each byte is moved only once
+	int src = packetposition - 1;
+	int dst = packetposition + count - 1;
+	while (src >= start)
+	{
+		unsigned char v = btbuffer[src--];
+		if (isEscapeChar(v))
+		{
+			btbuffer[dst--] = v ^ 0x20;
+			btbuffer[dst--] = 0x7d;
+		}
+		else
+			btbuffer[dst--] = v;
+	}
+
+	packetposition += count;
+}
+
 void writeLong(BYTE *btbuffer, unsigned long v)
 {
     writeByte(btbuffer,(unsigned char)((v >> 0) & 0xFF));
@@ -92,39 +169,25 @@ void writeShort(BYTE *btbuffer, unsigned short v)
     writeByte(btbuffer,(unsigned char)((v >> 8) & 0xFF));
 }
 
+// Bluetooth: checksum and escaping are done by writePacketTrailer()/writePacketLength()
 void writeByte(unsigned char *btbuffer, unsigned char v)
 {
-    if (ConnType == CT_BLUETOOTH)
-    {
-        //Keep a rolling checksum over the payload
-        FCSChecksum = (FCSChecksum >> 8) ^ fcstab[(FCSChecksum ^ v) & 0xff];
-        if (v == 0x7d || v == 0x7e || v == 0x11 || v == 0x12 || v == 0x13)
-        {
-            btbuffer[packetposition++] = 0x7d;
-            btbuffer[packetposition++] = v ^ 0x20;
-        }
-        else
-        {
-            btbuffer[packetposition++] = v;
-        }
-    }
-    else    // CT_ETHERNET
-        btbuffer[packetposition++] = v;
+    btbuffer[packetposition++] = v;
 }
 
 void writeArray(unsigned char *btbuffer, const unsigned char bytes[], int loopcount)
 {
-    for (int i = 0; i < loopcount; i++)
-    {
-        writeByte(btbuffer, bytes[i]);
-    }
+    memcpy(btbuffer + packetposition, bytes, loopcount);
+    packetposition += loopcount;
 }
 
 void writePacket(unsigned char *buf, unsigned char longwords, unsigned char ctrl, unsigned short ctrl2, unsigned short dstSUSyID, unsigned long dstSerial)
 {
 	if (ConnType == CT_BLUETOOTH)
 	{
+        escapeFrame(buf, escapePosition);
         buf[packetposition++] = 0x7E;   //Not included in checksum
+        escapePosition = fcsPosition = packetposition;
         writeLong(buf, BTH_L2SIGNATURE);
 	}
 	else
@@ -140,6 +203,8 @@ void writePacket(unsigned char *buf, unsigned char longwords, unsigned char ctrl
     writeShort(buf, ctrl2);
     writeShort(buf, 0);
     writeShort(buf, 0);
+    // Packet ID is 15 bits, replies are matched on (pcktID & 0x7FFF)
+    if (pcktID > 0x7FFF) pcktID = 1;
     writeShort(buf, pcktID | 0x8000);
 }
 
@@ -147,9 +212,23 @@ void writePacketTrailer(unsigned char *btbuffer)
 {
    	if (ConnType == CT_BLUETOOTH)
    	{
-        FCSChecksum ^= 0xFFFF;
-        btbuffer[packetposition++] = FCSChecksum & 0x00FF;
-        btbuffer[packetposition++] = (FCSChecksum >> 8) & 0x00FF;
+        unsigned short fcs = fcs16(0xFFFF, btbuffer + fcsPosition, packetposition - fcsPosition) ^ 0xFFFF;
+
+        // The FCS is sent unescaped, so it can't contain 0x7E or 0x7D
+        // Take the next packet ID (the inverter replies with it) until the FCS is valid
+        while (!isCrcValid(fcs & 0xFF, fcs >> 8))
+        {
+            if (++pcktID > 0x7FFF) pcktID = 1;
+            btbuffer[fcsPosition + 26] = pcktID & 0xFF;
+            btbuffer[fcsPosition + 27] = (pcktID >> 8) | 0x80;
+            fcs = fcs16(0xFFFF, btbuffer + fcsPosition, packetposition - fcsPosition) ^ 0xFFFF;
+        }
+
+        escapeFrame(btbuffer, escapePosition);
+        escapePosition = -1;
+
+        btbuffer[packetposition++] = fcs & 0x00FF;
+        btbuffer[packetposition++] = (fcs >> 8) & 0x00FF;
         btbuffer[packetposition++] = 0x7E;  //Trailing byte
    	}
    	else
@@ -162,8 +241,6 @@ void writePacketHeader(unsigned char *buf, const unsigned int control, const uns
 
     if (ConnType == CT_BLUETOOTH)
     {
-        FCSChecksum = 0xFFFF;
-
         buf[packetposition++] = 0x7E;
         buf[packetposition++] = 0;  //placeholder for len1
         buf[packetposition++] = 0;  //placeholder for len2
@@ -179,6 +256,8 @@ void writePacketHeader(unsigned char *buf, const unsigned int control, const uns
         buf[packetposition++] = (BYTE)(control & 0xFF);
         buf[packetposition++] = (BYTE)(control >> 8);
 
+        escapePosition = packetposition;
+
         cmdcode = 0xFFFF;  //Just set to dummy value
     }
     else
@@ -196,6 +275,13 @@ void writePacketLength(unsigned char *buf)
 {
     if (ConnType == CT_BLUETOOTH)
     {
+        // Packets without L2 trailer are escaped here
+        if (escapePosition >= 0)
+        {
+            escapeFrame(buf, escapePosition);
+            escapePosition = -1;
+        }
+
         buf[1] = packetposition & 0xFF;		    //Lo-Byte
         buf[2] = (packetposition >> 8) & 0xFF;	//Hi-Byte
         buf[3] = buf[0] ^ buf[1] ^ buf[2];      //checksum
@@ -211,21 +297,14 @@ void writePacketLength(unsigned char *buf)
 
 int validateChecksum()
 {
-    FCSChecksum = 0xffff;
     //Skip over 0x7e at start and end of packet
-    int i;
-    for(i = 1; i <= packetposition - 4; i++)
-    {
-        FCSChecksum = (FCSChecksum >> 8) ^ fcstab[(FCSChecksum ^ pcktBuf[i]) & 0xff];
-    }
-
-    FCSChecksum ^= 0xffff;
+    unsigned short fcs = fcs16(0xFFFF, pcktBuf + 1, packetposition - 4) ^ 0xFFFF;
 
-	if (get_short(pcktBuf + packetposition - 3) == (short)FCSChecksum)
+	if (get_short(pcktBuf + packetposition - 3) == (short)fcs)
         return true;
     else
     {
-		if (DEBUG_HIGH) printf("Invalid chk 0x%04X - Found 0x%02X%02X\n", FCSChecksum, pcktBuf[packetposition-2], pcktBuf[packetposition-3]);
+		if (DEBUG_HIGH) printf("Invalid chk 0x%04X - Found 0x%02X%02X\n", fcs, pcktBuf[packetposition-2], pcktBuf[packetposition-3]);
 		return false;
     }
 }
@@ -58,6 +58,7 @@ void writePacketTrailer(unsigned char *btbuffer);
 void writePacketHeader(unsigned char *btbuffer, const unsigned int control, const unsigned char *destaddress);
 void writePacketLength(unsigned char *buffer);
 int validateChecksum(void);
+unsigned short fcs16(unsigned short fcs, const unsigned char *buf, int len);
 short get_short(unsigned char *buf);
 int32_t get_long(unsigned char *buf);
 int64_t get_longlong(unsigned char *buf);
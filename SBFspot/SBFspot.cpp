@@ -67,12 +67,18 @@ DISCLAIMER:
 #include "SBFNet.h"
 #include "sunrise_sunset.h"
 #include "CSVexport.h"
+#include "ColumnExport.h"
 #include "EventData.h"
 #include "ArchData.h"
 #include "SQLselect.h"
 #include <boost/algorithm/string.hpp>
 #include <boost/asio/ip/address.hpp>
+#include <signal.h>
+#include <set>
 #include "mqtt.h"
+#include "HttpServer.h"
+#include "Capture.h"
+#include "PlantRegistry.h"
 
 using namespace std;
 using namespace boost;
@@ -83,8 +89,6 @@ using namespace boost::gregorian;
 int MAX_CommBuf = 0;
 int MAX_pcktBuf = 0;
 
-const int MAX_INVERTERS = 20;
-
 //Public vars
 int debug = 0;
 int verbose = 0;
@@ -94,11 +98,129 @@ char DateFormat[32];
 CONNECTIONTYPE ConnType = CT_NONE;
 TagDefs tagdefs = TagDefs();
 bool hasBatteryDevice = false;	// Plant has 1 or more battery device(s)
+volatile sig_atomic_t daemonStop = 0;	// Set by SIGINT/SIGTERM in daemon mode
 
-int main(int argc, char **argv)
+#if !defined(SBFSPOT_BENCH)	// SBFspotBench has its own main(), the helpers below are main()'s
+
+// Destinations of the archived day data, see exportDayData()
+struct DayDataExport
 {
-    char msg[80];
+	Config *cfg;
+#if defined(USE_SQLITE) || defined(USE_MYSQL)
+	db_SQL_Export *db;
+#endif
+};
+
+/*
+ * Called by BackfillDayData() for each archived day as soon as all devices have answered
+ */
+static void exportDayData(InverterData *Inverters[], time_t day, void *param)
+{
+	DayDataExport *dest = (DayDataExport *)param;
+	Config *cfg = dest->cfg;
+
+	if (VERBOSE_HIGH)
+	{
+		for (int inv=0; Inverters[inv]!=NULL; inv++)
+		{
+			printf("SUSyID: %d - SN: %lu\n", Inverters[inv]->SUSyID, Inverters[inv]->Serial);
+			for (unsigned int idx=0; idx<sizeof(Inverters[inv]->dayData)/sizeof(DayData); idx++)
+				if (Inverters[inv]->dayData[idx].datetime > 0)
+				{
+					printf("%s : %.3fkWh - %3.3fW\n", strftime_t(cfg->DateTimeFormat, Inverters[inv]->dayData[idx].datetime), (double)Inverters[inv]->dayData[idx].totalWh/1000, (double)Inverters[inv]->dayData[idx].watt);
+					fflush(stdout);
+				}
+			puts("======");
+		}
+	}
+
+	if (cfg->CSV_Export == 1)
+		ExportDayDataToCSV(cfg, Inverters);
+
+	if (cfg->Column_Export == 1)
+		ExportDayDataToColumns(cfg, Inverters);
+
+	#if defined(USE_SQLITE) || defined(USE_MYSQL)
+	if ((!cfg->nosql) && dest->db->isopen())
+		dest->db->day_data(Inverters);
+	#endif
+}
 
+#if defined(USE_SQLITE) || defined(USE_MYSQL)
+// Number of calendar days (local time) from day 'from' up to day 'to'
+static int daysBetween(time_t from, time_t to)
+{
+	struct tm tm_from, tm_to;
+	memcpy(&tm_from, localtime(&from), sizeof(tm_from));
+	memcpy(&tm_to, localtime(&to), sizeof(tm_to));
+	// Noon is never affected by a DST transition
+	tm_from.tm_hour = tm_to.tm_hour = 12;
+	tm_from.tm_min = tm_to.tm_min = 0;
+	tm_from.tm_sec = tm_to.tm_sec = 0;
+	tm_from.tm_isdst = tm_to.tm_isdst = -1;
+	return (int)((mktime(&tm_to) - mktime(&tm_from) + 43200) / 86400);
+}
+
+// Number of calendar months (UTC) from month 'from' up to month 'to'
+static int monthsBetween(time_t from, time_t to)
+{
+	struct tm tm_from, tm_to;
+	memcpy(&tm_from, gmtime(&from), sizeof(tm_from));
+	memcpy(&tm_to, gmtime(&to), sizeof(tm_to));
+	return (tm_to.tm_year - tm_from.tm_year) * 12 + tm_to.tm_mon - tm_from.tm_mon;
+}
+
+/*
+ * -sync: Limit the archive requests to what is missing in the database
+ * DayData is asked from the latest stored record of each device on,
+ * or from the start of that day when the CSV export needs whole days
+ * MonthData and EventData are asked from the month of the oldest latest record on
+ * The archive settings (-ad/-am/-ae) are kept as upper limit
+ */
+static void syncArchiveRange(Config *cfg, db_SQL_Export &db, InverterData *Inverters[], int &archDays, int &archMonths, int &archEventMonths)
+{
+	time_t now = time(NULL);
+	time_t lastDay = now, lastMonth = now, lastEvent = now;
+
+	for (int inv=0; Inverters[inv]!=NULL; inv++)
+	{
+		InverterData *pinv = Inverters[inv];
+		pinv->archDaySince = 0;
+		if (pinv->DevClass == CommunicationProduct) continue;
+
+		time_t last = 0;
+		if ((db.get_last_timestamp("DayData", pinv->Serial, last) == db_SQL_Base::SQL_OK) && (last > 0) && (cfg->CSV_Export != 1))
+			pinv->archDaySince = last;
+		if (last < lastDay) lastDay = last;
+
+		last = 0;
+		db.get_last_timestamp("MonthData", pinv->Serial, last);
+		if (last < lastMonth) lastMonth = last;
+
+		last = 0;
+		db.get_last_timestamp("EventData", pinv->Serial, last);
+		if (last < lastEvent) lastEvent = last;
+	}
+
+	// A device without any record needs the full range
+	if ((lastDay > 0) && (archDays > daysBetween(lastDay, now) + 1))
+		archDays = daysBetween(lastDay, now) + 1;
+	if ((lastMonth > 0) && (archMonths > monthsBetween(lastMonth, now) + 1))
+		archMonths = monthsBetween(lastMonth, now) + 1;
+	if ((lastEvent > 0) && (archEventMonths > monthsBetween(lastEvent, now) + 1))
+		archEventMonths = monthsBetween(lastEvent, now) + 1;
+
+	if (VERBOSE_NORMAL)
+	{
+		printf("Sync: DayData since %s (%d days)\n", (lastDay > 0) ? strftime_t(cfg->DateTimeFormat, lastDay) : "-", archDays);
+		printf("Sync: MonthData since %s (%d months)\n", (lastMonth > 0) ? strfgmtime_t(cfg->DateFormat, lastMonth) : "-", archMonths);
+		printf("Sync: EventData since %s (%d months)\n", (lastEvent > 0) ? strftime_t(cfg->DateTimeFormat, lastEvent) : "-", archEventMonths);
+	}
+}
+#endif
+
+int main(int argc, char **argv)
+{
     int rc = 0;
 
     Config cfg;
@@ -124,6 +246,18 @@ int main(int argc, char **argv)
 		return 0;
 	}
 
+	if (cfg.capture != CAP_NONE)
+	{
+		if (ConnType != CT_ETHERNET)
+		{
+			std::cout << "-record and -replay are only supported for Speedwire devices" << std::endl;
+			return 0;
+		}
+
+		if (capOpen(cfg.captureFile.c_str(), (CAPTUREMODE)cfg.capture) != 0)
+			return 1;
+	}
+
     strncpy(DateTimeFormat, cfg.DateTimeFormat, sizeof(DateTimeFormat));
     strncpy(DateFormat, cfg.DateFormat, sizeof(DateFormat));
 
@@ -141,7 +275,7 @@ int main(int argc, char **argv)
             printf("sunset : %02d:%02d\n", (int)cfg.sunset, (int)((cfg.sunset - (int)cfg.sunset) * 60));
         }
 
-        if ((cfg.forceInq == 0) && (cfg.isLight == 0))
+        if ((cfg.forceInq == 0) && (cfg.isLight == 0) && (cfg.daemon == 0))
         {
             if (quiet == 0) puts("Nothing to do... it's dark. Use -finq to force inquiry.");
             return 0;
@@ -155,648 +289,847 @@ int main(int argc, char **argv)
 		return(2);
 	}
 
-    //Allocate array to hold InverterData structs
-    InverterData *Inverters[MAX_INVERTERS];
-    for (int i=0; i<MAX_INVERTERS; Inverters[i++]=NULL);
+    //Devices of the plant
+    PlantRegistry plant;
 
-    if (ConnType == CT_BLUETOOTH)
-    {
-        int attempts = 1;
-        do
-        {
-            if (attempts != 1) sleep(1);
-            {
-                if (VERBOSE_NORMAL) printf("Connecting to %s (%d/%d)\n", cfg.BT_Address, attempts, cfg.BT_ConnectRetries);
-                rc = bthConnect(cfg.BT_Address);
-            }
-            attempts++;
-        }
-        while ((attempts <= cfg.BT_ConnectRetries) && (rc != 0));
+#if defined(USE_SQLITE) || defined(USE_MYSQL)
+    db_SQL_Export db = db_SQL_Export();
+#endif
 
+    if (cfg.daemon == 1)
+    {
+        signal(SIGINT, daemonSignalHandler);
+        signal(SIGTERM, daemonSignalHandler);
+        if (VERBOSE_NORMAL) printf("Running as daemon - Polling interval: %d sec\n", cfg.daemonInterval);
+    }
 
-        if (rc != 0)
-        {
-            snprintf(msg, sizeof(msg), "bthConnect() returned %d\n", rc);
-            print_error(stdout, PROC_CRITICAL, msg);
-            return rc;
-        }
+	// Live spot data over HTTP, served from a thread of its own
+	HttpServer http;
+	if ((cfg.daemon == 1) && (cfg.httpPort > 0))
+		http.start(cfg.httpAddress, cfg.httpPort);
+
+	bool isConnected = false;
+	int cycle = 0;
+	time_t nextPoll = time(NULL);
+	time_t lastArchTime = 0;		// Last cycle the archives were considered
+	time_t lastDayDataTime = 0;		// Last cycle day data was read
+#if defined(USE_SQLITE) || defined(USE_MYSQL)
+	time_t lastRetentionTime = 0;
+#endif
 
-		rc = initialiseSMAConnection(cfg.BT_Address, Inverters, cfg.MIS_Enabled);
+	/*********************************************************************
+	 * Polling cycle
+	 * Without -daemon, the loop is executed only once (connect, poll, quit)
+	 * With -daemon, connection and logon are kept alive between cycles
+	 *********************************************************************/
+	do
+	{
+		if (cycle++ > 0)
+		{
+			// Wait for the next polling slot (skip missed slots)
+			nextPoll += cfg.daemonInterval;
+			if (nextPoll <= time(NULL))
+				nextPoll = time(NULL) - time(NULL) % cfg.daemonInterval + cfg.daemonInterval;
 
-        if (rc != E_OK)
-        {
-            print_error(stdout, PROC_CRITICAL, "Failed to initialize communication with inverter.\n");
-            freemem(Inverters);
-            bthClose();
-            return rc;
-        }
+			while ((daemonStop == 0) && (time(NULL) < nextPoll))
+				sleep(1);
 
-        rc = getBT_SignalStrength(Inverters[0]);
-        if (VERBOSE_NORMAL) printf("BT Signal=%0.1f%%\n", Inverters[0]->BT_Signal);
+			if (daemonStop != 0) break;
 
-    }
-    else // CT_ETHERNET
-    {
-		if (VERBOSE_NORMAL) printf("Connecting to Local Network...\n");
-		rc = ethConnect(cfg.IP_Port);
-		if (rc != 0)
-		{
-			print_error(stdout, PROC_CRITICAL, "Failed to set up socket connection.");
-			return rc;
+			// Sunrise and sunset are changing every day
+			if ((cfg.latitude != 0) || (cfg.longitude != 0))
+				cfg.isLight = sunrise_sunset(cfg.latitude, cfg.longitude, &cfg.sunrise, &cfg.sunset, (float)cfg.SunRSOffset / 3600);
 		}
 
-		if (cfg.ip_addresslist.size() > 1)
-			// New method for multiple inverters with fixed IP
-			rc = ethInitConnectionMulti(Inverters, cfg.ip_addresslist);
-		else
-			// Old method for one inverter (fixed IP or broadcast)
-			rc = ethInitConnection(Inverters, cfg.IP_Address);
-
-		if (rc != E_OK)
+		// Daemon started or still running at night: wait for the next slot
+		if ((cfg.forceInq == 0) && (cfg.isLight == 0))
 		{
-			print_error(stdout, PROC_CRITICAL, "Failed to initialize Speedwire connection.");
-			ethClose();
-			return rc;
+			// Inverters are going to sleep - release the connection until sunrise
+			if (isConnected)
+			{
+				if (VERBOSE_NORMAL) puts("It's dark... Disconnecting until sunrise.");
+				disconnectPlant(&cfg, plant);
+				isConnected = false;
+			}
+			if (cfg.mqtt == 1) mqtt_keepalive(&cfg);
+			continue;
 		}
-    }
-
-    if (logonSMAInverter(Inverters, cfg.userGroup, cfg.SMA_Password) != E_OK)
-    {
-        snprintf(msg, sizeof(msg), "Logon failed. Check '%s' Password\n", cfg.userGroup == UG_USER? "USER":"INSTALLER");
-        print_error(stdout, PROC_CRITICAL, msg);
-        freemem(Inverters);
-        bthClose();
-        return 1;
-    }
-
-    /*************************************************
-     * At this point we are logged on to the inverter
-     *************************************************/
 
-    if (VERBOSE_NORMAL) puts("Logon OK");
-
-	// If SBFspot is executed with -settime argument
-	if (cfg.settime == 1)
-	{
-		rc = SetPlantTime(0, 0, 0);	// Set time ignoring limits
-		logoffSMAInverter(Inverters[0]);
+		if (!isConnected)
+		{
+			if ((rc = connectPlant(&cfg, plant)) != E_OK)
+			{
+				if (cfg.daemon == 0) return rc;
+				continue;	// Retry at next polling slot
+			}
 
-	    freemem(Inverters);
-		bthClose();	// Close socket
+			isConnected = true;
 
-		return rc;
-	}
+			/*************************************************
+			 * At this point we are logged on to the inverter
+			 *************************************************/
 
-	// Synchronize plant time with system time
-    // Only BT connected devices and if enabled in config _or_ requested by 123Solar
-	// Most probably Speedwire devices get their time from the local IP network
-    if ((ConnType == CT_BLUETOOTH) && (cfg.synchTime > 0 || cfg.s123 == S123_SYNC ))
-		if ((rc = SetPlantTime(cfg.synchTime, cfg.synchTimeLow, cfg.synchTimeHigh)) != E_OK)
-			std::cerr << "SetPlantTime returned an error: " << rc << std::endl;
+			if (VERBOSE_NORMAL) puts("Logon OK");
 
-	if ((rc = getInverterData(Inverters, sbftest)) != 0)
-        std::cerr << "getInverterData(sbftest) returned an error: " << rc << std::endl;
+			// If SBFspot is executed with -settime argument
+			if (cfg.settime == 1)
+			{
+				rc = SetPlantTime(0, 0, 0);	// Set time ignoring limits
+				disconnectPlant(&cfg, plant);
 
-	if ((rc = getInverterData(Inverters, SoftwareVersion)) != 0)
-        std::cerr << "getSoftwareVersion returned an error: " << rc << std::endl;
+				return rc;
+			}
 
-    if ((rc = getInverterData(Inverters, TypeLabel)) != 0)
-        std::cerr << "getTypeLabel returned an error: " << rc << std::endl;
-    else
-    {
-        for (int inv=0; Inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
-        {
-			if ((Inverters[inv]->DevClass == BatteryInverter) || (Inverters[inv]->SUSyID == 292))	//SB 3600-SE (Smart Energy)
-				hasBatteryDevice = Inverters[inv]->hasBattery = true;
-			else
-				Inverters[inv]->hasBattery = false;
+			// Synchronize plant time with system time
+			// Only BT connected devices and if enabled in config _or_ requested by 123Solar
+			// Most probably Speedwire devices get their time from the local IP network
+			if ((ConnType == CT_BLUETOOTH) && (cfg.synchTime > 0 || cfg.s123 == S123_SYNC ))
+				if ((rc = SetPlantTime(cfg.synchTime, cfg.synchTimeLow, cfg.synchTimeHigh)) != E_OK)
+					std::cerr << "SetPlantTime returned an error: " << rc << std::endl;
 
-            if (VERBOSE_NORMAL)
-            {
-                printf("SUSyID: %d - SN: %lu\n", Inverters[inv]->SUSyID, Inverters[inv]->Serial);
-                printf("Device Name:      %s\n", Inverters[inv]->DeviceName);
-                printf("Device Class:     %s%s\n", Inverters[inv]->DeviceClass, (Inverters[inv]->SUSyID == 292) ? " (with battery)":"");
-                printf("Device Type:      %s\n", Inverters[inv]->DeviceType);
-                printf("Software Version: %s\n", Inverters[inv]->SWVersion);
-                printf("Serial number:    %lu\n", Inverters[inv]->Serial);
-            }
-        }
-    }
+			if ((rc = getPlantInfo(&cfg, plant)) != E_OK)
+			{
+				disconnectPlant(&cfg, plant);
+				isConnected = false;
+				if (cfg.daemon == 0) return rc;
+				continue;	// Retry at next polling slot
+			}
+		}
 
-	// Check for Multigate and get connected devices
-    for (int inv=0; Inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
-	{
-		if ((Inverters[inv]->DevClass == CommunicationProduct) && (Inverters[inv]->SUSyID == SID_MULTIGATE))
+		// The device list doesn't change until the next connectPlant()
+		InverterData **Inverters = plant.devices();
+		for (int inv=0; Inverters[inv]!=NULL; inv++)
+			Inverters[inv]->stale = false;
+
+		// Device status is requested first: in daemon mode, the reply tells us
+		// if our session is still valid or if the plant has to be reconnected
+		// A device that doesn't answer is only marked stale, the plant is reconnected
+		// when the session expired or when none of the devices answered
+		rc = getInverterData(Inverters, plant.index(), DeviceStatus);
+		if ((rc == E_NOLOGON) && (cfg.daemon == 1))
 		{
-			if (VERBOSE_HIGH)
-				std::cout << "Multigate found. Looking for connected devices..." << std::endl;
+			if (VERBOSE_NORMAL) puts("Session expired. Logon again...");
+			if ((rc = logonSMAInverter(Inverters, plant.index(), cfg.userGroup, cfg.SMA_Password)) == E_OK)
+				rc = getInverterData(Inverters, plant.index(), DeviceStatus);
+		}
 
-			// multigate has its own ID
-			Inverters[inv]->multigateID = inv;
+		if (rc != 0)
+		{
+			std::cerr << "getDeviceStatus returned an error: " << rc << std::endl;
+			if (cfg.daemon == 1)
+			{
+				// Plant is not responding - reconnect at next polling slot
+				disconnectPlant(&cfg, plant);
+				isConnected = false;
+				continue;
+			}
+		}
+		else
+		{
+			for (int inv=0; Inverters[inv]!=NULL; inv++)
+			{
+				if (VERBOSE_NORMAL)
+				{
+					printf("SUSyID: %d - SN: %lu\n", Inverters[inv]->SUSyID, Inverters[inv]->Serial);
+					printf("Device Status:      %s\n", tagdefs.getDesc(Inverters[inv]->DeviceStatus, "?").c_str());
+				}
+			}
+		}
 
-			if ((rc = getDeviceList(Inverters, inv)) != 0)
-				std::cout << "getDeviceList returned an error: " << rc << std::endl;
+		if (hasBatteryDevice)
+		{
+			if ((rc = getInverterData(Inverters, plant.index(), BatteryChargeStatus)) != 0)
+				std::cerr << "getBatteryChargeStatus returned an error: " << rc << std::endl;
 			else
 			{
-				if (VERBOSE_HIGH)
+				for (int inv=0; Inverters[inv]!=NULL; inv++)
 				{
-					std::cout << "Found these devices:" << std::endl;
-					for (int ii=0; Inverters[ii]!=NULL && ii<MAX_INVERTERS; ii++)
+					if ((Inverters[inv]->DevClass == BatteryInverter) || (Inverters[inv]->hasBattery))
 					{
-						std::cout << "ID:" << ii << " S/N:" << Inverters[ii]->SUSyID << "-" << Inverters[ii]->Serial << " IP:" << Inverters[ii]->IPAddress << std::endl;
+						if (VERBOSE_NORMAL)
+						{
+							printf("SUSyID: %d - SN: %lu\n", Inverters[inv]->SUSyID, Inverters[inv]->Serial);
+							printf("Batt. Charging Status: %lu%%\n", Inverters[inv]->BatChaStt);
+						}
 					}
 				}
-			
-				if (logonSMAInverter(Inverters, cfg.userGroup, cfg.SMA_Password) != E_OK)
+			}
+
+			if ((rc = getInverterData(Inverters, plant.index(), BatteryInfo)) != 0)
+				std::cerr << "getBatteryInfo returned an error: " << rc << std::endl;
+			else
+			{
+				for (int inv=0; Inverters[inv]!=NULL; inv++)
 				{
-					snprintf(msg, sizeof(msg), "Logon failed. Check '%s' Password\n", cfg.userGroup == UG_USER? "USER":"INSTALLER");
-					print_error(stdout, PROC_CRITICAL, msg);
-					freemem(Inverters);
-					ethClose();
-					return 1;
+					if ((Inverters[inv]->DevClass == BatteryInverter) || (Inverters[inv]->hasBattery))
+					{
+						if (VERBOSE_NORMAL)
+						{
+							printf("SUSyID: %d - SN: %lu\n", Inverters[inv]->SUSyID, Inverters[inv]->Serial);
+							printf("Batt. Temperature: %3.1f%sC\n", (float)(Inverters[inv]->BatTmpVal / 10), SYM_DEGREE); // degree symbol is different on windows/linux
+							printf("Batt. Voltage    : %3.2fV\n", toVolt(Inverters[inv]->BatVol));
+							printf("Batt. Current    : %2.3fA\n", toAmp(Inverters[inv]->BatAmp));
+						}
+					}
 				}
+			}
 
-				if ((rc = getInverterData(Inverters, SoftwareVersion)) != 0)
-					printf("getSoftwareVersion returned an error: %d\n", rc);
-
-				if ((rc = getInverterData(Inverters, TypeLabel)) != 0)
-					printf("getTypeLabel returned an error: %d\n", rc);
-				else
+			if ((rc = getInverterData(Inverters, plant.index(), MeteringGridMsTotW)) != 0)
+				std::cerr << "getMeteringGridInfo returned an error: " << rc << std::endl;
+			else
+			{
+				for (int inv=0; Inverters[inv]!=NULL; inv++)
 				{
-					for (int ii=0; Inverters[ii]!=NULL && ii<MAX_INVERTERS; ii++)
+					if ((Inverters[inv]->DevClass == BatteryInverter) || (Inverters[inv]->hasBattery))
 					{
 						if (VERBOSE_NORMAL)
 						{
-							printf("SUSyID: %d - SN: %lu\n", Inverters[ii]->SUSyID, Inverters[ii]->Serial);
-							printf("Device Name:      %s\n", Inverters[ii]->DeviceName);
-							printf("Device Class:     %s\n", Inverters[ii]->DeviceClass);
-							printf("Device Type:      %s\n", Inverters[ii]->DeviceType);
-							printf("Software Version: %s\n", Inverters[ii]->SWVersion);
-							printf("Serial number:    %lu\n", Inverters[ii]->Serial);
+							printf("SUSyID: %d - SN: %lu\n", Inverters[inv]->SUSyID, Inverters[inv]->Serial);
+							printf("Grid Power Out : %dW\n", Inverters[inv]->MeteringGridMsTotWOut);
+							printf("Grid Power In  : %dW\n", Inverters[inv]->MeteringGridMsTotWIn);
 						}
 					}
 				}
 			}
 		}
-	}
 
-	if (hasBatteryDevice)
-	{
-		if ((rc = getInverterData(Inverters, BatteryChargeStatus)) != 0)
-	        std::cerr << "getBatteryChargeStatus returned an error: " << rc << std::endl;
+		if ((rc = getInverterData(Inverters, plant.index(), InverterTemperature)) != 0)
+			std::cerr << "getInverterTemperature returned an error: " << rc << std::endl;
 		else
 		{
-			for (int inv=0; Inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
+			for (int inv=0; Inverters[inv]!=NULL; inv++)
 			{
-				if ((Inverters[inv]->DevClass == BatteryInverter) || (Inverters[inv]->hasBattery))
+				if (VERBOSE_NORMAL)
 				{
-					if (VERBOSE_NORMAL)
+					printf("SUSyID: %d - SN: %lu\n", Inverters[inv]->SUSyID, Inverters[inv]->Serial);
+					printf("Device Temperature: %3.1f%sC\n", ((float)Inverters[inv]->Temperature / 100), SYM_DEGREE); // degree symbol is different on windows/linux
+				}
+			}
+		}
+
+		if (Inverters[0]->DevClass == SolarInverter)
+		{
+			if ((rc = getInverterData(Inverters, plant.index(), GridRelayStatus)) != 0)
+				std::cerr << "getGridRelayStatus returned an error: " << rc << std::endl;
+			else
+			{
+				for (int inv=0; Inverters[inv]!=NULL; inv++)
+				{
+					if (Inverters[inv]->DevClass == SolarInverter)
 					{
-						printf("SUSyID: %d - SN: %lu\n", Inverters[inv]->SUSyID, Inverters[inv]->Serial);
-						printf("Batt. Charging Status: %lu%%\n", Inverters[inv]->BatChaStt);
+						if (VERBOSE_NORMAL)
+						{
+							printf("SUSyID: %d - SN: %lu\n", Inverters[inv]->SUSyID, Inverters[inv]->Serial);
+							printf("GridRelay Status:      %s\n", tagdefs.getDesc(Inverters[inv]->GridRelayStatus, "?").c_str());
+						}
 					}
 				}
 			}
 		}
 
-		if ((rc = getInverterData(Inverters, BatteryInfo)) != 0)
-	        std::cerr << "getBatteryInfo returned an error: " << rc << std::endl;
+		if ((rc = getInverterData(Inverters, plant.index(), MaxACPower)) != 0)
+			std::cerr << "getMaxACPower returned an error: " << rc << std::endl;
 		else
 		{
-			for (int inv=0; Inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
+			//TODO: REVIEW THIS PART (getMaxACPower & getMaxACPower2 should be 1 function)
+			if ((Inverters[0]->Pmax1 == 0) && (rc = getInverterData(Inverters, plant.index(), MaxACPower2)) != 0)
+				std::cerr << "getMaxACPower2 returned an error: " << rc << std::endl;
+			else
 			{
-				if ((Inverters[inv]->DevClass == BatteryInverter) || (Inverters[inv]->hasBattery))
+				for (int inv=0; Inverters[inv]!=NULL; inv++)
 				{
 					if (VERBOSE_NORMAL)
 					{
 						printf("SUSyID: %d - SN: %lu\n", Inverters[inv]->SUSyID, Inverters[inv]->Serial);
-						printf("Batt. Temperature: %3.1f%sC\n", (float)(Inverters[inv]->BatTmpVal / 10), SYM_DEGREE); // degree symbol is different on windows/linux
-						printf("Batt. Voltage    : %3.2fV\n", toVolt(Inverters[inv]->BatVol));
-						printf("Batt. Current    : %2.3fA\n", toAmp(Inverters[inv]->BatAmp));
+						printf("Pac max phase 1: %luW\n", Inverters[inv]->Pmax1);
+						printf("Pac max phase 2: %luW\n", Inverters[inv]->Pmax2);
+						printf("Pac max phase 3: %luW\n", Inverters[inv]->Pmax3);
 					}
 				}
 			}
 		}
 
-		if ((rc = getInverterData(Inverters, MeteringGridMsTotW)) != 0)
-	        std::cerr << "getMeteringGridInfo returned an error: " << rc << std::endl;
+		if ((rc = getInverterData(Inverters, plant.index(), EnergyProduction)) != 0)
+			std::cerr << "getEnergyProduction returned an error: " << rc << std::endl;
+
+		if ((rc = getInverterData(Inverters, plant.index(), OperationTime)) != 0)
+			std::cerr << "getOperationTime returned an error: " << rc << std::endl;
 		else
 		{
-			for (int inv=0; Inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
+			for (int inv=0; Inverters[inv]!=NULL; inv++)
 			{
-				if ((Inverters[inv]->DevClass == BatteryInverter) || (Inverters[inv]->hasBattery))
+				if (VERBOSE_NORMAL)
 				{
-					if (VERBOSE_NORMAL)
-					{
-						printf("SUSyID: %d - SN: %lu\n", Inverters[inv]->SUSyID, Inverters[inv]->Serial);
-						printf("Grid Power Out : %dW\n", Inverters[inv]->MeteringGridMsTotWOut);
-						printf("Grid Power In  : %dW\n", Inverters[inv]->MeteringGridMsTotWIn);
-					}
+					printf("SUSyID: %d - SN: %lu\n", Inverters[inv]->SUSyID, Inverters[inv]->Serial);
+					puts("Energy Production:");
+					printf("\tEToday: %.3fkWh\n", tokWh(Inverters[inv]->EToday));
+					printf("\tETotal: %.3fkWh\n", tokWh(Inverters[inv]->ETotal));
+					printf("\tOperation Time: %.2fh\n", toHour(Inverters[inv]->OperationTime));
+					printf("\tFeed-In Time  : %.2fh\n", toHour(Inverters[inv]->FeedInTime));
 				}
 			}
 		}
-	}
 
-    if ((rc = getInverterData(Inverters, DeviceStatus)) != 0)
-        std::cerr << "getDeviceStatus returned an error: " << rc << std::endl;
-    else
-    {
-        for (int inv=0; Inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
-        {
-            if (VERBOSE_NORMAL)
-            {
-                printf("SUSyID: %d - SN: %lu\n", Inverters[inv]->SUSyID, Inverters[inv]->Serial);
-				printf("Device Status:      %s\n", tagdefs.getDesc(Inverters[inv]->DeviceStatus, "?").c_str());
-            }
-        }
-    }
+		if ((rc = getInverterData(Inverters, plant.index(), SpotDCPower)) != 0)
+			std::cerr << "getSpotDCPower returned an error: " << rc << std::endl;
 
-	if ((rc = getInverterData(Inverters, InverterTemperature)) != 0)
-        std::cerr << "getInverterTemperature returned an error: " << rc << std::endl;
-    else
-    {
-        for (int inv=0; Inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
-        {
-            if (VERBOSE_NORMAL)
-            {
-                printf("SUSyID: %d - SN: %lu\n", Inverters[inv]->SUSyID, Inverters[inv]->Serial);
-				printf("Device Temperature: %3.1f%sC\n", ((float)Inverters[inv]->Temperature / 100), SYM_DEGREE); // degree symbol is different on windows/linux
-            }
-        }
-    }
+		if ((rc = getInverterData(Inverters, plant.index(), SpotDCVoltage)) != 0)
+			std::cerr << "getSpotDCVoltage returned an error: " << rc << std::endl;
 
-	if (Inverters[0]->DevClass == SolarInverter)
-    {
-        if ((rc = getInverterData(Inverters, GridRelayStatus)) != 0)
-	        std::cerr << "getGridRelayStatus returned an error: " << rc << std::endl;
-        else
-        {
-            for (int inv=0; Inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
-            {
-                if (Inverters[inv]->DevClass == SolarInverter)
-                {
-                    if (VERBOSE_NORMAL)
-                    {
-                        printf("SUSyID: %d - SN: %lu\n", Inverters[inv]->SUSyID, Inverters[inv]->Serial);
-						printf("GridRelay Status:      %s\n", tagdefs.getDesc(Inverters[inv]->GridRelayStatus, "?").c_str());
-                    }
-                }
-            }
-        }
-    }
+		//Calculate missing DC Spot Values
+		if (cfg.calcMissingSpot == 1)
+			CalcMissingSpot(Inverters[0]);
 
-    if ((rc = getInverterData(Inverters, MaxACPower)) != 0)
-        std::cerr << "getMaxACPower returned an error: " << rc << std::endl;
-    else
-    {
-        //TODO: REVIEW THIS PART (getMaxACPower & getMaxACPower2 should be 1 function)
-        if ((Inverters[0]->Pmax1 == 0) && (rc = getInverterData(Inverters, MaxACPower2)) != 0)
-	        std::cerr << "getMaxACPower2 returned an error: " << rc << std::endl;
-        else
-        {
-            for (int inv=0; Inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
-            {
-                if (VERBOSE_NORMAL)
-                {
-                    printf("SUSyID: %d - SN: %lu\n", Inverters[inv]->SUSyID, Inverters[inv]->Serial);
-                    printf("Pac max phase 1: %luW\n", Inverters[inv]->Pmax1);
-                    printf("Pac max phase 2: %luW\n", Inverters[inv]->Pmax2);
-                    printf("Pac max phase 3: %luW\n", Inverters[inv]->Pmax3);
-                }
-            }
-        }
-    }
+		for (int inv=0; Inverters[inv]!=NULL; inv++)
+		{
+			Inverters[inv]->calPdcTot = Inverters[inv]->Pdc1 + Inverters[inv]->Pdc2;
+			if (VERBOSE_NORMAL)
+			{
+				printf("SUSyID: %d - SN: %lu\n", Inverters[inv]->SUSyID, Inverters[inv]->Serial);
+				puts("DC Spot Data:");
+				printf("\tString 1 Pdc: %7.3fkW - Udc: %6.2fV - Idc: %6.3fA\n", tokW(Inverters[inv]->Pdc1), toVolt(Inverters[inv]->Udc1), toAmp(Inverters[inv]->Idc1));
+				printf("\tString 2 Pdc: %7.3fkW - Udc: %6.2fV - Idc: %6.3fA\n", tokW(Inverters[inv]->Pdc2), toVolt(Inverters[inv]->Udc2), toAmp(Inverters[inv]->Idc2));
+				printf("\tCalculated Total Pdc: %7.3fkW\n", tokW(Inverters[inv]->calPdcTot));
+			}
+		}
 
-    if ((rc = getInverterData(Inverters, EnergyProduction)) != 0)
-        std::cerr << "getEnergyProduction returned an error: " << rc << std::endl;
+		// AC power, voltage/current and grid frequency are fetched in one go
+		int rcSpotAC = getInverterData(Inverters, plant.index(), SpotACPower | SpotACVoltage | SpotACTotalPower | SpotGridFrequency);
+		if (rcSpotAC != 0)
+			std::cerr << "getSpotACData returned an error: " << rcSpotAC << std::endl;
 
-    if ((rc = getInverterData(Inverters, OperationTime)) != 0)
-        std::cerr << "getOperationTime returned an error: " << rc << std::endl;
-    else
-    {
-        for (int inv=0; Inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
-        {
-            if (VERBOSE_NORMAL)
-            {
-                printf("SUSyID: %d - SN: %lu\n", Inverters[inv]->SUSyID, Inverters[inv]->Serial);
-                puts("Energy Production:");
-                printf("\tEToday: %.3fkWh\n", tokWh(Inverters[inv]->EToday));
-                printf("\tETotal: %.3fkWh\n", tokWh(Inverters[inv]->ETotal));
-                printf("\tOperation Time: %.2fh\n", toHour(Inverters[inv]->OperationTime));
-                printf("\tFeed-In Time  : %.2fh\n", toHour(Inverters[inv]->FeedInTime));
-            }
-        }
-    }
+		//Calculate missing AC Spot Values
+		if (cfg.calcMissingSpot == 1)
+			CalcMissingSpot(Inverters[0]);
 
-    if ((rc = getInverterData(Inverters, SpotDCPower)) != 0)
-        std::cerr << "getSpotDCPower returned an error: " << rc << std::endl;
+		for (int inv=0; Inverters[inv]!=NULL; inv++)
+		{
+			Inverters[inv]->calPacTot = Inverters[inv]->Pac1 + Inverters[inv]->Pac2 + Inverters[inv]->Pac3;
+			//Calculated Inverter Efficiency
+			Inverters[inv]->calEfficiency = Inverters[inv]->calPdcTot == 0 ? 0.0f : 100.0f * (float)Inverters[inv]->calPacTot / (float)Inverters[inv]->calPdcTot;
+			if (VERBOSE_NORMAL)
+			{
+				printf("SUSyID: %d - SN: %lu\n", Inverters[inv]->SUSyID, Inverters[inv]->Serial);
+				puts("AC Spot Data:");
+				printf("\tPhase 1 Pac : %7.3fkW - Uac: %6.2fV - Iac: %6.3fA\n", tokW(Inverters[inv]->Pac1), toVolt(Inverters[inv]->Uac1), toAmp(Inverters[inv]->Iac1));
+				printf("\tPhase 2 Pac : %7.3fkW - Uac: %6.2fV - Iac: %6.3fA\n", tokW(Inverters[inv]->Pac2), toVolt(Inverters[inv]->Uac2), toAmp(Inverters[inv]->Iac2));
+				printf("\tPhase 3 Pac : %7.3fkW - Uac: %6.2fV - Iac: %6.3fA\n", tokW(Inverters[inv]->Pac3), toVolt(Inverters[inv]->Uac3), toAmp(Inverters[inv]->Iac3));
+				printf("\tTotal Pac   : %7.3fkW - Calculated Pac: %7.3fkW\n", tokW(Inverters[inv]->TotalPac), tokW(Inverters[inv]->calPacTot));
+				printf("\tEfficiency  : %7.2f%%\n", Inverters[inv]->calEfficiency);
+			}
+		}
 
-    if ((rc = getInverterData(Inverters, SpotDCVoltage)) != 0)
-        std::cerr << "getSpotDCVoltage returned an error: " << rc << std::endl;
+		if (rcSpotAC == 0)
+		{
+			for (int inv=0; Inverters[inv]!=NULL; inv++)
+			{
+				if (VERBOSE_NORMAL)
+				{
+					printf("SUSyID: %d - SN: %lu\n", Inverters[inv]->SUSyID, Inverters[inv]->Serial);
+					printf("Grid Freq. : %.2fHz\n", toHz(Inverters[inv]->GridFreq));
+				}
+			}
+		}
 
-    //Calculate missing DC Spot Values
-    if (cfg.calcMissingSpot == 1)
-        CalcMissingSpot(Inverters[0]);
+		if (Inverters[0]->DevClass == SolarInverter)
+		{
+			for (int inv=0; Inverters[inv]!=NULL; inv++)
+			{
+				if (VERBOSE_NORMAL)
+				{
+					printf("SUSyID: %d - SN: %lu\n", Inverters[inv]->SUSyID, Inverters[inv]->Serial);
+					if (Inverters[inv]->InverterDatetime > 0)
+						printf("Current Inverter Time: %s\n", strftime_t(cfg.DateTimeFormat, Inverters[inv]->InverterDatetime));
 
-    for (int inv=0; Inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
-    {
-		Inverters[inv]->calPdcTot = Inverters[inv]->Pdc1 + Inverters[inv]->Pdc2;
-        if (VERBOSE_NORMAL)
-        {
-            printf("SUSyID: %d - SN: %lu\n", Inverters[inv]->SUSyID, Inverters[inv]->Serial);
-            puts("DC Spot Data:");
-            printf("\tString 1 Pdc: %7.3fkW - Udc: %6.2fV - Idc: %6.3fA\n", tokW(Inverters[inv]->Pdc1), toVolt(Inverters[inv]->Udc1), toAmp(Inverters[inv]->Idc1));
-            printf("\tString 2 Pdc: %7.3fkW - Udc: %6.2fV - Idc: %6.3fA\n", tokW(Inverters[inv]->Pdc2), toVolt(Inverters[inv]->Udc2), toAmp(Inverters[inv]->Idc2));
-            printf("\tCalculated Total Pdc: %7.3fkW\n", tokW(Inverters[inv]->calPdcTot));
-        }
-    }
+					if (Inverters[inv]->WakeupTime > 0)
+						printf("Inverter Wake-Up Time: %s\n", strftime_t(cfg.DateTimeFormat, Inverters[inv]->WakeupTime));
 
-    if ((rc = getInverterData(Inverters, SpotACPower)) != 0)
-        std::cerr << "getSpotACPower returned an error: " << rc << std::endl;
+					if (Inverters[inv]->SleepTime > 0)
+						printf("Inverter Sleep Time  : %s\n", strftime_t(cfg.DateTimeFormat, Inverters[inv]->SleepTime));
+				}
+			}
+		}
 
-    if ((rc = getInverterData(Inverters, SpotACVoltage)) != 0)
-        std::cerr << "getSpotACVoltage returned an error: " << rc << std::endl;
+		// Devices that missed a reply this cycle are left out of the spot exports
+		std::vector<InverterData *> answered;
+		for (int inv=0; Inverters[inv]!=NULL; inv++)
+		{
+			if (!Inverters[inv]->stale)
+				answered.push_back(Inverters[inv]);
+			else if (VERBOSE_NORMAL)
+				printf("SN: %lu did not answer, no spot data exported\n", Inverters[inv]->Serial);
+		}
+		answered.push_back(NULL);
+		InverterData **Answered = &answered[0];
 
-    if ((rc = getInverterData(Inverters, SpotACTotalPower)) != 0)
-        std::cerr << "getSpotACTotalPower returned an error: " << rc << std::endl;
+		if (http.isrunning())
+			http.update(&cfg, Answered);
 
-    //Calculate missing AC Spot Values
-    if (cfg.calcMissingSpot == 1)
-        CalcMissingSpot(Inverters[0]);
+		if ((Answered[0] != NULL) && (Answered[0]->DevClass == SolarInverter))
+		{
+			if ((cfg.CSV_Export == 1) && (cfg.nospot == 0))
+				ExportSpotDataToCSV(&cfg, Answered);
 
-    for (int inv=0; Inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
-    {
-        Inverters[inv]->calPacTot = Inverters[inv]->Pac1 + Inverters[inv]->Pac2 + Inverters[inv]->Pac3;
-        //Calculated Inverter Efficiency
-        Inverters[inv]->calEfficiency = Inverters[inv]->calPdcTot == 0 ? 0.0f : 100.0f * (float)Inverters[inv]->calPacTot / (float)Inverters[inv]->calPdcTot;
-        if (VERBOSE_NORMAL)
-        {
-            printf("SUSyID: %d - SN: %lu\n", Inverters[inv]->SUSyID, Inverters[inv]->Serial);
-            puts("AC Spot Data:");
-            printf("\tPhase 1 Pac : %7.3fkW - Uac: %6.2fV - Iac: %6.3fA\n", tokW(Inverters[inv]->Pac1), toVolt(Inverters[inv]->Uac1), toAmp(Inverters[inv]->Iac1));
-            printf("\tPhase 2 Pac : %7.3fkW - Uac: %6.2fV - Iac: %6.3fA\n", tokW(Inverters[inv]->Pac2), toVolt(Inverters[inv]->Uac2), toAmp(Inverters[inv]->Iac2));
-            printf("\tPhase 3 Pac : %7.3fkW - Uac: %6.2fV - Iac: %6.3fA\n", tokW(Inverters[inv]->Pac3), toVolt(Inverters[inv]->Uac3), toAmp(Inverters[inv]->Iac3));
-            printf("\tTotal Pac   : %7.3fkW - Calculated Pac: %7.3fkW\n", tokW(Inverters[inv]->TotalPac), tokW(Inverters[inv]->calPacTot));
-            printf("\tEfficiency  : %7.2f%%\n", Inverters[inv]->calEfficiency);
-        }
-    }
+			if ((cfg.Column_Export == 1) && (cfg.nospot == 0))
+				ExportSpotDataToColumns(&cfg, Answered);
 
-    if ((rc = getInverterData(Inverters, SpotGridFrequency)) != 0)
-        std::cerr << "getSpotGridFrequency returned an error: " << rc << std::endl;
-    else
-    {
-        for (int inv=0; Inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
-        {
-            if (VERBOSE_NORMAL)
-            {
-                printf("SUSyID: %d - SN: %lu\n", Inverters[inv]->SUSyID, Inverters[inv]->Serial);
-                printf("Grid Freq. : %.2fHz\n", toHz(Inverters[inv]->GridFreq));
-            }
-        }
-    }
+			if (cfg.wsl == 1)
+				ExportSpotDataToWSL(&cfg, Answered);
 
-    if (Inverters[0]->DevClass == SolarInverter)
-	{
-		for (int inv=0; Inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
+			if (cfg.s123 == S123_DATA)
+				ExportSpotDataTo123s(&cfg, Answered);
+			if (cfg.s123 == S123_INFO)
+				ExportInformationDataTo123s(&cfg, Answered);
+			if (cfg.s123 == S123_STATE)
+				ExportStateDataTo123s(&cfg, Answered);
+		}
+
+		if (hasBatteryDevice && (Answered[0] != NULL) && (cfg.CSV_Export == 1) && (cfg.nospot == 0))
+			ExportBatteryDataToCSV(&cfg, Answered);
+
+		#if defined(USE_SQLITE) || defined(USE_MYSQL)
+		if (!cfg.nosql && (Answered[0] != NULL))
 		{
-			if (VERBOSE_NORMAL)
+			// In daemon mode, the database remains open between polling cycles
+			if (!db.isopen())
 			{
-				printf("SUSyID: %d - SN: %lu\n", Inverters[inv]->SUSyID, Inverters[inv]->Serial);
-				if (Inverters[inv]->InverterDatetime > 0)
-					printf("Current Inverter Time: %s\n", strftime_t(cfg.DateTimeFormat, Inverters[inv]->InverterDatetime));
+				db.open(cfg.sqlHostname, cfg.sqlUsername, cfg.sqlUserPassword, cfg.sqlDatabase);
 
-				if (Inverters[inv]->WakeupTime > 0)
-					printf("Inverter Wake-Up Time: %s\n", strftime_t(cfg.DateTimeFormat, Inverters[inv]->WakeupTime));
+				int schema_version = 0;
+				if (db.isopen() && (db.get_config(SQL_SCHEMAVERSION, schema_version) == db.SQL_OK) && (schema_version < SQL_MINIMUM_SCHEMA_VERSION))
+					std::cerr << "Upgrade your database to version " << SQL_MINIMUM_SCHEMA_VERSION << " (see Update_370_*.sql)" << std::endl;
+			}
+			if (db.isopen())
+			{
+				time_t spottime = time(NULL);
+				// One transaction (one commit to disk) for all writes of this cycle
+				db.begin_transaction();
+				db.type_label(Answered);
+				db.device_status(Answered, spottime);
+				db.spot_data(Answered, spottime);
+				if (hasBatteryDevice) 
+					db.battery_data(Answered, spottime);
+				db.end_transaction();
+
+				// Once a day, raw spot data older than SQL_RetentionDays is purged (SQLite: or archived)
+				if ((cfg.sqlRetentionDays > 0) && (spottime - lastRetentionTime >= 86400))
+				{
+					db.retention(cfg.sqlRetentionDays, cfg.sqlArchive);
+					lastRetentionTime = spottime;
+				}
+			}
+		}
+		#endif
 
-				if (Inverters[inv]->SleepTime > 0)
-					printf("Inverter Sleep Time  : %s\n", strftime_t(cfg.DateTimeFormat, Inverters[inv]->SleepTime));
+		/*******
+		* MQTT *
+		********/
+		if (cfg.mqtt == 1) // MQTT enabled
+		{
+			rc = mqtt_publish(&cfg, Answered);
+			if (rc != 0)
+			{
+				std::cout << "Error " << rc << " while publishing to MQTT Broker" << std::endl;
 			}
 		}
-	}
 
-	if (Inverters[0]->DevClass == SolarInverter)
-	{
-		if ((cfg.CSV_Export == 1) && (cfg.nospot == 0))
-			ExportSpotDataToCSV(&cfg, Inverters);
-
-		if (cfg.wsl == 1)
-			ExportSpotDataToWSL(&cfg, Inverters);
-
-		if (cfg.s123 == S123_DATA)
-			ExportSpotDataTo123s(&cfg, Inverters);
-		if (cfg.s123 == S123_INFO)
-			ExportInformationDataTo123s(&cfg, Inverters);
-		if (cfg.s123 == S123_STATE)
-			ExportStateDataTo123s(&cfg, Inverters);
-	}
+		/********************************************************************
+		* First cycle retrieves the archives as requested on the commandline
+		* Next cycles (daemon mode) only refresh what has changed since:
+		* day data every 5 minutes, month data and events once a day
+		*********************************************************************/
+		time_t now = time(NULL);
+		int archDays = cfg.archDays;
+		int archMonths = cfg.archMonths;
+		int archEventMonths = cfg.archEventMonths;
 
-	if (hasBatteryDevice && (cfg.CSV_Export == 1) && (cfg.nospot == 0))
-		ExportBatteryDataToCSV(&cfg, Inverters);
+		if (lastArchTime != 0)
+		{
+			struct tm tm_now, tm_last;
+			memcpy(&tm_now, localtime(&now), sizeof(tm_now));
+			memcpy(&tm_last, localtime(&lastArchTime), sizeof(tm_last));
+			bool isNewDay = (tm_now.tm_yday != tm_last.tm_yday);
+
+			// On a new day, yesterday is read once more to get its last records
+			archDays = (cfg.archDays == 0) ? 0 : isNewDay ? 2 : (now / 300 != lastDayDataTime / 300) ? 1 : 0;
+			// On the 1st day of the month, read previous month too
+			archMonths = ((cfg.archMonths == 0) || !isNewDay) ? 0 : (tm_now.tm_mday == 1) ? 2 : 1;
+			archEventMonths = ((cfg.archEventMonths == 0) || !isNewDay) ? 0 : 1;
+		}
 
-	#if defined(USE_SQLITE) || defined(USE_MYSQL)
-	db_SQL_Export db = db_SQL_Export();
-	if (!cfg.nosql)
-	{
-		db.open(cfg.sqlHostname, cfg.sqlUsername, cfg.sqlUserPassword, cfg.sqlDatabase);
-		if (db.isopen())
+		lastArchTime = now;
+		if (archDays > 0)
+			lastDayDataTime = now;
+
+		#if defined(USE_SQLITE) || defined(USE_MYSQL)
+		if ((cfg.archSync == 1) && (0 == cfg.startdate) && (!cfg.nosql) && db.isopen())
+			syncArchiveRange(&cfg, db, Inverters, archDays, archMonths, archEventMonths);
+		#endif
+
+		//SolarInverter -> Continue to get archive data
+
+		/***************
+		* Get Day Data *
+		****************/
+		time_t arch_time = (0 == cfg.startdate) ? time(NULL) : cfg.startdate;
+
+		if (archDays > 0)
 		{
-			time_t spottime = time(NULL);
-			db.type_label(Inverters);
-			db.device_status(Inverters, spottime);
-			db.spot_data(Inverters, spottime);
-			if (hasBatteryDevice) 
-				db.battery_data(Inverters, spottime);
+			// Days are exported as they complete, several of them can be in progress at once
+			DayDataExport dayExport;
+			dayExport.cfg = &cfg;
+			#if defined(USE_SQLITE) || defined(USE_MYSQL)
+			dayExport.db = &db;
+			#endif
+
+			if ((rc = BackfillDayData(Inverters, arch_time, archDays, cfg.archConcurrency, exportDayData, &dayExport)) != E_OK)
+			{
+				if (rc != E_ARCHNODATA)
+					std::cerr << "BackfillDayData returned an error: " << rc << std::endl;
+			}
 		}
-	}
-	#endif
 
-	/*******
-	* MQTT *
-	********/
-	if (cfg.mqtt == 1) // MQTT enabled
-	{
-		rc = mqtt_publish(&cfg, Inverters);
-		if (rc != 0)
+
+		/*****************
+		* Get Month Data *
+		******************/
+		if (archMonths > 0)
 		{
-			std::cout << "Error " << rc << " while publishing to MQTT Broker" << std::endl;
+			getMonthDataOffset(Inverters); //Issues 115/130
+			arch_time = (0 == cfg.startdate) ? time(NULL) : cfg.startdate;
+			struct tm arch_tm;
+			memcpy(&arch_tm, gmtime(&arch_time), sizeof(arch_tm));
+
+			for (int count=0; count<archMonths; count++)
+			{
+				ArchiveMonthData(Inverters, &arch_tm);
+
+				if (VERBOSE_HIGH)
+				{
+					for (int inv = 0; Inverters[inv] != NULL; inv++)
+					{
+						printf("SUSyID: %d - SN: %lu\n", Inverters[inv]->SUSyID, Inverters[inv]->Serial);
+						for (unsigned int ii = 0; ii < sizeof(Inverters[inv]->monthData) / sizeof(MonthData); ii++)
+							if (Inverters[inv]->monthData[ii].datetime > 0)
+								printf("%s : %.3fkWh - %3.3fkWh\n", strfgmtime_t(cfg.DateFormat, Inverters[inv]->monthData[ii].datetime), (double)Inverters[inv]->monthData[ii].totalWh / 1000, (double)Inverters[inv]->monthData[ii].dayWh / 1000);
+						puts("======");
+					}
+				}
+
+				if (cfg.CSV_Export == 1)
+					ExportMonthDataToCSV(&cfg, Inverters);
+
+				#if defined(USE_SQLITE) || defined(USE_MYSQL)
+				if ((!cfg.nosql) && db.isopen())
+					db.month_data(Inverters);
+				#endif
+
+				//Go to previous month
+				if (--arch_tm.tm_mon < 0)
+				{
+					arch_tm.tm_mon = 11;
+					arch_tm.tm_year--;
+				}
+			}
 		}
-	}
 
-	//SolarInverter -> Continue to get archive data
-	unsigned int idx;
+		/*****************
+		* Get Event Data *
+		******************/
+		if (archEventMonths > 0)
+		{
+			// Events of the previous cycle are already exported
+			for (int inv=0; Inverters[inv]!=NULL; inv++)
+				Inverters[inv]->eventData.clear();
+
+			posix_time::ptime tm_utc(posix_time::from_time_t((0 == cfg.startdate) ? time(NULL) : cfg.startdate));
+			//ptime tm_utc(posix_time::second_clock::universal_time());
+			gregorian::date dt_utc(tm_utc.date().year(), tm_utc.date().month(), 1);
+			std::string dt_range_csv = str(format("%d%02d") % dt_utc.year() % static_cast<short>(dt_utc.month()));
 
-    /***************
-    * Get Day Data *
-    ****************/
-    time_t arch_time = (0 == cfg.startdate) ? time(NULL) : cfg.startdate;
+			for (int m = 0; m < archEventMonths; m++)
+			{
+				if (VERBOSE_LOW) cout << "Reading events: " << to_simple_string(dt_utc) << endl;
+				//Get user level events
+				rc = ArchiveEventData(Inverters, dt_utc, UG_USER);
+				if (rc == E_EOF) break; // No more data (first event reached)
+				else if (rc != E_OK) std::cerr << "ArchiveEventData(user) returned an error: " << rc << endl;
+
+				//When logged in as installer, get installer level events
+				if (cfg.userGroup == UG_INSTALLER)
+				{
+					rc = ArchiveEventData(Inverters, dt_utc, UG_INSTALLER);
+					if (rc == E_EOF) break; // No more data (first event reached)
+					else if (rc != E_OK) std::cerr << "ArchiveEventData(installer) returned an error: " << rc << endl;
+				}
+
+				//Move to previous month
+				if (dt_utc.month() == 1)
+					dt_utc = gregorian::date(dt_utc.year() - 1, 12, 1);
+				else
+					dt_utc = gregorian::date(dt_utc.year(), dt_utc.month() - 1, 1);
+
+			}
 
-    for (int count=0; count<cfg.archDays; count++)
+			if (rc == E_OK)
+			{
+				//Adjust start of range with 1 month
+				if (dt_utc.month() == 12)
+					dt_utc = gregorian::date(dt_utc.year() + 1, 1, 1);
+				else
+					dt_utc = gregorian::date(dt_utc.year(), dt_utc.month() + 1, 1);
+			}
+
+			if ((rc == E_OK) || (rc == E_EOF))
+			{
+				dt_range_csv = str(format("%d%02d-%s") % dt_utc.year() % static_cast<short>(dt_utc.month()) % dt_range_csv);
+
+				if ((cfg.CSV_Export == 1) && (archEventMonths > 0))
+					ExportEventsToCSV(&cfg, Inverters, dt_range_csv);
+
+			#if defined(USE_SQLITE) || defined(USE_MYSQL)
+			if ((!cfg.nosql) && db.isopen())
+				db.event_data(Inverters, tagdefs);
+			#endif
+			}
+		}
+
+		// CSV files remain open, write this cycle's rows to disk
+		if (cfg.CSV_Export == 1)
+			CSVflush(&cfg);
+
+		// -startdate only applies to the first cycle
+		cfg.startdate = 0;
+
+	} while ((cfg.daemon == 1) && (daemonStop == 0));
+
+	http.stop();
+	CSVclose();
+	ColumnClose();
+
+	if (isConnected)
+		disconnectPlant(&cfg, plant);
+
+	#if defined(USE_SQLITE) || defined(USE_MYSQL)
+	if ((!cfg.nosql) && db.isopen())
+		db.close();
+	#endif
+
+	capClose();
+
+    if (VERBOSE_NORMAL) print_error(stdout, PROC_INFO, "Done.\n");
+
+    return 0;
+}
+#endif
+
+//Connect to the plant (Bluetooth or Speedwire) and logon to all devices
+int connectPlant(Config *cfg, PlantRegistry &plant)
+{
+    char msg[80];
+
+    int rc = 0;
+
+    if (ConnType == CT_BLUETOOTH)
     {
-        if ((rc = ArchiveDayData(Inverters, arch_time)) != E_OK)
-        {
-            if (rc != E_ARCHNODATA)
-		        std::cerr << "ArchiveDayData returned an error: " << rc << std::endl;
-        }
-        else
+        int attempts = 1;
+        do
         {
-            if (VERBOSE_HIGH)
+            if (attempts != 1) sleep(1);
             {
-                for (int inv=0; Inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
-                {
-                    printf("SUSyID: %d - SN: %lu\n", Inverters[inv]->SUSyID, Inverters[inv]->Serial);
-                    for (idx=0; idx<sizeof(Inverters[inv]->dayData)/sizeof(DayData); idx++)
-                        if (Inverters[inv]->dayData[idx].datetime > 0)
-						{
-                            printf("%s : %.3fkWh - %3.3fW\n", strftime_t(cfg.DateTimeFormat, Inverters[inv]->dayData[idx].datetime), (double)Inverters[inv]->dayData[idx].totalWh/1000, (double)Inverters[inv]->dayData[idx].watt);
-						    fflush(stdout);
-						}
-                    puts("======");
-                }
+                if (VERBOSE_NORMAL) printf("Connecting to %s (%d/%d)\n", cfg->BT_Address, attempts, cfg->BT_ConnectRetries);
+                rc = bthConnect(cfg->BT_Address);
             }
+            attempts++;
+        }
+        while ((attempts <= cfg->BT_ConnectRetries) && (rc != 0));
 
-            if (cfg.CSV_Export == 1)
-                ExportDayDataToCSV(&cfg, Inverters);
 
-			#if defined(USE_SQLITE) || defined(USE_MYSQL)
-			if ((!cfg.nosql) && db.isopen())
-				db.day_data(Inverters);
-			#endif
+        if (rc != 0)
+        {
+            snprintf(msg, sizeof(msg), "bthConnect() returned %d\n", rc);
+            print_error(stdout, PROC_CRITICAL, msg);
+            return rc;
         }
 
-        //Goto previous day
-        arch_time -= 86400;
-    }
+		rc = initialiseSMAConnection(cfg->BT_Address, plant, cfg->MIS_Enabled);
+
+        if (rc != E_OK)
+        {
+            print_error(stdout, PROC_CRITICAL, "Failed to initialize communication with inverter.\n");
+            plant.clear();
+            bthClose();
+            return rc;
+        }
 
+        rc = getBT_SignalStrength(plant[0]);
+        if (VERBOSE_NORMAL) printf("BT Signal=%0.1f%%\n", plant[0]->BT_Signal);
 
-    /*****************
-    * Get Month Data *
-    ******************/
-	if (cfg.archMonths > 0)
-	{
-		getMonthDataOffset(Inverters); //Issues 115/130
-		arch_time = (0 == cfg.startdate) ? time(NULL) : cfg.startdate;
-		struct tm arch_tm;
-		memcpy(&arch_tm, gmtime(&arch_time), sizeof(arch_tm));
+    }
+    else // CT_ETHERNET
+    {
+		if (VERBOSE_NORMAL) printf("Connecting to Local Network...\n");
+		rc = ethConnect(cfg->IP_Port);
+		if (rc != 0)
+		{
+			print_error(stdout, PROC_CRITICAL, "Failed to set up socket connection.");
+			return rc;
+		}
 
-		for (int count=0; count<cfg.archMonths; count++)
+		if (cfg->ip_addresslist.size() > 1)
+			// New method for multiple inverters with fixed IP
+			rc = ethInitConnectionMulti(plant, cfg->ip_addresslist);
+		else
+			// Old method for one inverter (fixed IP or broadcast)
+			rc = ethInitConnection(plant, cfg->IP_Address);
+
+		if (rc != E_OK)
 		{
-			ArchiveMonthData(Inverters, &arch_tm);
+			print_error(stdout, PROC_CRITICAL, "Failed to initialize Speedwire connection.");
+			plant.clear();
+			ethClose();
+			return rc;
+		}
+    }
 
-			if (VERBOSE_HIGH)
-			{
-				for (int inv = 0; Inverters[inv] != NULL && inv<MAX_INVERTERS; inv++)
-				{
-					printf("SUSyID: %d - SN: %lu\n", Inverters[inv]->SUSyID, Inverters[inv]->Serial);
-					for (unsigned int ii = 0; ii < sizeof(Inverters[inv]->monthData) / sizeof(MonthData); ii++)
-						if (Inverters[inv]->monthData[ii].datetime > 0)
-							printf("%s : %.3fkWh - %3.3fkWh\n", strfgmtime_t(cfg.DateFormat, Inverters[inv]->monthData[ii].datetime), (double)Inverters[inv]->monthData[ii].totalWh / 1000, (double)Inverters[inv]->monthData[ii].dayWh / 1000);
-					puts("======");
-				}
-			}
+    // BT or IP addresses of the devices are known
+    plant.reindex();
 
-			if (cfg.CSV_Export == 1)
-				ExportMonthDataToCSV(&cfg, Inverters);
+    if (logonSMAInverter(plant.devices(), plant.index(), cfg->userGroup, cfg->SMA_Password) != E_OK)
+    {
+        snprintf(msg, sizeof(msg), "Logon failed. Check '%s' Password\n", cfg->userGroup == UG_USER? "USER":"INSTALLER");
+        print_error(stdout, PROC_CRITICAL, msg);
+        plant.clear();
+        bthClose();
+        return 1;
+    }
 
-			#if defined(USE_SQLITE) || defined(USE_MYSQL)
-			if ((!cfg.nosql) && db.isopen())
-				db.month_data(Inverters);
-			#endif
+    // SUSyID and Serial are known now
+    plant.reindex();
 
-			//Go to previous month
-			if (--arch_tm.tm_mon < 0)
-			{
-				arch_tm.tm_mon = 11;
-				arch_tm.tm_year--;
-			}
-		}
-	}
+    return E_OK;
+}
 
-    /*****************
-    * Get Event Data *
-    ******************/
-	posix_time::ptime tm_utc(posix_time::from_time_t((0 == cfg.startdate) ? time(NULL) : cfg.startdate));
-	//ptime tm_utc(posix_time::second_clock::universal_time());
-	gregorian::date dt_utc(tm_utc.date().year(), tm_utc.date().month(), 1);
-	std::string dt_range_csv = str(format("%d%02d") % dt_utc.year() % static_cast<short>(dt_utc.month()));
+//Logoff from all devices, free the inverter list and close the connection
+void disconnectPlant(Config *cfg, PlantRegistry &plant)
+{
+	InverterData **inverters = plant.devices();
 
-	for (int m = 0; m < cfg.archEventMonths; m++)
+	if (cfg->ConnectionType == CT_BLUETOOTH)
+		logoffSMAInverter(inverters[0]);
+	else
 	{
-		if (VERBOSE_LOW) cout << "Reading events: " << to_simple_string(dt_utc) << endl;
-		//Get user level events
-		rc = ArchiveEventData(Inverters, dt_utc, UG_USER);
-		if (rc == E_EOF) break; // No more data (first event reached)
-		else if (rc != E_OK) std::cerr << "ArchiveEventData(user) returned an error: " << rc << endl;
-
-		//When logged in as installer, get installer level events
-		if (cfg.userGroup == UG_INSTALLER)
-		{
-			rc = ArchiveEventData(Inverters, dt_utc, UG_INSTALLER);
-			if (rc == E_EOF) break; // No more data (first event reached)
-			else if (rc != E_OK) std::cerr << "ArchiveEventData(installer) returned an error: " << rc << endl;
-		}
+		logoffMultigateDevices(inverters);
+		for (int inv=0; inverters[inv]!=NULL; inv++)
+			logoffSMAInverter(inverters[inv]);
+	}
 
-		//Move to previous month
-		if (dt_utc.month() == 1)
-			dt_utc = gregorian::date(dt_utc.year() - 1, 12, 1);
-		else
-			dt_utc = gregorian::date(dt_utc.year(), dt_utc.month() - 1, 1);
+    plant.clear();
+    bthClose();
+}
 
-	}
+//Get device info (type, software version, ...) and devices connected to a multigate
+//This is done once after connecting to the plant
+int getPlantInfo(Config *cfg, PlantRegistry &plant)
+{
+    InverterData **Inverters = plant.devices();
+    char msg[80];
 
-	if (rc == E_OK)
-	{
-		//Adjust start of range with 1 month
-		if (dt_utc.month() == 12)
-			dt_utc = gregorian::date(dt_utc.year() + 1, 1, 1);
-		else
-			dt_utc = gregorian::date(dt_utc.year(), dt_utc.month() + 1, 1);
-	}
+    int rc = 0;
 
-	if ((rc == E_OK) || (rc == E_EOF))
-	{
-		dt_range_csv = str(format("%d%02d-%s") % dt_utc.year() % static_cast<short>(dt_utc.month()) % dt_range_csv);
+	if ((rc = getInverterData(Inverters, plant.index(), sbftest)) != 0)
+        std::cerr << "getInverterData(sbftest) returned an error: " << rc << std::endl;
 
-		if ((cfg.CSV_Export == 1) && (cfg.archEventMonths > 0))
-			ExportEventsToCSV(&cfg, Inverters, dt_range_csv);
+	if ((rc = getInverterData(Inverters, plant.index(), SoftwareVersion)) != 0)
+        std::cerr << "getSoftwareVersion returned an error: " << rc << std::endl;
 
-	#if defined(USE_SQLITE) || defined(USE_MYSQL)
-	if ((!cfg.nosql) && db.isopen())
-		db.event_data(Inverters, tagdefs);
-	#endif
-	}
+    if ((rc = getInverterData(Inverters, plant.index(), TypeLabel)) != 0)
+        std::cerr << "getTypeLabel returned an error: " << rc << std::endl;
+    else
+    {
+        for (int inv=0; Inverters[inv]!=NULL; inv++)
+        {
+			if ((Inverters[inv]->DevClass == BatteryInverter) || (Inverters[inv]->SUSyID == 292))	//SB 3600-SE (Smart Energy)
+				hasBatteryDevice = Inverters[inv]->hasBattery = true;
+			else
+				Inverters[inv]->hasBattery = false;
 
-	if (cfg.ConnectionType == CT_BLUETOOTH)
-		logoffSMAInverter(Inverters[0]);
-	else
+            if (VERBOSE_NORMAL)
+            {
+                printf("SUSyID: %d - SN: %lu\n", Inverters[inv]->SUSyID, Inverters[inv]->Serial);
+                printf("Device Name:      %s\n", Inverters[inv]->DeviceName);
+                printf("Device Class:     %s%s\n", Inverters[inv]->DeviceClass, (Inverters[inv]->SUSyID == 292) ? " (with battery)":"");
+                printf("Device Type:      %s\n", Inverters[inv]->DeviceType);
+                printf("Software Version: %s\n", Inverters[inv]->SWVersion);
+                printf("Serial number:    %lu\n", Inverters[inv]->Serial);
+            }
+        }
+    }
+
+	// Check for Multigate and get connected devices
+    for (int inv=0; Inverters[inv]!=NULL; inv++)
 	{
-		logoffMultigateDevices(Inverters);
-		for (int inv=0; Inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
-			logoffSMAInverter(Inverters[inv]);
-	}
+		if ((Inverters[inv]->DevClass == CommunicationProduct) && (Inverters[inv]->SUSyID == SID_MULTIGATE))
+		{
+			if (VERBOSE_HIGH)
+				std::cout << "Multigate found. Looking for connected devices..." << std::endl;
 
-    freemem(Inverters);
-    bthClose();
+			// multigate has its own ID
+			Inverters[inv]->multigateID = inv;
 
-	#if defined(USE_SQLITE) || defined(USE_MYSQL)
-	if ((!cfg.nosql) && db.isopen())
-		db.close();
-	#endif
+			rc = getDeviceList(plant, inv);
+			Inverters = plant.devices();	// Devices were added
+			if (rc != 0)
+				std::cout << "getDeviceList returned an error: " << rc << std::endl;
+			else
+			{
+				if (VERBOSE_HIGH)
+				{
+					std::cout << "Found these devices:" << std::endl;
+					for (int ii=0; Inverters[ii]!=NULL; ii++)
+					{
+						std::cout << "ID:" << ii << " S/N:" << Inverters[ii]->SUSyID << "-" << Inverters[ii]->Serial << " IP:" << Inverters[ii]->IPAddress << std::endl;
+					}
+				}
+			
+				if (logonSMAInverter(Inverters, plant.index(), cfg->userGroup, cfg->SMA_Password) != E_OK)
+				{
+					snprintf(msg, sizeof(msg), "Logon failed. Check '%s' Password\n", cfg->userGroup == UG_USER? "USER":"INSTALLER");
+					print_error(stdout, PROC_CRITICAL, msg);
+					return 1;
+				}
 
+				if ((rc = getInverterData(Inverters, plant.index(), SoftwareVersion)) != 0)
+					printf("getSoftwareVersion returned an error: %d\n", rc);
 
-    if (VERBOSE_NORMAL) print_error(stdout, PROC_INFO, "Done.\n");
+				if ((rc = getInverterData(Inverters, plant.index(), TypeLabel)) != 0)
+					printf("getTypeLabel returned an error: %d\n", rc);
+				else
+				{
+					for (int ii=0; Inverters[ii]!=NULL; ii++)
+					{
+						if (VERBOSE_NORMAL)
+						{
+							printf("SUSyID: %d - SN: %lu\n", Inverters[ii]->SUSyID, Inverters[ii]->Serial);
+							printf("Device Name:      %s\n", Inverters[ii]->DeviceName);
+							printf("Device Class:     %s\n", Inverters[ii]->DeviceClass);
+							printf("Device Type:      %s\n", Inverters[ii]->DeviceType);
+							printf("Software Version: %s\n", Inverters[ii]->SWVersion);
+							printf("Serial number:    %lu\n", Inverters[ii]->Serial);
+						}
+					}
+				}
+			}
+		}
+	}
 
-    return 0;
+	return E_OK;
 }
 
-//Free memory allocated by initialiseSMAConnection()
-void freemem(InverterData *inverters[])
+//Stop daemon gracefully on SIGINT/SIGTERM
+void daemonSignalHandler(int sig)
 {
-    for (int i=0; i<MAX_INVERTERS; i++)
-        if (inverters[i] != NULL)
-        {
-            delete inverters[i];
-            inverters[i] = NULL;
-        }
+	daemonStop = 1;
 }
 
 E_SBFSPOT getPacket(unsigned char senderaddr[6], int wait4Command)
@@ -835,33 +1168,33 @@ E_SBFSPOT getPacket(unsigned char senderaddr[6], int wait4Command)
 
                 if (hasL2pckt == 1)
                 {
-                    //Copy CommBuf to packetbuffer
-                    int bufptr = sizeof(pkHeader);
-                    bool escNext = false;
+                    //Copy CommBuf to packetbuffer and unescape it
+                    //Runs without 0x7D are copied at once, most packets have none
+                    const unsigned char *src = CommBuf + sizeof(pkHeader);
+                    const unsigned char *end = CommBuf + btohs(pkHdr->pkLength);
 
                     if (DEBUG_NORMAL) printf("PacketLength=%d\n", btohs(pkHdr->pkLength));
 
-                    for (int i = sizeof(pkHeader); i < btohs(pkHdr->pkLength); i++)
+                    while (src < end)
                     {
-                        pcktBuf[index] = CommBuf[bufptr++];
-                        //Keep 1st byte raw unescaped 0x7E
-                        if (escNext == true)
-                        {
-                            pcktBuf[index] ^= 0x20;
-                            escNext = false;
-                            index++;
-                        }
-                        else
+                        const unsigned char *esc = (const unsigned char *)memchr(src, 0x7D, end - src);
+                        int count = (int)((esc ? esc : end) - src);
+                        //One more byte is needed for the escaped one
+                        if (index + count + (esc ? 1 : 0) >= maxpcktBufsize)
                         {
-                            if (pcktBuf[index] == 0x7D)
-                                escNext = true; //Throw away the 0x7d byte
-                            else
-                                index++;
+                            printf("Warning: pcktBuf buffer overflow! (%d)\n", maxpcktBufsize);
+                            return E_BUFOVRFLW;
                         }
-                        if (index >= maxpcktBufsize)
+
+                        memcpy(pcktBuf + index, src, count);
+                        index += count;
+                        src += count;
+
+                        if (esc)
                         {
-                            printf("Warning: pcktBuf buffer overflow! (%d)\n", index);
-                            return E_BUFOVRFLW;
+                            src++;	//Throw away the 0x7d byte
+                            if (src < end)
+                                pcktBuf[index++] = *src++ ^ 0x20;
                         }
                     }
                     packetposition = index;
@@ -933,68 +1266,18 @@ E_SBFSPOT getPacket(unsigned char senderaddr[6], int wait4Command)
     return rc;
 }
 
-int getInverterIndexBySerial(InverterData *inverters[], unsigned short SUSyID, uint32_t Serial)
-{
-	if (DEBUG_HIGHEST)
-	{
-		printf("getInverterIndexBySerial()\n");
-		printf("Looking up %d:%lu\n", SUSyID, (unsigned long)Serial);
-	}
-
-    for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
-    {
-		if (DEBUG_HIGHEST)
-			printf("Inverter[%d] %d:%lu\n", inv, inverters[inv]->SUSyID, inverters[inv]->Serial);
-
-		if ((inverters[inv]->SUSyID == SUSyID) && inverters[inv]->Serial == Serial)
-            return inv;
-    }
-
-	if (DEBUG_HIGHEST)
-		printf("Serial Not Found!\n");
-	
-	return -1;
-}
-
-int getInverterIndexBySerial(InverterData *inverters[], uint32_t Serial)
-{
-    for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
-    {
-        if (inverters[inv]->Serial == Serial)
-            return inv;
-    }
-
-    return -1;
-}
-
-int getInverterIndexByAddress(InverterData *inverters[], unsigned char bt_addr[6])
-{
-    for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
-    {
-        int byt;
-        for (byt=0; byt<6; byt++)
-        {
-            if (inverters[inv]->BTAddress[byt] != bt_addr[byt])
-                break;
-        }
-
-        if (byt == 6)
-            return inv;
-    }
-
-    return -1;	//No inverter found
-}
-
-E_SBFSPOT ethGetPacket(void)
+E_SBFSPOT ethGetPacket(int timeout_ms)
 {
     if (DEBUG_NORMAL) printf("ethGetPacket()\n");
     E_SBFSPOT rc = E_OK;
 
-    ethPacketHeaderL1L2 *pkHdr = (ethPacketHeaderL1L2 *)CommBuf;
+    // Receive the datagram in front of pcktBuf, its L2 part lands at pcktBuf+1 (no copy needed)
+    BYTE *datagram = pcktBuf + 1 - sizeof(ethPacketHeaderL1);
+    ethPacketHeaderL1L2 *pkHdr = (ethPacketHeaderL1L2 *)datagram;
 
     do
     {
-        int bib = ethRead(CommBuf, sizeof(CommBuf));
+        int bib = ethRead(datagram, maxpcktBufsize - 1 + sizeof(ethPacketHeaderL1), timeout_ms);
 
         if (bib <= 0)
         {
@@ -1008,14 +1291,11 @@ E_SBFSPOT ethGetPacket(void)
             //More data after header?
             if (pkLen > 0)
             {
-	            if (DEBUG_HIGH) HexDump(CommBuf, bib, 10);
+	            if (DEBUG_HIGH) HexDump(datagram, bib, 10);
                 if (btohl(pkHdr->pcktHdrL2.MagicNumber) == ETH_L2SIGNATURE)
                 {
-                    // Copy CommBuf to packetbuffer
-                    // Dummy byte to align with BTH (7E)
+                    // Dummy byte to align with BTH (7E), overwrites the last byte of the L1 header
                     pcktBuf[0]= 0;
-                    // We need last 6 bytes of ethPacketHeader too
-                    memcpy(pcktBuf+1, CommBuf + sizeof(ethPacketHeaderL1), bib - sizeof(ethPacketHeaderL1));
                     // Point packetposition at last byte in our buffer
 					// This is different from BTH
                     packetposition = bib - sizeof(ethPacketHeaderL1);
@@ -1043,7 +1323,7 @@ E_SBFSPOT ethGetPacket(void)
     return rc;
 }
 
-E_SBFSPOT ethInitConnection(InverterData *inverters[], char *IP_Address)
+E_SBFSPOT ethInitConnection(PlantRegistry &plant, char *IP_Address)
 {
     if (VERBOSE_NORMAL) puts("Initializing...");
 
@@ -1085,8 +1365,8 @@ E_SBFSPOT ethInitConnection(InverterData *inverters[], char *IP_Address)
     int devcount = 0;
     //for_each inverter found
     //{
-        inverters[devcount] = new InverterData;
-		resetInverterData(inverters[devcount]);
+        plant.add();
+        InverterData **inverters = plant.devices();
         // Store received IP address as readable text to InverterData struct
         // IP address is found at pos 38 in the buffer
         // Don't know yet for multiple inverter plants
@@ -1136,7 +1416,7 @@ E_SBFSPOT ethInitConnection(InverterData *inverters[], char *IP_Address)
 }
 
 // Initialise multiple ethernet connected inverters
-E_SBFSPOT ethInitConnectionMulti(InverterData *inverters[], std::vector<std::string> IPaddresslist)
+E_SBFSPOT ethInitConnectionMulti(PlantRegistry &plant, std::vector<std::string> IPaddresslist)
 {
     if (VERBOSE_NORMAL) puts("Initializing...");
 
@@ -1151,8 +1431,8 @@ E_SBFSPOT ethInitConnectionMulti(InverterData *inverters[], std::vector<std::str
 
     for (unsigned int devcount = 0; devcount < IPaddresslist.size(); devcount++)
 	{
-		inverters[devcount] = new InverterData;
-		resetInverterData(inverters[devcount]);
+		plant.add();
+		InverterData **inverters = plant.devices();
 		strcpy(inverters[devcount]->IPAddress, IPaddresslist[devcount].c_str());
         if (quiet == 0) printf("Inverter IP address: %s from SBFspot.cfg\n", inverters[devcount]->IPAddress);
 
@@ -1187,7 +1467,7 @@ E_SBFSPOT ethInitConnectionMulti(InverterData *inverters[], std::vector<std::str
     return rc;
 }
 
-E_SBFSPOT initialiseSMAConnection(const char *BTAddress, InverterData *inverters[], int MIS)
+E_SBFSPOT initialiseSMAConnection(const char *BTAddress, PlantRegistry &plant, int MIS)
 {
     if (VERBOSE_NORMAL) puts("Initializing...");
 
@@ -1208,15 +1488,14 @@ E_SBFSPOT initialiseSMAConnection(const char *BTAddress, InverterData *inverters
 	if (MIS == 0)
 	{
 		// Allocate memory for inverter data struct
-		inverters[0] = new InverterData;
-		resetInverterData(inverters[0]);
+		InverterData *inverter = plant.add();
 
 		// Copy previously converted BT address
 		for (int i=0; i<6; i++)
-			inverters[0]->BTAddress[i] = (unsigned char)tmp[i];
+			inverter->BTAddress[i] = (unsigned char)tmp[i];
 
 		// Call 2.0.6 init function
-		return initialiseSMAConnection(inverters[0]);
+		return initialiseSMAConnection(inverter);
 	}
 
     for (int i=0; i<6; i++)
@@ -1292,19 +1571,13 @@ E_SBFSPOT initialiseSMAConnection(const char *BTAddress, InverterData *inverters
         if (get_short(pcktBuf+ptr+6) == 0x0101) // Inverters only - Ignore other devices
         {
             if (DEBUG_NORMAL) printf("Inverter\n");
-            if (devcount < MAX_INVERTERS)
-            {
-                inverters[devcount] = new InverterData;
-				resetInverterData(inverters[devcount]);
-
-                for (int i=0; i<6; i++)
-                    inverters[devcount]->BTAddress[i] = pcktBuf[ptr+i];
+            InverterData *inverter = plant.add();
 
-                inverters[devcount]->NetID = NetID;
-                devcount++;
-            }
-            else if (DEBUG_HIGHEST) printf("MAX_INVERTERS limit (%d) reached.\n", MAX_INVERTERS);
+            for (int i=0; i<6; i++)
+                inverter->BTAddress[i] = pcktBuf[ptr+i];
 
+            inverter->NetID = NetID;
+            devcount++;
         }
         else if (DEBUG_NORMAL) printf(memcmp((unsigned char *)pcktBuf+ptr, LocalBTAddress, sizeof(LocalBTAddress)) == 0 ? "Local BT Address\n" : "Another device?\n");
     }
@@ -1404,22 +1677,14 @@ E_SBFSPOT initialiseSMAConnection(const char *BTAddress, InverterData *inverters
                 if (get_short(pcktBuf+ptr+6) == 0x0101) // Inverters only - Ignore other devices
                 {
                     if (DEBUG_NORMAL) printf("Inverter\n");
-                    if (devcount < MAX_INVERTERS)
-                    {
-                        if (!inverters[devcount]) // If not yet allocated, do it now
-						{
-                            inverters[devcount] = new InverterData;
-							resetInverterData(inverters[devcount]);
-						}
+                    // If not yet allocated, do it now
+                    InverterData *inverter = (devcount < plant.count()) ? plant[devcount] : plant.add();
 
-                        for (int i=0; i<6; i++)
-                            inverters[devcount]->BTAddress[i] = pcktBuf[ptr+i];
-
-                        inverters[devcount]->NetID = NetID;
-                        devcount++;
-                    }
-                    else if (DEBUG_HIGHEST) printf("MAX_INVERTERS limit (%d) reached.\n", MAX_INVERTERS);
+                    for (int i=0; i<6; i++)
+                        inverter->BTAddress[i] = pcktBuf[ptr+i];
 
+                    inverter->NetID = NetID;
+                    devcount++;
                 }
                 else if (DEBUG_NORMAL) printf(memcmp((unsigned char *)pcktBuf+ptr, LocalBTAddress, sizeof(LocalBTAddress)) == 0 ? "Local BT Address\n" : "Another device?\n");
             }
@@ -1435,23 +1700,24 @@ E_SBFSPOT initialiseSMAConnection(const char *BTAddress, InverterData *inverters
     }
 
     //Send broadcast request for identification
-    do
-    {
-        pcktID++;
-        writePacketHeader(pcktBuf, 0x01, addr_unknown);
-        writePacket(pcktBuf, 0x09, 0xA0, 0, anySUSyID, anySerial);
-        writeLong(pcktBuf, 0x00000200);
-        writeLong(pcktBuf, 0);
-        writeLong(pcktBuf, 0);
-        writePacketTrailer(pcktBuf);
-        writePacketLength(pcktBuf);
-    }
-    while (!isCrcValid(pcktBuf[packetposition-3], pcktBuf[packetposition-2]));
+    pcktID++;
+    writePacketHeader(pcktBuf, 0x01, addr_unknown);
+    writePacket(pcktBuf, 0x09, 0xA0, 0, anySUSyID, anySerial);
+    writeLong(pcktBuf, 0x00000200);
+    writeLong(pcktBuf, 0);
+    writeLong(pcktBuf, 0);
+    writePacketTrailer(pcktBuf);
+    writePacketLength(pcktBuf);
 
     bthSend(pcktBuf);
 
+    // BT addresses of the devices are known
+    plant.reindex();
+    InverterData **inverters = plant.devices();
+    const DeviceIndex &index = plant.index();
+
     //All inverters *should* reply with their SUSyID & SerialNr (and some other unknown info)
-    for (int idx=0; inverters[idx]!=NULL && idx<MAX_INVERTERS; idx++)
+    for (int idx=0; inverters[idx]!=NULL; idx++)
     {
         if (getPacket(addr_unknown, 0x01) != E_OK)
             return E_INIT;
@@ -1459,7 +1725,7 @@ E_SBFSPOT initialiseSMAConnection(const char *BTAddress, InverterData *inverters
         if (!validateChecksum())
             return E_CHKSUM;
 
-        int invindex = getInverterIndexByAddress(inverters, CommBuf + 4);
+        int invindex = index.byBTAddress(CommBuf + 4);
 
         if (invindex >= 0)
         {
@@ -1510,17 +1776,14 @@ E_SBFSPOT initialiseSMAConnection(InverterData *invData)
                LocalBTAddress[2], LocalBTAddress[1], LocalBTAddress[0]);
     }
 
-	do
-    {
-	    pcktID++;
-        writePacketHeader(pcktBuf, 0x01, addr_unknown);
-		writePacket(pcktBuf, 0x09, 0xA0, 0, anySUSyID, anySerial);
-		writeLong(pcktBuf, 0x00000200);
-        writeLong(pcktBuf, 0);
-        writeLong(pcktBuf, 0);
-        writePacketTrailer(pcktBuf);
-        writePacketLength(pcktBuf);
-	} while (!isCrcValid(pcktBuf[packetposition-3], pcktBuf[packetposition-2]));
+	pcktID++;
+    writePacketHeader(pcktBuf, 0x01, addr_unknown);
+	writePacket(pcktBuf, 0x09, 0xA0, 0, anySUSyID, anySerial);
+	writeLong(pcktBuf, 0x00000200);
+    writeLong(pcktBuf, 0);
+    writeLong(pcktBuf, 0);
+    writePacketTrailer(pcktBuf);
+    writePacketLength(pcktBuf);
 
 	bthSend(pcktBuf);
 
@@ -1538,7 +1801,7 @@ E_SBFSPOT initialiseSMAConnection(InverterData *invData)
     return E_OK;
 }
 
-E_SBFSPOT logonSMAInverter(InverterData *inverters[], long userGroup, char *password)
+E_SBFSPOT logonSMAInverter(InverterData *inverters[], const DeviceIndex &index, long userGroup, char *password)
 {
 #define MAX_PWLENGTH 12
     unsigned char pw[MAX_PWLENGTH] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
@@ -1560,29 +1823,25 @@ E_SBFSPOT logonSMAInverter(InverterData *inverters[], long userGroup, char *pass
 
     if (ConnType == CT_BLUETOOTH)
     {
-	    do
-		{
-			pcktID++;
-			now = time(NULL);
-			writePacketHeader(pcktBuf, 0x01, addr_unknown);
-			writePacket(pcktBuf, 0x0E, 0xA0, 0x0100, anySUSyID, anySerial);
-			writeLong(pcktBuf, 0xFFFD040C);
-			writeLong(pcktBuf, userGroup);	// User / Installer
-			writeLong(pcktBuf, 0x00000384); // Timeout = 900sec ?
-			writeLong(pcktBuf, now);
-			writeLong(pcktBuf, 0);
-			writeArray(pcktBuf, pw, sizeof(pw));
-			writePacketTrailer(pcktBuf);
-			writePacketLength(pcktBuf);
-		}
-		while (!isCrcValid(pcktBuf[packetposition-3], pcktBuf[packetposition-2]));
+		pcktID++;
+		now = time(NULL);
+		writePacketHeader(pcktBuf, 0x01, addr_unknown);
+		writePacket(pcktBuf, 0x0E, 0xA0, 0x0100, anySUSyID, anySerial);
+		writeLong(pcktBuf, 0xFFFD040C);
+		writeLong(pcktBuf, userGroup);	// User / Installer
+		writeLong(pcktBuf, 0x00000384); // Timeout = 900sec ?
+		writeLong(pcktBuf, now);
+		writeLong(pcktBuf, 0);
+		writeArray(pcktBuf, pw, sizeof(pw));
+		writePacketTrailer(pcktBuf);
+		writePacketLength(pcktBuf);
 
 		bthSend(pcktBuf);
 
         do	//while (validPcktID == 0);
         {
             // In a multi inverter plant we get a reply from all inverters
-            for (int i=0; inverters[i]!=NULL && i<MAX_INVERTERS; i++)
+            for (int i=0; inverters[i]!=NULL; i++)
             {
                 if ((rc  = getPacket(addr_unknown, 1)) != E_OK)
                     return rc;
@@ -1594,7 +1853,7 @@ E_SBFSPOT logonSMAInverter(InverterData *inverters[], long userGroup, char *pass
 	                unsigned short rcvpcktID = get_short(pcktBuf+27) & 0x7FFF;
                     if ((pcktID == rcvpcktID) && (get_long(pcktBuf + 41) == now))
                     {
-                        int ii = getInverterIndexByAddress(inverters, CommBuf + 4);
+                        int ii = index.byBTAddress(CommBuf + 4);
                         if (ii >= 0 )
                         {
                             inverters[ii]->SUSyID = get_short(pcktBuf + 15);
@@ -1621,28 +1880,24 @@ E_SBFSPOT logonSMAInverter(InverterData *inverters[], long userGroup, char *pass
     }
     else    // CT_ETHERNET
     {
-		for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
+		for (int inv=0; inverters[inv]!=NULL; inv++)
 		{
-			do
-			{
-				pcktID++;
-				now = time(NULL);
-				writePacketHeader(pcktBuf, 0x01, addr_unknown);
-				if (inverters[inv]->SUSyID != SID_SB240)
-					writePacket(pcktBuf, 0x0E, 0xA0, 0x0100, inverters[inv]->SUSyID, inverters[inv]->Serial);
-				else
-					writePacket(pcktBuf, 0x0E, 0xE0, 0x0100, inverters[inv]->SUSyID, inverters[inv]->Serial);
-
-				writeLong(pcktBuf, 0xFFFD040C);
-				writeLong(pcktBuf, userGroup);	// User / Installer
-				writeLong(pcktBuf, 0x00000384); // Timeout = 900sec ?
-				writeLong(pcktBuf, now);
-				writeLong(pcktBuf, 0);
-				writeArray(pcktBuf, pw, sizeof(pw));
-				writePacketTrailer(pcktBuf);
-				writePacketLength(pcktBuf);
-			}
-			while (!isCrcValid(pcktBuf[packetposition-3], pcktBuf[packetposition-2]));
+			pcktID++;
+			now = time(NULL);
+			writePacketHeader(pcktBuf, 0x01, addr_unknown);
+			if (inverters[inv]->SUSyID != SID_SB240)
+				writePacket(pcktBuf, 0x0E, 0xA0, 0x0100, inverters[inv]->SUSyID, inverters[inv]->Serial);
+			else
+				writePacket(pcktBuf, 0x0E, 0xE0, 0x0100, inverters[inv]->SUSyID, inverters[inv]->Serial);
+
+			writeLong(pcktBuf, 0xFFFD040C);
+			writeLong(pcktBuf, userGroup);	// User / Installer
+			writeLong(pcktBuf, 0x00000384); // Timeout = 900sec ?
+			writeLong(pcktBuf, now);
+			writeLong(pcktBuf, 0);
+			writeArray(pcktBuf, pw, sizeof(pw));
+			writePacketTrailer(pcktBuf);
+			writePacketLength(pcktBuf);
 
 			ethSend(pcktBuf, inverters[inv]->IPAddress);
 
@@ -1676,17 +1931,13 @@ E_SBFSPOT logonSMAInverter(InverterData *inverters[], long userGroup, char *pass
 E_SBFSPOT logoffSMAInverter(InverterData *inverter)
 {
     if (DEBUG_NORMAL) puts("logoffSMAInverter()");
-    do
-    {
-        pcktID++;
-        writePacketHeader(pcktBuf, 0x01, addr_unknown);
-        writePacket(pcktBuf, 0x08, 0xA0, 0x0300, anySUSyID, anySerial);
-        writeLong(pcktBuf, 0xFFFD010E);
-        writeLong(pcktBuf, 0xFFFFFFFF);
-        writePacketTrailer(pcktBuf);
-        writePacketLength(pcktBuf);
-    }
-    while (!isCrcValid(pcktBuf[packetposition-3], pcktBuf[packetposition-2]));
+    pcktID++;
+    writePacketHeader(pcktBuf, 0x01, addr_unknown);
+    writePacket(pcktBuf, 0x08, 0xA0, 0x0300, anySUSyID, anySerial);
+    writeLong(pcktBuf, 0xFFFD010E);
+    writeLong(pcktBuf, 0xFFFFFFFF);
+    writePacketTrailer(pcktBuf);
+    writePacketLength(pcktBuf);
 
     if(ConnType == CT_BLUETOOTH)
         bthSend(pcktBuf);
@@ -1705,25 +1956,21 @@ E_SBFSPOT SetPlantTime(time_t ndays, time_t lowerlimit, time_t upperlimit)
     if (DEBUG_NORMAL)
 		std::cout <<"SetPlantTime()" << std::endl;
 
-    do
-    {
-        pcktID++;
-        writePacketHeader(pcktBuf, 0x01, addr_unknown);
-        writePacket(pcktBuf, 0x10, 0xA0, 0, anySUSyID, anySerial);
-        writeLong(pcktBuf, 0xF000020A);
-        writeLong(pcktBuf, 0x00236D00);
-        writeLong(pcktBuf, 0x00236D00);
-        writeLong(pcktBuf, 0x00236D00);
-        writeLong(pcktBuf, 0);
-        writeLong(pcktBuf, 0);
-        writeLong(pcktBuf, 0);
-        writeLong(pcktBuf, 0);
-        writeLong(pcktBuf, 1);
-        writeLong(pcktBuf, 1);
-        writePacketTrailer(pcktBuf);
-        writePacketLength(pcktBuf);
-    }
-    while (!isCrcValid(pcktBuf[packetposition-3], pcktBuf[packetposition-2]));
+    pcktID++;
+    writePacketHeader(pcktBuf, 0x01, addr_unknown);
+    writePacket(pcktBuf, 0x10, 0xA0, 0, anySUSyID, anySerial);
+    writeLong(pcktBuf, 0xF000020A);
+    writeLong(pcktBuf, 0x00236D00);
+    writeLong(pcktBuf, 0x00236D00);
+    writeLong(pcktBuf, 0x00236D00);
+    writeLong(pcktBuf, 0);
+    writeLong(pcktBuf, 0);
+    writeLong(pcktBuf, 0);
+    writeLong(pcktBuf, 0);
+    writeLong(pcktBuf, 1);
+    writeLong(pcktBuf, 1);
+    writePacketTrailer(pcktBuf);
+    writePacketLength(pcktBuf);
 
     bthSend(pcktBuf);
 
@@ -1809,27 +2056,23 @@ E_SBFSPOT SetPlantTime(time_t ndays, time_t lowerlimit, time_t upperlimit)
 			std::cout << "Adjusting plant time..." << std:: endl;
 		}
 
-		do
-		{
-			pcktID++;
-			writePacketHeader(pcktBuf, 0x01, addr_unknown);
-			writePacket(pcktBuf, 0x10, 0xA0, 0, anySUSyID, anySerial);
-			writeLong(pcktBuf, 0xF000020A);
-			writeLong(pcktBuf, 0x00236D00);
-			writeLong(pcktBuf, 0x00236D00);
-			writeLong(pcktBuf, 0x00236D00);
-			// Get new host time
-			hosttime = time(NULL);
-			writeLong(pcktBuf, hosttime);
-			writeLong(pcktBuf, hosttime);
-			writeLong(pcktBuf, hosttime);
-			writeLong(pcktBuf, tz | dst);
-			writeLong(pcktBuf, ++magic);
-			writeLong(pcktBuf, 1);
-			writePacketTrailer(pcktBuf);
-			writePacketLength(pcktBuf);
-		}
-		while (!isCrcValid(pcktBuf[packetposition-3], pcktBuf[packetposition-2]));
+		pcktID++;
+		writePacketHeader(pcktBuf, 0x01, addr_unknown);
+		writePacket(pcktBuf, 0x10, 0xA0, 0, anySUSyID, anySerial);
+		writeLong(pcktBuf, 0xF000020A);
+		writeLong(pcktBuf, 0x00236D00);
+		writeLong(pcktBuf, 0x00236D00);
+		writeLong(pcktBuf, 0x00236D00);
+		// Get new host time
+		hosttime = time(NULL);
+		writeLong(pcktBuf, hosttime);
+		writeLong(pcktBuf, hosttime);
+		writeLong(pcktBuf, hosttime);
+		writeLong(pcktBuf, tz | dst);
+		writeLong(pcktBuf, ++magic);
+		writeLong(pcktBuf, 1);
+		writePacketTrailer(pcktBuf);
+		writePacketLength(pcktBuf);
 
 		bthSend(pcktBuf);
 		// No response expected
@@ -1872,6 +2115,9 @@ int parseCmdline(int argc, char **argv, Config *cfg)
 	cfg->startdate = 0;
 	cfg->settime = 0;
 	cfg->mqtt = 0;
+	cfg->daemon = 0;
+	cfg->archSync = 0;
+	cfg->capture = CAP_NONE;
 
 	bool help_requested = false;
 
@@ -1972,6 +2218,10 @@ int parseCmdline(int argc, char **argv, Config *cfg)
 
 		}
 
+		// Before -d (debug level)
+		else if (stricmp(argv[i], "-daemon") == 0)
+			cfg->daemon = 1;
+
         //Set debug level
         else if(strnicmp(argv[i], "-d", 2) == 0)
         {
@@ -2127,6 +2377,20 @@ int parseCmdline(int argc, char **argv, Config *cfg)
 		else if (stricmp(argv[i], "-mqtt") == 0)
 			cfg->mqtt = 1;
 
+		else if (stricmp(argv[i], "-sync") == 0)
+			cfg->archSync = 1;
+
+		else if ((strnicmp(argv[i], "-record:", 8) == 0) || (strnicmp(argv[i], "-replay:", 8) == 0))
+		{
+			if (strlen(argv[i]) == 8)
+			{
+				InvalidArg(argv[i]);
+				return -1;
+			}
+			cfg->capture = (strnicmp(argv[i], "-record:", 8) == 0) ? CAP_RECORD : CAP_REPLAY;
+			cfg->captureFile = argv[i] + 8;
+		}
+
         //Show Help
         else if (stricmp(argv[i], "-?") == 0)
         {
@@ -2206,7 +2470,11 @@ void SayHello(int ShowHelp)
 		std::cout << " -loadlive           Use predefined settings for manual upload to pvoutput.org\n";
 		std::cout << " -startdate:YYYYMMDD Set start date for historic data retrieval\n";
 		std::cout << " -settime            Sync inverter time with host time\n";
-		std::cout << " -mqtt               Publish spot data to MQTT broker\n" << std::endl;
+		std::cout << " -mqtt               Publish spot data to MQTT broker\n";
+		std::cout << " -daemon             Keep running and poll the plant every DaemonInterval seconds\n";
+		std::cout << " -sync               Only get archived data newer than stored in the database\n";
+		std::cout << " -record:file        Record all Speedwire packets to file\n";
+		std::cout << " -replay:file        Replay recorded Speedwire packets from file (no network)\n" << std::endl;
 
 		std::cout << "Libraries used:\n";
 #if defined(USE_SQLITE)
@@ -2271,6 +2539,9 @@ int GetConfig(Config *cfg)
     cfg->CSV_ExtendedHeader = 1;
     cfg->CSV_Header = 1;
     cfg->CSV_SaveZeroPower = 1;
+    cfg->CSV_Sync = 0;
+    cfg->CSV_DayDataFile = 0;
+    cfg->Column_Export = 0;
     cfg->SunRSOffset = 900;
     cfg->SpotTimeSource = 0;
     cfg->SpotWebboxHeader = 0;
@@ -2278,6 +2549,12 @@ int GetConfig(Config *cfg)
 	strcpy(cfg->locale, "en-US");
 	cfg->synchTimeLow = 1;
 	cfg->synchTimeHigh = 3600;
+	cfg->daemonInterval = 60;
+	cfg->isLight = 1;	// Without Latitude/Longitude, it's never dark
+	cfg->httpPort = 0;
+	cfg->httpAddress = "";
+	cfg->archConcurrency = 1;
+	cfg->sqlRetentionDays = 0;
 	// MQTT default values
 	cfg->mqtt_host = "localhost";
 	cfg->mqtt_port = ""; // mosquitto: 1883/8883 for TLS
@@ -2494,7 +2771,39 @@ int GetConfig(Config *cfg)
                 {
                     lValue = strtol(value, &pEnd, 10);
                     if (((lValue == 0) || (lValue == 1)) && (*pEnd == 0))
-                        cfg->CSV_SaveZeroPower = (int)lValue;
+                        cfg->CSV_SaveZeroPower = (int)lValue;
+                    else
+                    {
+                        fprintf(stderr, CFG_InvalidValue, variable, CFG_Boolean);
+                        rc = -2;
+                    }
+                }
+				else if(stricmp(variable, "CSV_Sync") == 0)
+                {
+                    lValue = strtol(value, &pEnd, 10);
+                    if (((lValue == 0) || (lValue == 1)) && (*pEnd == 0))
+                        cfg->CSV_Sync = (int)lValue;
+                    else
+                    {
+                        fprintf(stderr, CFG_InvalidValue, variable, CFG_Boolean);
+                        rc = -2;
+                    }
+                }
+				else if(stricmp(variable, "CSV_DayDataFile") == 0)
+                {
+					if (stricmp(value, "Day") == 0) cfg->CSV_DayDataFile = 0;
+					else if (stricmp(value, "Month") == 0) cfg->CSV_DayDataFile = 1;
+                    else
+                    {
+                        fprintf(stderr, CFG_InvalidValue, variable, "Day|Month");
+                        rc = -2;
+                    }
+                }
+				else if(stricmp(variable, "Column_Export") == 0)
+                {
+                    lValue = strtol(value, &pEnd, 10);
+                    if (((lValue == 0) || (lValue == 1)) && (*pEnd == 0))
+                        cfg->Column_Export = (int)lValue;
                     else
                     {
                         fprintf(stderr, CFG_InvalidValue, variable, CFG_Boolean);
@@ -2572,6 +2881,41 @@ int GetConfig(Config *cfg)
                         rc = -2;
                     }
                 }
+				else if(stricmp(variable, "DaemonInterval") == 0)
+                {
+                    lValue = strtol(value, &pEnd, 10);
+                    if ((lValue >= 5) && (lValue <= 3600) && (*pEnd == 0))
+						cfg->daemonInterval = (int)lValue;
+                    else
+                    {
+                        fprintf(stderr, CFG_InvalidValue, variable, "(5-3600)");
+                        rc = -2;
+                    }
+                }
+				else if(stricmp(variable, "ArchiveConcurrency") == 0)
+                {
+                    lValue = strtol(value, &pEnd, 10);
+                    if ((lValue >= 1) && (lValue <= 8) && (*pEnd == 0))
+						cfg->archConcurrency = (int)lValue;
+                    else
+                    {
+                        fprintf(stderr, CFG_InvalidValue, variable, "(1-8)");
+                        rc = -2;
+                    }
+                }
+				else if(stricmp(variable, "HTTP_Port") == 0)
+                {
+                    lValue = strtol(value, &pEnd, 10);
+                    if ((lValue >= 0) && (lValue <= 65535) && (*pEnd == 0))
+						cfg->httpPort = (int)lValue;
+                    else
+                    {
+                        fprintf(stderr, CFG_InvalidValue, variable, "(0-65535)");
+                        rc = -2;
+                    }
+                }
+				else if(stricmp(variable, "HTTP_Address") == 0)
+					cfg->httpAddress = value;
 				else if(stricmp(variable, "Timezone") == 0)
 				{
 					cfg->timezone = value;
@@ -2601,6 +2945,21 @@ int GetConfig(Config *cfg)
 
 				else if(stricmp(variable, "SQL_Database") == 0)
 					cfg->sqlDatabase = value;
+				else if(stricmp(variable, "SQL_RetentionDays") == 0)
+                {
+                    lValue = strtol(value, &pEnd, 10);
+                    if ((lValue >= 0) && (lValue <= 36500) && (*pEnd == 0))
+						cfg->sqlRetentionDays = (int)lValue;
+                    else
+                    {
+                        fprintf(stderr, CFG_InvalidValue, variable, "(0-36500)");
+                        rc = -2;
+                    }
+                }
+#if defined(USE_SQLITE)
+				else if(stricmp(variable, "SQL_Archive") == 0)
+					cfg->sqlArchive = value;
+#endif
 #if defined(USE_MYSQL)
 				else if(stricmp(variable, "SQL_Hostname") == 0)
 					cfg->sqlHostname = value;
@@ -2713,6 +3072,13 @@ int GetConfig(Config *cfg)
 		cfg->nospot = 1;
 	}
 
+	// The rows of a day are found back by their date when the month file is updated
+	if ((cfg->CSV_DayDataFile == 1) && !CSVparsableDateTime(cfg->DateTimeFormat))
+	{
+		fprintf(stderr, "CSV_DayDataFile=Month needs a DateTimeFormat with the day, month and year, using only %%d %%m %%Y %%y %%H %%M %%S (DateTimeFormat=%s)\n", cfg->DateTimeFormat);
+		rc = -2;
+	}
+
 	// If 1st day of the month and -am1 specified, force to -am2 to get last day of prev month
 	if (cfg->archMonths == 1)
 	{
@@ -2757,13 +3123,23 @@ void ShowConfig(Config *cfg)
 		"\nCSV_ExtendedHeader=" << cfg->CSV_ExtendedHeader << \
 		"\nCSV_Header=" << cfg->CSV_Header << \
 		"\nCSV_SaveZeroPower=" << cfg->CSV_SaveZeroPower << \
+		"\nCSV_Sync=" << cfg->CSV_Sync << \
+		"\nCSV_DayDataFile=" << (cfg->CSV_DayDataFile == 0 ? "Day" : "Month") << \
+		"\nColumn_Export=" << cfg->Column_Export << \
 		"\nCSV_Spot_TimeSource=" << cfg->SpotTimeSource << \
 		"\nCSV_Spot_WebboxHeader=" << cfg->SpotWebboxHeader << \
 		"\nLocale=" << cfg->locale << \
-		"\nBTConnectRetries=" << cfg->BT_ConnectRetries << std::endl;
+		"\nBTConnectRetries=" << cfg->BT_ConnectRetries << \
+		"\nDaemonInterval=" << cfg->daemonInterval << \
+		"\nArchiveConcurrency=" << cfg->archConcurrency << std::endl;
 
 #if defined(USE_MYSQL) || defined(USE_SQLITE)
-	std::cout << "SQL_Database=" << cfg->sqlDatabase << std::endl;
+	std::cout << "SQL_Database=" << cfg->sqlDatabase << \
+		"\nSQL_RetentionDays=" << cfg->sqlRetentionDays << std::endl;
+#endif
+
+#if defined(USE_SQLITE)
+	std::cout << "SQL_Archive=" << cfg->sqlArchive << std::endl;
 #endif
 
 #if defined(USE_MYSQL)
@@ -2783,6 +3159,12 @@ void ShowConfig(Config *cfg)
 			"\nMQTT_ItemFormat=" << cfg->mqtt_item_format << std::endl;
 	}
 
+	if (cfg->httpPort > 0)
+	{
+		std::cout << "HTTP_Port=" << cfg->httpPort << \
+			"\nHTTP_Address=" << cfg->httpAddress << std::endl;
+	}
+
 	std::cout << "### End of Config ###" << std::endl;
 }
 
@@ -2826,585 +3208,543 @@ int isValidSender(unsigned char senderaddr[6], unsigned char address[6])
     return 1;
 }
 
-int getInverterData(InverterData *devList[], enum getInverterDataType type)
+/*
+ * LRI decoder table
+ * Each entry tells decodeInverterData() where a record goes in InverterData and how to print it
+ * To support a new LRI, add it here (keep the table sorted on lri)
+ * Entries of the same LRI are tried in order, cls 0 matches any class
+ */
+enum LriField
+{
+    LF_LONG,        // DWORD -> long
+    LF_ULONG,       // DWORD -> unsigned long
+    LF_INT32,       // DWORD -> int32_t
+    LF_LONGLONG,    // QWORD -> long long
+    LF_NAME,        // TEXT -> DeviceName
+    LF_SWVER,       // Software package -> SWVersion
+    LF_ATTRIB,      // STATUS attribute -> int
+    LF_ATTRDESC,    // STATUS attribute -> description (char[64])
+    LF_CLASS,       // STATUS attribute -> DevClass + description (char[64])
+    LF_NONE         // Known record, not stored
+};
+
+#define NO_FIELD ((size_t)-1)
+
+typedef struct
 {
-    if (DEBUG_NORMAL) printf("getInverterData(%d)\n", type);
-    const char *strWatt = "%-12s: %ld (W) %s";
-    const char *strVolt = "%-12s: %.2f (V) %s";
-    const char *strAmp = "%-12s: %.3f (A) %s";
-    const char *strkWh = "%-12s: %.3f (kWh) %s";
-    const char *strHour = "%-12s: %.3f (h) %s";
+    uint32_t lri;
+    uint32_t cls;           // 0 = any class
+    int recordsize;
+    LriField field;
+    size_t offset;          // Target member in InverterData
+    size_t timestamp;       // Member receiving the record timestamp or NO_FIELD
+    const char *name;       // For debug output (NULL = no output)
+    const char *unit;
+    double divisor;
+    int decimals;
+} LriDecoder;
+
+#define IDOFS(member) offsetof(InverterData, member)
+
+static const LriDecoder lriDecoders[] =
+{
+    { OperationHealth,          0, 40, LF_ATTRIB,   IDOFS(DeviceStatus),          NO_FIELD,                 "INV_STATUS",    "",    1,    0 },
+    { CoolsysTmpNom,            0, 28, LF_LONG,     IDOFS(Temperature),           NO_FIELD,                 NULL,            "",    1,    0 },
+    { DcMsWatt,                 1, 28, LF_LONG,     IDOFS(Pdc1),                  NO_FIELD,                 "SPOT_PDC1",     "W",   1,    0 },
+    { DcMsWatt,                 2, 28, LF_LONG,     IDOFS(Pdc2),                  NO_FIELD,                 "SPOT_PDC2",     "W",   1,    0 },
+    { DcMsWatt,                 0, 28, LF_NONE,     NO_FIELD,                     NO_FIELD,                 NULL,            "",    1,    0 },
+    { MeteringTotWhOut,         0, 16, LF_LONGLONG, IDOFS(ETotal),                IDOFS(InverterDatetime),  "SPOT_ETOTAL",   "kWh", 1000, 3 },
+    { MeteringDyWhOut,          0, 16, LF_LONGLONG, IDOFS(EToday),                IDOFS(InverterDatetime),  "SPOT_ETODAY",   "kWh", 1000, 3 },
+    { GridMsTotW,               0, 28, LF_LONG,     IDOFS(TotalPac),              IDOFS(SleepTime),         "SPOT_PACTOT",   "W",   1,    0 },
+    { BatChaStt,                0, 28, LF_ULONG,    IDOFS(BatChaStt),             NO_FIELD,                 NULL,            "",    1,    0 },
+    { OperationHealthSttOk,     0, 28, LF_LONG,     IDOFS(Pmax1),                 NO_FIELD,                 "INV_PACMAX1",   "W",   1,    0 },
+    { OperationHealthSttWrn,    0, 28, LF_LONG,     IDOFS(Pmax2),                 NO_FIELD,                 "INV_PACMAX2",   "W",   1,    0 },
+    { OperationHealthSttAlm,    0, 28, LF_LONG,     IDOFS(Pmax3),                 NO_FIELD,                 "INV_PACMAX3",   "W",   1,    0 },
+    { OperationGriSwStt,        0, 40, LF_ATTRIB,   IDOFS(GridRelayStatus),       NO_FIELD,                 "INV_GRIDRELAY", "",    1,    0 },
+    { DcMsVol,                  1, 28, LF_LONG,     IDOFS(Udc1),                  NO_FIELD,                 "SPOT_UDC1",     "V",   100,  2 },
+    { DcMsVol,                  2, 28, LF_LONG,     IDOFS(Udc2),                  NO_FIELD,                 "SPOT_UDC2",     "V",   100,  2 },
+    { DcMsVol,                  0, 28, LF_NONE,     NO_FIELD,                     NO_FIELD,                 NULL,            "",    1,    0 },
+    { DcMsAmp,                  1, 28, LF_LONG,     IDOFS(Idc1),                  NO_FIELD,                 "SPOT_IDC1",     "A",   1000, 3 },
+    { DcMsAmp,                  2, 28, LF_LONG,     IDOFS(Idc2),                  NO_FIELD,                 "SPOT_IDC2",     "A",   1000, 3 },
+    { DcMsAmp,                  0, 28, LF_NONE,     NO_FIELD,                     NO_FIELD,                 NULL,            "",    1,    0 },
+    { MeteringGridMsTotWhOut,   0, 28, LF_INT32,    IDOFS(MeteringGridMsTotWOut), NO_FIELD,                 NULL,            "",    1,    0 },
+    { MeteringGridMsTotWhIn,    0, 28, LF_INT32,    IDOFS(MeteringGridMsTotWIn),  NO_FIELD,                 NULL,            "",    1,    0 },
+    { MeteringTotOpTms,         0, 16, LF_LONGLONG, IDOFS(OperationTime),         NO_FIELD,                 "SPOT_OPERTM",   "h",   3600, 3 },
+    { MeteringTotFeedTms,       0, 16, LF_LONGLONG, IDOFS(FeedInTime),            NO_FIELD,                 "SPOT_FEEDTM",   "h",   3600, 3 },
+    { GridMsWphsA,              0, 28, LF_LONG,     IDOFS(Pac1),                  NO_FIELD,                 "SPOT_PAC1",     "W",   1,    0 },
+    { GridMsWphsB,              0, 28, LF_LONG,     IDOFS(Pac2),                  NO_FIELD,                 "SPOT_PAC2",     "W",   1,    0 },
+    { GridMsWphsC,              0, 28, LF_LONG,     IDOFS(Pac3),                  NO_FIELD,                 "SPOT_PAC3",     "W",   1,    0 },
+    { GridMsPhVphsA,            0, 28, LF_LONG,     IDOFS(Uac1),                  NO_FIELD,                 "SPOT_UAC1",     "V",   100,  2 },
+    { GridMsPhVphsB,            0, 28, LF_LONG,     IDOFS(Uac2),                  NO_FIELD,                 "SPOT_UAC2",     "V",   100,  2 },
+    { GridMsPhVphsC,            0, 28, LF_LONG,     IDOFS(Uac3),                  NO_FIELD,                 "SPOT_UAC3",     "V",   100,  2 },
+    { GridMsAphsA_1,            0, 28, LF_LONG,     IDOFS(Iac1),                  NO_FIELD,                 "SPOT_IAC1",     "A",   1000, 3 },
+    { GridMsAphsB_1,            0, 28, LF_LONG,     IDOFS(Iac2),                  NO_FIELD,                 "SPOT_IAC2",     "A",   1000, 3 },
+    { GridMsAphsC_1,            0, 28, LF_LONG,     IDOFS(Iac3),                  NO_FIELD,                 "SPOT_IAC3",     "A",   1000, 3 },
+    { GridMsAphsA,              0, 28, LF_LONG,     IDOFS(Iac1),                  NO_FIELD,                 "SPOT_IAC1",     "A",   1000, 3 },
+    { GridMsAphsB,              0, 28, LF_LONG,     IDOFS(Iac2),                  NO_FIELD,                 "SPOT_IAC2",     "A",   1000, 3 },
+    { GridMsAphsC,              0, 28, LF_LONG,     IDOFS(Iac3),                  NO_FIELD,                 "SPOT_IAC3",     "A",   1000, 3 },
+    { GridMsHz,                 0, 28, LF_LONG,     IDOFS(GridFreq),              NO_FIELD,                 "SPOT_FREQ",     "Hz",  100,  2 },
+    { BatDiagCapacThrpCnt,      0, 28, LF_ULONG,    IDOFS(BatDiagCapacThrpCnt),   NO_FIELD,                 NULL,            "",    1,    0 },
+    { BatDiagTotAhIn,           0, 28, LF_ULONG,    IDOFS(BatDiagTotAhIn),        NO_FIELD,                 NULL,            "",    1,    0 },
+    { BatDiagTotAhOut,          0, 28, LF_ULONG,    IDOFS(BatDiagTotAhOut),       NO_FIELD,                 NULL,            "",    1,    0 },
+    { BatTmpVal,                0, 28, LF_ULONG,    IDOFS(BatTmpVal),             NO_FIELD,                 NULL,            "",    1,    0 },
+    { BatVol,                   0, 28, LF_ULONG,    IDOFS(BatVol),                NO_FIELD,                 NULL,            "",    1,    0 },
+    { BatAmp,                   0, 28, LF_LONG,     IDOFS(BatAmp),                NO_FIELD,                 NULL,            "",    1,    0 },
+    { NameplateLocation,        0, 40, LF_NAME,     IDOFS(DeviceName),            IDOFS(WakeupTime),        "INV_NAME",      "",    1,    0 },
+    { NameplateMainModel,       0, 40, LF_CLASS,    IDOFS(DeviceClass),           NO_FIELD,                 "INV_CLASS",     "",    1,    0 },
+    { NameplateModel,           0, 40, LF_ATTRDESC, IDOFS(DeviceType),            NO_FIELD,                 "INV_TYPE",      "",    1,    0 },
+    { NameplatePkgRev,          0, 40, LF_SWVER,    IDOFS(SWVersion),             NO_FIELD,                 "INV_SWVER",     "",    1,    0 }
+};
+
+static const int lriDecoderCount = sizeof(lriDecoders) / sizeof(lriDecoders[0]);
+
+// Binary search on lri/cls, returns NULL if the LRI is unknown
+static const LriDecoder *findLriDecoder(uint32_t lri, uint32_t cls)
+{
+    int lo = 0;
+    int hi = lriDecoderCount - 1;
 
-    int rc = E_OK;
+    while (lo <= hi)
+    {
+        int mid = (lo + hi) / 2;
+        const LriDecoder *dec = &lriDecoders[mid];
+        if (dec->lri < lri)
+            lo = mid + 1;
+        else if (dec->lri > lri)
+            hi = mid - 1;
+        else
+        {
+            // Found the LRI, now look for the class (entries of the same LRI are adjacent)
+            while ((mid > 0) && (lriDecoders[mid - 1].lri == lri)) mid--;
+            for (; (mid < lriDecoderCount) && (lriDecoders[mid].lri == lri); mid++)
+            {
+                if ((lriDecoders[mid].cls == 0) || (lriDecoders[mid].cls == cls))
+                    return &lriDecoders[mid];
+            }
+            return NULL;
+        }
+    }
+
+    return NULL;
+}
 
+// Get the attribute with value 1 from a STATUS record (0 if none)
+static unsigned long getActiveAttribute(const BYTE *rec, int recordsize)
+{
+    unsigned long active = 0;
+
+    for (int idx = 8; idx < recordsize; idx += 4)
+    {
+        unsigned long attribute = ((unsigned long)get_long((BYTE *)rec + idx)) & 0x00FFFFFF;
+        unsigned char attValue = rec[idx + 3];
+        if (attribute == 0xFFFFFE) break;	//End of attributes
+        if (attValue == 1)
+            active = attribute;
+    }
+
+    return active;
+}
+
+void decodeInverterData(InverterData *devList[], int inv, unsigned long type)
+{
     int recordsize = 0;
-    int validPcktID = 0;
+    char *dev = (char *)devList[inv];
+
+    for (int ii = 41; ii < packetposition - 3; ii += recordsize)
+    {
+        uint32_t code = ((uint32_t)get_long(pcktBuf + ii));
+        uint32_t lri = code & 0x00FFFF00;
+        uint32_t cls = code & 0xFF;
+        time_t datetime = (time_t)get_long(pcktBuf + ii + 4);
+
+        const LriDecoder *dec = findLriDecoder(lri, cls);
+        if (dec == NULL)
+        {
+            if (recordsize == 0) recordsize = 12;
+            continue;
+        }
+
+        if (recordsize == 0) recordsize = dec->recordsize;
+
+        if (dec->timestamp != NO_FIELD)
+            *(time_t *)(dev + dec->timestamp) = datetime;
+
+        switch (dec->field)
+        {
+        case LF_LONG:
+        case LF_ULONG:
+        case LF_INT32:
+            {
+                int32_t value = (int32_t)get_long(pcktBuf + ii + 16);
+                if ((value == (int32_t)NaN_S32) || (value == (int32_t)NaN_U32)) value = 0;
+
+                if (dec->field == LF_LONG)
+                    *(long *)(dev + dec->offset) = value;
+                else if (dec->field == LF_ULONG)
+                    *(unsigned long *)(dev + dec->offset) = value;
+                else
+                    *(int32_t *)(dev + dec->offset) = value;
+
+                if (DEBUG_NORMAL && dec->name) printf("%-12s: %.*f (%s) %s", dec->name, dec->decimals, (double)value / dec->divisor, dec->unit, ctime(&datetime));
+            }
+            break;
+
+        case LF_LONGLONG:
+            {
+                int64_t value64 = get_longlong(pcktBuf + ii + 8);
+                if ((value64 == (int64_t)NaN_S64) || (value64 == (int64_t)NaN_U64)) value64 = 0;
+
+                *(long long *)(dev + dec->offset) = value64;
+
+                if (DEBUG_NORMAL && dec->name) printf("%-12s: %.*f (%s) %s", dec->name, dec->decimals, (double)value64 / dec->divisor, dec->unit, ctime(&datetime));
+            }
+            break;
+
+        case LF_NAME:
+            strncpy(dev + dec->offset, (char *)pcktBuf + ii + 8, sizeof(devList[inv]->DeviceName)-1);
+            if (DEBUG_NORMAL) printf("%-12s: '%s' %s", dec->name, dev + dec->offset, ctime(&datetime));
+            break;
+
+        case LF_SWVER:
+            {
+                unsigned char Vtype = pcktBuf[ii + 24];
+                char ReleaseType[4];
+                if (Vtype > 5)
+                    sprintf(ReleaseType, "%d", Vtype);
+                else
+                    sprintf(ReleaseType, "%c", "NEABRS"[Vtype]); //NOREV-EXPERIMENTAL-ALPHA-BETA-RELEASE-SPECIAL
+                unsigned char Vbuild = pcktBuf[ii + 25];
+                unsigned char Vminor = pcktBuf[ii + 26];
+                unsigned char Vmajor = pcktBuf[ii + 27];
+                //Vmajor and Vminor = 0x12 should be printed as '12' and not '18' (BCD)
+                snprintf(devList[inv]->SWVersion, sizeof(devList[inv]->SWVersion), "%c%c.%c%c.%02d.%s", '0'+(Vmajor >> 4), '0'+(Vmajor & 0x0F), '0'+(Vminor >> 4), '0'+(Vminor & 0x0F), Vbuild, ReleaseType);
+                if (DEBUG_NORMAL) printf("%-12s: '%s' %s", dec->name, devList[inv]->SWVersion, ctime(&datetime));
+            }
+            break;
+
+        case LF_ATTRIB:
+            {
+                unsigned long attribute = getActiveAttribute(pcktBuf + ii, recordsize);
+                if (attribute != 0)
+                    *(int *)(dev + dec->offset) = (int)attribute;
+                if (DEBUG_NORMAL) printf("%-12s: '%s' %s", dec->name, tagdefs.getDesc(*(int *)(dev + dec->offset), "?").c_str(), ctime(&datetime));
+            }
+            break;
+
+        case LF_NONE:
+            break;
+
+        case LF_ATTRDESC:
+        case LF_CLASS:
+            {
+                // DeviceType and DeviceClass are both char[64]
+                char *desc = dev + dec->offset;
+                const size_t descsize = sizeof(devList[inv]->DeviceType);
+                unsigned long attribute = getActiveAttribute(pcktBuf + ii, recordsize);
+                if (attribute != 0)
+                {
+                    if (dec->field == LF_CLASS)
+                        devList[inv]->DevClass = (DEVICECLASS)attribute;
 
-    unsigned long command;
-    unsigned long first;
-    unsigned long last;
+                    string description = tagdefs.getDesc(attribute);
+                    if (!description.empty())
+                    {
+                        memset(desc, 0, descsize);
+                        strncpy(desc, description.c_str(), descsize - 1);
+                    }
+                    else if (dec->field == LF_CLASS)
+                    {
+                        strncpy(desc, "UNKNOWN CLASS", descsize);
+                        printf("Unknown Device Class. Report this issue at https://github.com/SBFspot/SBFspot/issues with following info:\n");
+                        printf("0x%08lX and Device Class=...\n", attribute);
+                    }
+                    else
+                    {
+                        strncpy(desc, "UNKNOWN TYPE", descsize);
+                        printf("Unknown Inverter Type. Report this issue at https://github.com/SBFspot/SBFspot/issues with following info:\n");
+                        printf("0x%08lX and Inverter Type=<Fill in the exact type> (e.g. SB1300TL-10)\n", attribute);
+                    }
+                }
+                if (DEBUG_NORMAL) printf("%-12s: '%s' %s", dec->name, desc, ctime(&datetime));
+            }
+            break;
+        }
+
+        devList[inv]->flags |= type;
+    }
+}
+
+/*
+ * Get the request (command and LRI range) for a getInverterDataType
+ */
+int getInverterQuery(enum getInverterDataType type, InverterQuery &query)
+{
+    query.types = type;
 
     switch(type)
     {
     case EnergyProduction:
         // SPOT_ETODAY, SPOT_ETOTAL
-        command = 0x54000200;
-        first = 0x00260100;
-        last = 0x002622FF;
+        query.command = 0x54000200;
+        query.first = 0x00260100;
+        query.last = 0x002622FF;
         break;
 
     case SpotDCPower:
         // SPOT_PDC1, SPOT_PDC2
-        command = 0x53800200;
-        first = 0x00251E00;
-        last = 0x00251EFF;
+        query.command = 0x53800200;
+        query.first = 0x00251E00;
+        query.last = 0x00251EFF;
         break;
 
     case SpotDCVoltage:
         // SPOT_UDC1, SPOT_UDC2, SPOT_IDC1, SPOT_IDC2
-        command = 0x53800200;
-        first = 0x00451F00;
-        last = 0x004521FF;
+        query.command = 0x53800200;
+        query.first = 0x00451F00;
+        query.last = 0x004521FF;
         break;
 
     case SpotACPower:
         // SPOT_PAC1, SPOT_PAC2, SPOT_PAC3
-        command = 0x51000200;
-        first = 0x00464000;
-        last = 0x004642FF;
+        query.command = 0x51000200;
+        query.first = 0x00464000;
+        query.last = 0x004642FF;
         break;
 
     case SpotACVoltage:
         // SPOT_UAC1, SPOT_UAC2, SPOT_UAC3, SPOT_IAC1, SPOT_IAC2, SPOT_IAC3
-        command = 0x51000200;
-        first = 0x00464800;
-        last = 0x004655FF;
+        query.command = 0x51000200;
+        query.first = 0x00464800;
+        query.last = 0x004655FF;
         break;
 
     case SpotGridFrequency:
         // SPOT_FREQ
-        command = 0x51000200;
-        first = 0x00465700;
-        last = 0x004657FF;
+        query.command = 0x51000200;
+        query.first = 0x00465700;
+        query.last = 0x004657FF;
         break;
 
     case MaxACPower:
         // INV_PACMAX1, INV_PACMAX2, INV_PACMAX3
-        command = 0x51000200;
-        first = 0x00411E00;
-        last = 0x004120FF;
+        query.command = 0x51000200;
+        query.first = 0x00411E00;
+        query.last = 0x004120FF;
         break;
 
     case MaxACPower2:
         // INV_PACMAX1_2
-        command = 0x51000200;
-        first = 0x00832A00;
-        last = 0x00832AFF;
+        query.command = 0x51000200;
+        query.first = 0x00832A00;
+        query.last = 0x00832AFF;
         break;
 
     case SpotACTotalPower:
         // SPOT_PACTOT
-        command = 0x51000200;
-        first = 0x00263F00;
-        last = 0x00263FFF;
+        query.command = 0x51000200;
+        query.first = 0x00263F00;
+        query.last = 0x00263FFF;
         break;
 
     case TypeLabel:
         // INV_NAME, INV_TYPE, INV_CLASS
-        command = 0x58000200;
-        first = 0x00821E00;
-        last = 0x008220FF;
+        query.command = 0x58000200;
+        query.first = 0x00821E00;
+        query.last = 0x008220FF;
         break;
 
     case SoftwareVersion:
         // INV_SWVERSION
-        command = 0x58000200;
-        first = 0x00823400;
-        last = 0x008234FF;
+        query.command = 0x58000200;
+        query.first = 0x00823400;
+        query.last = 0x008234FF;
         break;
 
     case DeviceStatus:
         // INV_STATUS
-        command = 0x51800200;
-        first = 0x00214800;
-        last = 0x002148FF;
+        query.command = 0x51800200;
+        query.first = 0x00214800;
+        query.last = 0x002148FF;
         break;
 
     case GridRelayStatus:
         // INV_GRIDRELAY
-        command = 0x51800200;
-        first = 0x00416400;
-        last = 0x004164FF;
+        query.command = 0x51800200;
+        query.first = 0x00416400;
+        query.last = 0x004164FF;
         break;
 
     case OperationTime:
         // SPOT_OPERTM, SPOT_FEEDTM
-        command = 0x54000200;
-        first = 0x00462E00;
-        last = 0x00462FFF;
+        query.command = 0x54000200;
+        query.first = 0x00462E00;
+        query.last = 0x00462FFF;
         break;
 
     case BatteryChargeStatus:
-        command = 0x51000200;
-        first = 0x00295A00;
-        last = 0x00295AFF;
+        query.command = 0x51000200;
+        query.first = 0x00295A00;
+        query.last = 0x00295AFF;
         break;
 
     case BatteryInfo:
-        command = 0x51000200;
-        first = 0x00491E00;
-        last = 0x00495DFF;
+        query.command = 0x51000200;
+        query.first = 0x00491E00;
+        query.last = 0x00495DFF;
         break;
 
 	case InverterTemperature:
-		command = 0x52000200;
-		first = 0x00237700;
-		last = 0x002377FF;
+		query.command = 0x52000200;
+		query.first = 0x00237700;
+		query.last = 0x002377FF;
 		break;
 
 	case sbftest:
-		command = 0x64020200;
-		first = 0x00618D00;
-		last = 0x00618DFF;
+		query.command = 0x64020200;
+		query.first = 0x00618D00;
+		query.last = 0x00618DFF;
 
 		case MeteringGridMsTotW:
-		command = 0x51000200;
-		first = 0x00463600;
-		last = 0x004637FF;
+		query.command = 0x51000200;
+		query.first = 0x00463600;
+		query.last = 0x004637FF;
 		break;
 
     default:
         return E_BADARG;
     };
 
-    for (int i=0; devList[i]!=NULL && i<MAX_INVERTERS; i++)
+    return E_OK;
+}
+
+
+static bool compareInverterQuery(const InverterQuery &a, const InverterQuery &b)
+{
+    if (a.command != b.command)
+        return a.command < b.command;
+    return a.first < b.first;
+}
+
+/*
+ * Build the list of requests for a set of getInverterDataTypes
+ * LRI ranges of the same command are merged into one request when they overlap
+ * or when the gap between them is at most LRI_MAXGAP
+ */
+int planInverterQueries(unsigned long types, std::vector<InverterQuery> &plan)
+{
+    std::vector<InverterQuery> queries;
+
+    for (int bit = 0; bit < 32; bit++)
     {
-		do
-		{
-			pcktID++;
-			writePacketHeader(pcktBuf, 0x01, addr_unknown);
-			if (devList[i]->SUSyID == SID_SB240)
-				writePacket(pcktBuf, 0x09, 0xE0, 0, devList[i]->SUSyID, devList[i]->Serial);
-			else
-				writePacket(pcktBuf, 0x09, 0xA0, 0, devList[i]->SUSyID, devList[i]->Serial);
-			writeLong(pcktBuf, command);
-			writeLong(pcktBuf, first);
-			writeLong(pcktBuf, last);
-			writePacketTrailer(pcktBuf);
-			writePacketLength(pcktBuf);
-		}
-		while (!isCrcValid(pcktBuf[packetposition-3], pcktBuf[packetposition-2]));
+        if ((types & (1UL << bit)) == 0) continue;
 
-		if (ConnType == CT_BLUETOOTH)
-		{
-			bthSend(pcktBuf);
-		}
+        InverterQuery query;
+        if (getInverterQuery((getInverterDataType)(1UL << bit), query) != E_OK)
+            return E_BADARG;
+        queries.push_back(query);
+    }
+
+    std::sort(queries.begin(), queries.end(), compareInverterQuery);
+
+    plan.clear();
+    for (std::vector<InverterQuery>::iterator it = queries.begin(); it != queries.end(); ++it)
+    {
+        if (!plan.empty() && (plan.back().command == it->command) && (it->first <= plan.back().last + LRI_MAXGAP))
+        {
+            plan.back().types |= it->types;
+            if (it->last > plan.back().last)
+                plan.back().last = it->last;
+        }
+        else
+            plan.push_back(*it);
+    }
+
+    if (DEBUG_NORMAL)
+    {
+        for (std::vector<InverterQuery>::iterator it = plan.begin(); it != plan.end(); ++it)
+            printf("Query 0x%08lX [0x%08lX-0x%08lX] for types 0x%08lX\n", it->command, it->first, it->last, it->types);
+    }
+
+    return plan.empty() ? E_BADARG : E_OK;
+}
+
+/*
+ * Get one or more getInverterDataTypes (OR'ed together) from all devices
+ * The types are combined in as few requests as possible (see planInverterQueries)
+ */
+int getInverterData(InverterData *devList[], const DeviceIndex &index, unsigned long types)
+{
+    if (DEBUG_NORMAL) printf("getInverterData(0x%08lX)\n", types);
+
+    std::vector<InverterQuery> plan;
+    int rc = planInverterQueries(types, plan);
+    if (rc != E_OK) return rc;
+
+    for (std::vector<InverterQuery>::iterator it = plan.begin(); it != plan.end(); ++it)
+    {
+        int qrc;
+        if (ConnType == CT_ETHERNET)
+            qrc = ethGetInverterData(devList, index, *it);
+        else
+            qrc = bthGetInverterData(devList, index, *it);
+
+        if (qrc == E_NOLOGON) return qrc;
+        if (qrc != E_OK) rc = qrc;
+    }
+
+    return rc;
+}
+
+/*
+ * Bluetooth: Query the devices one after the other
+ */
+int bthGetInverterData(InverterData *devList[], const DeviceIndex &index, const InverterQuery &query)
+{
+    int rc = E_OK;
+    int validPcktID = 0;
+
+    for (int i=0; devList[i]!=NULL; i++)
+    {
+		pcktID++;
+		writePacketHeader(pcktBuf, 0x01, addr_unknown);
+		if (devList[i]->SUSyID == SID_SB240)
+			writePacket(pcktBuf, 0x09, 0xE0, 0, devList[i]->SUSyID, devList[i]->Serial);
 		else
-		{
-			ethSend(pcktBuf, devList[i]->IPAddress);
-		}
+			writePacket(pcktBuf, 0x09, 0xA0, 0, devList[i]->SUSyID, devList[i]->Serial);
+		writeLong(pcktBuf, query.command);
+		writeLong(pcktBuf, query.first);
+		writeLong(pcktBuf, query.last);
+		writePacketTrailer(pcktBuf);
+		writePacketLength(pcktBuf);
+
+		bthSend(pcktBuf);
 
 		validPcktID = 0;
         do
         {
-            if (ConnType == CT_BLUETOOTH)
-                rc = getPacket(devList[i]->BTAddress, 1);
-            else
-                rc = ethGetPacket();
+            rc = getPacket(devList[i]->BTAddress, 1);
 
             if (rc != E_OK) return rc;
 
-            if ((ConnType == CT_BLUETOOTH) && (!validateChecksum()))
+            if (!validateChecksum())
                 return E_CHKSUM;
             else
             {
                 unsigned short rcvpcktID = get_short(pcktBuf+27) & 0x7FFF;
                 if (pcktID == rcvpcktID)
                 {
-                    int inv = getInverterIndexBySerial(devList, get_short(pcktBuf + 15), get_long(pcktBuf + 17));
+                    // Error 0x0017: Not logged on (session timed out)
+                    if (get_short(pcktBuf + 23) == 0x0017)
+                    {
+                        if (DEBUG_NORMAL) printf("Session expired (SUSyID: %d - SN: %lu)\n", devList[i]->SUSyID, devList[i]->Serial);
+                        return E_NOLOGON;
+                    }
+
+                    int inv = index.bySerial(get_short(pcktBuf + 15), get_long(pcktBuf + 17));
                     if (inv >= 0)
                     {
                         validPcktID = 1;
-                        int32_t value = 0;
-                        int64_t value64 = 0;
-                        unsigned char Vtype = 0;
-                        unsigned char Vbuild = 0;
-                        unsigned char Vminor = 0;
-                        unsigned char Vmajor = 0;
-                        for (int ii = 41; ii < packetposition - 3; ii += recordsize)
-                        {
-                            uint32_t code = ((uint32_t)get_long(pcktBuf + ii));
-                            LriDef lri = (LriDef)(code & 0x00FFFF00);
-                            uint32_t cls = code & 0xFF;
-                            unsigned char dataType = code >> 24;
-                            time_t datetime = (time_t)get_long(pcktBuf + ii + 4);
-
-                            // fix: We can't rely on dataType because it can be both 0x00 or 0x40 for DWORDs
-                            if ((lri == MeteringDyWhOut) || (lri == MeteringTotWhOut) || (lri == MeteringTotFeedTms) || (lri == MeteringTotOpTms))	//QWORD
-                            //if ((code == SPOT_ETODAY) || (code == SPOT_ETOTAL) || (code == SPOT_FEEDTM) || (code == SPOT_OPERTM))	//QWORD
-                            {
-                                value64 = get_longlong(pcktBuf + ii + 8);
-                                if ((value64 == (int64_t)NaN_S64) || (value64 == (int64_t)NaN_U64)) value64 = 0;
-                            }
-                            else if ((dataType != 0x10) && (dataType != 0x08))	//Not TEXT or STATUS, so it should be DWORD
-                            {
-                                value = (int32_t)get_long(pcktBuf + ii + 16);
-                                if ((value == (int32_t)NaN_S32) || (value == (int32_t)NaN_U32)) value = 0;
-                            }
-
-                            switch (lri)
-                            {
-                            case GridMsTotW: //SPOT_PACTOT
-                                if (recordsize == 0) recordsize = 28;
-                                //This function gives us the time when the inverter was switched off
-                                devList[inv]->SleepTime = datetime;
-                                devList[inv]->TotalPac = value;
-                                devList[inv]->flags |= type;
-                                if (DEBUG_NORMAL) printf(strWatt, "SPOT_PACTOT", value, ctime(&datetime));
-                                break;
-
-                            case OperationHealthSttOk: //INV_PACMAX1
-                                if (recordsize == 0) recordsize = 28;
-                                devList[inv]->Pmax1 = value;
-                                devList[inv]->flags |= type;
-                                if (DEBUG_NORMAL) printf(strWatt, "INV_PACMAX1", value, ctime(&datetime));
-                                break;
-
-                            case OperationHealthSttWrn: //INV_PACMAX2
-                                if (recordsize == 0) recordsize = 28;
-                                devList[inv]->Pmax2 = value;
-                                devList[inv]->flags |= type;
-                                if (DEBUG_NORMAL) printf(strWatt, "INV_PACMAX2", value, ctime(&datetime));
-                                break;
-
-                            case OperationHealthSttAlm: //INV_PACMAX3
-                                if (recordsize == 0) recordsize = 28;
-                                devList[inv]->Pmax3 = value;
-                                devList[inv]->flags |= type;
-                                if (DEBUG_NORMAL) printf(strWatt, "INV_PACMAX3", value, ctime(&datetime));
-                                break;
-
-                            case GridMsWphsA: //SPOT_PAC1
-                                if (recordsize == 0) recordsize = 28;
-                                devList[inv]->Pac1 = value;
-                                devList[inv]->flags |= type;
-                                if (DEBUG_NORMAL) printf(strWatt, "SPOT_PAC1", value, ctime(&datetime));
-                                break;
-
-                            case GridMsWphsB: //SPOT_PAC2
-                                if (recordsize == 0) recordsize = 28;
-                                devList[inv]->Pac2 = value;
-                                devList[inv]->flags |= type;
-                                if (DEBUG_NORMAL) printf(strWatt, "SPOT_PAC2", value, ctime(&datetime));
-                                break;
-
-                            case GridMsWphsC: //SPOT_PAC3
-                                if (recordsize == 0) recordsize = 28;
-                                devList[inv]->Pac3 = value;
-                                devList[inv]->flags |= type;
-                                if (DEBUG_NORMAL) printf(strWatt, "SPOT_PAC3", value, ctime(&datetime));
-                                break;
-
-                            case GridMsPhVphsA: //SPOT_UAC1
-                                if (recordsize == 0) recordsize = 28;
-                                devList[inv]->Uac1 = value;
-                                devList[inv]->flags |= type;
-                                if (DEBUG_NORMAL) printf(strVolt, "SPOT_UAC1", toVolt(value), ctime(&datetime));
-                                break;
-
-                            case GridMsPhVphsB: //SPOT_UAC2
-                                if (recordsize == 0) recordsize = 28;
-                                devList[inv]->Uac2 = value;
-                                devList[inv]->flags |= type;
-                                if (DEBUG_NORMAL) printf(strVolt, "SPOT_UAC2", toVolt(value), ctime(&datetime));
-                                break;
-
-                            case GridMsPhVphsC: //SPOT_UAC3
-                                if (recordsize == 0) recordsize = 28;
-                                devList[inv]->Uac3 = value;
-                                devList[inv]->flags |= type;
-                                if (DEBUG_NORMAL) printf(strVolt, "SPOT_UAC3", toVolt(value), ctime(&datetime));
-                                break;
-
-                            case GridMsAphsA_1: //SPOT_IAC1
-							case GridMsAphsA:
-                                if (recordsize == 0) recordsize = 28;
-                                devList[inv]->Iac1 = value;
-                                devList[inv]->flags |= type;
-                                if (DEBUG_NORMAL) printf(strAmp, "SPOT_IAC1", toAmp(value), ctime(&datetime));
-                                break;
-
-                            case GridMsAphsB_1: //SPOT_IAC2
-							case GridMsAphsB:
-                                if (recordsize == 0) recordsize = 28;
-                                devList[inv]->Iac2 = value;
-                                devList[inv]->flags |= type;
-                                if (DEBUG_NORMAL) printf(strAmp, "SPOT_IAC2", toAmp(value), ctime(&datetime));
-                                break;
-
-                            case GridMsAphsC_1: //SPOT_IAC3
-							case GridMsAphsC:
-                                if (recordsize == 0) recordsize = 28;
-                                devList[inv]->Iac3 = value;
-                                devList[inv]->flags |= type;
-                                if (DEBUG_NORMAL) printf(strAmp, "SPOT_IAC3", toAmp(value), ctime(&datetime));
-                                break;
-
-                            case GridMsHz: //SPOT_FREQ
-                                if (recordsize == 0) recordsize = 28;
-                                devList[inv]->GridFreq = value;
-                                devList[inv]->flags |= type;
-                                if (DEBUG_NORMAL) printf("%-12s: %.2f (Hz) %s", "SPOT_FREQ", toHz(value), ctime(&datetime));
-                                break;
-
-                            case DcMsWatt: //SPOT_PDC1 / SPOT_PDC2
-                                if (recordsize == 0) recordsize = 28;
-                                if (cls == 1)   // MPP1
-                                {
-                                    devList[inv]->Pdc1 = value;
-                                    if (DEBUG_NORMAL) printf(strWatt, "SPOT_PDC1", value, ctime(&datetime));
-                                }
-                                if (cls == 2)   // MPP2
-                                {
-                                    devList[inv]->Pdc2 = value;
-                                    if (DEBUG_NORMAL) printf(strWatt, "SPOT_PDC2", value, ctime(&datetime));
-                                }
-                                devList[inv]->flags |= type;
-                                break;
-
-                            case DcMsVol: //SPOT_UDC1 / SPOT_UDC2
-                                if (recordsize == 0) recordsize = 28;
-                                if (cls == 1)
-                                {
-                                    devList[inv]->Udc1 = value;
-                                    if (DEBUG_NORMAL) printf(strVolt, "SPOT_UDC1", toVolt(value), ctime(&datetime));
-                                }
-                                if (cls == 2)
-                                {
-                                    devList[inv]->Udc2 = value;
-                                    if (DEBUG_NORMAL) printf(strVolt, "SPOT_UDC2", toVolt(value), ctime(&datetime));
-                                }
-                                devList[inv]->flags |= type;
-                                break;
-
-                            case DcMsAmp: //SPOT_IDC1 / SPOT_IDC2
-                                if (recordsize == 0) recordsize = 28;
-                                if (cls == 1)
-                                {
-                                    devList[inv]->Idc1 = value;
-                                    if (DEBUG_NORMAL) printf(strAmp, "SPOT_IDC1", toAmp(value), ctime(&datetime));
-                                }
-                                if (cls == 2)
-                                {
-                                    devList[inv]->Idc2 = value;
-                                    if (DEBUG_NORMAL) printf(strAmp, "SPOT_IDC2", toAmp(value), ctime(&datetime));
-                                }
-                                devList[inv]->flags |= type;
-                                break;
-
-                            case MeteringTotWhOut: //SPOT_ETOTAL
-                                if (recordsize == 0) recordsize = 16;
-								//In case SPOT_ETODAY missing, this function gives us inverter time (eg: SUNNY TRIPOWER 6.0)
-								devList[inv]->InverterDatetime = datetime;
-								devList[inv]->ETotal = value64;
-                                devList[inv]->flags |= type;
-                                if (DEBUG_NORMAL) printf(strkWh, "SPOT_ETOTAL", tokWh(value64), ctime(&datetime));
-                                break;
-
-                            case MeteringDyWhOut: //SPOT_ETODAY
-                                if (recordsize == 0) recordsize = 16;
-                                //This function gives us the current inverter time
-                                devList[inv]->InverterDatetime = datetime;
-                                devList[inv]->EToday = value64;
-                                devList[inv]->flags |= type;
-                                if (DEBUG_NORMAL) printf(strkWh, "SPOT_ETODAY", tokWh(value64), ctime(&datetime));
-                                break;
-
-                            case MeteringTotOpTms: //SPOT_OPERTM
-                                if (recordsize == 0) recordsize = 16;
-                                devList[inv]->OperationTime = value64;
-                                devList[inv]->flags |= type;
-                                if (DEBUG_NORMAL) printf(strHour, "SPOT_OPERTM", toHour(value64), ctime(&datetime));
-                                break;
-
-                            case MeteringTotFeedTms: //SPOT_FEEDTM
-                                if (recordsize == 0) recordsize = 16;
-                                devList[inv]->FeedInTime = value64;
-                                devList[inv]->flags |= type;
-                                if (DEBUG_NORMAL) printf(strHour, "SPOT_FEEDTM", toHour(value64), ctime(&datetime));
-                                break;
-
-                            case NameplateLocation: //INV_NAME
-                                if (recordsize == 0) recordsize = 40;
-                                //This function gives us the time when the inverter was switched on
-                                devList[inv]->WakeupTime = datetime;
-                                strncpy(devList[inv]->DeviceName, (char *)pcktBuf + ii + 8, sizeof(devList[inv]->DeviceName)-1);
-                                devList[inv]->flags |= type;
-                                if (DEBUG_NORMAL) printf("%-12s: '%s' %s", "INV_NAME", devList[inv]->DeviceName, ctime(&datetime));
-                                break;
-
-                            case NameplatePkgRev: //INV_SWVER
-                                if (recordsize == 0) recordsize = 40;
-                                Vtype = pcktBuf[ii + 24];
-                                char ReleaseType[4];
-                                if (Vtype > 5)
-                                    sprintf(ReleaseType, "%d", Vtype);
-                                else
-                                    sprintf(ReleaseType, "%c", "NEABRS"[Vtype]); //NOREV-EXPERIMENTAL-ALPHA-BETA-RELEASE-SPECIAL
-                                Vbuild = pcktBuf[ii + 25];
-                                Vminor = pcktBuf[ii + 26];
-                                Vmajor = pcktBuf[ii + 27];
-                                //Vmajor and Vminor = 0x12 should be printed as '12' and not '18' (BCD)
-                                snprintf(devList[inv]->SWVersion, sizeof(devList[inv]->SWVersion), "%c%c.%c%c.%02d.%s", '0'+(Vmajor >> 4), '0'+(Vmajor & 0x0F), '0'+(Vminor >> 4), '0'+(Vminor & 0x0F), Vbuild, ReleaseType);
-                                devList[inv]->flags |= type;
-                                if (DEBUG_NORMAL) printf("%-12s: '%s' %s", "INV_SWVER", devList[inv]->SWVersion, ctime(&datetime));
-                                break;
-
-                            case NameplateModel: //INV_TYPE
-                                if (recordsize == 0) recordsize = 40;
-                                for (int idx = 8; idx < recordsize; idx += 4)
-                                {
-                                    unsigned long attribute = ((unsigned long)get_long(pcktBuf + ii + idx)) & 0x00FFFFFF;
-                                    unsigned char status = pcktBuf[ii + idx + 3];
-                                    if (attribute == 0xFFFFFE) break;	//End of attributes
-                                    if (status == 1)
-                                    {
-										string devtype = tagdefs.getDesc(attribute);
-										if (!devtype.empty())
-										{
-											memset(devList[inv]->DeviceType, 0, sizeof(devList[inv]->DeviceType));
-											strncpy(devList[inv]->DeviceType, devtype.c_str(), sizeof(devList[inv]->DeviceType) - 1);
-										}
-										else
-										{
-											strncpy(devList[inv]->DeviceType, "UNKNOWN TYPE", sizeof(devList[inv]->DeviceType));
-                                            printf("Unknown Inverter Type. Report this issue at https://github.com/SBFspot/SBFspot/issues with following info:\n");
-                                            printf("0x%08lX and Inverter Type=<Fill in the exact type> (e.g. SB1300TL-10)\n", attribute);
-										}
-                                    }
-                                }
-                                devList[inv]->flags |= type;
-                                if (DEBUG_NORMAL) printf("%-12s: '%s' %s", "INV_TYPE", devList[inv]->DeviceType, ctime(&datetime));
-                                break;
-
-                            case NameplateMainModel: //INV_CLASS
-                                if (recordsize == 0) recordsize = 40;
-                                for (int idx = 8; idx < recordsize; idx += 4)
-                                {
-                                    unsigned long attribute = ((unsigned long)get_long(pcktBuf + ii + idx)) & 0x00FFFFFF;
-                                    unsigned char attValue = pcktBuf[ii + idx + 3];
-                                    if (attribute == 0xFFFFFE) break;	//End of attributes
-                                    if (attValue == 1)
-                                    {
-                                        devList[inv]->DevClass = (DEVICECLASS)attribute;
-										string devclass = tagdefs.getDesc(attribute);
-										if (!devclass.empty())
-										{
-											memset(devList[inv]->DeviceClass, 0, sizeof(devList[inv]->DeviceClass));
-											strncpy(devList[inv]->DeviceClass, devclass.c_str(), sizeof(devList[inv]->DeviceClass) - 1);
-										}
-										else
-										{
-                                            strncpy(devList[inv]->DeviceClass, "UNKNOWN CLASS", sizeof(devList[inv]->DeviceClass));
-                                            printf("Unknown Device Class. Report this issue at https://github.com/SBFspot/SBFspot/issues with following info:\n");
-                                            printf("0x%08lX and Device Class=...\n", attribute);
-                                        }
-                                    }
-                                }
-                                devList[inv]->flags |= type;
-                                if (DEBUG_NORMAL) printf("%-12s: '%s' %s", "INV_CLASS", devList[inv]->DeviceClass, ctime(&datetime));
-                                break;
-
-                            case OperationHealth: //INV_STATUS:
-                                if (recordsize == 0) recordsize = 40;
-                                for (int idx = 8; idx < recordsize; idx += 4)
-                                {
-                                    unsigned long attribute = ((unsigned long)get_long(pcktBuf + ii + idx)) & 0x00FFFFFF;
-                                    unsigned char attValue = pcktBuf[ii + idx + 3];
-                                    if (attribute == 0xFFFFFE) break;	//End of attributes
-                                    if (attValue == 1)
-                                        devList[inv]->DeviceStatus = attribute;
-                                }
-                                devList[inv]->flags |= type;
-								if (DEBUG_NORMAL) printf("%-12s: '%s' %s", "INV_STATUS", tagdefs.getDesc(devList[inv]->DeviceStatus, "?").c_str(), ctime(&datetime));
-                                break;
-
-                            case OperationGriSwStt: //INV_GRIDRELAY
-                                if (recordsize == 0) recordsize = 40;
-                                for (int idx = 8; idx < recordsize; idx += 4)
-                                {
-                                    unsigned long attribute = ((unsigned long)get_long(pcktBuf + ii + idx)) & 0x00FFFFFF;
-                                    unsigned char attValue = pcktBuf[ii + idx + 3];
-                                    if (attribute == 0xFFFFFE) break;	//End of attributes
-                                    if (attValue == 1)
-                                        devList[inv]->GridRelayStatus = attribute;
-                                }
-                                devList[inv]->flags |= type;
-                                if (DEBUG_NORMAL) printf("%-12s: '%s' %s", "INV_GRIDRELAY", tagdefs.getDesc(devList[inv]->GridRelayStatus, "?").c_str(), ctime(&datetime));
-                                break;
-
-                            case BatChaStt:
-                                if (recordsize == 0) recordsize = 28;
-                                devList[inv]->BatChaStt = value;
-                                devList[inv]->flags |= type;
-                                break;
-
-                            case BatDiagCapacThrpCnt:
-                                if (recordsize == 0) recordsize = 28;
-                                devList[inv]->BatDiagCapacThrpCnt = value;
-                                devList[inv]->flags |= type;
-                                break;
-
-                            case BatDiagTotAhIn:
-                                if (recordsize == 0) recordsize = 28;
-                                devList[inv]->BatDiagTotAhIn = value;
-                                devList[inv]->flags |= type;
-                                break;
-
-                            case BatDiagTotAhOut:
-                                if (recordsize == 0) recordsize = 28;
-                                devList[inv]->BatDiagTotAhOut = value;
-                                devList[inv]->flags |= type;
-                                break;
-
-                            case BatTmpVal:
-                                if (recordsize == 0) recordsize = 28;
-                                devList[inv]->BatTmpVal = value;
-                                devList[inv]->flags |= type;
-                                break;
-
-                            case BatVol:
-                                if (recordsize == 0) recordsize = 28;
-                                devList[inv]->BatVol = value;
-                                devList[inv]->flags |= type;
-                                break;
-
-                            case BatAmp:
-                                if (recordsize == 0) recordsize = 28;
-                                devList[inv]->BatAmp = value;
-                                devList[inv]->flags |= type;
-                                break;
-
-							case CoolsysTmpNom:
-                                if (recordsize == 0) recordsize = 28;
-								devList[inv]->Temperature = value;
-								devList[inv]->flags |= type;
-								break;
-
-							case MeteringGridMsTotWhOut:
-                                if (recordsize == 0) recordsize = 28;
-								devList[inv]->MeteringGridMsTotWOut = value;
-								break;
-
-							case MeteringGridMsTotWhIn:
-                                if (recordsize == 0) recordsize = 28;
-								devList[inv]->MeteringGridMsTotWIn = value;
-								break;
-
-                            default:
-                                if (recordsize == 0) recordsize = 12;
-                            }
-                        }
+                        decodeInverterData(devList, inv, query.types);
                     }
                 }
                 else
@@ -3419,8 +3759,133 @@ int getInverterData(InverterData *devList[], enum getInverterDataType type)
     return E_OK;
 }
 
+/*
+ * Speedwire: Query all devices at once instead of one after the other
+ * Each device gets its own pcktID and deadline, replies are matched on pcktID as they arrive
+ * Devices sharing the same IP address (e.g. behind a multigate) are queried one at a time
+ * A device that doesn't answer in time is marked stale and isn't asked again until
+ * the next polling cycle, the others are still processed
+ * Returns E_NODATA only if none of the devices answered
+ */
+E_SBFSPOT ethGetInverterData(InverterData *devList[], const DeviceIndex &index, const InverterQuery &query)
+{
+    using namespace boost::posix_time;
+
+    enum { REQ_QUEUED, REQ_PENDING, REQ_DONE };
+
+    struct Request
+    {
+        int state;
+        unsigned short pcktID;
+        ptime deadline;
+    };
+
+    int devcount = 0;
+    while (devList[devcount] != NULL) devcount++;
+
+    std::vector<Request> req(devcount);
+    int remaining = 0;
+    for (int i=0; i<devcount; i++)
+    {
+        req[i].state = devList[i]->stale ? REQ_DONE : REQ_QUEUED;
+        if (req[i].state == REQ_QUEUED) remaining++;
+    }
+
+    boost::unordered_map<unsigned short, int> pending;	// pcktID -> device
+    std::set<std::string> busyIP;
+    int answered = 0;
+
+    while (remaining > 0)
+    {
+        // Send a request to each device whose IP address is not busy
+        for (int i=0; i<devcount; i++)
+        {
+            if ((req[i].state != REQ_QUEUED) || (busyIP.count(devList[i]->IPAddress) > 0))
+                continue;
+
+            pcktID++;
+            writePacketHeader(pcktBuf, 0x01, addr_unknown);
+            if (devList[i]->SUSyID == SID_SB240)
+                writePacket(pcktBuf, 0x09, 0xE0, 0, devList[i]->SUSyID, devList[i]->Serial);
+            else
+                writePacket(pcktBuf, 0x09, 0xA0, 0, devList[i]->SUSyID, devList[i]->Serial);
+            writeLong(pcktBuf, query.command);
+            writeLong(pcktBuf, query.first);
+            writeLong(pcktBuf, query.last);
+            writePacketTrailer(pcktBuf);
+            writePacketLength(pcktBuf);
+
+            ethSend(pcktBuf, devList[i]->IPAddress);
+
+            req[i].state = REQ_PENDING;
+            req[i].pcktID = pcktID & 0x7FFF;
+            req[i].deadline = boost::posix_time::microsec_clock::universal_time() + milliseconds(ETH_TIMEOUT);
+            pending[req[i].pcktID] = i;
+            busyIP.insert(devList[i]->IPAddress);
+        }
+
+        // Wait no longer than the first deadline
+        ptime now = boost::posix_time::microsec_clock::universal_time();
+        ptime deadline = now + milliseconds(ETH_TIMEOUT);
+        for (int i=0; i<devcount; i++)
+            if ((req[i].state == REQ_PENDING) && (req[i].deadline < deadline))
+                deadline = req[i].deadline;
+
+        long timeout_ms = (deadline > now) ? (long)(deadline - now).total_milliseconds() : 0;
+
+        if (ethGetPacket((int)timeout_ms) == E_OK)
+        {
+            unsigned short rcvpcktID = get_short(pcktBuf+27) & 0x7FFF;
+            boost::unordered_map<unsigned short, int>::iterator it = pending.find(rcvpcktID);
+            int dev = (it != pending.end()) ? it->second : -1;
+            int inv = index.bySerial(get_short(pcktBuf + 15), get_long(pcktBuf + 17));
+
+            if ((dev < 0) || (inv < 0))
+            {
+                // Not a reply from one of our devices (e.g. our own request looped back)
+                if (DEBUG_HIGHEST) printf("Unexpected packet ID %d\n", rcvpcktID);
+            }
+            else
+            {
+                // Error 0x0017: Not logged on (session timed out)
+                if (get_short(pcktBuf + 23) == 0x0017)
+                {
+                    if (DEBUG_NORMAL) printf("Session expired (SUSyID: %d - SN: %lu)\n", devList[dev]->SUSyID, devList[dev]->Serial);
+                    return E_NOLOGON;
+                }
+
+                decodeInverterData(devList, inv, query.types);
+
+                answered++;
+                req[dev].state = REQ_DONE;
+                pending.erase(it);
+                busyIP.erase(devList[dev]->IPAddress);
+                remaining--;
+            }
+        }
+
+        // Give up on devices that missed their deadline
+        now = boost::posix_time::microsec_clock::universal_time();
+        for (int i=0; i<devcount; i++)
+        {
+            if ((req[i].state == REQ_PENDING) && (req[i].deadline <= now))
+            {
+                if (VERBOSE_NORMAL) printf("No reply from %s (SN: %lu)\n", devList[i]->IPAddress, devList[i]->Serial);
+                devList[i]->stale = true;
+                req[i].state = REQ_DONE;
+                pending.erase(req[i].pcktID);
+                busyIP.erase(devList[i]->IPAddress);
+                remaining--;
+            }
+        }
+    }
+
+    return (answered > 0) ? E_OK : E_NODATA;
+}
+
 void resetInverterData(InverterData *inv)
 {
+	inv->stale = false;
 	inv->BatAmp = 0;
 	inv->BatChaStt = 0;
 	inv->BatDiagCapacThrpCnt = 0;
@@ -3474,6 +3939,7 @@ void resetInverterData(InverterData *inv)
 	inv->Udc2 = 0;
 	inv->WakeupTime = 0;
 	inv->monthDataOffset = 0;
+	inv->archDaySince = 0;
 	inv->multigateID = -1;
 	inv->MeteringGridMsTotWIn = 0;
 	inv->MeteringGridMsTotWOut = 0;
@@ -3484,28 +3950,25 @@ E_SBFSPOT setDeviceData(InverterData *inv, LriDef lri, uint16_t cmd, Rec40S32 &d
 {
 	E_SBFSPOT rc = E_OK;
 
-	do
-	{
-        pcktID++;
-		time_t now = time(NULL);
-		writePacketHeader(pcktBuf, 0x01, inv->BTAddress);
-        writePacket(pcktBuf, 0x12, 0xE0, 0x0100, inv->SUSyID, inv->Serial);
-		writeShort(pcktBuf, 0x010E);
-		writeShort(pcktBuf, cmd);
-		writeLong(pcktBuf, 0x0A);
-		writeLong(pcktBuf, lri | 0x02000001);
-		writeLong(pcktBuf, now);
-		writeLong(pcktBuf, data.MinLL());
-		writeLong(pcktBuf, data.MaxLL());
-		writeLong(pcktBuf, data.MinUL());
-		writeLong(pcktBuf, data.MaxUL());
-		writeLong(pcktBuf, data.MinActual());
-		writeLong(pcktBuf, data.MaxActual());
-		writeLong(pcktBuf, data.Res1());
-		writeLong(pcktBuf, data.Res2());
-		writePacketTrailer(pcktBuf);
-		writePacketLength(pcktBuf);
-	} while (!isCrcValid(pcktBuf[packetposition-3], pcktBuf[packetposition-2]));
+    pcktID++;
+	time_t now = time(NULL);
+	writePacketHeader(pcktBuf, 0x01, inv->BTAddress);
+    writePacket(pcktBuf, 0x12, 0xE0, 0x0100, inv->SUSyID, inv->Serial);
+	writeShort(pcktBuf, 0x010E);
+	writeShort(pcktBuf, cmd);
+	writeLong(pcktBuf, 0x0A);
+	writeLong(pcktBuf, lri | 0x02000001);
+	writeLong(pcktBuf, now);
+	writeLong(pcktBuf, data.MinLL());
+	writeLong(pcktBuf, data.MaxLL());
+	writeLong(pcktBuf, data.MinUL());
+	writeLong(pcktBuf, data.MaxUL());
+	writeLong(pcktBuf, data.MinActual());
+	writeLong(pcktBuf, data.MaxActual());
+	writeLong(pcktBuf, data.Res1());
+	writeLong(pcktBuf, data.Res2());
+	writePacketTrailer(pcktBuf);
+	writePacketLength(pcktBuf);
 
     if (ConnType == CT_BLUETOOTH)
     {
@@ -3524,22 +3987,18 @@ E_SBFSPOT getDeviceData(InverterData *inv, LriDef lri, uint16_t cmd, Rec40S32 &d
 	E_SBFSPOT rc = E_OK;
 
 	const int recordsize = 40;
-	do
-	{
-		pcktID++;
-		writePacketHeader(pcktBuf, 0x01, inv->BTAddress);
-		if (inv->SUSyID == SID_SB240)
-			writePacket(pcktBuf, 0x09, 0xE0, 0, inv->SUSyID, inv->Serial);
-		else
-			writePacket(pcktBuf, 0x09, 0xA0, 0, inv->SUSyID, inv->Serial);
-		writeShort(pcktBuf, 0x0200);
-		writeShort(pcktBuf, cmd);
-		writeLong(pcktBuf, lri);
-		writeLong(pcktBuf, lri | 0xFF);
-		writePacketTrailer(pcktBuf);
-		writePacketLength(pcktBuf);
-	}
-	while (!isCrcValid(pcktBuf[packetposition-3], pcktBuf[packetposition-2]));
+	pcktID++;
+	writePacketHeader(pcktBuf, 0x01, inv->BTAddress);
+	if (inv->SUSyID == SID_SB240)
+		writePacket(pcktBuf, 0x09, 0xE0, 0, inv->SUSyID, inv->Serial);
+	else
+		writePacket(pcktBuf, 0x09, 0xA0, 0, inv->SUSyID, inv->Serial);
+	writeShort(pcktBuf, 0x0200);
+	writeShort(pcktBuf, cmd);
+	writeLong(pcktBuf, lri);
+	writeLong(pcktBuf, lri | 0xFF);
+	writePacketTrailer(pcktBuf);
+	writePacketLength(pcktBuf);
 
     if (ConnType == CT_BLUETOOTH)
     {
@@ -3597,37 +4056,26 @@ E_SBFSPOT getDeviceData(InverterData *inv, LriDef lri, uint16_t cmd, Rec40S32 &d
     return rc;
 }
 
-E_SBFSPOT getDeviceList(InverterData *devList[], int multigateID)
+E_SBFSPOT getDeviceList(PlantRegistry &plant, int multigateID)
 {
 	E_SBFSPOT rc = E_OK;
 	
 	const int recordsize = 32;
 
-	uint32_t devcount = 0;
-	while ((devList[devcount] != NULL) && (devcount < MAX_INVERTERS))
-		devcount++;
-
-	if (devcount >= MAX_INVERTERS)
-	{
-		std::cerr << "ERROR: MAX_INVERTERS too low." << std::endl;
-		return E_BUFOVRFLW;
-	}
+	// Devices are added to the plant, the multigate itself doesn't move
+	InverterData *multigate = plant[multigateID];
 
-	do
-	{
-		pcktID++;
-		writePacketHeader(pcktBuf, 0x01, NULL);
-		writePacket(pcktBuf, 0x09, 0xE0, 0, devList[multigateID]->SUSyID, devList[multigateID]->Serial);
-		writeShort(pcktBuf, 0x0200);
-		writeShort(pcktBuf, 0xFFF5);
-		writeLong(pcktBuf, 0);
-		writeLong(pcktBuf, 0xFFFFFFFF);
-		writePacketTrailer(pcktBuf);
-		writePacketLength(pcktBuf);
-	}
-	while (!isCrcValid(pcktBuf[packetposition-3], pcktBuf[packetposition-2]));
+	pcktID++;
+	writePacketHeader(pcktBuf, 0x01, NULL);
+	writePacket(pcktBuf, 0x09, 0xE0, 0, multigate->SUSyID, multigate->Serial);
+	writeShort(pcktBuf, 0x0200);
+	writeShort(pcktBuf, 0xFFF5);
+	writeLong(pcktBuf, 0);
+	writeLong(pcktBuf, 0xFFFFFFFF);
+	writePacketTrailer(pcktBuf);
+	writePacketLength(pcktBuf);
 
-	if (ethSend(pcktBuf, devList[multigateID]->IPAddress) == -1)	// SOCKET_ERROR
+	if (ethSend(pcktBuf, multigate->IPAddress) == -1)	// SOCKET_ERROR
 		return E_NODATA;
 
 	int validPcktID = 0;
@@ -3650,66 +4098,56 @@ E_SBFSPOT getDeviceList(InverterData *devList[], int multigateID)
 			//uint32_t lastrec = get_long(pcktBuf + 37);
 
 			uint32_t serial = get_long(pcktBuf + 17);
-			if (serial == devList[multigateID]->Serial)
+			if (serial == multigate->Serial)
             {
 				rc = E_NODATA;
                 validPcktID = 1;
                 for (int i = 41; i < packetposition - 3; i += recordsize)
                 {
 					uint16_t devclass = get_short(pcktBuf + i + 4);
-					if ((devclass == 3) && (devcount < (uint32_t)MAX_INVERTERS))
+					if (devclass == 3)
 					{
-						devList[devcount] = new InverterData;
-						resetInverterData(devList[devcount]);
-						devList[devcount]->SUSyID = get_short(pcktBuf + i + 6);
-						devList[devcount]->Serial = get_long(pcktBuf + i + 8);
-						strcpy(devList[devcount]->IPAddress, devList[multigateID]->IPAddress);
-						devList[devcount]->multigateID = multigateID;
-						if (++devcount >= MAX_INVERTERS)
-						{
-							std::cerr << "ERROR: MAX_INVERTERS too low." << std::endl;
-							rc = E_BUFOVRFLW;
-							break;
-						}
-						else
-							rc = E_OK;
+						InverterData *dev = plant.add();
+						dev->SUSyID = get_short(pcktBuf + i + 6);
+						dev->Serial = get_long(pcktBuf + i + 8);
+						strcpy(dev->IPAddress, multigate->IPAddress);
+						dev->multigateID = multigateID;
+						rc = E_OK;
 					}
                 }
             }
-			else if (DEBUG_HIGHEST) printf("Serial Nr mismatch. Expected %lu, received %d\n", devList[multigateID]->Serial, serial);
+			else if (DEBUG_HIGHEST) printf("Serial Nr mismatch. Expected %lu, received %d\n", multigate->Serial, serial);
         }
         else if (DEBUG_HIGHEST) printf("Packet ID mismatch. Expected %d, received %d\n", pcktID, rcvpcktID);
     }
     while (validPcktID == 0);
 
+	plant.reindex();
+
     return rc;
 }
 
 E_SBFSPOT logoffMultigateDevices(InverterData *inverters[])
 {
     if (DEBUG_NORMAL) puts("logoffMultigateDevices()");
-	for (int mg=0; inverters[mg]!=NULL && mg<MAX_INVERTERS; mg++)
+	for (int mg=0; inverters[mg]!=NULL; mg++)
 	{
 		InverterData *pmg = inverters[mg];
 		if (pmg->SUSyID == SID_MULTIGATE)
 		{
 			pmg->hasDayData = true;
-			for (int sb240=0; inverters[sb240]!=NULL && sb240<MAX_INVERTERS; sb240++)
+			for (int sb240=0; inverters[sb240]!=NULL; sb240++)
 			{
 				InverterData *psb = inverters[sb240];
 				if ((psb->SUSyID == SID_SB240) && (psb->multigateID == mg))
 				{		
-					do
-					{
-						pcktID++;
-						writePacketHeader(pcktBuf, 0, NULL);
-						writePacket(pcktBuf, 0x08, 0xE0, 0x0300, psb->SUSyID, psb->Serial);
-						writeLong(pcktBuf, 0xFFFD010E);
-						writeLong(pcktBuf, 0xFFFFFFFF);
-						writePacketTrailer(pcktBuf);
-						writePacketLength(pcktBuf);
-					}
-					while (!isCrcValid(pcktBuf[packetposition-3], pcktBuf[packetposition-2]));
+					pcktID++;
+					writePacketHeader(pcktBuf, 0, NULL);
+					writePacket(pcktBuf, 0x08, 0xE0, 0x0300, psb->SUSyID, psb->Serial);
+					writeLong(pcktBuf, 0xFFFD010E);
+					writeLong(pcktBuf, 0xFFFFFFFF);
+					writePacketTrailer(pcktBuf);
+					writePacketLength(pcktBuf);
 
 					ethSend(pcktBuf, psb->IPAddress);
 
@@ -176,6 +176,7 @@ typedef struct
 	MonthData monthData[31];
 	bool hasMonthData;
 	time_t monthDataOffset;	// Issue 115
+	time_t archDaySince;	// -sync: Latest DayData record in the database, older records are not asked (0=whole days)
 	std::vector<EventData> eventData;
 	long calPdcTot;
 	long calPacTot;
@@ -191,10 +192,20 @@ typedef struct
 	int32_t	MeteringGridMsTotWOut;		// Power grid feed-in (Out)
 	int32_t MeteringGridMsTotWIn;		// Power grid reference (In)
 	bool hasBattery;					// Smart Energy device
+	bool stale;							// Missed a reply this polling cycle, spot values are outdated
 	int logonStatus;
 	int multigateID;
 } InverterData;
 
+// Request for one or more getInverterDataTypes sharing the same command
+typedef struct
+{
+	unsigned long types;	// getInverterDataType(s) OR'ed together
+	unsigned long command;
+	unsigned long first;	// First LRI
+	unsigned long last;		// Last LRI
+} InverterQuery;
+
 typedef enum
 {
     CT_NONE = 0,
@@ -228,6 +239,8 @@ typedef struct
     std::string sqlHostname;
     std::string sqlUsername;
     std::string sqlUserPassword;
+	int		sqlRetentionDays;		// Days of raw spot data kept in the database (0=forever - default 0)
+	std::string sqlArchive;			// SQLite: Database to move expired spot data to (strftime pattern)
 	int		synchTime;				// 1=Synch inverter time with computer time (default=0)
 	float	sunrise;
 	float	sunset;
@@ -240,6 +253,9 @@ typedef struct
 	int		CSV_Header;
 	int		CSV_ExtendedHeader;
 	int		CSV_SaveZeroPower;
+	int		CSV_Sync;				// 0-1 (1=fsync CSV files at the end of each polling cycle)
+	int		CSV_DayDataFile;		// 0=One day data file per day; 1=One per month
+	int		Column_Export;			// 0-1 (1=Also export spot and day data to column files *.sbfc)
 	int		SunRSOffset;			// Offset to start before sunrise and end after sunset
 	int		userGroup;				// USER|INSTALLER
 	char	prgVersion[16];
@@ -260,6 +276,10 @@ typedef struct
 	std::string mqtt_publish_data;	// comma delimited list of spot data to publish (Timestamp,Serial,MeteringDyWhOut,GridMsTotW,...)
 	std::string mqtt_item_format;   // default "{key}": {value}
 	std::string mqtt_item_delimiter;// default comma
+	int		daemonInterval;			// Polling interval in daemon mode (5-3600 sec - default 60)
+	int		archConcurrency;		// Speedwire: Archived day requests in flight per device (1-8 - default 1)
+	int		httpPort;				// Port of the built-in HTTP server in daemon mode (0=disabled - default 0)
+	std::string httpAddress;		// Address the HTTP server listens on (default all interfaces)
 
 	//Commandline settings
 	int		debug;				// -d			Debug level (0-5)
@@ -278,6 +298,10 @@ typedef struct
     S123_COMMAND	s123;		// -123s		123Solar Web Solar logger support(http://www.123solar.org/)
 	int		settime;			// -settime		Set plant time
 	int		mqtt;				// -mqtt		Publish spot data to mqtt broker
+	int		daemon;				// -daemon		Keep running and poll the plant every DaemonInterval seconds
+	int		archSync;			// -sync		Only get archived data newer than stored in the database
+	int		capture;			// -record:file or -replay:file (CAPTUREMODE)
+	std::string	captureFile;	// Speedwire capture file
 } Config;
 
 
@@ -432,7 +456,8 @@ typedef enum
 	E_EOF			= -9,	// End of data
 	E_PRIVILEGE		= -10,	// Privilege not held (need installer login)
 	E_LOGONFAILED	= -11,	// Logon failed, other than Invalid Password (E_INVPASSW)
-	E_COMM			= -12	// General communication error
+	E_COMM			= -12,	// General communication error
+	E_NOLOGON		= -13	// Not logged on (session expired)
 } E_SBFSPOT;
 
 //User Group
@@ -443,6 +468,9 @@ typedef enum
 #define SID_MULTIGATE	175
 #define SID_SB240		244
 
+//Max distance between LRI ranges to merge them into one request
+#define LRI_MAXGAP		0x00000A00
+
 #if !defined(ARRAYSIZE)
 #define ARRAYSIZE(a) sizeof(a) / sizeof(a[0])
 #endif
@@ -455,48 +483,56 @@ typedef enum
 #define toHz(value32) (float)value32/100
 #define toTemp(value32) (float)value32/100
 
+class PlantRegistry;
+class DeviceIndex;
+
 //Function prototypes
 E_SBFSPOT initialiseSMAConnection(InverterData *invData);
-E_SBFSPOT ethInitConnection(InverterData *inverters[], char *IP_Address);
-E_SBFSPOT ethInitConnectionMulti(InverterData *inverters[], std::vector<std::string> IPaddresslist);
+E_SBFSPOT ethInitConnection(PlantRegistry &plant, char *IP_Address);
+E_SBFSPOT ethInitConnectionMulti(PlantRegistry &plant, std::vector<std::string> IPaddresslist);
 void CalcMissingSpot(InverterData *invData);
 int DaysInMonth(int month, int year);
 int getBT_SignalStrength(InverterData *invData);
-void freemem(InverterData *inverters[]);
 int GetConfig(Config *cfg);
 const char *getEventCategory(unsigned short eFlags);
 const char *getEventGroup(unsigned long eGroup);
 const char *getEventType(unsigned short eventflags);
-int getInverterData(InverterData *inverters[], enum getInverterDataType type);
-int getInverterIndexByAddress(InverterData *inverters[], unsigned char bt_addr[6]);
-int getInverterIndexBySerial(InverterData *inverters[], unsigned short SUSyID, uint32_t Serial);
-int getInverterIndexBySerial(InverterData *inverters[], uint32_t Serial);
+int getInverterData(InverterData *inverters[], const DeviceIndex &index, unsigned long types);
+int getInverterQuery(enum getInverterDataType type, InverterQuery &query);
+int planInverterQueries(unsigned long types, std::vector<InverterQuery> &plan);
+int bthGetInverterData(InverterData *inverters[], const DeviceIndex &index, const InverterQuery &query);
+E_SBFSPOT ethGetInverterData(InverterData *inverters[], const DeviceIndex &index, const InverterQuery &query);
+void decodeInverterData(InverterData *inverters[], int inv, unsigned long type);
 E_SBFSPOT getPacket(unsigned char senderaddr[6], int wait4Command);
 //int get_tzOffset(void);
 void HexDump(unsigned char *buf, int count, int radix);
-E_SBFSPOT initialiseSMAConnection(const char *BTAddress, InverterData *inverters[], int MIS);
+E_SBFSPOT initialiseSMAConnection(const char *BTAddress, PlantRegistry &plant, int MIS);
 void InvalidArg(char *arg);
 int isCrcValid(unsigned char lb, unsigned char hb);
 int isValidSender(unsigned char senderaddr[6], unsigned char address[6]);
-E_SBFSPOT logonSMAInverter(InverterData *inverters[], long userGroup, char *password);
+E_SBFSPOT logonSMAInverter(InverterData *inverters[], const DeviceIndex &index, long userGroup, char *password);
 E_SBFSPOT logoffSMAInverter(InverterData *inverter);
 E_SBFSPOT logoffMultigateDevices(InverterData *inverters[]);
 int parseCmdline(int argc, char **argv, Config *cfg);
 void printHexBytes(BYTE *buf, int num);
 void SayHello(int ShowHelp);
 E_SBFSPOT SetPlantTime(time_t ndays, time_t lowerlimit = 0, time_t upperlimit = 0);
-E_SBFSPOT ethGetPacket(void);
+E_SBFSPOT ethGetPacket(int timeout_ms = ETH_TIMEOUT);
 void resetInverterData(InverterData *inv);
 void ShowConfig(Config *cfg);
 E_SBFSPOT getInverterWMax(InverterData *inv, Rec40S32 &data);
 E_SBFSPOT setInverterWMax(InverterData *inv, Rec40S32 &data);
 E_SBFSPOT getDeviceData(InverterData *inv, LriDef lri, uint16_t cmd, Rec40S32 &data);
 E_SBFSPOT setDeviceData(InverterData *inv, LriDef lri, uint16_t cmd, Rec40S32 &data);
-E_SBFSPOT getDeviceList(InverterData *devList[], int multigateID);
+E_SBFSPOT getDeviceList(PlantRegistry &plant, int multigateID);
+int connectPlant(Config *cfg, PlantRegistry &plant);
+void disconnectPlant(Config *cfg, PlantRegistry &plant);
+int getPlantInfo(Config *cfg, PlantRegistry &plant);
+void daemonSignalHandler(int sig);
 
 extern unsigned char CommBuf[COMMBUFSIZE];
 
-extern BYTE pcktBuf[maxpcktBufsize];
+extern BYTE *const pcktBuf;	// maxpcktBufsize bytes
 extern unsigned char RootDeviceAddress[6];
 extern unsigned char LocalBTAddress[6];
 extern unsigned char addr_broadcast[6];
@@ -508,7 +544,6 @@ extern unsigned short AppSUSyID;
 extern unsigned long AppSerial;
 extern const unsigned short anySUSyID;
 extern const unsigned long anySerial;
-extern const int MAX_INVERTERS;
 
 extern const char *IP_Broadcast;
 extern const char *IP_Inverter;
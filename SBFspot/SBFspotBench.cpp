@@ -0,0 +1,703 @@
+/************************************************************************************************
+SBFspot - Yet another tool to read power production of SMA solar inverters
+(c)2012-2020, SBF
+
+Latest version found at https://github.com/SBFspot/SBFspot
+
+License: Attribution-NonCommercial-ShareAlike 3.0 Unported (CC BY-NC-SA 3.0)
+http://creativecommons.org/licenses/by-nc-sa/3.0/
+
+You are free:
+to Share  to copy, distribute and transmit the work
+to Remix  to adapt the work
+Under the following conditions:
+Attribution:
+You must attribute the work in the manner specified by the author or licensor
+(but not in any way that suggests that they endorse you or your use of the work).
+Noncommercial:
+You may not use this work for commercial purposes.
+Share Alike:
+If you alter, transform, or build upon this work, you may distribute the resulting work
+only under the same or similar license to this one.
+
+DISCLAIMER:
+A user of SBFspot software acknowledges that he or she is receiving this
+software on an "as is" basis and the user is not relying on the accuracy
+or functionality of the software for any purpose. The user further
+acknowledges that any use of this software will be at his own risk
+and the copyright owner accepts no responsibility whatsoever arising from
+the use or application of the software.
+
+SMA is a registered trademark of SMA Solar Technology AG
+
+************************************************************************************************/
+
+/*
+ * SBFspotBench - Benchmarks for the protocol, decode and export hot paths of SBFspot
+ *
+ * Each benchmark runs on synthetic plants of 1, 10, 100 and 1000 inverters
+ * No inverters are needed: replies are built with the same functions SBFspot uses to build requests
+ * and are fed to SBFspot through a socket pair (Bluetooth) or a capture file (Speedwire)
+ *
+ * Compile: make bench
+ * Usage: SBFspotBench [-t:ms] [-b:name] [-out:path] [-sql:file]
+ *	-t:ms		Minimum run time per benchmark and plant size (default 1000ms)
+ *	-b:name		Only run benchmarks starting with name (e.g. -b:getPacket)
+ *	-out:path	Folder for the temporary CSV, database and capture files (default .)
+ *	-sql:file	SQLite script to create the database (default CreateSQLiteDB.sql)
+ *
+ * Run it from the SBFspot source folder to use the taglist and database script
+ */
+
+#include "version.h"
+#include "osselect.h"
+#include "SBFspot.h"
+#include "misc.h"
+#include "SBFNet.h"
+#include "bluetooth.h"
+#include "Ethernet.h"
+#include "ArchData.h"
+#include "CSVexport.h"
+#include "SQLselect.h"
+#include "mqtt.h"
+#include "Capture.h"
+#include "HttpServer.h"
+#include <stdio.h>
+#include <string.h>
+#include <fstream>
+#include <sstream>
+#include <deque>
+#include <map>
+#include <boost/algorithm/string.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#define BENCH_SUSYID	131
+#define BENCH_SERIAL	2100000000
+#define BENCH_IP		"127.0.%d.%d"	// One address per device
+#define BENCH_BATCH		64		// Max number of BT packets queued in the socket pair
+#define ARCH_RECSPERPACKET	60	// Day records per reply packet
+
+// Offset of the packet count in a Speedwire datagram (14 bytes L1 header + 24)
+#define ETH_PCKTCOUNT_OFFSET	38
+
+static const int plantSizes[] = {1, 10, 100, 1000};
+
+static int minTime = 1000;
+static std::string benchFilter;
+static std::string outputPath = ".";
+static std::string sqlScript = "CreateSQLiteDB.sql";
+static Config cfg;
+static std::vector<std::string> tempFiles;
+
+// Records of a spot AC reply (SpotACPower, SpotACVoltage and SpotGridFrequency)
+static const unsigned long spotACRecords[] =
+{
+	GridMsWphsA, GridMsWphsB, GridMsWphsC,
+	GridMsPhVphsA, GridMsPhVphsB, GridMsPhVphsC,
+	GridMsAphsA_1, GridMsAphsB_1, GridMsAphsC_1,
+	GridMsHz
+};
+
+static const time_t benchTime = time(NULL);
+
+static boost::posix_time::ptime now(void)
+{
+	return boost::posix_time::microsec_clock::universal_time();
+}
+
+static double elapsed_us(const boost::posix_time::ptime &start)
+{
+	return (double)(now() - start).total_microseconds();
+}
+
+static InverterData **createPlant(int size)
+{
+	InverterData **plant = new InverterData*[size + 1];
+
+	for (int inv = 0; inv < size; inv++)
+	{
+		InverterData *invData = new InverterData;
+		resetInverterData(invData);
+
+		invData->SUSyID = BENCH_SUSYID;
+		invData->Serial = BENCH_SERIAL + inv;
+		invData->BTAddress[0] = inv & 0xFF;
+		invData->BTAddress[1] = (inv >> 8) & 0xFF;
+		snprintf(invData->IPAddress, sizeof(invData->IPAddress), BENCH_IP, 1 + inv / 250, 2 + inv % 250);
+		snprintf(invData->DeviceName, sizeof(invData->DeviceName), "SN: %lu", invData->Serial);
+		strcpy(invData->DeviceClass, "Solar Inverters");
+		strcpy(invData->DeviceType, "SB 3000TL-21");
+		strcpy(invData->SWVersion, "03.01.16.R");
+		invData->DevClass = SolarInverter;
+		invData->DeviceStatus = 307;		// Ok
+		invData->GridRelayStatus = 51;		// Closed
+		invData->InverterDatetime = benchTime;
+		invData->Pdc1 = 1200 + inv % 97;
+		invData->Pdc2 = 1100 + inv % 89;
+		invData->Udc1 = 32150 + inv % 83;
+		invData->Udc2 = 31870 + inv % 79;
+		invData->Idc1 = 3732 + inv % 73;
+		invData->Idc2 = 3451 + inv % 71;
+		invData->Pac1 = 2200 + inv % 67;
+		invData->Iac1 = 9565 + inv % 61;
+		invData->Uac1 = 23012 + inv % 59;
+		invData->TotalPac = invData->Pac1;
+		invData->calPdcTot = invData->Pdc1 + invData->Pdc2;
+		invData->calPacTot = invData->Pac1;
+		invData->calEfficiency = 100.0f * invData->calPacTot / invData->calPdcTot;
+		invData->GridFreq = 4999 + inv % 3;
+		invData->EToday = 12345 + inv;
+		invData->ETotal = 23456789 + inv * 1000;
+		invData->OperationTime = 34567890 + inv;
+		invData->FeedInTime = 33456789 + inv;
+		invData->Temperature = 4250 + inv % 53;
+		plant[inv] = invData;
+	}
+
+	plant[size] = NULL;
+	return plant;
+}
+
+static void freePlant(InverterData **plant, int size)
+{
+	for (int inv = 0; inv < size; inv++)
+		delete plant[inv];
+	delete[] plant;
+}
+
+// Build the reply of a device on a spot AC request, the way the inverter sends it (Bluetooth or Speedwire)
+static void writeSpotReply(unsigned char *buf, InverterData *invData)
+{
+	writePacketHeader(buf, 0x01, addr_unknown);
+	writePacket(buf, 0x09, 0xA0, 0, invData->SUSyID, invData->Serial);
+	writeLong(buf, 0x51000201);
+	writeLong(buf, spotACRecords[0]);
+	writeLong(buf, spotACRecords[ARRAYSIZE(spotACRecords) - 1] | 0xFF);
+
+	for (unsigned int rec = 0; rec < ARRAYSIZE(spotACRecords); rec++)
+	{
+		unsigned long value = (unsigned long)invData->Pac1 * (rec + 1) + invData->Serial % 1000;
+		writeLong(buf, 0x40000001 | spotACRecords[rec]);
+		writeLong(buf, (unsigned long)invData->InverterDatetime);
+		for (int i = 0; i < 4; i++)
+			writeLong(buf, value);
+		writeLong(buf, 1);
+	}
+
+	writePacketTrailer(buf);
+	writePacketLength(buf);
+}
+
+/*
+ * Benchmarks
+ * Each function runs once over the whole plant and returns the measured time in microseconds (-1 on error)
+ */
+
+// Build and checksum (FCS16) a spot data request for each device (Bluetooth)
+static double bench_writePacket(InverterData *plant[], int size)
+{
+	ConnType = CT_BLUETOOTH;
+	boost::posix_time::ptime start = now();
+
+	for (int inv = 0; inv < size; inv++)
+	{
+		pcktID++;
+		writePacketHeader(pcktBuf, 0x01, plant[inv]->BTAddress);
+		writePacket(pcktBuf, 0x09, 0xA0, 0, plant[inv]->SUSyID, plant[inv]->Serial);
+		writeLong(pcktBuf, 0x51000200);
+		writeLong(pcktBuf, spotACRecords[0]);
+		writeLong(pcktBuf, spotACRecords[ARRAYSIZE(spotACRecords) - 1] | 0xFF);
+		writePacketTrailer(pcktBuf);
+		writePacketLength(pcktBuf);
+	}
+
+	return elapsed_us(start);
+}
+
+// Receive and unescape a Bluetooth spot AC reply of each device
+static double bench_getPacket(InverterData *plant[], int size)
+{
+	int sv[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0)
+	{
+		perror("socketpair");
+		return -1;
+	}
+
+	// bthRead() reads from our end of the socket pair
+	SOCKET sock_save = sock;
+	sock = sv[0];
+	ConnType = CT_BLUETOOTH;
+
+	double elapsed = 0;
+	for (int first = 0; (first < size) && (elapsed >= 0); first += BENCH_BATCH)
+	{
+		int last = (first + BENCH_BATCH < size) ? first + BENCH_BATCH : size;
+
+		for (int inv = first; inv < last; inv++)
+		{
+			writeSpotReply(pcktBuf, plant[inv]);
+			if (write(sv[1], pcktBuf, packetposition) != packetposition)
+			{
+				perror("write");
+				elapsed = -1;
+			}
+		}
+
+		boost::posix_time::ptime start = now();
+		for (int inv = first; (inv < last) && (elapsed >= 0); inv++)
+		{
+			if (getPacket(addr_unknown, 1) != E_OK)
+			{
+				puts("getPacket() failed");
+				elapsed = -1;
+			}
+		}
+		if (elapsed >= 0) elapsed += elapsed_us(start);
+	}
+
+	close(sv[0]);
+	close(sv[1]);
+	sock = sock_save;
+
+	return elapsed;
+}
+
+// Decode a Speedwire spot AC reply of each device
+// The memcpy stands for recvfrom(): ethGetPacket() receives the datagram in front of pcktBuf
+static double bench_decode(InverterData *plant[], int size)
+{
+	ConnType = CT_ETHERNET;
+
+	std::vector<std::vector<unsigned char> > datagrams(size);
+	for (int inv = 0; inv < size; inv++)
+	{
+		writeSpotReply(pcktBuf, plant[inv]);
+		datagrams[inv].assign(pcktBuf, pcktBuf + packetposition);
+	}
+
+	boost::posix_time::ptime start = now();
+
+	for (int inv = 0; inv < size; inv++)
+	{
+		memcpy(pcktBuf + 1 - sizeof(ethPacketHeaderL1), &datagrams[inv][0], datagrams[inv].size());
+		pcktBuf[0] = 0;
+		packetposition = datagrams[inv].size() - sizeof(ethPacketHeaderL1);
+		decodeInverterData(plant, inv, SpotACPower | SpotACVoltage | SpotGridFrequency);
+	}
+
+	return elapsed_us(start);
+}
+
+// Midnight of the day, days back from benchTime
+static time_t benchDayStart(int day)
+{
+	time_t t = benchTime - day * 86400;
+	struct tm start_tm;
+	memcpy(&start_tm, localtime(&t), sizeof(start_tm));
+	start_tm.tm_hour = 0;
+	start_tm.tm_min = 0;
+	start_tm.tm_sec = 0;
+	start_tm.tm_isdst = -1;
+	return mktime(&start_tm);
+}
+
+/*
+ * Archived days asked by one request of BackfillDayData()
+ */
+struct BenchBackfillRequest
+{
+	int inv;
+	int req;			// 0 = today and the days before
+	unsigned short pcktID;
+	time_t from;
+	time_t to;
+	time_t next;		// First record of the next fragment
+	int fragments;		// Fragments still to send
+};
+
+static void writeBackfillRequest(InverterData *plant[], BenchBackfillRequest &r, int days, int &seq)
+{
+	// Days go back in time: request 0 asks today and the 6 days before
+	int firstDay = r.req * ARCH_DAYSPERREQUEST;
+	int lastDay = std::min(firstDay + ARCH_DAYSPERREQUEST, days) - 1;
+	r.from = benchDayStart(lastDay) - 300;
+	r.to = benchDayStart(firstDay) + 86100;
+	r.next = r.from;
+	r.fragments = (int)(((r.to - r.from) / 300 + ARCH_RECSPERPACKET) / ARCH_RECSPERPACKET);
+	r.pcktID = pcktID = seq++ % 0x7FFF + 1;
+
+	InverterData *inv = plant[r.inv];
+	writePacketHeader(pcktBuf, 0x01, inv->BTAddress);
+	writePacket(pcktBuf, 0x09, 0xE0, 0, inv->SUSyID, inv->Serial);
+	writeLong(pcktBuf, 0x70000200);
+	writeLong(pcktBuf, r.from);
+	writeLong(pcktBuf, r.to);
+	writePacketTrailer(pcktBuf);
+	writePacketLength(pcktBuf);
+	capWrite('>', inv->IPAddress, pcktBuf, packetposition);
+}
+
+static void writeBackfillFragment(InverterData *plant[], BenchBackfillRequest &r, time_t oldest)
+{
+	InverterData *inv = plant[r.inv];
+	pcktID = r.pcktID;
+	writePacketHeader(pcktBuf, 0x01, addr_unknown);
+	writePacket(pcktBuf, 0x09, 0xE0, 0, inv->SUSyID, inv->Serial);
+	writeLong(pcktBuf, 0x70000201);
+	writeLong(pcktBuf, r.from);
+	writeLong(pcktBuf, r.to);
+	for (int rec = 0; (rec < ARCH_RECSPERPACKET) && (r.next <= r.to); rec++, r.next += 300)
+	{
+		unsigned long long totalWh = inv->ETotal + (r.next - oldest) / 300 * 200 + (r.next / 300) % 50;
+		writeLong(pcktBuf, (unsigned long)r.next);
+		writeLong(pcktBuf, (unsigned long)(totalWh & 0xFFFFFFFF));
+		writeLong(pcktBuf, (unsigned long)(totalWh >> 32));
+	}
+	writePacketTrailer(pcktBuf);
+	writePacketLength(pcktBuf);
+	r.fragments--;
+	pcktBuf[ETH_PCKTCOUNT_OFFSET] = r.fragments & 0xFF;
+	pcktBuf[ETH_PCKTCOUNT_OFFSET + 1] = (r.fragments >> 8) & 0xFF;
+	capWrite('<', inv->IPAddress, pcktBuf, packetposition);
+}
+
+/*
+ * Record the requests and replies of BackfillDayData() for a number of days
+ * The requests are in the order BackfillDayData() sends them: maxPerDevice requests per device,
+ * then the next request of a device as soon as its previous one is answered (each device has its own IP address)
+ * Like on a real network, the devices answer at the same time: the fragments of all pending requests take turns
+ */
+static int writeBackfillCapture(const std::string &filename, InverterData *plant[], int size, int days, int maxPerDevice)
+{
+	if (capOpen(filename.c_str(), CAP_RECORD) != 0)
+		return -1;
+
+	ConnType = CT_ETHERNET;
+	unsigned short pcktID_save = pcktID;
+	int requests = (days + ARCH_DAYSPERREQUEST - 1) / ARCH_DAYSPERREQUEST;
+	time_t oldest = benchDayStart(days - 1) - 300;
+	int seq = 0;
+
+	std::deque<BenchBackfillRequest> pending;
+	for (int inv = 0; inv < size; inv++)
+	{
+		for (int req = 0; (req < maxPerDevice) && (req < requests); req++)
+		{
+			BenchBackfillRequest r;
+			r.inv = inv;
+			r.req = req;
+			writeBackfillRequest(plant, r, days, seq);
+			pending.push_back(r);
+		}
+	}
+
+	while (!pending.empty())
+	{
+		BenchBackfillRequest r = pending.front();
+		pending.pop_front();
+		writeBackfillFragment(plant, r, oldest);
+
+		if (r.fragments > 0)
+			pending.push_back(r);
+		else if (r.req + maxPerDevice < requests)
+		{
+			r.req += maxPerDevice;
+			writeBackfillRequest(plant, r, days, seq);
+			pending.push_back(r);
+		}
+	}
+
+	capClose();
+	pcktID = pcktID_save;
+
+	return 0;
+}
+
+static void countBackfillDay(InverterData *inverters[], time_t day, void *param)
+{
+	(*(int *)param)++;
+}
+
+// Get and parse the archived days (5 min records) of each device from a replayed capture (Speedwire)
+static double benchBackfill(InverterData *plant[], int size, int days, int maxPerDevice)
+{
+	static std::map<int, int> capSize;	// Plant size of the capture file per number of days
+	std::stringstream filename;
+	filename << outputPath << FOLDER_SEP << "SBFspotBench-Backfill-" << days << ".txt";
+
+	if (capSize[days] != size)
+	{
+		if (writeBackfillCapture(filename.str(), plant, size, days, maxPerDevice) != 0)
+			return -1;
+		if (capSize[days] == 0) tempFiles.push_back(filename.str());
+		capSize[days] = size;
+	}
+
+	if (capOpen(filename.str().c_str(), CAP_REPLAY) != 0)
+		return -1;
+
+	ConnType = CT_ETHERNET;
+	int dayCount = 0;
+	boost::posix_time::ptime start = now();
+
+	E_SBFSPOT rc = BackfillDayData(plant, benchTime, days, maxPerDevice, countBackfillDay, &dayCount);
+	double elapsed = elapsed_us(start);
+	capClose();
+
+	if ((rc != E_OK) || (dayCount != days))
+	{
+		printf("BackfillDayData() returned %d after %d of %d days\n", rc, dayCount, days);
+		return -1;
+	}
+
+	return elapsed;
+}
+
+// One day, one request per device
+static double bench_BackfillDayData_1d(InverterData *plant[], int size)
+{
+	return benchBackfill(plant, size, 1, 1);
+}
+
+// Two weeks with ArchiveConcurrency=2: both requests of a device are in flight at once
+static double bench_BackfillDayData_14d(InverterData *plant[], int size)
+{
+	return benchBackfill(plant, size, 14, 2);
+}
+
+static double bench_ExportSpotDataToCSV(InverterData *plant[], int size)
+{
+	boost::posix_time::ptime start = now();
+
+	if (ExportSpotDataToCSV(&cfg, plant) != 0)
+		return -1;
+
+	// One polling cycle: the file stays open, rows are flushed at the end of the cycle
+	CSVflush(&cfg);
+
+	return elapsed_us(start);
+}
+
+#if defined(USE_SQLITE)
+static db_SQL_Export db;
+
+static int createDatabase(const std::string &filename)
+{
+	std::ifstream fs(sqlScript.c_str());
+	if (!fs.is_open())
+	{
+		printf("Unable to open %s\n", sqlScript.c_str());
+		return -1;
+	}
+
+	std::stringstream sql;
+	sql << fs.rdbuf();
+
+	remove(filename.c_str());
+
+	sqlite3 *dbHandle = NULL;
+	int rc = sqlite3_open(filename.c_str(), &dbHandle);
+	if (rc == SQLITE_OK)
+		rc = sqlite3_exec(dbHandle, sql.str().c_str(), NULL, NULL, NULL);
+	if (rc != SQLITE_OK)
+		printf("Unable to create database %s: %s\n", filename.c_str(), sqlite3_errmsg(dbHandle));
+	sqlite3_close(dbHandle);
+
+	return rc;
+}
+
+static double bench_spot_data(InverterData *plant[], int size)
+{
+	static time_t spottime = benchTime;
+
+	if (!db.isopen())
+	{
+		std::string filename = outputPath + FOLDER_SEP + "SBFspotBench.db";
+		if (createDatabase(filename) != SQLITE_OK)
+			return -1;
+		tempFiles.push_back(filename);
+
+		if (db.open("", "", "", filename) != SQLITE_OK)
+			return -1;
+	}
+
+	// Each run is a new polling cycle
+	spottime += 300;
+	boost::posix_time::ptime start = now();
+
+	if (db.spot_data(plant, spottime) != SQLITE_OK)
+		return -1;
+
+	return elapsed_us(start);
+}
+#endif
+
+// Build the MQTT message of each device (without publishing it)
+static double bench_mqtt_message(InverterData *plant[], int size)
+{
+	std::vector<std::string> items;
+	boost::split(items, cfg.mqtt_publish_data, boost::is_any_of(","));
+
+	size_t length = 0;
+	boost::posix_time::ptime start = now();
+
+	for (int inv = 0; inv < size; inv++)
+		length += mqtt_message(&cfg, plant[inv], items).length();
+
+	return (length > 0) ? elapsed_us(start) : -1;
+}
+
+// Render the JSON and Prometheus snapshot of the HTTP server (without serving it)
+static double bench_http_snapshot(InverterData *plant[], int size)
+{
+	static HttpServer http;
+	boost::posix_time::ptime start = now();
+
+	http.update(&cfg, plant);
+
+	return elapsed_us(start);
+}
+
+typedef double (*BenchFunc)(InverterData *plant[], int size);
+
+typedef struct
+{
+	const char *name;
+	BenchFunc func;
+} Benchmark;
+
+static const Benchmark benchmarks[] =
+{
+	{ "writePacket",			bench_writePacket },
+	{ "getPacket",				bench_getPacket },
+	{ "decodeInverterData",		bench_decode },
+	{ "BackfillDayData_1d",		bench_BackfillDayData_1d },
+	{ "BackfillDayData_14d",	bench_BackfillDayData_14d },
+	{ "ExportSpotDataToCSV",	bench_ExportSpotDataToCSV },
+#if defined(USE_SQLITE)
+	{ "spot_data",				bench_spot_data },
+#endif
+	{ "mqtt_message",			bench_mqtt_message },
+	{ "http_snapshot",			bench_http_snapshot }
+};
+
+static void initConfig(void)
+{
+	strcpy(cfg.outputPath, outputPath.c_str());
+	strcpy(cfg.plantname, "SBFspotBench");
+	strcpy(cfg.DateTimeFormat, "%d/%m/%Y %H:%M:%S");
+	strcpy(cfg.DateFormat, "%d/%m/%Y");
+	strcpy(cfg.TimeFormat, "%H:%M:%S");
+	strcpy(cfg.prgVersion, VERSION);
+	strcpy(cfg.locale, "en-US");
+	cfg.delimiter = ';';
+	cfg.precision = 3;
+	cfg.decimalpoint = ',';
+	cfg.CSV_Header = 1;
+	cfg.CSV_ExtendedHeader = 1;
+	cfg.SpotTimeSource = 0;
+	cfg.SpotWebboxHeader = 0;
+	cfg.sunrise = 6.5f;
+	cfg.sunset = 21.25f;
+	cfg.mqtt_publish_data = "Timestamp,SunRise,SunSet,InvSerial,InvName,InvTime,InvStatus,InvTemperature,InvGridRelay,EToday,ETotal,PACTot,UDC1,UDC2,IDC1,IDC2,PDC1,PDC2";
+	cfg.mqtt_item_format = "\"{key}\": {value}";
+	cfg.mqtt_item_delimiter = ",";
+	cfg.quiet = 1;
+
+	std::stringstream csvfile;
+	csvfile << outputPath << FOLDER_SEP << cfg.plantname << "-Spot-" << strftime_t("%Y%m%d", benchTime) << ".csv";
+	tempFiles.push_back(csvfile.str());
+}
+
+static int parseArgs(int argc, char **argv)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		if (strncmp(argv[i], "-t:", 3) == 0)
+			minTime = atoi(argv[i] + 3);
+		else if (strncmp(argv[i], "-b:", 3) == 0)
+			benchFilter = argv[i] + 3;
+		else if (strncmp(argv[i], "-out:", 5) == 0)
+			outputPath = argv[i] + 5;
+		else if (strncmp(argv[i], "-sql:", 5) == 0)
+			sqlScript = argv[i] + 5;
+		else
+		{
+			printf("Usage: %s [-t:ms] [-b:name] [-out:path] [-sql:file]\n", argv[0]);
+			return -1;
+		}
+	}
+
+	if (minTime <= 0) minTime = 1;
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	if (parseArgs(argc, argv) != 0)
+		return 1;
+
+	initConfig();
+
+	if (tagdefs.readall("", cfg.locale) != TagDefs::READ_OK)
+		puts("Taglist not found - Status texts will be shown as '?'");
+
+	printf("SBFspotBench V%s - Minimum run time %dms\n\n", VERSION, minTime);
+	printf("%-20s %9s %8s %14s %14s\n", "Benchmark", "Inverters", "Runs", "usec/run", "usec/inverter");
+
+	int rc = 0;
+
+	for (unsigned int b = 0; b < ARRAYSIZE(benchmarks); b++)
+	{
+		if (strncmp(benchmarks[b].name, benchFilter.c_str(), benchFilter.length()) != 0)
+			continue;
+
+		for (unsigned int p = 0; p < ARRAYSIZE(plantSizes); p++)
+		{
+			int size = plantSizes[p];
+			InverterData **plant = createPlant(size);
+
+			// Warm up (and setup of files)
+			double elapsed = benchmarks[b].func(plant, size);
+			int runs = 0;
+
+			if (elapsed >= 0)
+			{
+				elapsed = 0;
+				while ((elapsed < minTime * 1000.0) || (runs == 0))
+				{
+					double run = benchmarks[b].func(plant, size);
+					if (run < 0)
+					{
+						elapsed = run;
+						break;
+					}
+					elapsed += run;
+					runs++;
+				}
+			}
+
+			if (elapsed < 0)
+			{
+				printf("%-20s %9d Failed\n", benchmarks[b].name, size);
+				rc = 1;
+			}
+			else
+				printf("%-20s %9d %8d %14.1f %14.3f\n", benchmarks[b].name, size, runs, elapsed / runs, elapsed / runs / size);
+
+			freePlant(plant, size);
+		}
+	}
+
+#if defined(USE_SQLITE)
+	db.close();
+#endif
+
+	CSVclose();
+
+	for (std::vector<std::string>::iterator it = tempFiles.begin(); it != tempFiles.end(); ++it)
+		remove(it->c_str());
+
+	return rc;
+}
@@ -0,0 +1,327 @@
+/************************************************************************************************
+SBFspot - Yet another tool to read power production of SMA solar inverters
+(c)2012-2020, SBF
+
+Latest version found at https://github.com/SBFspot/SBFspot
+
+License: Attribution-NonCommercial-ShareAlike 3.0 Unported (CC BY-NC-SA 3.0)
+http://creativecommons.org/licenses/by-nc-sa/3.0/
+
+You are free:
+to Share  to copy, distribute and transmit the work
+to Remix  to adapt the work
+Under the following conditions:
+Attribution:
+You must attribute the work in the manner specified by the author or licensor
+(but not in any way that suggests that they endorse you or your use of the work).
+Noncommercial:
+You may not use this work for commercial purposes.
+Share Alike:
+If you alter, transform, or build upon this work, you may distribute the resulting work
+only under the same or similar license to this one.
+
+DISCLAIMER:
+A user of SBFspot software acknowledges that he or she is receiving this
+software on an "as is" basis and the user is not relying on the accuracy
+or functionality of the software for any purpose. The user further
+acknowledges that any use of this software will be at his own risk
+and the copyright owner accepts no responsibility whatsoever arising from
+the use or application of the software.
+
+SMA is a registered trademark of SMA Solar Technology AG
+
+************************************************************************************************/
+
+/*
+ * SBFspotBroker - Minimal MQTT 3.1.1 broker for testing the builtin publisher (MQTT_Publisher=builtin)
+ *
+ * Received packets are shown, nothing is forwarded to subscribers. QoS 1 messages are acknowledged,
+ * PINGREQ is answered and a client that is silent for 1.5 times its keep alive period is disconnected,
+ * like a real broker does.
+ * To test redelivery, -drop# closes the connection instead of acknowledging every #th PUBLISH
+ * -noping leaves PINGREQ unanswered, to test the detection of a dead connection
+ *
+ * Compile: make broker
+ * Usage: SBFspotBroker [-port:1883] [-drop#] [-noping]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define BROKER_MAXCLIENTS	16
+
+// Control packet types (high nibble of the fixed header)
+#define MQTT_CONNECT		0x10
+#define MQTT_CONNACK		0x20
+#define MQTT_PUBLISH		0x30
+#define MQTT_PUBACK			0x40
+#define MQTT_PINGREQ		0xC0
+#define MQTT_PINGRESP		0xD0
+#define MQTT_DISCONNECT		0xE0
+
+typedef struct
+{
+	int sock;
+	int id;
+	int keepalive;			// Seconds (0 = no timeout)
+	time_t lastrecv;
+	std::string rxbuf;		// Incomplete packet
+} Client;
+
+static volatile sig_atomic_t stop = 0;
+
+static uint16_t get_ushort(const std::string &buf, size_t pos)
+{
+	return ((unsigned char)buf[pos] << 8) | (unsigned char)buf[pos + 1];
+}
+
+// 2 byte length followed by the string, empty when it doesn't fit in the packet
+static std::string get_string(const std::string &buf, size_t &pos)
+{
+	if (pos + 2 > buf.size()) return "";
+	size_t len = get_ushort(buf, pos);
+	pos += 2;
+	if (pos + len > buf.size()) return "";
+	std::string str = buf.substr(pos, len);
+	pos += len;
+	return str;
+}
+
+static void closeClient(Client *client, const char *reason)
+{
+	printf("%-10s conn%d\n", reason, client->id);
+	close(client->sock);
+	client->sock = -1;
+	client->rxbuf.clear();
+}
+
+// Returns 0 when the connection should be closed
+static int handlePacket(Client *client, unsigned char header, const std::string &body, int drop, int noping)
+{
+	static int published = 0;
+	unsigned char type = header & 0xF0;
+
+	if ((type == MQTT_CONNECT) && (body.size() >= 10))
+	{
+		size_t pos = 0;
+		std::string protocol = get_string(body, pos);
+		unsigned char level = body[pos++];
+		unsigned char flags = body[pos++];
+		client->keepalive = get_ushort(body, pos);
+		pos += 2;
+		std::string clientid = get_string(body, pos);
+		std::string username = (flags & 0x80) ? get_string(body, pos) : "";
+
+		printf("%-10s conn%d %s level=%d flags=0x%02X keepalive=%d id=%s user=%s\n", "CONNECT", client->id, protocol.c_str(), level, flags, client->keepalive, clientid.c_str(), username.c_str());
+
+		const unsigned char connack[] = { MQTT_CONNACK, 2, 0, 0 };
+		send(client->sock, connack, sizeof(connack), MSG_NOSIGNAL);
+	}
+	else if (type == MQTT_PUBLISH)
+	{
+		int qos = (header >> 1) & 0x03;
+		size_t pos = 0;
+		std::string topic = get_string(body, pos);
+		uint16_t id = 0;
+		if ((qos > 0) && (pos + 2 <= body.size()))
+		{
+			id = get_ushort(body, pos);
+			pos += 2;
+		}
+		std::string payload = (pos < body.size()) ? body.substr(pos) : "";
+
+		printf("%-10s conn%d dup=%d qos=%d retain=%d id=%u topic=%s payload=%.60s\n", "PUBLISH", client->id, (header >> 3) & 0x01, qos, header & 0x01, id, topic.c_str(), payload.c_str());
+
+		if ((drop > 0) && (++published % drop == 0))
+			return 0;
+
+		if (qos > 0)
+		{
+			const unsigned char puback[] = { MQTT_PUBACK, 2, (unsigned char)(id >> 8), (unsigned char)(id & 0xFF) };
+			send(client->sock, puback, sizeof(puback), MSG_NOSIGNAL);
+		}
+	}
+	else if (type == MQTT_PINGREQ)
+	{
+		printf("%-10s conn%d%s\n", "PINGREQ", client->id, noping ? " (ignored)" : "");
+
+		if (!noping)
+		{
+			const unsigned char pingresp[] = { MQTT_PINGRESP, 0 };
+			send(client->sock, pingresp, sizeof(pingresp), MSG_NOSIGNAL);
+		}
+	}
+	else if (type == MQTT_DISCONNECT)
+		return 0;
+	else
+		printf("%-10s conn%d type=0x%02X\n", "UNKNOWN", client->id, type);
+
+	return 1;
+}
+
+// Process the complete packets in the receive buffer
+// Returns 0 when the connection should be closed
+static int handleData(Client *client, int drop, int noping)
+{
+	for (;;)
+	{
+		// Remaining length: 1-4 bytes of 7 bits
+		size_t length = 0;
+		size_t pos = 1;
+		bool complete = false;
+		for (int shift = 0; (pos < client->rxbuf.size()) && (shift < 28) && !complete; shift += 7)
+		{
+			unsigned char digit = client->rxbuf[pos++];
+			length |= (size_t)(digit & 0x7F) << shift;
+			complete = ((digit & 0x80) == 0);
+		}
+
+		if (!complete || (client->rxbuf.size() < pos + length))
+			return 1;
+
+		unsigned char header = client->rxbuf[0];
+		std::string body = client->rxbuf.substr(pos, length);
+		client->rxbuf.erase(0, pos + length);
+
+		if (handlePacket(client, header, body, drop, noping) == 0)
+			return 0;
+	}
+}
+
+static void signalHandler(int sig)
+{
+	stop = 1;
+}
+
+int main(int argc, char **argv)
+{
+	int port = 1883;
+	int drop = 0;
+	int noping = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strncmp(argv[i], "-port:", 6) == 0)
+			port = atoi(argv[i] + 6);
+		else if ((strncmp(argv[i], "-drop", 5) == 0) && (argv[i][5] != 0))
+			drop = atoi(argv[i] + 5);
+		else if (strcmp(argv[i], "-noping") == 0)
+			noping = 1;
+		else
+		{
+			printf("Usage: SBFspotBroker [-port:1883] [-drop#] [-noping]\n");
+			printf(" -port:#     TCP port (default=1883)\n");
+			printf(" -drop#      Close the connection at every #th PUBLISH\n");
+			printf(" -noping     Don't answer PINGREQ\n");
+			return 1;
+		}
+	}
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	int listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	int reuse = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+	if ((listener < 0) || (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) < 0) || (listen(listener, 5) < 0))
+	{
+		perror("bind");
+		return 1;
+	}
+
+	setvbuf(stdout, NULL, _IOLBF, 0);	// Show the packets when redirected to a file
+	printf("Broker: %s:%d\n", inet_ntoa(addr.sin_addr), port);
+
+	signal(SIGINT, signalHandler);
+	signal(SIGTERM, signalHandler);
+
+	Client clients[BROKER_MAXCLIENTS];
+	for (int i = 0; i < BROKER_MAXCLIENTS; i++)
+		clients[i].sock = -1;
+	int connections = 0;
+
+	while (stop == 0)
+	{
+		fd_set readfds;
+		FD_ZERO(&readfds);
+		FD_SET(listener, &readfds);
+		int maxfd = listener;
+		for (int i = 0; i < BROKER_MAXCLIENTS; i++)
+		{
+			if (clients[i].sock < 0) continue;
+			FD_SET(clients[i].sock, &readfds);
+			if (clients[i].sock > maxfd) maxfd = clients[i].sock;
+		}
+
+		struct timeval tv;
+		tv.tv_sec = 1;
+		tv.tv_usec = 0;
+
+		if (select(maxfd + 1, &readfds, NULL, NULL, &tv) > 0)
+		{
+			if (FD_ISSET(listener, &readfds))
+			{
+				int sock = accept(listener, NULL, NULL);
+				int i = 0;
+				while ((i < BROKER_MAXCLIENTS) && (clients[i].sock >= 0)) i++;
+				if (i == BROKER_MAXCLIENTS)
+					close(sock);
+				else if (sock >= 0)
+				{
+					clients[i].sock = sock;
+					clients[i].id = ++connections;
+					clients[i].keepalive = 0;
+					clients[i].lastrecv = time(NULL);
+				}
+			}
+
+			for (int i = 0; i < BROKER_MAXCLIENTS; i++)
+			{
+				if ((clients[i].sock < 0) || !FD_ISSET(clients[i].sock, &readfds)) continue;
+
+				char buffer[1024];
+				int len = recv(clients[i].sock, buffer, sizeof(buffer), 0);
+				if (len <= 0)
+				{
+					closeClient(&clients[i], "CLOSED");
+					continue;
+				}
+
+				clients[i].lastrecv = time(NULL);
+				clients[i].rxbuf.append(buffer, len);
+				if (handleData(&clients[i], drop, noping) == 0)
+					closeClient(&clients[i], "DISCONNECT");
+			}
+		}
+
+		// MQTT 3.1.1 - 3.1.2.10: disconnect after one and a half times the keep alive period
+		time_t now = time(NULL);
+		for (int i = 0; i < BROKER_MAXCLIENTS; i++)
+		{
+			if ((clients[i].sock >= 0) && (clients[i].keepalive > 0) && (2 * (now - clients[i].lastrecv) > 3 * clients[i].keepalive))
+				closeClient(&clients[i], "TIMEOUT");
+		}
+	}
+
+	for (int i = 0; i < BROKER_MAXCLIENTS; i++)
+	{
+		if (clients[i].sock >= 0)
+			close(clients[i].sock);
+	}
+	close(listener);
+
+	return 0;
+}
@@ -0,0 +1,490 @@
+/************************************************************************************************
+SBFspot - Yet another tool to read power production of SMA solar inverters
+(c)2012-2020, SBF
+
+Latest version found at https://github.com/SBFspot/SBFspot
+
+License: Attribution-NonCommercial-ShareAlike 3.0 Unported (CC BY-NC-SA 3.0)
+http://creativecommons.org/licenses/by-nc-sa/3.0/
+
+You are free:
+to Share  to copy, distribute and transmit the work
+to Remix  to adapt the work
+Under the following conditions:
+Attribution:
+You must attribute the work in the manner specified by the author or licensor
+(but not in any way that suggests that they endorse you or your use of the work).
+Noncommercial:
+You may not use this work for commercial purposes.
+Share Alike:
+If you alter, transform, or build upon this work, you may distribute the resulting work
+only under the same or similar license to this one.
+
+DISCLAIMER:
+A user of SBFspot software acknowledges that he or she is receiving this
+software on an "as is" basis and the user is not relying on the accuracy
+or functionality of the software for any purpose. The user further
+acknowledges that any use of this software will be at his own risk
+and the copyright owner accepts no responsibility whatsoever arising from
+the use or application of the software.
+
+SMA is a registered trademark of SMA Solar Technology AG
+
+************************************************************************************************/
+
+/*
+ * SBFspotSim - Simulated Speedwire inverter(s) for testing and benchmarking SBFspot without a plant
+ *
+ * Each simulated inverter listens on its own loopback address (127.0.0.2, 127.0.0.3, ...)
+ * To use it, set IP_Address=127.0.0.2 (or a comma separated list) in SBFspot.cfg
+ *
+ * Supported requests: init, logon/logoff, spot data (AC/DC/energy/status/nameplate/temperature)
+ * and archived day/month data. Events are answered with an empty reply.
+ *
+ * Compile: make sim
+ * Usage: SBFspotSim [-n#] [-addr:127.0.0.2] [-port:9522] [-d]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <signal.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define SIM_MAXINVERTERS	250
+#define SIM_SUSYID			131
+#define SIM_SERIAL			2100000000
+#define SIM_PNOM			3000		// Nominal power (W)
+#define SIM_ETOTAL			5000000		// Energy at 1/1/1970 (Wh) ;-)
+
+// Offsets in a Speedwire datagram
+#define OFS_DSTSUSYID	20
+#define OFS_DSTSERIAL	22
+#define OFS_SRCSUSYID	28
+#define OFS_SRCSERIAL	30
+#define OFS_ERRCODE		36
+#define OFS_PCKTCOUNT	38
+#define OFS_PCKTID		40
+#define OFS_COMMAND		42
+#define OFS_FIRST		46
+#define OFS_LAST		50
+#define OFS_RECORDS		54
+
+#define ARCH_RECSPERPACKET	60	// Day/month records per reply packet
+
+typedef enum
+{
+	R_DWORD,	// 28 byte record
+	R_QWORD,	// 16 byte record
+	R_STATUS,	// 40 byte record with attribute
+	R_NAME,		// 40 byte record with text
+	R_SWVER		// 40 byte record with software version
+} RECTYPE;
+
+typedef struct
+{
+	uint32_t command;
+	uint32_t lri;
+	unsigned char cls;
+	unsigned char dataType;
+	RECTYPE type;
+} SimRecord;
+
+// Values are filled in by simValue()
+static const SimRecord simRecords[] =
+{
+	{ 0x51800200, 0x00214800, 1, 0x08, R_STATUS },	// OperationHealth
+	{ 0x52000200, 0x00237700, 1, 0x40, R_DWORD },	// CoolsysTmpNom
+	{ 0x53800200, 0x00251E00, 1, 0x40, R_DWORD },	// DcMsWatt MPP1
+	{ 0x53800200, 0x00251E00, 2, 0x40, R_DWORD },	// DcMsWatt MPP2
+	{ 0x54000200, 0x00260100, 1, 0x00, R_QWORD },	// MeteringTotWhOut
+	{ 0x54000200, 0x00262200, 1, 0x00, R_QWORD },	// MeteringDyWhOut
+	{ 0x51000200, 0x00263F00, 1, 0x40, R_DWORD },	// GridMsTotW
+	{ 0x51000200, 0x00411E00, 1, 0x00, R_DWORD },	// OperationHealthSttOk
+	{ 0x51000200, 0x00411F00, 1, 0x00, R_DWORD },	// OperationHealthSttWrn
+	{ 0x51000200, 0x00412000, 1, 0x00, R_DWORD },	// OperationHealthSttAlm
+	{ 0x51800200, 0x00416400, 1, 0x08, R_STATUS },	// OperationGriSwStt
+	{ 0x53800200, 0x00451F00, 1, 0x40, R_DWORD },	// DcMsVol MPP1
+	{ 0x53800200, 0x00451F00, 2, 0x40, R_DWORD },	// DcMsVol MPP2
+	{ 0x53800200, 0x00452100, 1, 0x40, R_DWORD },	// DcMsAmp MPP1
+	{ 0x53800200, 0x00452100, 2, 0x40, R_DWORD },	// DcMsAmp MPP2
+	{ 0x54000200, 0x00462E00, 1, 0x00, R_QWORD },	// MeteringTotOpTms
+	{ 0x54000200, 0x00462F00, 1, 0x00, R_QWORD },	// MeteringTotFeedTms
+	{ 0x51000200, 0x00464000, 1, 0x40, R_DWORD },	// GridMsWphsA
+	{ 0x51000200, 0x00464100, 1, 0x40, R_DWORD },	// GridMsWphsB
+	{ 0x51000200, 0x00464200, 1, 0x40, R_DWORD },	// GridMsWphsC
+	{ 0x51000200, 0x00464800, 1, 0x00, R_DWORD },	// GridMsPhVphsA
+	{ 0x51000200, 0x00464900, 1, 0x00, R_DWORD },	// GridMsPhVphsB
+	{ 0x51000200, 0x00464A00, 1, 0x00, R_DWORD },	// GridMsPhVphsC
+	{ 0x51000200, 0x00465300, 1, 0x00, R_DWORD },	// GridMsAphsA
+	{ 0x51000200, 0x00465400, 1, 0x00, R_DWORD },	// GridMsAphsB
+	{ 0x51000200, 0x00465500, 1, 0x00, R_DWORD },	// GridMsAphsC
+	{ 0x51000200, 0x00465700, 1, 0x00, R_DWORD },	// GridMsHz
+	{ 0x58000200, 0x00821E00, 1, 0x10, R_NAME },	// NameplateLocation
+	{ 0x58000200, 0x00821F00, 1, 0x08, R_STATUS },	// NameplateMainModel
+	{ 0x58000200, 0x00822000, 1, 0x08, R_STATUS },	// NameplateModel
+	{ 0x58000200, 0x00823400, 1, 0x08, R_SWVER }	// NameplatePkgRev
+};
+
+static int debug = 0;
+static volatile sig_atomic_t stop = 0;
+
+static void put_short(unsigned char *buf, uint16_t v)
+{
+	buf[0] = v & 0xFF;
+	buf[1] = (v >> 8) & 0xFF;
+}
+
+static void put_long(unsigned char *buf, uint32_t v)
+{
+	for (int i = 0; i < 4; i++)
+		buf[i] = (v >> (8 * i)) & 0xFF;
+}
+
+static void put_longlong(unsigned char *buf, uint64_t v)
+{
+	for (int i = 0; i < 8; i++)
+		buf[i] = (v >> (8 * i)) & 0xFF;
+}
+
+static uint16_t get_ushort(const unsigned char *buf)
+{
+	return buf[0] | (buf[1] << 8);
+}
+
+static uint32_t get_ulong(const unsigned char *buf)
+{
+	return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+// Fraction of nominal power: half a sine wave between 06:00 and 18:00 local time
+static double simSun(time_t t)
+{
+	struct tm tm_local;
+	localtime_r(&t, &tm_local);
+	double hours = tm_local.tm_hour + tm_local.tm_min / 60.0 + tm_local.tm_sec / 3600.0 - 6.0;
+	if ((hours <= 0) || (hours >= 12)) return 0;
+	return sin(M_PI * hours / 12.0);
+}
+
+// Energy produced today until t (Wh)
+static double simEnergyToday(int inv, time_t t)
+{
+	struct tm tm_local;
+	localtime_r(&t, &tm_local);
+	double hours = tm_local.tm_hour + tm_local.tm_min / 60.0 + tm_local.tm_sec / 3600.0 - 6.0;
+	if (hours <= 0) return 0;
+	if (hours > 12) hours = 12;
+	return (SIM_PNOM + 100 * inv) * 12.0 / M_PI * (1 - cos(M_PI * hours / 12.0));
+}
+
+// Total energy produced until t (Wh)
+static uint64_t simEnergyTotal(int inv, time_t t)
+{
+	double perDay = (SIM_PNOM + 100 * inv) * 24.0 / M_PI;
+	return SIM_ETOTAL + (uint64_t)(t / 86400) * (uint64_t)perDay + (uint64_t)simEnergyToday(inv, t);
+}
+
+static int32_t simValue(int inv, const SimRecord *rec, time_t now)
+{
+	int32_t pac = (int32_t)((SIM_PNOM + 100 * inv) * simSun(now));
+	int32_t pdc = (int32_t)(pac / 0.96);
+
+	switch (rec->lri)
+	{
+	case 0x00214800: return 307;							// Ok
+	case 0x00416400: return pac > 0 ? 51 : 311;				// Closed / Open
+	case 0x00821F00: return 8001;							// Solar Inverters
+	case 0x00822000: return 9074;							// SB 3000TL-21
+	case 0x00237700: return 3500 + pac / 2;					// 0.01 degC
+	case 0x00251E00: return rec->cls == 1 ? pdc / 2 : pdc - pdc / 2;
+	case 0x00451F00: return pac > 0 ? 32000 + rec->cls * 1000 : 0;	// 0.01V
+	case 0x00452100: return pac > 0 ? (pdc / 2) * 100000 / (32000 + rec->cls * 1000) : 0;	// mA
+	case 0x00263F00:
+	case 0x00464000: return pac;
+	case 0x00411E00:
+	case 0x00411F00:
+	case 0x00412000: return SIM_PNOM + 100 * inv;
+	case 0x00464800: return 23000 + (int32_t)(now % 100);	// 0.01V
+	case 0x00465300: return pac * 1000 / 230;				// mA
+	case 0x00465700: return 4995 + (int32_t)(now % 10);		// 0.01Hz
+	default: return 0;
+	}
+}
+
+static uint64_t simValue64(int inv, const SimRecord *rec, time_t now)
+{
+	switch (rec->lri)
+	{
+	case 0x00260100: return simEnergyTotal(inv, now);
+	case 0x00262200: return (uint64_t)simEnergyToday(inv, now);
+	case 0x00462E00: return (uint64_t)(now / 86400) * 13 * 3600;	// 13 hours/day
+	case 0x00462F00: return (uint64_t)(now / 86400) * 12 * 3600;	// 12 hours/day
+	default: return 0;
+	}
+}
+
+// Write Speedwire headers, returns position of the first record
+static int writeHeader(unsigned char *buf, const unsigned char *req, int inv, uint16_t errcode, uint16_t pcktcount)
+{
+	memset(buf, 0, OFS_RECORDS);
+	memcpy(buf, req, OFS_RECORDS);	// Copy request and fix what's different
+	put_short(buf + OFS_DSTSUSYID, get_ushort(req + OFS_SRCSUSYID));
+	put_long(buf + OFS_DSTSERIAL, get_ulong(req + OFS_SRCSERIAL));
+	put_short(buf + OFS_SRCSUSYID, SIM_SUSYID);
+	put_long(buf + OFS_SRCSERIAL, SIM_SERIAL + inv);
+	put_short(buf + OFS_ERRCODE, errcode);
+	put_short(buf + OFS_PCKTCOUNT, pcktcount);
+	buf[OFS_COMMAND] = req[OFS_COMMAND] + 1;	// Reply: 0x...0200 => 0x...0201
+	return OFS_RECORDS;
+}
+
+// Write trailer and packet length, returns datagram size
+static int writeTrailer(unsigned char *buf, int pos)
+{
+	put_long(buf + pos, 0);
+	pos += 4;
+	int datalen = pos - 20;
+	buf[12] = (datalen >> 8) & 0xFF;
+	buf[13] = datalen & 0xFF;
+	buf[18] = datalen / 4;	// Longwords
+	return pos;
+}
+
+static int buildSpotReply(unsigned char *buf, const unsigned char *req, int inv)
+{
+	uint32_t command = get_ulong(req + OFS_COMMAND);
+	uint32_t first = get_ulong(req + OFS_FIRST);
+	uint32_t last = get_ulong(req + OFS_LAST);
+	time_t now = time(NULL);
+
+	int pos = writeHeader(buf, req, inv, 0, 0);
+
+	for (unsigned int i = 0; i < sizeof(simRecords) / sizeof(simRecords[0]); i++)
+	{
+		const SimRecord *rec = &simRecords[i];
+		if ((rec->command != command) || (rec->lri < (first & 0x00FFFF00)) || (rec->lri > last)) continue;
+
+		unsigned char *p = buf + pos;
+		put_long(p, (rec->dataType << 24) | rec->lri | rec->cls);
+		put_long(p + 4, (uint32_t)now);
+
+		switch (rec->type)
+		{
+		case R_QWORD:
+			put_longlong(p + 8, simValue64(inv, rec, now));
+			pos += 16;
+			break;
+
+		case R_DWORD:
+			{
+				int32_t value = simValue(inv, rec, now);
+				for (int v = 8; v < 24; v += 4)
+					put_long(p + v, (uint32_t)value);
+				put_long(p + 24, 1);
+				pos += 28;
+			}
+			break;
+
+		case R_STATUS:
+			put_long(p + 8, 0x01000000 | (uint32_t)simValue(inv, rec, now));
+			put_long(p + 12, 0x00FFFFFE);
+			for (int v = 16; v < 40; v += 4)
+				put_long(p + v, 0);
+			pos += 40;
+			break;
+
+		case R_NAME:
+			memset(p + 8, 0, 32);
+			snprintf((char *)p + 8, 32, "SN: %u", SIM_SERIAL + inv);
+			pos += 40;
+			break;
+
+		case R_SWVER:
+			memset(p + 8, 0, 32);
+			p[24] = 4;		// Release
+			p[25] = 0x10;	// Build
+			p[26] = 0x01;	// Minor (BCD)
+			p[27] = 0x03;	// Major (BCD)
+			pos += 40;
+			break;
+		}
+	}
+
+	return writeTrailer(buf, pos);
+}
+
+// Archived day (5 min) or month (daily) data
+static void sendArchive(int sock, const struct sockaddr_in *to, const unsigned char *req, int inv)
+{
+	int interval = (get_ulong(req + OFS_COMMAND) == 0x70000200) ? 300 : 86400;
+	time_t now = time(NULL);
+	time_t from = get_ulong(req + OFS_FIRST);
+	time_t to_time = get_ulong(req + OFS_LAST);
+	if (to_time > now) to_time = now;
+	from -= from % interval;
+
+	int recs = (to_time >= from) ? (int)((to_time - from) / interval) + 1 : 0;
+	int packets = (recs + ARCH_RECSPERPACKET - 1) / ARCH_RECSPERPACKET;
+	if (packets == 0) packets = 1;
+
+	unsigned char buf[OFS_RECORDS + ARCH_RECSPERPACKET * 12 + 4];
+	time_t t = from;
+	for (int pckt = packets - 1; pckt >= 0; pckt--)
+	{
+		int pos = writeHeader(buf, req, inv, 0, pckt);
+		for (int r = 0; (r < ARCH_RECSPERPACKET) && (t <= to_time); r++, t += interval)
+		{
+			put_long(buf + pos, (uint32_t)t);
+			put_longlong(buf + pos + 4, simEnergyTotal(inv, t));
+			pos += 12;
+		}
+		int len = writeTrailer(buf, pos);
+		sendto(sock, buf, len, 0, (const struct sockaddr *)to, sizeof(*to));
+	}
+}
+
+static void handleRequest(int sock, const struct sockaddr_in *from, const unsigned char *req, int len, int inv)
+{
+	if ((len < OFS_RECORDS) || (get_ulong(req) != 0x00414D53))
+		return;
+
+	uint32_t dstSerial = get_ulong(req + OFS_DSTSERIAL);
+	if ((dstSerial != 0xFFFFFFFF) && (dstSerial != (uint32_t)(SIM_SERIAL + inv)))
+		return;
+
+	uint32_t command = get_ulong(req + OFS_COMMAND);
+	if (debug) printf("Inverter %d: command 0x%08X [0x%08X-0x%08X] pcktID %d\n", inv, command, get_ulong(req + OFS_FIRST), get_ulong(req + OFS_LAST), get_ushort(req + OFS_PCKTID) & 0x7FFF);
+
+	unsigned char buf[2048];
+	int replylen = 0;
+
+	switch (command)
+	{
+	case 0xFFFD010E:	// Logoff
+		return;
+
+	case 0x70000200:	// Archived day data
+	case 0x70200200:	// Archived month data
+		sendArchive(sock, from, req, inv);
+		return;
+
+	case 0xFFFD040C:	// Logon
+	case 0x00000200:	// Init
+	case 0x70100200:	// Events (user)
+	case 0x70120200:	// Events (installer)
+		replylen = writeTrailer(buf, writeHeader(buf, req, inv, 0, 0));
+		break;
+
+	default:
+		replylen = buildSpotReply(buf, req, inv);
+	}
+
+	sendto(sock, buf, replylen, 0, (const struct sockaddr *)from, sizeof(*from));
+}
+
+static void signalHandler(int sig)
+{
+	stop = 1;
+}
+
+int main(int argc, char **argv)
+{
+	int count = 1;
+	int port = 9522;
+	const char *baseAddr = "127.0.0.2";
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strncmp(argv[i], "-n", 2) == 0)
+			count = atoi(argv[i] + 2);
+		else if (strncmp(argv[i], "-addr:", 6) == 0)
+			baseAddr = argv[i] + 6;
+		else if (strncmp(argv[i], "-port:", 6) == 0)
+			port = atoi(argv[i] + 6);
+		else if (strcmp(argv[i], "-d") == 0)
+			debug = 1;
+		else
+		{
+			printf("Usage: SBFspotSim [-n#] [-addr:127.0.0.2] [-port:9522] [-d]\n");
+			printf(" -n#         Number of inverters (1-%d, default=1)\n", SIM_MAXINVERTERS);
+			printf(" -addr:IP    Address of first inverter (default=127.0.0.2)\n");
+			printf(" -port:#     UDP port (default=9522)\n");
+			printf(" -d          Show requests\n");
+			return 1;
+		}
+	}
+
+	if ((count < 1) || (count > SIM_MAXINVERTERS))
+	{
+		printf("Number of inverters should be 1-%d\n", SIM_MAXINVERTERS);
+		return 1;
+	}
+
+	int socks[SIM_MAXINVERTERS];
+	uint32_t base = ntohl(inet_addr(baseAddr));
+	int maxfd = 0;
+
+	for (int inv = 0; inv < count; inv++)
+	{
+		struct sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(port);
+		addr.sin_addr.s_addr = htonl(base + inv);
+
+		socks[inv] = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		int reuse = 1;
+		setsockopt(socks[inv], SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+		if ((socks[inv] < 0) || (bind(socks[inv], (struct sockaddr *)&addr, sizeof(addr)) < 0))
+		{
+			perror("bind");
+			return 1;
+		}
+		if (socks[inv] > maxfd) maxfd = socks[inv];
+
+		printf("Inverter %d: %s:%d SUSyID: %d - SN: %u\n", inv, inet_ntoa(addr.sin_addr), port, SIM_SUSYID, SIM_SERIAL + inv);
+	}
+
+	signal(SIGINT, signalHandler);
+	signal(SIGTERM, signalHandler);
+
+	while (stop == 0)
+	{
+		fd_set readfds;
+		FD_ZERO(&readfds);
+		for (int inv = 0; inv < count; inv++)
+			FD_SET(socks[inv], &readfds);
+
+		struct timeval tv;
+		tv.tv_sec = 1;
+		tv.tv_usec = 0;
+
+		if (select(maxfd + 1, &readfds, NULL, NULL, &tv) <= 0)
+			continue;
+
+		for (int inv = 0; inv < count; inv++)
+		{
+			if (!FD_ISSET(socks[inv], &readfds)) continue;
+
+			unsigned char req[2048];
+			struct sockaddr_in from;
+			socklen_t fromlen = sizeof(from);
+			int len = recvfrom(socks[inv], req, sizeof(req), 0, (struct sockaddr *)&from, &fromlen);
+			if (len > 0)
+				handleRequest(socks[inv], &from, req, len, inv);
+		}
+	}
+
+	for (int inv = 0; inv < count; inv++)
+		close(socks[inv]);
+
+	return 0;
+}
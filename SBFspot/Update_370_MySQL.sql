@@ -0,0 +1,158 @@
+-- Upgrade an SBFspot 3.6 database to SchemaVersion 2 (SBFspot 3.7.0)
+
+-- Sums of the SpotData, SpotDataX and Consumption values per Period, written at insert time
+-- Divide by Samples to get the averages
+-- Period 300: TimeStamp is the nearest 5 minutes (like Nearest5min), for SpotDataX the start of the 5 minutes
+-- Period 3600: TimeStamp is the start of the hour
+-- Period 86400: TimeStamp is local midnight
+CREATE Table SpotDataRollup (
+	Period int(4) NOT NULL,
+	TimeStamp int(4) NOT NULL,
+	Serial int(4) NOT NULL,
+	Samples int(4) NOT NULL,
+	Pdc1 bigint, Pdc2 bigint,
+	Idc1 double, Idc2 double,
+	Udc1 double, Udc2 double,
+	Pac1 bigint, Pac2 bigint, Pac3 bigint,
+	Iac1 double, Iac2 double, Iac3 double,
+	Uac1 double, Uac2 double, Uac3 double,
+	Temperature double,
+	PRIMARY KEY (Period, Serial, TimeStamp)
+);
+
+CREATE Table SpotDataXRollup (
+	Period int(4) NOT NULL,
+	`TimeStamp` int(4) NOT NULL,
+	`Serial` int(4) NOT NULL,
+	`Key` int(4) NOT NULL,
+	Samples int(4) NOT NULL,
+	`Value` bigint,
+	PRIMARY KEY (Period, `Serial`, `TimeStamp`, `Key`)
+);
+
+CREATE Table ConsumptionRollup (
+	Period int(4) NOT NULL,
+	TimeStamp int(4) NOT NULL,
+	Samples int(4) NOT NULL,
+	EnergyUsed bigint,
+	PowerUsed bigint,
+	PRIMARY KEY (Period, TimeStamp)
+);
+
+-- Consumption is written by other tools, so it is rolled up by a trigger
+-- Each row counts in Samples, a NULL EnergyUsed or PowerUsed is added as 0 (avg() would skip it)
+DELIMITER //
+CREATE TRIGGER trgConsumptionRollup AFTER INSERT ON Consumption
+	FOR EACH ROW
+BEGIN
+	INSERT INTO ConsumptionRollup VALUES(300, (NEW.TimeStamp + 150) DIV 300 * 300, 1, IFNULL(NEW.EnergyUsed, 0), IFNULL(NEW.PowerUsed, 0))
+	ON DUPLICATE KEY UPDATE Samples = Samples + 1, EnergyUsed = EnergyUsed + VALUES(EnergyUsed), PowerUsed = PowerUsed + VALUES(PowerUsed);
+	INSERT INTO ConsumptionRollup VALUES(3600, NEW.TimeStamp DIV 3600 * 3600, 1, IFNULL(NEW.EnergyUsed, 0), IFNULL(NEW.PowerUsed, 0))
+	ON DUPLICATE KEY UPDATE Samples = Samples + 1, EnergyUsed = EnergyUsed + VALUES(EnergyUsed), PowerUsed = PowerUsed + VALUES(PowerUsed);
+	INSERT INTO ConsumptionRollup VALUES(86400, UNIX_TIMESTAMP(DATE(FROM_UNIXTIME(NEW.TimeStamp))), 1, IFNULL(NEW.EnergyUsed, 0), IFNULL(NEW.PowerUsed, 0))
+	ON DUPLICATE KEY UPDATE Samples = Samples + 1, EnergyUsed = EnergyUsed + VALUES(EnergyUsed), PowerUsed = PowerUsed + VALUES(PowerUsed);
+END//
+DELIMITER ;
+
+-- DayData not yet uploaded to PVoutput (SBFspotUploadDaemon)
+CREATE INDEX idxDayDataPending ON DayData (Serial, PVoutput, TimeStamp);
+
+DROP VIEW IF EXISTS vwAvgConsumption;
+DROP VIEW IF EXISTS vwAvgSpotData;
+DROP VIEW IF EXISTS vwBatteryData;
+
+CREATE VIEW vwAvgConsumption AS
+    SELECT From_UnixTime(TimeStamp) AS Nearest5min,
+    cast(EnergyUsed / Samples As decimal(9)) As EnergyUsed,
+    cast(PowerUsed / Samples As decimal(9)) As PowerUsed
+    FROM ConsumptionRollup
+    WHERE Period = 300;
+
+CREATE VIEW vwAvgSpotData AS
+       SELECT From_UnixTime(TimeStamp) AS nearest5min,
+              serial,
+              cast(Pdc1 / Samples as decimal(9)) AS Pdc1,
+              cast(Pdc2 / Samples as decimal(9)) AS Pdc2,
+              cast(Idc1 / Samples as decimal(9,3)) AS Idc1,
+              cast(Idc2 / Samples as decimal(9,3)) AS Idc2,
+              cast(Udc1 / Samples as decimal(9,2)) AS Udc1,
+              cast(Udc2 / Samples as decimal(9,2)) AS Udc2,
+              cast(Pac1 / Samples as decimal(9)) AS Pac1,
+              cast(Pac2 / Samples as decimal(9)) AS Pac2,
+              cast(Pac3 / Samples as decimal(9)) AS Pac3,
+              cast(Iac1 / Samples as decimal(9,3)) AS Iac1,
+              cast(Iac2 / Samples as decimal(9,3)) AS Iac2,
+              cast(Iac3 / Samples as decimal(9,3)) AS Iac3,
+              cast(Uac1 / Samples as decimal(9,2)) AS Uac1,
+              cast(Uac2 / Samples as decimal(9,2)) AS Uac2,
+              cast(Uac3 / Samples as decimal(9,2)) AS Uac3,
+              cast(Temperature / Samples as decimal(9,2)) AS Temperature
+        FROM SpotDataRollup
+        WHERE Period = 300;
+
+-- Hourly (Period=3600) and daily (Period=86400) averages
+CREATE VIEW vwSpotDataRollup AS
+       SELECT Period,
+              From_UnixTime(TimeStamp) AS TimeStamp,
+              Serial,
+              Samples,
+              cast(Pdc1 / Samples as decimal(9)) AS Pdc1,
+              cast(Pdc2 / Samples as decimal(9)) AS Pdc2,
+              cast(Idc1 / Samples as decimal(9,3)) AS Idc1,
+              cast(Idc2 / Samples as decimal(9,3)) AS Idc2,
+              cast(Udc1 / Samples as decimal(9,2)) AS Udc1,
+              cast(Udc2 / Samples as decimal(9,2)) AS Udc2,
+              cast(Pac1 / Samples as decimal(9)) AS Pac1,
+              cast(Pac2 / Samples as decimal(9)) AS Pac2,
+              cast(Pac3 / Samples as decimal(9)) AS Pac3,
+              cast(Iac1 / Samples as decimal(9,3)) AS Iac1,
+              cast(Iac2 / Samples as decimal(9,3)) AS Iac2,
+              cast(Iac3 / Samples as decimal(9,3)) AS Iac3,
+              cast(Uac1 / Samples as decimal(9,2)) AS Uac1,
+              cast(Uac2 / Samples as decimal(9,2)) AS Uac2,
+              cast(Uac3 / Samples as decimal(9,2)) AS Uac3,
+              cast(Temperature / Samples as decimal(9,2)) AS Temperature
+        FROM SpotDataRollup;
+
+CREATE VIEW vwBatteryData AS
+    SELECT FROM_UNIXTIME(sdx.`TimeStamp`) AS `5min`,
+           sdx.`Serial`,
+           inv.`Name`,
+           MAX(CASE WHEN `Key` = 10586 THEN `Value` / Samples END) AS ChaStatus,
+           MAX(CASE WHEN `Key` = 18779 THEN CAST(`Value` / Samples / 10 AS DECIMAL(10,1)) END) AS Temperature,
+           MAX(CASE WHEN `Key` = 18781 THEN CAST(`Value` / Samples / 1000 AS DECIMAL(10,3)) END) AS ChaCurrent,
+           MAX(CASE WHEN `Key` = 18780 THEN CAST(`Value` / Samples / 100 AS DECIMAL(10,2)) END) AS ChaVoltage,
+           MAX(CASE WHEN `Key` = 17974 THEN `Value` / Samples END) AS GridMsTotWOut,
+           MAX(CASE WHEN `Key` = 17975 THEN `Value` / Samples END) AS GridMsTotWIn
+      FROM SpotDataXRollup AS sdx
+           INNER JOIN
+           Inverters AS inv ON sdx.`Serial` = inv.`Serial`
+     WHERE sdx.Period = 300
+     GROUP BY sdx.`TimeStamp`, sdx.`Serial`;
+
+-- Roll up the existing data
+INSERT INTO SpotDataRollup
+	SELECT Period, Bucket, Serial, COUNT(*),
+		SUM(Pdc1), SUM(Pdc2), SUM(Idc1), SUM(Idc2), SUM(Udc1), SUM(Udc2),
+		SUM(Pac1), SUM(Pac2), SUM(Pac3), SUM(Iac1), SUM(Iac2), SUM(Iac3),
+		SUM(Uac1), SUM(Uac2), SUM(Uac3), SUM(Temperature)
+	FROM (SELECT 300 AS Period, (TimeStamp + 150) DIV 300 * 300 AS Bucket, SpotData.* FROM SpotData
+		UNION ALL SELECT 3600, TimeStamp DIV 3600 * 3600, SpotData.* FROM SpotData
+		UNION ALL SELECT 86400, UNIX_TIMESTAMP(DATE(FROM_UNIXTIME(TimeStamp))), SpotData.* FROM SpotData) AS sd
+	GROUP BY Period, Serial, Bucket;
+
+INSERT INTO SpotDataXRollup
+	SELECT Period, Bucket, `Serial`, `Key`, COUNT(*), SUM(`Value`)
+	FROM (SELECT 300 AS Period, `TimeStamp` DIV 300 * 300 AS Bucket, SpotDataX.* FROM SpotDataX
+		UNION ALL SELECT 3600, `TimeStamp` DIV 3600 * 3600, SpotDataX.* FROM SpotDataX
+		UNION ALL SELECT 86400, UNIX_TIMESTAMP(DATE(FROM_UNIXTIME(`TimeStamp`))), SpotDataX.* FROM SpotDataX) AS sdx
+	GROUP BY Period, `Serial`, Bucket, `Key`;
+
+INSERT INTO ConsumptionRollup
+	SELECT Period, Bucket, COUNT(*), IFNULL(SUM(EnergyUsed), 0), IFNULL(SUM(PowerUsed), 0)
+	FROM (SELECT 300 AS Period, (TimeStamp + 150) DIV 300 * 300 AS Bucket, Consumption.* FROM Consumption
+		UNION ALL SELECT 3600, TimeStamp DIV 3600 * 3600, Consumption.* FROM Consumption
+		UNION ALL SELECT 86400, UNIX_TIMESTAMP(DATE(FROM_UNIXTIME(TimeStamp))), Consumption.* FROM Consumption) AS cons
+	GROUP BY Period, Bucket;
+
+UPDATE Config SET `Value` = '2' WHERE `Key` = 'SchemaVersion';
@@ -0,0 +1,159 @@
+-- Upgrade an SBFspot 3.6 database to SchemaVersion 2 (SBFspot 3.7.0)
+
+-- Sums of the SpotData, SpotDataX and Consumption values per Period, written at insert time
+-- Divide by Samples to get the averages
+-- Period 300: TimeStamp is the nearest 5 minutes (like Nearest5min), for SpotDataX the start of the 5 minutes
+-- Period 3600: TimeStamp is the start of the hour
+-- Period 86400: TimeStamp is local midnight
+CREATE Table SpotDataRollup (
+	Period int(4) NOT NULL,
+	TimeStamp datetime NOT NULL,
+	Serial int(4) NOT NULL,
+	Samples int(4) NOT NULL,
+	Pdc1 int(8), Pdc2 int(8),
+	Idc1 double, Idc2 double,
+	Udc1 double, Udc2 double,
+	Pac1 int(8), Pac2 int(8), Pac3 int(8),
+	Iac1 double, Iac2 double, Iac3 double,
+	Uac1 double, Uac2 double, Uac3 double,
+	Temperature double,
+	PRIMARY KEY (Period, Serial, TimeStamp)
+);
+
+CREATE Table SpotDataXRollup (
+	Period int(4) NOT NULL,
+	TimeStamp datetime NOT NULL,
+	Serial int(4) NOT NULL,
+	[Key] int(4) NOT NULL,
+	Samples int(4) NOT NULL,
+	[Value] int(8),
+	PRIMARY KEY (Period, Serial, TimeStamp, [Key])
+);
+
+CREATE Table ConsumptionRollup (
+	Period int(4) NOT NULL,
+	TimeStamp datetime NOT NULL,
+	Samples int(4) NOT NULL,
+	EnergyUsed int(8),
+	PowerUsed int(8),
+	PRIMARY KEY (Period, TimeStamp)
+);
+
+-- Consumption is written by other tools, so it is rolled up by a trigger
+-- Each row counts in Samples, a NULL EnergyUsed or PowerUsed is added as 0 (avg() would skip it)
+CREATE TRIGGER trgConsumptionRollup AFTER INSERT ON Consumption
+BEGIN
+	INSERT OR IGNORE INTO ConsumptionRollup VALUES(300, (NEW.TimeStamp + 150) / 300 * 300, 0, 0, 0);
+	INSERT OR IGNORE INTO ConsumptionRollup VALUES(3600, NEW.TimeStamp / 3600 * 3600, 0, 0, 0);
+	INSERT OR IGNORE INTO ConsumptionRollup VALUES(86400, CAST(strftime('%s', NEW.TimeStamp, 'unixepoch', 'localtime', 'start of day', 'utc') AS INTEGER), 0, 0, 0);
+	UPDATE ConsumptionRollup SET Samples = Samples + 1,
+		EnergyUsed = EnergyUsed + IFNULL(NEW.EnergyUsed, 0),
+		PowerUsed = PowerUsed + IFNULL(NEW.PowerUsed, 0)
+	WHERE (Period = 300 AND TimeStamp = (NEW.TimeStamp + 150) / 300 * 300)
+	   OR (Period = 3600 AND TimeStamp = NEW.TimeStamp / 3600 * 3600)
+	   OR (Period = 86400 AND TimeStamp = CAST(strftime('%s', NEW.TimeStamp, 'unixepoch', 'localtime', 'start of day', 'utc') AS INTEGER));
+END;
+
+-- DayData not yet uploaded to PVoutput (SBFspotUploadDaemon)
+CREATE INDEX idxDayDataPending ON DayData (Serial, TimeStamp) WHERE PVoutput IS NULL;
+
+DROP VIEW IF EXISTS vwAvgConsumption;
+DROP VIEW IF EXISTS vwAvgSpotData;
+DROP VIEW IF EXISTS vwBatteryData;
+
+CREATE VIEW vwAvgConsumption AS
+	SELECT datetime(TimeStamp, 'unixepoch', 'localtime') AS Timestamp,
+		datetime(TimeStamp, 'unixepoch', 'localtime') AS Nearest5min,
+		1.0 * EnergyUsed / Samples As EnergyUsed,
+		1.0 * PowerUsed / Samples As PowerUsed
+	FROM ConsumptionRollup
+	WHERE Period = 300;
+
+CREATE VIEW vwAvgSpotData AS
+       SELECT datetime(TimeStamp, 'unixepoch', 'localtime') AS nearest5min,
+              serial,
+              1.0 * Pdc1 / Samples AS Pdc1,
+              1.0 * Pdc2 / Samples AS Pdc2,
+              Idc1 / Samples AS Idc1,
+              Idc2 / Samples AS Idc2,
+              Udc1 / Samples AS Udc1,
+              Udc2 / Samples AS Udc2,
+              1.0 * Pac1 / Samples AS Pac1,
+              1.0 * Pac2 / Samples AS Pac2,
+              1.0 * Pac3 / Samples AS Pac3,
+              Iac1 / Samples AS Iac1,
+              Iac2 / Samples AS Iac2,
+              Iac3 / Samples AS Iac3,
+              Uac1 / Samples AS Uac1,
+              Uac2 / Samples AS Uac2,
+              Uac3 / Samples AS Uac3,
+              Temperature / Samples AS Temperature
+        FROM SpotDataRollup
+        WHERE Period = 300;
+
+-- Hourly (Period=3600) and daily (Period=86400) averages
+CREATE VIEW vwSpotDataRollup AS
+       SELECT Period,
+              datetime(TimeStamp, 'unixepoch', 'localtime') AS TimeStamp,
+              Serial,
+              Samples,
+              1.0 * Pdc1 / Samples AS Pdc1,
+              1.0 * Pdc2 / Samples AS Pdc2,
+              Idc1 / Samples AS Idc1,
+              Idc2 / Samples AS Idc2,
+              Udc1 / Samples AS Udc1,
+              Udc2 / Samples AS Udc2,
+              1.0 * Pac1 / Samples AS Pac1,
+              1.0 * Pac2 / Samples AS Pac2,
+              1.0 * Pac3 / Samples AS Pac3,
+              Iac1 / Samples AS Iac1,
+              Iac2 / Samples AS Iac2,
+              Iac3 / Samples AS Iac3,
+              Uac1 / Samples AS Uac1,
+              Uac2 / Samples AS Uac2,
+              Uac3 / Samples AS Uac3,
+              Temperature / Samples AS Temperature
+        FROM SpotDataRollup;
+
+CREATE VIEW vwBatteryData AS
+    SELECT DATETIME(sdx.[TimeStamp], 'unixepoch', 'localtime') AS [5min],
+           sdx.[Serial],
+           inv.[Name],
+           MAX(CASE WHEN [Key] = 10586 THEN 1.0 * [Value] / Samples END) AS ChaStatus,
+           MAX(CASE WHEN [Key] = 18779 THEN 1.0 * [Value] / Samples / 10 END) AS Temperature,
+           MAX(CASE WHEN [Key] = 18781 THEN 1.0 * [Value] / Samples / 1000 END) AS ChaCurrent,
+           MAX(CASE WHEN [Key] = 18780 THEN 1.0 * [Value] / Samples / 100 END) AS ChaVoltage,
+           MAX(CASE WHEN [Key] = 17974 THEN 1.0 * [Value] / Samples END) AS GridMsTotWOut,
+           MAX(CASE WHEN [Key] = 17975 THEN 1.0 * [Value] / Samples END) AS GridMsTotWIn
+      FROM SpotDataXRollup AS sdx
+           INNER JOIN
+           Inverters AS inv ON sdx.[Serial] = inv.[Serial]
+     WHERE sdx.Period = 300
+     GROUP BY sdx.[TimeStamp], sdx.[Serial];
+
+-- Roll up the existing data
+INSERT INTO SpotDataRollup
+	SELECT Period, Bucket, Serial, COUNT(*),
+		SUM(Pdc1), SUM(Pdc2), SUM(Idc1), SUM(Idc2), SUM(Udc1), SUM(Udc2),
+		SUM(Pac1), SUM(Pac2), SUM(Pac3), SUM(Iac1), SUM(Iac2), SUM(Iac3),
+		SUM(Uac1), SUM(Uac2), SUM(Uac3), SUM(Temperature)
+	FROM (SELECT 300 AS Period, (TimeStamp + 150) / 300 * 300 AS Bucket, * FROM SpotData
+		UNION ALL SELECT 3600, TimeStamp / 3600 * 3600, * FROM SpotData
+		UNION ALL SELECT 86400, CAST(strftime('%s', TimeStamp, 'unixepoch', 'localtime', 'start of day', 'utc') AS INTEGER), * FROM SpotData)
+	GROUP BY Period, Serial, Bucket;
+
+INSERT INTO SpotDataXRollup
+	SELECT Period, Bucket, Serial, [Key], COUNT(*), SUM([Value])
+	FROM (SELECT 300 AS Period, [TimeStamp] / 300 * 300 AS Bucket, * FROM SpotDataX
+		UNION ALL SELECT 3600, [TimeStamp] / 3600 * 3600, * FROM SpotDataX
+		UNION ALL SELECT 86400, CAST(strftime('%s', [TimeStamp], 'unixepoch', 'localtime', 'start of day', 'utc') AS INTEGER), * FROM SpotDataX)
+	GROUP BY Period, Serial, Bucket, [Key];
+
+INSERT INTO ConsumptionRollup
+	SELECT Period, Bucket, COUNT(*), TOTAL(EnergyUsed), TOTAL(PowerUsed)
+	FROM (SELECT 300 AS Period, (TimeStamp + 150) / 300 * 300 AS Bucket, * FROM Consumption
+		UNION ALL SELECT 3600, TimeStamp / 3600 * 3600, * FROM Consumption
+		UNION ALL SELECT 86400, CAST(strftime('%s', TimeStamp, 'unixepoch', 'localtime', 'start of day', 'utc') AS INTEGER), * FROM Consumption)
+	GROUP BY Period, Bucket;
+
+UPDATE Config SET `Value` = '2' WHERE `Key` = 'SchemaVersion';
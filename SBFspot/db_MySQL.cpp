@@ -34,9 +34,6 @@ DISCLAIMER:
 
 #if defined(USE_MYSQL)
 
-//TODO: MAX_INVERTERS is defined twice (Quick but dirty fix)
-const int MAX_INVERTERS = 20;
-
 #include "db_MySQL.h"
 #include <boost/algorithm/string.hpp>
 #include <boost/lexical_cast.hpp>
@@ -63,6 +60,56 @@ string db_SQL_Base::status_text(int status)
 	}
 }
 
+// Start of the rollup period that contains t
+// 5 minutes and hours are aligned on UTC, days start at local midnight
+time_t db_SQL_Base::rollup_timestamp(time_t t, int period)
+{
+	if (period == SQL_ROLLUP_DAY)
+	{
+		struct tm tm_day = *localtime(&t);
+		tm_day.tm_hour = tm_day.tm_min = tm_day.tm_sec = 0;
+		tm_day.tm_isdst = -1;
+		return mktime(&tm_day);
+	}
+
+	return t - (t % period);
+}
+
+// Local midnight of the 1st day of the month that contains t, moved by months
+time_t db_SQL_Base::month_start(time_t t, int months)
+{
+	struct tm tm_month = *localtime(&t);
+	tm_month.tm_mday = 1;
+	tm_month.tm_hour = tm_month.tm_min = tm_month.tm_sec = 0;
+	tm_month.tm_mon += months;
+	tm_month.tm_isdst = -1;
+	return mktime(&tm_month);
+}
+
+// PVoutput date and time (YYYYMMDD,HH:MM local time) back to the DayData timestamp(s)
+// In the hour repeated at the end of DST, one local time matches two timestamps
+void db_SQL_Base::pvo_timestamps(const std::string &datetime, std::vector<time_t> &timestamps)
+{
+	struct tm tm_pvo;
+	memset(&tm_pvo, 0, sizeof(tm_pvo));
+
+	if (sscanf(datetime.c_str(), "%4d%2d%2d,%2d:%2d", &tm_pvo.tm_year, &tm_pvo.tm_mon, &tm_pvo.tm_mday, &tm_pvo.tm_hour, &tm_pvo.tm_min) != 5)
+		return;
+
+	tm_pvo.tm_year -= 1900;
+	tm_pvo.tm_mon -= 1;
+	tm_pvo.tm_isdst = -1;
+	time_t t = mktime(&tm_pvo);
+
+	for (time_t ts = t - 3600; ts <= t + 3600; ts += 3600)
+	{
+		char buffer[16];
+		strftime(buffer, sizeof(buffer), "%Y%m%d,%H:%M", localtime(&ts));
+		if (datetime == buffer)
+			timestamps.push_back(ts);
+	}
+}
+
 int db_SQL_Base::open(string server, string user, string pass, string database)
 {
 	int result = SQL_OK;
@@ -97,6 +144,10 @@ int db_SQL_Base::close(void)
 {
 	int result = SQL_OK;
 
+	for (std::map<std::string, MYSQL_STMT*>::iterator it = m_statements.begin(); it != m_statements.end(); ++it)
+		mysql_stmt_close(it->second);
+	m_statements.clear();
+
 	mysql_close(m_dbHandle);
 	m_dbHandle = NULL;
 
@@ -109,71 +160,167 @@ int db_SQL_Base::exec_query(string qry)
 	return mysql_real_query(m_dbHandle, qry.c_str(), qry.size());
 }
 
+// Transactions may be nested (e.g. all exports of a polling cycle around spot_data())
+// Only the outermost begin/end pair talks to the database; when one of the nested
+// transactions failed, the outermost end_transaction() rolls back everything
+int db_SQL_Base::begin_transaction(void)
+{
+	if (m_transaction++ > 0)
+		return SQL_OK;
+
+	m_rollback = false;
+	return exec_query("START TRANSACTION");
+}
+
+int db_SQL_Base::end_transaction(int rc)
+{
+	if (rc != SQL_OK)
+		m_rollback = true;
+
+	if (--m_transaction > 0)
+		return rc;
+
+	m_transaction = 0;
+
+	if (m_rollback)
+	{
+		exec_query("ROLLBACK");
+		return (rc != SQL_OK) ? rc : SQL_ERROR;
+	}
+
+	return exec_query("COMMIT");
+}
+
+// Prepared statements are kept until the database is closed
+MYSQL_STMT *db_SQL_Base::prepare(const char *sql)
+{
+	std::map<std::string, MYSQL_STMT*>::iterator it = m_statements.find(sql);
+	if (it != m_statements.end())
+		return it->second;
+
+	MYSQL_STMT *pStmt = mysql_stmt_init(m_dbHandle);
+	if (!pStmt)
+	{
+		print_error("Out of memory");
+		return NULL;
+	}
+
+	if (mysql_stmt_prepare(pStmt, sql, strlen(sql)) != SQL_OK)
+	{
+		print_error("mysql_stmt_prepare() returned", sql);
+		mysql_stmt_close(pStmt);
+		return NULL;
+	}
+
+	m_statements[sql] = pStmt;
+	return pStmt;
+}
+
 int db_SQL_Base::type_label(InverterData *inverters[])
 {
-	std::stringstream sql;
+	// Instead of using REPLACE which is actually a DELETE followed by INSERT,
+	// we do an INSERT IGNORE (for new records) followed by UPDATE (for existing records)
+	MYSQL_STMT *pInsert = prepare("INSERT IGNORE INTO Inverters VALUES(?,?,?,?,0,0,0,0,0,0,'','',0)");
+	MYSQL_STMT *pUpdate = prepare("UPDATE Inverters SET Name=?,Type=?,SW_Version=? WHERE Serial=?");
 	int rc = SQL_OK;
 
-	for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
+	if ((pInsert == NULL) || (pUpdate == NULL))
+		return SQL_ERROR;
+
+	MYSQL_BIND values[4];
+
+	begin_transaction();
+
+	for (int inv=0; inverters[inv]!=NULL; inv++)
 	{
-		sql.str("");
-
-		// Instead of using REPLACE which is actually a DELETE followed by INSERT,
-		// we do an INSERT IGNORE (for new records) followed by UPDATE (for existing records)
-		sql << "INSERT IGNORE INTO Inverters VALUES(" <<
-			inverters[inv]->Serial << ',' <<
-			s_quoted(inverters[inv]->DeviceName) << ',' <<
-			s_quoted(inverters[inv]->DeviceType) << ',' <<
-			s_quoted(inverters[inv]->SWVersion) << ',' <<
-			"0,0,0,0,0,0,'','',0)";
-
-		if ((rc = exec_query(sql.str())) != SQL_OK)
-			print_error("exec_query() returned", sql.str());
-
-		sql.str("");
-
-		sql << "UPDATE Inverters SET" <<
-			" Name=" << s_quoted(inverters[inv]->DeviceName) <<
-			",Type=" << s_quoted(inverters[inv]->DeviceType) <<
-			",SW_Version=" << s_quoted(inverters[inv]->SWVersion) <<
-			" WHERE Serial=" << inverters[inv]->Serial;
-
-		if ((rc = exec_query(sql.str())) != SQL_OK)
-			print_error("exec_query() returned", sql.str());
+		uint32_t Serial = inverters[inv]->Serial;
+		std::string Name = inverters[inv]->DeviceName;
+		std::string Type = inverters[inv]->DeviceType;
+		std::string SWVersion = inverters[inv]->SWVersion;
+
+		memset(values, 0, sizeof(values));
+		bind_param(values[0], MYSQL_TYPE_LONG, &Serial, true);
+		bind_param(values[1], Name);
+		bind_param(values[2], Type);
+		bind_param(values[3], SWVersion);
+
+		mysql_stmt_bind_param(pInsert, values);
+
+		if ((rc = mysql_stmt_execute(pInsert)) != SQL_OK)
+		{
+			print_error("[type_label]mysql_stmt_execute() returned");
+			break;
+		}
+
+		memset(values, 0, sizeof(values));
+		bind_param(values[0], Name);
+		bind_param(values[1], Type);
+		bind_param(values[2], SWVersion);
+		bind_param(values[3], MYSQL_TYPE_LONG, &Serial, true);
+
+		mysql_stmt_bind_param(pUpdate, values);
+
+		if ((rc = mysql_stmt_execute(pUpdate)) != SQL_OK)
+		{
+			print_error("[type_label]mysql_stmt_execute() returned");
+			break;
+		}
 	}
 
-	return rc;
+	return end_transaction(rc);
 }
 
 int db_SQL_Base::device_status(InverterData *inverters[], time_t spottime)
 {
-	std::stringstream sql;
+	MYSQL_STMT *pStmt = prepare("UPDATE Inverters SET TimeStamp=?,TotalPac=?,EToday=?,ETotal=?,OperatingTime=?,FeedInTime=?,"
+		"Status=?,GridRelay=?,Temperature=? WHERE Serial=?");
 	int rc = SQL_OK;
 
+	if (pStmt == NULL)
+		return SQL_ERROR;
+
+	MYSQL_BIND values[10];
+
 	// Take time from computer instead of inverter
 	//time_t spottime = cfg->SpotTimeSource == 0 ? inverters[0]->InverterDatetime : time(NULL);
+	int32_t TimeStamp = (int32_t)spottime;
+
+	begin_transaction();
 
-	for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
+	for (int inv=0; inverters[inv]!=NULL; inv++)
 	{
-		sql.str("");
-
-		sql << "UPDATE Inverters SET" <<
-			" TimeStamp=" << strftime_t(spottime) <<
-			",TotalPac=" << inverters[inv]->TotalPac <<
-			",EToday=" << inverters[inv]->EToday <<	
-			",ETotal=" << inverters[inv]->ETotal <<
-			",OperatingTime=" << (double)inverters[inv]->OperationTime/3600 <<
-			",FeedInTime=" << (double)inverters[inv]->FeedInTime/3600 <<
-			",Status=" << s_quoted(status_text(inverters[inv]->DeviceStatus)) <<
-			",GridRelay=" << s_quoted(status_text(inverters[inv]->GridRelayStatus)) <<
-			",Temperature=" << (float)inverters[inv]->Temperature/100 <<
-			" WHERE Serial=" << inverters[inv]->Serial;
-
-		if ((rc = exec_query(sql.str())) != SQL_OK)
-			print_error("exec_query() returned", sql.str());
+		int32_t TotalPac = inverters[inv]->TotalPac;
+		int64_t EToday = inverters[inv]->EToday;
+		int64_t ETotal = inverters[inv]->ETotal;
+		double OperatingTime = (double)inverters[inv]->OperationTime/3600;
+		double FeedInTime = (double)inverters[inv]->FeedInTime/3600;
+		std::string Status = status_text(inverters[inv]->DeviceStatus);
+		std::string GridRelay = status_text(inverters[inv]->GridRelayStatus);
+		double Temperature = (double)inverters[inv]->Temperature/100;
+		uint32_t Serial = inverters[inv]->Serial;
+
+		memset(values, 0, sizeof(values));
+		bind_param(values[0], MYSQL_TYPE_LONG, &TimeStamp);
+		bind_param(values[1], MYSQL_TYPE_LONG, &TotalPac);
+		bind_param(values[2], MYSQL_TYPE_LONGLONG, &EToday);
+		bind_param(values[3], MYSQL_TYPE_LONGLONG, &ETotal);
+		bind_param(values[4], MYSQL_TYPE_DOUBLE, &OperatingTime);
+		bind_param(values[5], MYSQL_TYPE_DOUBLE, &FeedInTime);
+		bind_param(values[6], Status);
+		bind_param(values[7], GridRelay);
+		bind_param(values[8], MYSQL_TYPE_DOUBLE, &Temperature);
+		bind_param(values[9], MYSQL_TYPE_LONG, &Serial, true);
+
+		mysql_stmt_bind_param(pStmt, values);
+
+		if ((rc = mysql_stmt_execute(pStmt)) != SQL_OK)
+		{
+			print_error("[device_status]mysql_stmt_execute() returned");
+			break;
+		}
 	}
 
-	return rc;
+	return end_transaction(rc);
 }
 
 int db_SQL_Base::batch_get_archdaydata(std::string &data, unsigned int Serial, int datelimit, int statuslimit, int& recordcount)
@@ -182,11 +329,18 @@ int db_SQL_Base::batch_get_archdaydata(std::string &data, unsigned int Serial, i
 	int rc = SQL_OK;
 	recordcount = 0;
 
-	sql << "SELECT DATE_FORMAT(Timestamp,'%Y%m%d,%H:%i'),V1,V2,V3,V4,V5,V6,V7,V8,V9,V10,V11,V12 FROM vwPvoData "
-		"WHERE TimeStamp>NOW()-INTERVAL " << datelimit-1 << " DAY "
-		"AND PVoutput IS NULL "
-		"AND Serial=" << Serial << " "
-		"ORDER BY TimeStamp "
+	// Same values as vwPvoData, but only the pending rows of idxDayDataPending are read
+	// and the 5-minute averages come from the rollup tables instead of GROUP BY views
+	sql << "SELECT DATE_FORMAT(FROM_UNIXTIME(dd.TimeStamp),'%Y%m%d,%H:%i'),dd.TotalYield,dd.Power,"
+		"CAST(cons.EnergyUsed/cons.Samples AS DECIMAL(9)),CAST(cons.PowerUsed/cons.Samples AS DECIMAL(9)),"
+		"CAST(spot.Temperature/spot.Samples AS DECIMAL(9,2)),CAST(spot.Uac1/spot.Samples AS DECIMAL(9,2)) "
+		"FROM DayData AS dd "
+		"LEFT JOIN SpotDataRollup AS spot ON spot.Period=300 AND spot.Serial=dd.Serial AND spot.TimeStamp=dd.TimeStamp "
+		"LEFT JOIN ConsumptionRollup AS cons ON cons.Period=300 AND cons.TimeStamp=dd.TimeStamp "
+		"WHERE dd.Serial=" << Serial << " "
+		"AND dd.PVoutput IS NULL "
+		"AND dd.TimeStamp>UNIX_TIMESTAMP(NOW()-INTERVAL " << datelimit-1 << " DAY) "
+		"ORDER BY dd.TimeStamp "
 		"LIMIT " << statuslimit;
 
 	rc = mysql_query(m_dbHandle, sql.str().c_str());
@@ -207,8 +361,8 @@ int db_SQL_Base::batch_get_archdaydata(std::string &data, unsigned int Serial, i
 			// Date
 			result << sqlRow[0];
 
-			// Energy Generation, Power Generation, Energy Consumption, Power Consumption, Temperature, Voltage and Extended values
-			for (int Vx = 1; Vx <= 12; Vx++)
+			// Energy Generation, Power Generation, Energy Consumption, Power Consumption, Temperature and Voltage
+			for (int Vx = 1; Vx <= 6; Vx++)
 			{
 				result << ",";
 				if (sqlRow[Vx] != NULL)
@@ -251,36 +405,38 @@ int db_SQL_Base::batch_set_pvoflag(const std::string &data, unsigned int Serial)
 	vector<std::string> items;
 	boost::split(items, data, boost::is_any_of(";"));
 
-	exec_query("START TRANSACTION");
+	// Update by primary key (TimeStamp, Serial) instead of formatting the TimeStamp of every row
+	vector<time_t> timestamps;
+	for (vector<std::string>::iterator it=items.begin(); it!=items.end(); ++it)
+	{
+		if (it->substr(15, 1) == "1")
+			pvo_timestamps(it->substr(0, 14), timestamps);
+	}
 
+	if (timestamps.empty())
+		return SQL_OK;
+
+	// One statement (one round trip) for the whole batch
 	sql << "UPDATE DayData "
 		"SET PVoutput=1 "
 		"WHERE Serial=" << Serial << " "
-		"AND DATE_FORMAT(FROM_UNIXTIME(Timestamp),'%Y%m%d,%H:%i') "
-		"IN (";
+		"AND TimeStamp IN (";
 
-	bool firstitem = true;
-	for (vector<std::string>::iterator it=items.begin(); it!=items.end(); ++it)
+	for (vector<time_t>::iterator it=timestamps.begin(); it!=timestamps.end(); ++it)
 	{
-		if (it->substr(15, 1) == "1")
-		{
-			if (!firstitem)
-				sql << ",";
-			else
-				firstitem = false;
-			sql << s_quoted(it->substr(0, 14));
-		}
+		if (it != timestamps.begin())
+			sql << ",";
+		sql << *it;
 	}
 
 	sql << ")";
 
+	begin_transaction();
+
 	if ((rc = exec_query(sql.str())) != SQL_OK)
-	{
 		print_error("exec_query() returned", sql.str());
-		exec_query("ROLLBACK");
-	}
-	else
-		exec_query("COMMIT");
+
+	rc = end_transaction(rc);
 
 	return rc;
 }
@@ -337,6 +493,37 @@ int db_SQL_Base::get_config(const std::string key, int &value)
 	return rc;
 }
 
+// Latest TimeStamp of a device in DayData, MonthData or EventData (0 if none)
+int db_SQL_Base::get_last_timestamp(const std::string table, unsigned int Serial, time_t &timestamp)
+{
+	std::stringstream sql;
+	int rc = SQL_OK;
+	timestamp = 0;
+
+	// Walks the primary key (TimeStamp, Serial) backwards, stops at the first record of this device
+	sql << "SELECT TimeStamp FROM " << table << " WHERE Serial=" << Serial << " ORDER BY TimeStamp DESC LIMIT 1";
+
+	rc = mysql_query(m_dbHandle, sql.str().c_str());
+
+	if (rc == SQL_OK)
+	{
+		MYSQL_RES *sqlResult = mysql_store_result(m_dbHandle);
+		MYSQL_ROW sqlRow = mysql_fetch_row(sqlResult);
+		if (sqlRow && sqlRow[0])
+			timestamp = (time_t)strtoul(sqlRow[0], NULL, 10);
+
+        if(sqlResult)
+        {
+            mysql_free_result(sqlResult);
+            sqlResult = NULL;
+        }
+	}
+	else
+		print_error("[get_last_timestamp]mysql_query() returned", sql.str());
+
+	return rc;
+}
+
 std::string db_SQL_Base::timestamp(void)
 {
     char buffer[100];
@@ -45,18 +45,14 @@ int db_SQL_Export::day_data(InverterData *inverters[])
 
 	MYSQL_BIND values[5];
 
-	MYSQL_STMT *pStmt = mysql_stmt_init(m_dbHandle);
-	if (!pStmt)
-	{
-		print_error("Out of memory");
-		return SQL_ERROR;
-	}
-
-	if ((rc = mysql_stmt_prepare(pStmt, sql, strlen(sql))) == SQL_OK)
+	MYSQL_STMT *pStmt = prepare(sql);
+	if (pStmt == NULL)
+		rc = SQL_ERROR;
+	else
 	{
-		exec_query("START TRANSACTION");
+		begin_transaction();
 
-		for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
+		for (int inv=0; inverters[inv]!=NULL; inv++)
 		{
 			const unsigned int numelements = sizeof(inverters[inv]->dayData)/sizeof(DayData);
 			unsigned int first_rec, last_rec;
@@ -83,8 +79,8 @@ int db_SQL_Export::day_data(InverterData *inverters[])
 				// Store data from first to last record
 		        for (unsigned int idx = first_rec; idx <= last_rec; idx++)
 				{
-					// Invalid dates are not written to db
-					if (inverters[inv]->dayData[idx].datetime > 0)
+					// Invalid dates and records already in the db (-sync) are not written
+					if (inverters[inv]->dayData[idx].datetime > inverters[inv]->archDaySince)
 					{
 						memset(values, 0, sizeof(values));
 
@@ -129,12 +125,7 @@ int db_SQL_Export::day_data(InverterData *inverters[])
 			}
 		}
 
-		mysql_stmt_close(pStmt);
-
-		if (rc == SQL_OK)
-			exec_query("COMMIT");
-		else
-			exec_query("ROLLBACK");
+		rc = end_transaction(rc);
 	}
 
 	return rc;
@@ -147,18 +138,14 @@ int db_SQL_Export::month_data(InverterData *inverters[])
 
 	MYSQL_BIND values[4];
 
-	MYSQL_STMT *pStmt = mysql_stmt_init(m_dbHandle);
-	if (!pStmt)
-	{
-		print_error("Out of memory");
-		return SQL_ERROR;
-	}
-
-	if ((rc = mysql_stmt_prepare(pStmt, sql, strlen(sql))) == SQL_OK)
+	MYSQL_STMT *pStmt = prepare(sql);
+	if (pStmt == NULL)
+		rc = SQL_ERROR;
+	else
 	{
-		exec_query("START TRANSACTION");
+		begin_transaction();
 
-		for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
+		for (int inv=0; inverters[inv]!=NULL; inv++)
 		{
 			for (unsigned int idx = 0; idx < sizeof(inverters[inv]->monthData)/sizeof(MonthData); idx++)
 			{
@@ -203,12 +190,7 @@ int db_SQL_Export::month_data(InverterData *inverters[])
 			}
 		}
 
-		mysql_stmt_close(pStmt);
-
-		if (rc == SQL_OK)
-			exec_query("COMMIT");
-		else
-			exec_query("ROLLBACK");
+		rc = end_transaction(rc);
 	}
 
 	return rc;
@@ -216,69 +198,197 @@ int db_SQL_Export::month_data(InverterData *inverters[])
 
 int db_SQL_Export::spot_data(InverterData *inv[], time_t spottime)
 {
-	stringstream sql;
+	const char *sql = "INSERT INTO SpotData VALUES(?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?)";
 	int rc = SQL_OK;
 
-	for (int i=0; inv[i]!=NULL && i<MAX_INVERTERS; i++)
-	{
-		sql.str("");
-		sql << "INSERT INTO SpotData VALUES(" <<
-		spottime << ',' <<
-		inv[i]->Serial << ',' <<
-		inv[i]->Pdc1 << ',' <<
-		inv[i]->Pdc2 << ',' <<
-		(float)inv[i]->Idc1/1000 << ',' <<
-		(float)inv[i]->Idc2/1000 << ',' <<
-		(float)inv[i]->Udc1/100 << ',' <<
-		(float)inv[i]->Udc2/100 << ',' <<
-		inv[i]->Pac1 << ',' <<
-		inv[i]->Pac2 << ',' <<
-		inv[i]->Pac3 << ',' <<
-		(float)inv[i]->Iac1/1000 << ',' <<
-		(float)inv[i]->Iac2/1000 << ',' <<
-		(float)inv[i]->Iac3/1000 << ',' <<
-		(float)inv[i]->Uac1/100 << ',' <<
-		(float)inv[i]->Uac2/100 << ',' <<
-		(float)inv[i]->Uac3/100 << ',' <<
-		inv[i]->EToday << ',' <<
-		inv[i]->ETotal << ',' <<
-		(float)inv[i]->GridFreq/100 << ',' <<
-		(double)inv[i]->OperationTime/3600 << ',' <<
-		(double)inv[i]->FeedInTime/3600 << ',' <<
-		(float)inv[i]->BT_Signal << ',' <<
-		s_quoted(status_text(inv[i]->DeviceStatus)) << ',' <<
-		s_quoted(status_text(inv[i]->GridRelayStatus)) << ',' <<
-		(float)inv[i]->Temperature/100 << ")";
+	MYSQL_STMT *pStmt = prepare(sql);
+	if (pStmt == NULL)
+		return SQL_ERROR;
 
-		if ((rc = exec_query(sql.str())) != SQL_OK)
+	MYSQL_BIND values[26];
+
+	int32_t TimeStamp = (int32_t)spottime;
+
+	begin_transaction();
+
+	for (int i=0; inv[i]!=NULL; i++)
+	{
+		uint32_t Serial = inv[i]->Serial;
+		int32_t Pdc[2] = {(int32_t)inv[i]->Pdc1, (int32_t)inv[i]->Pdc2};
+		double Idc[2] = {(double)inv[i]->Idc1/1000, (double)inv[i]->Idc2/1000};
+		double Udc[2] = {(double)inv[i]->Udc1/100, (double)inv[i]->Udc2/100};
+		int32_t Pac[3] = {(int32_t)inv[i]->Pac1, (int32_t)inv[i]->Pac2, (int32_t)inv[i]->Pac3};
+		double Iac[3] = {(double)inv[i]->Iac1/1000, (double)inv[i]->Iac2/1000, (double)inv[i]->Iac3/1000};
+		double Uac[3] = {(double)inv[i]->Uac1/100, (double)inv[i]->Uac2/100, (double)inv[i]->Uac3/100};
+		int64_t EToday = inv[i]->EToday;
+		int64_t ETotal = inv[i]->ETotal;
+		double Frequency = (double)inv[i]->GridFreq/100;
+		double OperatingTime = (double)inv[i]->OperationTime/3600;
+		double FeedInTime = (double)inv[i]->FeedInTime/3600;
+		double BT_Signal = inv[i]->BT_Signal;
+		string Status = status_text(inv[i]->DeviceStatus);
+		string GridRelay = status_text(inv[i]->GridRelayStatus);
+		double Temperature = (double)inv[i]->Temperature/100;
+
+		memset(values, 0, sizeof(values));
+		bind_param(values[0], MYSQL_TYPE_LONG, &TimeStamp);
+		bind_param(values[1], MYSQL_TYPE_LONG, &Serial, true);
+		bind_param(values[2], MYSQL_TYPE_LONG, &Pdc[0]);
+		bind_param(values[3], MYSQL_TYPE_LONG, &Pdc[1]);
+		bind_param(values[4], MYSQL_TYPE_DOUBLE, &Idc[0]);
+		bind_param(values[5], MYSQL_TYPE_DOUBLE, &Idc[1]);
+		bind_param(values[6], MYSQL_TYPE_DOUBLE, &Udc[0]);
+		bind_param(values[7], MYSQL_TYPE_DOUBLE, &Udc[1]);
+		bind_param(values[8], MYSQL_TYPE_LONG, &Pac[0]);
+		bind_param(values[9], MYSQL_TYPE_LONG, &Pac[1]);
+		bind_param(values[10], MYSQL_TYPE_LONG, &Pac[2]);
+		bind_param(values[11], MYSQL_TYPE_DOUBLE, &Iac[0]);
+		bind_param(values[12], MYSQL_TYPE_DOUBLE, &Iac[1]);
+		bind_param(values[13], MYSQL_TYPE_DOUBLE, &Iac[2]);
+		bind_param(values[14], MYSQL_TYPE_DOUBLE, &Uac[0]);
+		bind_param(values[15], MYSQL_TYPE_DOUBLE, &Uac[1]);
+		bind_param(values[16], MYSQL_TYPE_DOUBLE, &Uac[2]);
+		bind_param(values[17], MYSQL_TYPE_LONGLONG, &EToday);
+		bind_param(values[18], MYSQL_TYPE_LONGLONG, &ETotal);
+		bind_param(values[19], MYSQL_TYPE_DOUBLE, &Frequency);
+		bind_param(values[20], MYSQL_TYPE_DOUBLE, &OperatingTime);
+		bind_param(values[21], MYSQL_TYPE_DOUBLE, &FeedInTime);
+		bind_param(values[22], MYSQL_TYPE_DOUBLE, &BT_Signal);
+		bind_param(values[23], Status);
+		bind_param(values[24], GridRelay);
+		bind_param(values[25], MYSQL_TYPE_DOUBLE, &Temperature);
+
+		mysql_stmt_bind_param(pStmt, values);
+
+		if ((rc = mysql_stmt_execute(pStmt)) != SQL_OK)
 		{
-			print_error("[spot_data]exec_query() returned", sql.str());
+			print_error("[spot_data]mysql_stmt_execute() returned");
 			break;
 		}
+
+		if ((rc = spot_rollup(inv[i], spottime)) != SQL_OK)
+			break;
 	}
 
-	return rc;
+	return end_transaction(rc);
 }
 
-int db_SQL_Export::event_data(InverterData *inv[], TagDefs& tags)
+// Adds a SpotData row to the sums of its 5-minute, hour and day period in SpotDataRollup
+int db_SQL_Export::spot_rollup(InverterData *inv, time_t spottime)
 {
-	const char *sql = "INSERT INTO EventData(EntryID,TimeStamp,Serial,SusyID,EventCode,EventType,Category,EventGroup,Tag,OldValue,NewValue,UserGroup) VALUES(?,?,?,?,?,?,?,?,?,?,?,?) ON DUPLICATE KEY UPDATE Serial=Serial";
+	const char *sql = "INSERT INTO SpotDataRollup VALUES(?,?,?,1,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?) ON DUPLICATE KEY UPDATE Samples=Samples+1,"
+		"Pdc1=Pdc1+VALUES(Pdc1),Pdc2=Pdc2+VALUES(Pdc2),Idc1=Idc1+VALUES(Idc1),Idc2=Idc2+VALUES(Idc2),Udc1=Udc1+VALUES(Udc1),Udc2=Udc2+VALUES(Udc2),"
+		"Pac1=Pac1+VALUES(Pac1),Pac2=Pac2+VALUES(Pac2),Pac3=Pac3+VALUES(Pac3),Iac1=Iac1+VALUES(Iac1),Iac2=Iac2+VALUES(Iac2),Iac3=Iac3+VALUES(Iac3),"
+		"Uac1=Uac1+VALUES(Uac1),Uac2=Uac2+VALUES(Uac2),Uac3=Uac3+VALUES(Uac3),Temperature=Temperature+VALUES(Temperature)";
 	int rc = SQL_OK;
 
-	MYSQL_BIND values[12];
+	MYSQL_STMT *pStmt = prepare(sql);
+	if (pStmt == NULL)
+		return SQL_ERROR;
+
+	MYSQL_BIND values[19];
 
-	MYSQL_STMT *pStmt = mysql_stmt_init(m_dbHandle);
-	if (!pStmt)
+	const int periods[] = {SQL_ROLLUP_5MIN, SQL_ROLLUP_HOUR, SQL_ROLLUP_DAY};
+	int32_t Period = 0;
+	int32_t TimeStamp = 0;
+	uint32_t Serial = inv->Serial;
+	int64_t Pdc[2] = {inv->Pdc1, inv->Pdc2};
+	double Idc[2] = {(double)inv->Idc1/1000, (double)inv->Idc2/1000};
+	double Udc[2] = {(double)inv->Udc1/100, (double)inv->Udc2/100};
+	int64_t Pac[3] = {inv->Pac1, inv->Pac2, inv->Pac3};
+	double Iac[3] = {(double)inv->Iac1/1000, (double)inv->Iac2/1000, (double)inv->Iac3/1000};
+	double Uac[3] = {(double)inv->Uac1/100, (double)inv->Uac2/100, (double)inv->Uac3/100};
+	double Temperature = (double)inv->Temperature/100;
+
+	memset(values, 0, sizeof(values));
+	bind_param(values[0], MYSQL_TYPE_LONG, &Period);
+	bind_param(values[1], MYSQL_TYPE_LONG, &TimeStamp);
+	bind_param(values[2], MYSQL_TYPE_LONG, &Serial, true);
+	bind_param(values[3], MYSQL_TYPE_LONGLONG, &Pdc[0]);
+	bind_param(values[4], MYSQL_TYPE_LONGLONG, &Pdc[1]);
+	bind_param(values[5], MYSQL_TYPE_DOUBLE, &Idc[0]);
+	bind_param(values[6], MYSQL_TYPE_DOUBLE, &Idc[1]);
+	bind_param(values[7], MYSQL_TYPE_DOUBLE, &Udc[0]);
+	bind_param(values[8], MYSQL_TYPE_DOUBLE, &Udc[1]);
+	bind_param(values[9], MYSQL_TYPE_LONGLONG, &Pac[0]);
+	bind_param(values[10], MYSQL_TYPE_LONGLONG, &Pac[1]);
+	bind_param(values[11], MYSQL_TYPE_LONGLONG, &Pac[2]);
+	bind_param(values[12], MYSQL_TYPE_DOUBLE, &Iac[0]);
+	bind_param(values[13], MYSQL_TYPE_DOUBLE, &Iac[1]);
+	bind_param(values[14], MYSQL_TYPE_DOUBLE, &Iac[2]);
+	bind_param(values[15], MYSQL_TYPE_DOUBLE, &Uac[0]);
+	bind_param(values[16], MYSQL_TYPE_DOUBLE, &Uac[1]);
+	bind_param(values[17], MYSQL_TYPE_DOUBLE, &Uac[2]);
+	bind_param(values[18], MYSQL_TYPE_DOUBLE, &Temperature);
+
+	mysql_stmt_bind_param(pStmt, values);
+
+	// The bound buffers are read at execute time
+	for (int p=0; (p<3) && (rc == SQL_OK); p++)
 	{
-		print_error("Out of memory");
+		// 5-minute periods are centred on TimeStamp, like DayData and Nearest5min in vwSpotData
+		Period = periods[p];
+		TimeStamp = (int32_t)rollup_timestamp(Period == SQL_ROLLUP_5MIN ? spottime + SQL_ROLLUP_5MIN/2 : spottime, Period);
+
+		if ((rc = mysql_stmt_execute(pStmt)) != SQL_OK)
+			print_error("[spot_rollup]mysql_stmt_execute() returned");
+	}
+
+	return rc;
+}
+
+// Adds a SpotDataX value to the sums of its 5-minute, hour and day period in SpotDataXRollup
+int db_SQL_Export::battery_rollup(int32_t tm, int32_t sn, int32_t key, int32_t val)
+{
+	const char *sql = "INSERT INTO SpotDataXRollup VALUES(?,?,?,?,1,?) ON DUPLICATE KEY UPDATE Samples=Samples+1,`Value`=`Value`+VALUES(`Value`)";
+	int rc = SQL_OK;
+
+	MYSQL_STMT *pStmt = prepare(sql);
+	if (pStmt == NULL)
 		return SQL_ERROR;
+
+	MYSQL_BIND values[5];
+
+	const int periods[] = {SQL_ROLLUP_5MIN, SQL_ROLLUP_HOUR, SQL_ROLLUP_DAY};
+	int32_t Period = 0;
+	int32_t TimeStamp = 0;
+
+	memset(values, 0, sizeof(values));
+	bind_param(values[0], MYSQL_TYPE_LONG, &Period);
+	bind_param(values[1], MYSQL_TYPE_LONG, &TimeStamp);
+	bind_param(values[2], MYSQL_TYPE_LONG, &sn, true);
+	bind_param(values[3], MYSQL_TYPE_LONG, &key);
+	bind_param(values[4], MYSQL_TYPE_LONG, &val);
+
+	mysql_stmt_bind_param(pStmt, values);
+
+	for (int p=0; (p<3) && (rc == SQL_OK); p++)
+	{
+		Period = periods[p];
+		TimeStamp = (int32_t)rollup_timestamp(tm, Period);
+
+		if ((rc = mysql_stmt_execute(pStmt)) != SQL_OK)
+			print_error("[battery_rollup]mysql_stmt_execute() returned");
 	}
 
-	if ((rc = mysql_stmt_prepare(pStmt, sql, strlen(sql))) == SQL_OK)
+	return rc;
+}
+
+int db_SQL_Export::event_data(InverterData *inv[], TagDefs& tags)
+{
+	const char *sql = "INSERT INTO EventData(EntryID,TimeStamp,Serial,SusyID,EventCode,EventType,Category,EventGroup,Tag,OldValue,NewValue,UserGroup) VALUES(?,?,?,?,?,?,?,?,?,?,?,?) ON DUPLICATE KEY UPDATE Serial=Serial";
+	int rc = SQL_OK;
+
+	MYSQL_BIND values[12];
+
+	MYSQL_STMT *pStmt = prepare(sql);
+	if (pStmt == NULL)
+		rc = SQL_ERROR;
+	else
 	{
-		exec_query("START TRANSACTION");
+		begin_transaction();
 
-		for (int i=0; inv[i]!=NULL && i<MAX_INVERTERS; i++)
+		for (int i=0; inv[i]!=NULL; i++)
 		{
 			for (vector<EventData>::iterator it=inv[i]->eventData.begin(); it!=inv[i]->eventData.end(); ++it)
 			{
@@ -400,12 +510,7 @@ int db_SQL_Export::event_data(InverterData *inv[], TagDefs& tags)
 			}
 		}
 
-		mysql_stmt_close(pStmt);
-
-		if (rc == SQL_OK)
-			exec_query("COMMIT");
-		else
-			exec_query("ROLLBACK");
+		rc = end_transaction(rc);
 	}
 
 	return rc;
@@ -416,47 +521,30 @@ int db_SQL_Export::battery_data(InverterData *inverters[], time_t spottime)
 	const char *sql = "INSERT INTO SpotDataX(`TimeStamp`,`Serial`,`Key`,`Value`) VALUES(?,?,?,?)";
 	int rc = SQL_OK;
 
-	MYSQL_STMT *pStmt = mysql_stmt_init(m_dbHandle);
-	if (!pStmt)
-	{
-		print_error("Out of memory");
+	MYSQL_STMT *pStmt = prepare(sql);
+	if (pStmt == NULL)
 		return SQL_ERROR;
-	}
 
-	if ((rc = mysql_stmt_prepare(pStmt, sql, strlen(sql))) == SQL_OK)
-	{
-		exec_query("START TRANSACTION");
+	begin_transaction();
 
-		for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
+	for (int inv=0; inverters[inv]!=NULL; inv++)
+	{
+		InverterData* id = inverters[inv];
+		if ((id->DevClass == BatteryInverter) || (id->hasBattery))
 		{
-			InverterData* id = inverters[inv];
-		    if ((id->DevClass == BatteryInverter) || (id->hasBattery))
-			{
-				if ((rc = insert_battery_data(pStmt, spottime, id->Serial, BatChaStt >> 8, id->BatChaStt)) != SQL_OK) break;
-				if ((rc = insert_battery_data(pStmt, spottime, id->Serial, BatTmpVal >> 8, id->BatTmpVal)) != SQL_OK) break;
-				if ((rc = insert_battery_data(pStmt, spottime, id->Serial, BatVol >> 8, id->BatVol)) != SQL_OK) break;
-				if ((rc = insert_battery_data(pStmt, spottime, id->Serial, BatAmp >> 8, id->BatAmp)) != SQL_OK) break;
-				//if ((rc = insert_battery_data(pStmt, spottime, id->Serial, BatDiagCapacThrpCnt >> 8, id->BatDiagCapacThrpCnt)) != SQL_OK) break;
-				//if ((rc = insert_battery_data(pStmt, spottime, id->Serial, BatDiagTotAhIn >> 8, id->BatDiagTotAhIn)) != SQL_OK) break;
-				//if ((rc = insert_battery_data(pStmt, spottime, id->Serial, BatDiagTotAhOut >> 8, id->BatDiagTotAhOut)) != SQL_OK) break;
-				if ((rc = insert_battery_data(pStmt, spottime, id->Serial, MeteringGridMsTotWIn >> 8, id->MeteringGridMsTotWIn)) != SQL_OK) break;
-				if ((rc = insert_battery_data(pStmt, spottime, id->Serial, MeteringGridMsTotWOut >> 8, id->MeteringGridMsTotWOut)) != SQL_OK) break;
-			}
+			if ((rc = insert_battery_data(pStmt, spottime, id->Serial, BatChaStt >> 8, id->BatChaStt)) != SQL_OK) break;
+			if ((rc = insert_battery_data(pStmt, spottime, id->Serial, BatTmpVal >> 8, id->BatTmpVal)) != SQL_OK) break;
+			if ((rc = insert_battery_data(pStmt, spottime, id->Serial, BatVol >> 8, id->BatVol)) != SQL_OK) break;
+			if ((rc = insert_battery_data(pStmt, spottime, id->Serial, BatAmp >> 8, id->BatAmp)) != SQL_OK) break;
+			//if ((rc = insert_battery_data(pStmt, spottime, id->Serial, BatDiagCapacThrpCnt >> 8, id->BatDiagCapacThrpCnt)) != SQL_OK) break;
+			//if ((rc = insert_battery_data(pStmt, spottime, id->Serial, BatDiagTotAhIn >> 8, id->BatDiagTotAhIn)) != SQL_OK) break;
+			//if ((rc = insert_battery_data(pStmt, spottime, id->Serial, BatDiagTotAhOut >> 8, id->BatDiagTotAhOut)) != SQL_OK) break;
+			if ((rc = insert_battery_data(pStmt, spottime, id->Serial, MeteringGridMsTotWIn >> 8, id->MeteringGridMsTotWIn)) != SQL_OK) break;
+			if ((rc = insert_battery_data(pStmt, spottime, id->Serial, MeteringGridMsTotWOut >> 8, id->MeteringGridMsTotWOut)) != SQL_OK) break;
 		}
-
-		mysql_stmt_close(pStmt);
-
-		if (rc == SQL_OK)
-			exec_query("COMMIT");
-		else
-			exec_query("ROLLBACK");
-	}
-	else
-	{
-		print_error("[battery_data]mysql_stmt_prepare() returned");
 	}
 
-	return rc;
+	return end_transaction(rc);
 }
 
 int db_SQL_Export::insert_battery_data(MYSQL_STMT *pStmt, int32_t tm, int32_t sn, int32_t key, int32_t val)
@@ -495,6 +583,120 @@ int db_SQL_Export::insert_battery_data(MYSQL_STMT *pStmt, int32_t tm, int32_t sn
 	{
 		print_error("[battery_data]mysql_stmt_execute() returned");
 	}
+	else
+		rc = battery_rollup(tm, sn, key, val);
+
+	return rc;
+}
+
+// Raw SpotData and SpotDataX rows before local midnight, days ago, are deleted
+// Their averages remain available in the rollup tables
+// The archive database is not used by MySQL: partition the tables instead (see CreateMySQLDB.sql)
+int db_SQL_Export::retention(int days, const std::string &archive)
+{
+	if (days <= 0)
+		return SQL_OK;
+
+	const char *tables[] = { "SpotData", "SpotDataX" };
+	time_t cutoff = rollup_timestamp(time(NULL) - days * 86400, SQL_ROLLUP_DAY);
+	int rc = SQL_OK;
+
+	for (int t = 0; (t < 2) && (rc == SQL_OK); t++)
+	{
+		if ((rc = partition_spotdata(tables[t], cutoff)) != SQL_OK)
+			break;
+
+		// Rows of a partitioned table that were not dropped with their partition, or all rows of an unpartitioned one
+		std::stringstream sql;
+		sql << "DELETE FROM " << tables[t] << " WHERE TimeStamp<" << cutoff;
+
+		if ((rc = exec_query(sql.str())) != SQL_OK)
+			print_error("[retention]mysql_query() returned", sql.str());
+		else if (isverbose(2))
+			std::cout << "Purged " << mysql_affected_rows(m_dbHandle) << " rows from " << tables[t] << std::endl;
+	}
+
+	return rc;
+}
+
+// Monthly RANGE partitions on TimeStamp: the partitions of expired months are dropped,
+// the MAXVALUE partition is split so that the current and the next month have their own.
+// Tables without a MAXVALUE partition are left alone
+int db_SQL_Export::partition_spotdata(const char *table, time_t cutoff)
+{
+	std::stringstream sql;
+	std::string maxpart, expired;
+	time_t lastbound = 0;
+	int rc = SQL_OK;
+
+	sql << "SELECT PARTITION_NAME,PARTITION_DESCRIPTION FROM information_schema.PARTITIONS "
+		"WHERE TABLE_SCHEMA=DATABASE() AND TABLE_NAME='" << table << "' AND PARTITION_NAME IS NOT NULL "
+		"ORDER BY PARTITION_ORDINAL_POSITION";
+
+	if ((rc = mysql_query(m_dbHandle, sql.str().c_str())) != SQL_OK)
+	{
+		print_error("[retention]mysql_query() returned", sql.str());
+		return rc;
+	}
+
+	MYSQL_RES *sqlResult = mysql_store_result(m_dbHandle);
+	if (sqlResult)
+	{
+		MYSQL_ROW sqlRow;
+		while ((sqlRow = mysql_fetch_row(sqlResult)) != NULL)
+		{
+			if (!sqlRow[0] || !sqlRow[1])
+				continue;
+
+			if (strcmp(sqlRow[1], "MAXVALUE") == 0)
+				maxpart = sqlRow[0];
+			else
+			{
+				time_t bound = (time_t)strtoul(sqlRow[1], NULL, 10);
+				if (bound <= cutoff)
+					expired += (expired.empty() ? "" : ",") + std::string(sqlRow[0]);
+				if (bound > lastbound)
+					lastbound = bound;
+			}
+		}
+
+		mysql_free_result(sqlResult);
+	}
+
+	if (maxpart.empty())
+		return SQL_OK;
+
+	if (!expired.empty())
+	{
+		sql.str("");
+		sql << "ALTER TABLE " << table << " DROP PARTITION " << expired;
+		if ((rc = exec_query(sql.str())) != SQL_OK)
+		{
+			print_error("[retention]mysql_query() returned", sql.str());
+			return rc;
+		}
+		else if (isverbose(2))
+			std::cout << "Dropped partitions " << expired << " from " << table << std::endl;
+	}
+
+	// The first partition also holds everything before the current month
+	time_t now = time(NULL);
+	time_t bound = (lastbound == 0) ? month_start(now) : month_start(lastbound, 1);
+
+	for (; (bound <= month_start(now, 2)) && (rc == SQL_OK); bound = month_start(bound, 1))
+	{
+		time_t lastmonth = bound - 1;
+		char name[16];
+		strftime(name, sizeof(name), "p%Y%m", localtime(&lastmonth));
+
+		sql.str("");
+		sql << "ALTER TABLE " << table << " REORGANIZE PARTITION " << maxpart << " INTO ("
+			"PARTITION " << name << " VALUES LESS THAN (" << bound << "),"
+			"PARTITION " << maxpart << " VALUES LESS THAN MAXVALUE)";
+
+		if ((rc = exec_query(sql.str())) != SQL_OK)
+			print_error("[retention]mysql_query() returned", sql.str());
+	}
 
 	return rc;
 }
@@ -50,9 +50,13 @@ public:
 	int spot_data(InverterData *inv[], time_t spottime);
 	int event_data(InverterData *inv[], TagDefs& tags);
 	int battery_data(InverterData *inverters[], time_t spottime);
+	int retention(int days, const std::string &archive);
 
 private:
 	int insert_battery_data(MYSQL_STMT *pStmt, int32_t tm, int32_t sn, int32_t key, int32_t val);
+	int spot_rollup(InverterData *inv, time_t spottime);
+	int battery_rollup(int32_t tm, int32_t sn, int32_t key, int32_t val);
+	int partition_spotdata(const char *table, time_t cutoff);
 };
 
 #endif //#if defined(USE_MYSQL)
@@ -52,9 +52,6 @@ DISCLAIMER:
 
 #if defined(USE_SQLITE)
 
-//TODO: MAX_INVERTERS is defined twice (Quick but dirty fix)
-const int MAX_INVERTERS = 20;
-
 #include "db_SQLite.h"
 #include <boost/algorithm/string.hpp>
 #include <boost/lexical_cast.hpp>
@@ -81,6 +78,56 @@ string db_SQL_Base::status_text(int status)
 	}
 }
 
+// Start of the rollup period that contains t
+// 5 minutes and hours are aligned on UTC, days start at local midnight
+time_t db_SQL_Base::rollup_timestamp(time_t t, int period)
+{
+	if (period == SQL_ROLLUP_DAY)
+	{
+		struct tm tm_day = *localtime(&t);
+		tm_day.tm_hour = tm_day.tm_min = tm_day.tm_sec = 0;
+		tm_day.tm_isdst = -1;
+		return mktime(&tm_day);
+	}
+
+	return t - (t % period);
+}
+
+// Local midnight of the 1st day of the month that contains t, moved by months
+time_t db_SQL_Base::month_start(time_t t, int months)
+{
+	struct tm tm_month = *localtime(&t);
+	tm_month.tm_mday = 1;
+	tm_month.tm_hour = tm_month.tm_min = tm_month.tm_sec = 0;
+	tm_month.tm_mon += months;
+	tm_month.tm_isdst = -1;
+	return mktime(&tm_month);
+}
+
+// PVoutput date and time (YYYYMMDD,HH:MM local time) back to the DayData timestamp(s)
+// In the hour repeated at the end of DST, one local time matches two timestamps
+void db_SQL_Base::pvo_timestamps(const std::string &datetime, std::vector<time_t> &timestamps)
+{
+	struct tm tm_pvo;
+	memset(&tm_pvo, 0, sizeof(tm_pvo));
+
+	if (sscanf(datetime.c_str(), "%4d%2d%2d,%2d:%2d", &tm_pvo.tm_year, &tm_pvo.tm_mon, &tm_pvo.tm_mday, &tm_pvo.tm_hour, &tm_pvo.tm_min) != 5)
+		return;
+
+	tm_pvo.tm_year -= 1900;
+	tm_pvo.tm_mon -= 1;
+	tm_pvo.tm_isdst = -1;
+	time_t t = mktime(&tm_pvo);
+
+	for (time_t ts = t - 3600; ts <= t + 3600; ts += 3600)
+	{
+		char buffer[16];
+		strftime(buffer, sizeof(buffer), "%Y%m%d,%H:%M", localtime(&ts));
+		if (datetime == buffer)
+			timestamps.push_back(ts);
+	}
+}
+
 int db_SQL_Base::open(string server, string user, string pass, string database)
 {
 	int result = SQLITE_OK;
@@ -117,6 +164,10 @@ int db_SQL_Base::close(void)
 {
 	int result = SQLITE_OK;
 
+	for (std::map<std::string, sqlite3_stmt*>::iterator it = m_statements.begin(); it != m_statements.end(); ++it)
+		sqlite3_finalize(it->second);
+	m_statements.clear();
+
 	if((result = sqlite3_close(m_dbHandle)) != SQLITE_OK)
         print_error("Can't close SQLite db [" + m_database + "]");
     else
@@ -153,92 +204,165 @@ int db_SQL_Base::exec_query(string qry)
 	return result;
 }
 
+// Transactions may be nested (e.g. all exports of a polling cycle around spot_data())
+// Only the outermost begin/end pair talks to the database; when one of the nested
+// transactions failed, the outermost end_transaction() rolls back everything
+int db_SQL_Base::begin_transaction(void)
+{
+	if (m_transaction++ > 0)
+		return SQLITE_OK;
+
+	m_rollback = false;
+	return exec_query("BEGIN IMMEDIATE TRANSACTION");
+}
+
+int db_SQL_Base::end_transaction(int rc)
+{
+	if (rc != SQLITE_OK)
+		m_rollback = true;
+
+	if (--m_transaction > 0)
+		return rc;
+
+	m_transaction = 0;
+
+	if (m_rollback)
+	{
+		exec_query("ROLLBACK");
+		return (rc != SQLITE_OK) ? rc : SQLITE_ERROR;
+	}
+
+	return exec_query("COMMIT");
+}
+
+// Prepared statements are kept until the database is closed
+// Callers have to sqlite3_reset() the statement after use
+sqlite3_stmt *db_SQL_Base::prepare(const char *sql)
+{
+	std::map<std::string, sqlite3_stmt*>::iterator it = m_statements.find(sql);
+	if (it != m_statements.end())
+		return it->second;
+
+	sqlite3_stmt *pStmt = NULL;
+	if (sqlite3_prepare_v2(m_dbHandle, sql, -1, &pStmt, NULL) != SQLITE_OK)
+	{
+		print_error("sqlite3_prepare_v2() returned", sql);
+		return NULL;
+	}
+
+	m_statements[sql] = pStmt;
+	return pStmt;
+}
+
 int db_SQL_Base::type_label(InverterData *inverters[])
 {
-	std::stringstream sql;
+	// Instead of using REPLACE which is actually a DELETE followed by INSERT,
+	// we do an INSERT OR IGNORE (for new records) followed by UPDATE (for existing records)
+	sqlite3_stmt *pInsert = prepare("INSERT OR IGNORE INTO Inverters VALUES(?1,?2,?3,?4,0,0,0,0,0,0,'','',0)");
+	sqlite3_stmt *pUpdate = prepare("UPDATE Inverters SET Name=?2,Type=?3,SW_Version=?4 WHERE Serial=?1");
 	int rc = SQLITE_OK;
 
-	for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
+	if ((pInsert == NULL) || (pUpdate == NULL))
+		return SQLITE_ERROR;
+
+	begin_transaction();
+
+	for (int inv=0; (inverters[inv]!=NULL) && (rc == SQLITE_OK); inv++)
 	{
-		sql.str("");
-
-		// Instead of using REPLACE which is actually a DELETE followed by INSERT,
-		// we do an INSERT OR IGNORE (for new records) followed by UPDATE (for existing records)
-		sql << "INSERT OR IGNORE INTO Inverters VALUES(" <<
-			inverters[inv]->Serial << ',' <<
-			s_quoted(inverters[inv]->DeviceName) << ',' <<
-			s_quoted(inverters[inv]->DeviceType) << ',' <<
-			s_quoted(inverters[inv]->SWVersion) << ',' <<
-			"0,0,0,0,0,0,'','',0)";
-
-		if ((rc = exec_query(sql.str())) != SQLITE_OK)
-			print_error("exec_query() returned", sql.str());
-
-		sql.str("");
-
-		sql << "UPDATE Inverters SET" <<
-			" Name=" << s_quoted(inverters[inv]->DeviceName) <<
-			",Type=" << s_quoted(inverters[inv]->DeviceType) <<
-			",SW_Version=" << s_quoted(inverters[inv]->SWVersion) <<
-			" WHERE Serial=" << inverters[inv]->Serial;
-
-		if ((rc = exec_query(sql.str())) != SQLITE_OK)
-			print_error("exec_query() returned", sql.str());
+		sqlite3_stmt *stmts[] = {pInsert, pUpdate};
+		for (int s=0; s<2; s++)
+		{
+			// Fix #269: uint32 serial numbers are bound as int64
+			sqlite3_bind_int64(stmts[s], 1, inverters[inv]->Serial);
+			sqlite3_bind_text(stmts[s], 2, inverters[inv]->DeviceName, -1, SQLITE_STATIC);
+			sqlite3_bind_text(stmts[s], 3, inverters[inv]->DeviceType, -1, SQLITE_STATIC);
+			sqlite3_bind_text(stmts[s], 4, inverters[inv]->SWVersion, -1, SQLITE_STATIC);
+
+			if ((rc = sqlite3_step(stmts[s])) == SQLITE_DONE)
+				rc = SQLITE_OK;
+			else
+				print_error("[type_label]sqlite3_step() returned");
+
+			sqlite3_clear_bindings(stmts[s]);
+			sqlite3_reset(stmts[s]);
+
+			if (rc != SQLITE_OK)
+				break;
+		}
 	}
 
-	return rc;
+	return end_transaction(rc);
 }
 
 int db_SQL_Base::device_status(InverterData *inverters[], time_t spottime)
 {
-	std::stringstream sql;
+	sqlite3_stmt *pStmt = prepare("UPDATE Inverters SET TimeStamp=?2,TotalPac=?3,EToday=?4,ETotal=?5,OperatingTime=?6,FeedInTime=?7,"
+		"Status=?8,GridRelay=?9,Temperature=?10 WHERE Serial=?1");
 	int rc = SQLITE_OK;
 
+	if (pStmt == NULL)
+		return SQLITE_ERROR;
+
 	// Take time from computer instead of inverter
 	//time_t spottime = cfg->SpotTimeSource == 0 ? inverters[0]->InverterDatetime : time(NULL);
 
-	for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
+	begin_transaction();
+
+	for (int inv=0; inverters[inv]!=NULL; inv++)
 	{
-		sql.str("");
-
-		sql << "UPDATE Inverters SET" <<
-			" TimeStamp=" << strftime_t(spottime) <<
-			",TotalPac=" << inverters[inv]->TotalPac <<
-			",EToday=" << inverters[inv]->EToday <<
-			",ETotal=" << inverters[inv]->ETotal <<
-			",OperatingTime=" << (double)inverters[inv]->OperationTime/3600 <<
-			",FeedInTime=" << (double)inverters[inv]->FeedInTime/3600 <<
-			",Status=" << s_quoted(status_text(inverters[inv]->DeviceStatus)) <<
-			",GridRelay=" << s_quoted(status_text(inverters[inv]->GridRelayStatus)) <<
-			",Temperature=" << (float)inverters[inv]->Temperature/100 <<
-			" WHERE Serial=" << inverters[inv]->Serial;
-
-		if ((rc = exec_query(sql.str())) != SQLITE_OK)
-			print_error("exec_query() returned", sql.str());
+		sqlite3_bind_int64(pStmt, 1, inverters[inv]->Serial);
+		sqlite3_bind_int64(pStmt, 2, spottime);
+		sqlite3_bind_int64(pStmt, 3, inverters[inv]->TotalPac);
+		sqlite3_bind_int64(pStmt, 4, inverters[inv]->EToday);
+		sqlite3_bind_int64(pStmt, 5, inverters[inv]->ETotal);
+		sqlite3_bind_double(pStmt, 6, (double)inverters[inv]->OperationTime/3600);
+		sqlite3_bind_double(pStmt, 7, (double)inverters[inv]->FeedInTime/3600);
+		sqlite3_bind_text(pStmt, 8, status_text(inverters[inv]->DeviceStatus).c_str(), -1, SQLITE_TRANSIENT);
+		sqlite3_bind_text(pStmt, 9, status_text(inverters[inv]->GridRelayStatus).c_str(), -1, SQLITE_TRANSIENT);
+		sqlite3_bind_double(pStmt, 10, (double)inverters[inv]->Temperature/100);
+
+		if ((rc = sqlite3_step(pStmt)) == SQLITE_DONE)
+			rc = SQLITE_OK;
+		else
+			print_error("[device_status]sqlite3_step() returned");
+
+		sqlite3_clear_bindings(pStmt);
+		sqlite3_reset(pStmt);
+
+		if (rc != SQLITE_OK)
+			break;
 	}
 
-	return rc;
+	return end_transaction(rc);
 }
 
 int db_SQL_Base::batch_get_archdaydata(std::string &data, unsigned int Serial, int datelimit, int statuslimit, int& recordcount)
 {
-	std::stringstream sql;
+	// Same values as vwPvoData, but only the pending rows of idxDayDataPending are read
+	// and the 5-minute averages come from the rollup tables instead of GROUP BY views
+	const char *sql = "SELECT strftime('%Y%m%d,%H:%M',dd.TimeStamp,'unixepoch','localtime'),dd.TotalYield,dd.Power,"
+		"ROUND(1.0*cons.EnergyUsed/cons.Samples),ROUND(1.0*cons.PowerUsed/cons.Samples),spot.Temperature/spot.Samples,spot.Uac1/spot.Samples "
+		"FROM DayData AS dd "
+		"LEFT JOIN SpotDataRollup AS spot ON spot.Period=300 AND spot.Serial=dd.Serial AND spot.TimeStamp=dd.TimeStamp "
+		"LEFT JOIN ConsumptionRollup AS cons ON cons.Period=300 AND cons.TimeStamp=dd.TimeStamp "
+		"WHERE dd.Serial=?1 AND dd.PVoutput IS NULL "
+		"AND dd.TimeStamp>CAST(strftime('%s',DATE(),?2,'utc') AS INTEGER) "
+		"ORDER BY dd.TimeStamp "
+		"LIMIT ?3";
 	int rc = SQLITE_OK;
 	recordcount = 0;
 
-	sqlite3_stmt *pStmt = NULL;
-
-	sql << "SELECT strftime('%Y%m%d,%H:%M',TimeStamp),V1,V2,V3,V4,V5,V6,V7,V8,V9,V10,V11,V12 FROM [vwPvoData] WHERE "
-        "TimeStamp>DATE(DATE(),'" << -(datelimit-2) << " day') "
-        "AND PVoutput IS NULL "
-        "AND Serial=" << Serial << " "
-        "ORDER BY TimeStamp "
-        "LIMIT " << statuslimit;
-
-	rc = sqlite3_prepare_v2(m_dbHandle, sql.str().c_str(), -1, &pStmt, NULL);
+	sqlite3_stmt *pStmt = prepare(sql);
 
-	if (pStmt != NULL)
+	if (pStmt == NULL)
+		rc = SQLITE_ERROR;
+	else
 	{
+		std::string days = intToString(-(datelimit-2)) + " day";
+		sqlite3_bind_int64(pStmt, 1, Serial);
+		sqlite3_bind_text(pStmt, 2, days.c_str(), -1, SQLITE_TRANSIENT);
+		sqlite3_bind_int(pStmt, 3, statuslimit);
+
 		std::stringstream result;
 		while (sqlite3_step(pStmt) == SQLITE_ROW)
 		{
@@ -276,14 +400,6 @@ int db_SQL_Base::batch_get_archdaydata(std::string &data, unsigned int Serial, i
 			if (sqlite3_column_type(pStmt, 6) != SQLITE_NULL)
 				result << sqlite3_column_double(pStmt, 6);
 
-			// Extended values
-			for (int extval = 7; extval <= 12; extval++)
-			{
-				result << ",";
-				if (sqlite3_column_type(pStmt, extval) != SQLITE_NULL)
-					result << sqlite3_column_double(pStmt, extval);
-			}
-
 			const std::string& str = result.str();
 			int end = str.length();
 
@@ -297,7 +413,8 @@ int db_SQL_Base::batch_get_archdaydata(std::string &data, unsigned int Serial, i
 			recordcount++;
 		}
 
-		sqlite3_finalize(pStmt);
+		sqlite3_clear_bindings(pStmt);
+		sqlite3_reset(pStmt);
 	}
 
 	return rc;
@@ -305,37 +422,49 @@ int db_SQL_Base::batch_get_archdaydata(std::string &data, unsigned int Serial, i
 
 int db_SQL_Base::batch_set_pvoflag(const std::string &data, unsigned int Serial)
 {
-	std::stringstream sql;
 	int rc = SQLITE_OK;
 
 	vector<std::string> items;
 	boost::split(items, data, boost::is_any_of(";"));
 
-	sql << "UPDATE OR ROLLBACK DayData "
-		"SET PVoutput=1 "
-		"WHERE Serial=" << Serial << " "
-		"AND strftime('%Y%m%d,%H:%M',datetime(TimeStamp, 'unixepoch', 'localtime')) "
-		"IN (";
-
-	bool firstitem = true;
+	// Update by primary key (TimeStamp, Serial) instead of formatting the TimeStamp of every row
+	vector<time_t> timestamps;
 	for (vector<std::string>::iterator it=items.begin(); it!=items.end(); ++it)
 	{
 		if (it->substr(15, 1) == "1")
+			pvo_timestamps(it->substr(0, 14), timestamps);
+	}
+
+	if (timestamps.empty())
+		return SQLITE_OK;
+
+	sqlite3_stmt *pStmt = prepare("UPDATE DayData SET PVoutput=1 WHERE TimeStamp=?1 AND Serial=?2");
+
+	if (pStmt == NULL)
+		return SQLITE_ERROR;
+
+	begin_transaction();
+
+	for (vector<time_t>::iterator it=timestamps.begin(); it!=timestamps.end(); ++it)
+	{
+		sqlite3_bind_int64(pStmt, 1, *it);
+		sqlite3_bind_int64(pStmt, 2, Serial);
+
+		rc = sqlite3_step(pStmt);
+		sqlite3_reset(pStmt);
+
+		if (rc != SQLITE_DONE)
 		{
-			if (!firstitem)
-				sql << ",";
-			else
-				firstitem = false;
-			sql << s_quoted(it->substr(0, 14));
+			print_error("[batch_set_pvoflag]sqlite3_step() returned");
+			break;
 		}
-	}
 
-	sql << ")";
+		rc = SQLITE_OK;
+	}
 
-	if ((rc = exec_query(sql.str())) != SQLITE_OK)
-		print_error("exec_query() returned", sql.str());
+	sqlite3_clear_bindings(pStmt);
 
-	return rc;
+	return end_transaction(rc);
 }
 
 int db_SQL_Base::set_config(const std::string key, const std::string value)
@@ -384,6 +513,33 @@ int db_SQL_Base::get_config(const std::string key, int &value)
 	return rc;
 }
 
+// Latest TimeStamp of a device in DayData, MonthData or EventData (0 if none)
+int db_SQL_Base::get_last_timestamp(const std::string table, unsigned int Serial, time_t &timestamp)
+{
+	std::stringstream sql;
+	int rc = SQLITE_OK;
+	timestamp = 0;
+
+	sqlite3_stmt *pStmt = NULL;
+
+	// Walks the primary key (TimeStamp, Serial) backwards, stops at the first record of this device
+	sql << "SELECT TimeStamp FROM " << table << " WHERE Serial=" << Serial << " ORDER BY TimeStamp DESC LIMIT 1";
+
+	rc = sqlite3_prepare_v2(m_dbHandle, sql.str().c_str(), -1, &pStmt, NULL);
+
+	if (pStmt != NULL)
+	{
+		if (sqlite3_step(pStmt) == SQLITE_ROW)
+			timestamp = (time_t)sqlite3_column_int64(pStmt, 0);
+
+		sqlite3_finalize(pStmt);
+	}
+	else
+		print_error("[get_last_timestamp]sqlite3_prepare_v2() returned", sql.str());
+
+	return rc;
+}
+
 std::string db_SQL_Base::timestamp(void)
 {
     char buffer[100];
@@ -39,6 +39,7 @@ DISCLAIMER:
 #include "osselect.h"
 #include "SBFspot.h"
 #include <sqlite3.h>
+#include <map>
 
 extern int quiet;
 extern int verbose;
@@ -48,8 +49,13 @@ extern int verbose;
 #define SQL_BATCH_DATELIMIT		"Batch_DateLimit"
 #define SQL_BATCH_STATUSLIMIT	"Batch_StatusLimit"
 
-#define SQL_MINIMUM_SCHEMA_VERSION 1
-#define SQL_RECOMMENDED_SCHEMA_VERSION 1
+#define SQL_MINIMUM_SCHEMA_VERSION 2
+#define SQL_RECOMMENDED_SCHEMA_VERSION 2
+
+// Periods (seconds) of SpotDataRollup, SpotDataXRollup and ConsumptionRollup
+#define SQL_ROLLUP_5MIN		300
+#define SQL_ROLLUP_HOUR		3600
+#define SQL_ROLLUP_DAY		86400
 #define SQL_BUSY_RETRY_COUNT 20
 
 class db_SQL_Base
@@ -64,13 +70,18 @@ public:
 protected:
 	sqlite3 *m_dbHandle;
 	std::string m_database;
+	std::map<std::string, sqlite3_stmt*> m_statements;	// Prepared statements, keyed by SQL text
+	int m_transaction;	// Nesting level of begin_transaction()
+	bool m_rollback;	// Set when a nested transaction failed
 
 public:
-	db_SQL_Base() { m_dbHandle = NULL; }
+	db_SQL_Base() { m_dbHandle = NULL; m_transaction = 0; m_rollback = false; }
 	~db_SQL_Base() { if (m_dbHandle) close(); }
 	int open(std::string server, std::string user, std::string pass, std::string database);
 	int close(void);
 	int exec_query(std::string qry);
+	int begin_transaction(void);
+	int end_transaction(int rc = SQL_OK);
 	std::string errortext(void) { return m_dbHandle ? sqlite3_errmsg(m_dbHandle) : "Unable to open the database file [" + m_database + "]"; }
 	bool isopen(void) { return (m_dbHandle != NULL); }
 	int type_label(InverterData *inverters[]);
@@ -80,6 +91,7 @@ public:
 	int set_config(const std::string key, const std::string value);
 	int get_config(const std::string key, std::string &value);
 	int get_config(const std::string key, int &value);
+	int get_last_timestamp(const std::string table, unsigned int Serial, time_t &timestamp);
 	std::string intToString(const int i) { return static_cast<std::ostringstream*>( &(std::ostringstream() << i) )->str(); }
 
 protected:
@@ -87,6 +99,10 @@ protected:
 	std::string s_quoted(char *str) { return "'" + std::string(str) + "'"; }
 	bool isverbose(int level) { return !quiet && (verbose >= level); }
 	std::string status_text(int status);
+	time_t rollup_timestamp(time_t t, int period);
+	time_t month_start(time_t t, int months = 0);
+	void pvo_timestamps(const std::string &datetime, std::vector<time_t> &timestamps);
+	sqlite3_stmt *prepare(const char *sql);
 	void print_error(std::string msg) { std::cerr << timestamp() << "Error: " << msg << ": '" << (m_dbHandle != NULL ? sqlite3_errmsg(m_dbHandle) : "null") << "'" << std::endl; }
 	void print_error(std::string msg, std::string sql) { std::cerr << timestamp() << "Error: " << msg << ": '" << (m_dbHandle != NULL ? sqlite3_errmsg(m_dbHandle) : "null") << "' while executing\n" << sql << std::endl; }
 	std::string strftime_t(time_t utctime) { return static_cast<std::ostringstream*>( &(std::ostringstream() << utctime) )->str(); }
@@ -41,12 +41,14 @@ int db_SQL_Export::day_data(InverterData *inverters[])
 	const char *sql = "INSERT INTO DayData(TimeStamp,Serial,TotalYield,Power,PVoutput) VALUES(?1,?2,?3,?4,?5)";
 	int rc = SQLITE_OK;
 
-	sqlite3_stmt* pStmt;
-	if ((rc = sqlite3_prepare_v2(m_dbHandle, sql, strlen(sql), &pStmt, NULL)) == SQLITE_OK)
+	sqlite3_stmt* pStmt = prepare(sql);
+	if (pStmt == NULL)
+		rc = SQLITE_ERROR;
+	else
 	{
-		exec_query("BEGIN IMMEDIATE TRANSACTION");
+		begin_transaction();
 
-		for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
+		for (int inv=0; inverters[inv]!=NULL; inv++)
 		{
 			const unsigned int numelements = sizeof(inverters[inv]->dayData)/sizeof(DayData);
 			unsigned int first_rec, last_rec;
@@ -73,8 +75,8 @@ int db_SQL_Export::day_data(InverterData *inverters[])
 				// Store data from first to last record
 		        for (unsigned int idx = first_rec; idx <= last_rec; idx++)
 				{
-					// Invalid dates are not written to db
-					if (inverters[inv]->dayData[idx].datetime > 0)
+					// Invalid dates and records already in the db (-sync) are not written
+					if (inverters[inv]->dayData[idx].datetime > inverters[inv]->archDaySince)
 					{
 						sqlite3_bind_int(pStmt, 1, inverters[inv]->dayData[idx].datetime);
 						// Fix #269
@@ -87,28 +89,24 @@ int db_SQL_Export::day_data(InverterData *inverters[])
 
 						rc = sqlite3_step(pStmt);
 						if ((rc != SQLITE_DONE) && (rc != SQLITE_CONSTRAINT))
-						{
 							print_error("[day_data]sqlite3_step() returned");
-							break;
-						}
+						else
+							rc = SQLITE_OK;
 
 						sqlite3_clear_bindings(pStmt);
 						sqlite3_reset(pStmt);
-						rc = SQLITE_OK;
+
+						if (rc != SQLITE_OK)
+							break;
 					}
 				}
 			}
 		}
 
-		sqlite3_finalize(pStmt);
-
-		if (rc == SQLITE_OK)
-			exec_query("COMMIT");
-		else
-		{
+		if (rc != SQLITE_OK)
 			print_error("[day_data]Transaction failed. Rolling back now...");
-			exec_query("ROLLBACK");
-		}
+
+		rc = end_transaction(rc);
 	}
 
 	return rc;
@@ -117,30 +115,37 @@ int db_SQL_Export::day_data(InverterData *inverters[])
 int db_SQL_Export::month_data(InverterData *inverters[])
 {
 	const char *sql = "INSERT INTO MonthData(TimeStamp,Serial,TotalYield,DayYield) VALUES(?1,?2,?3,?4)";
+	const char *rmvsql = "DELETE FROM MonthData WHERE Serial=?1 AND strftime('%Y-%m',datetime(TimeStamp, 'unixepoch'))=?2";
 	int rc = SQLITE_OK;
 
-	sqlite3_stmt* pStmt;
-	if ((rc = sqlite3_prepare_v2(m_dbHandle, sql, strlen(sql), &pStmt, NULL)) == SQLITE_OK)
+	sqlite3_stmt* pStmt = prepare(sql);
+	sqlite3_stmt* pRmvStmt = prepare(rmvsql);
+	if ((pStmt == NULL) || (pRmvStmt == NULL))
+		rc = SQLITE_ERROR;
+	else
 	{
-		exec_query("BEGIN IMMEDIATE TRANSACTION");
+		begin_transaction();
 
-		for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
+		for (int inv=0; inverters[inv]!=NULL; inv++)
 		{
 			//Fix Issue 74: Double data in Monthdata tables
 			tm *ptm = gmtime(&inverters[inv]->monthData[0].datetime);
 			char dt[32];
 			strftime(dt, sizeof(dt), "%Y-%m", ptm);  
 
-			std::stringstream rmvsql;
-			rmvsql.str("");
-			rmvsql << "DELETE FROM MonthData WHERE Serial=" << inverters[inv]->Serial << " AND strftime('%Y-%m',datetime(TimeStamp, 'unixepoch'))='" << dt << "';";
+			sqlite3_bind_int64(pRmvStmt, 1, inverters[inv]->Serial);
+			sqlite3_bind_text(pRmvStmt, 2, dt, -1, SQLITE_STATIC);
+
+			if ((rc = sqlite3_step(pRmvStmt)) == SQLITE_DONE)
+				rc = SQLITE_OK;
+			else
+				print_error("[month_data]sqlite3_step() returned");
+
+			sqlite3_clear_bindings(pRmvStmt);
+			sqlite3_reset(pRmvStmt);
 
-			rc = exec_query(rmvsql.str().c_str());
 			if (rc != SQLITE_OK)
-			{
-				print_error("[month_data]sqlite3_exec() returned");
 				break;
-			}
 
 			for (unsigned int idx = 0; idx < sizeof(inverters[inv]->monthData)/sizeof(MonthData); idx++)
 			{
@@ -156,75 +161,188 @@ int db_SQL_Export::month_data(InverterData *inverters[])
 
 					rc = sqlite3_step(pStmt);
 					if ((rc != SQLITE_DONE) && (rc != SQLITE_CONSTRAINT))
-					{
 						print_error("[month_data]sqlite3_step() returned");
-						break;
-					}
+					else
+						rc = SQLITE_OK;
 
 					sqlite3_clear_bindings(pStmt);
 					sqlite3_reset(pStmt);
-					rc = SQLITE_OK;
+
+					if (rc != SQLITE_OK)
+						break;
 				}
 			}
 		}
 
-		sqlite3_finalize(pStmt);
+		if (rc != SQLITE_OK)
+			print_error("[month_data]Transaction failed. Rolling back now...");
+
+		rc = end_transaction(rc);
+	}
 
-		if (rc == SQLITE_OK)
-			exec_query("COMMIT");
+	return rc;
+}
+
+int db_SQL_Export::spot_data(InverterData *inv[], time_t spottime)
+{
+	const char *sql = "INSERT INTO SpotData VALUES(?1,?2,?3,?4,?5,?6,?7,?8,?9,?10,?11,?12,?13,?14,?15,?16,?17,?18,?19,?20,?21,?22,?23,?24,?25,?26)";
+	int rc = SQLITE_OK;
+
+	sqlite3_stmt* pStmt = prepare(sql);
+	if (pStmt == NULL)
+		return SQLITE_ERROR;
+
+	begin_transaction();
+
+	for (int i=0; inv[i]!=NULL; i++)
+	{
+		sqlite3_bind_int64(pStmt, 1, spottime);
+		// Fix #269
+		// To store unsigned int32 serial numbers, we're using sqlite3_bind_int64
+		sqlite3_bind_int64(pStmt, 2, inv[i]->Serial);
+		sqlite3_bind_int64(pStmt, 3, inv[i]->Pdc1);
+		sqlite3_bind_int64(pStmt, 4, inv[i]->Pdc2);
+		sqlite3_bind_double(pStmt, 5, (double)inv[i]->Idc1/1000);
+		sqlite3_bind_double(pStmt, 6, (double)inv[i]->Idc2/1000);
+		sqlite3_bind_double(pStmt, 7, (double)inv[i]->Udc1/100);
+		sqlite3_bind_double(pStmt, 8, (double)inv[i]->Udc2/100);
+		sqlite3_bind_int64(pStmt, 9, inv[i]->Pac1);
+		sqlite3_bind_int64(pStmt, 10, inv[i]->Pac2);
+		sqlite3_bind_int64(pStmt, 11, inv[i]->Pac3);
+		sqlite3_bind_double(pStmt, 12, (double)inv[i]->Iac1/1000);
+		sqlite3_bind_double(pStmt, 13, (double)inv[i]->Iac2/1000);
+		sqlite3_bind_double(pStmt, 14, (double)inv[i]->Iac3/1000);
+		sqlite3_bind_double(pStmt, 15, (double)inv[i]->Uac1/100);
+		sqlite3_bind_double(pStmt, 16, (double)inv[i]->Uac2/100);
+		sqlite3_bind_double(pStmt, 17, (double)inv[i]->Uac3/100);
+		sqlite3_bind_int64(pStmt, 18, inv[i]->EToday);
+		sqlite3_bind_int64(pStmt, 19, inv[i]->ETotal);
+		sqlite3_bind_double(pStmt, 20, (double)inv[i]->GridFreq/100);
+		sqlite3_bind_double(pStmt, 21, (double)inv[i]->OperationTime/3600);
+		sqlite3_bind_double(pStmt, 22, (double)inv[i]->FeedInTime/3600);
+		sqlite3_bind_double(pStmt, 23, inv[i]->BT_Signal);
+		sqlite3_bind_text(pStmt, 24, status_text(inv[i]->DeviceStatus).c_str(), -1, SQLITE_TRANSIENT);
+		sqlite3_bind_text(pStmt, 25, status_text(inv[i]->GridRelayStatus).c_str(), -1, SQLITE_TRANSIENT);
+		sqlite3_bind_double(pStmt, 26, (double)inv[i]->Temperature/100);
+
+		if ((rc = sqlite3_step(pStmt)) == SQLITE_DONE)
+			rc = SQLITE_OK;
 		else
+			print_error("[spot_data]sqlite3_step() returned");
+
+		sqlite3_clear_bindings(pStmt);
+		sqlite3_reset(pStmt);
+
+		if (rc == SQLITE_OK)
+			rc = spot_rollup(inv[i], spottime);
+
+		if (rc != SQLITE_OK)
+			break;
+	}
+
+	if (rc != SQLITE_OK)
+		print_error("[spot_data]Transaction failed. Rolling back now...");
+
+	return end_transaction(rc);
+}
+
+// Adds a SpotData row to the sums of its 5-minute, hour and day period in SpotDataRollup
+// INSERT OR IGNORE creates the period, UPDATE adds the values (no UPSERT before SQLite 3.24)
+int db_SQL_Export::spot_rollup(InverterData *inv, time_t spottime)
+{
+	const char *sqlNew = "INSERT OR IGNORE INTO SpotDataRollup VALUES(?1,?2,?3,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0)";
+	const char *sqlAdd = "UPDATE SpotDataRollup SET Samples=Samples+1,"
+		"Pdc1=Pdc1+?4,Pdc2=Pdc2+?5,Idc1=Idc1+?6,Idc2=Idc2+?7,Udc1=Udc1+?8,Udc2=Udc2+?9,"
+		"Pac1=Pac1+?10,Pac2=Pac2+?11,Pac3=Pac3+?12,Iac1=Iac1+?13,Iac2=Iac2+?14,Iac3=Iac3+?15,"
+		"Uac1=Uac1+?16,Uac2=Uac2+?17,Uac3=Uac3+?18,Temperature=Temperature+?19 "
+		"WHERE Period=?1 AND TimeStamp=?2 AND Serial=?3";
+	int rc = SQLITE_OK;
+
+	sqlite3_stmt *stmts[] = {prepare(sqlNew), prepare(sqlAdd)};
+	if ((stmts[0] == NULL) || (stmts[1] == NULL))
+		return SQLITE_ERROR;
+
+	const int periods[] = {SQL_ROLLUP_5MIN, SQL_ROLLUP_HOUR, SQL_ROLLUP_DAY};
+
+	sqlite3_bind_int64(stmts[1], 4, inv->Pdc1);
+	sqlite3_bind_int64(stmts[1], 5, inv->Pdc2);
+	sqlite3_bind_double(stmts[1], 6, (double)inv->Idc1/1000);
+	sqlite3_bind_double(stmts[1], 7, (double)inv->Idc2/1000);
+	sqlite3_bind_double(stmts[1], 8, (double)inv->Udc1/100);
+	sqlite3_bind_double(stmts[1], 9, (double)inv->Udc2/100);
+	sqlite3_bind_int64(stmts[1], 10, inv->Pac1);
+	sqlite3_bind_int64(stmts[1], 11, inv->Pac2);
+	sqlite3_bind_int64(stmts[1], 12, inv->Pac3);
+	sqlite3_bind_double(stmts[1], 13, (double)inv->Iac1/1000);
+	sqlite3_bind_double(stmts[1], 14, (double)inv->Iac2/1000);
+	sqlite3_bind_double(stmts[1], 15, (double)inv->Iac3/1000);
+	sqlite3_bind_double(stmts[1], 16, (double)inv->Uac1/100);
+	sqlite3_bind_double(stmts[1], 17, (double)inv->Uac2/100);
+	sqlite3_bind_double(stmts[1], 18, (double)inv->Uac3/100);
+	sqlite3_bind_double(stmts[1], 19, (double)inv->Temperature/100);
+
+	for (int p=0; (p<3) && (rc == SQLITE_OK); p++)
+	{
+		// 5-minute periods are centred on TimeStamp, like DayData and Nearest5min in vwSpotData
+		time_t timestamp = rollup_timestamp(periods[p] == SQL_ROLLUP_5MIN ? spottime + SQL_ROLLUP_5MIN/2 : spottime, periods[p]);
+
+		for (int s=0; (s<2) && (rc == SQLITE_OK); s++)
 		{
-			print_error("[month_data]Transaction failed. Rolling back now...");
-			exec_query("ROLLBACK");
+			sqlite3_bind_int(stmts[s], 1, periods[p]);
+			sqlite3_bind_int64(stmts[s], 2, timestamp);
+			sqlite3_bind_int64(stmts[s], 3, inv->Serial);
+
+			if ((rc = sqlite3_step(stmts[s])) == SQLITE_DONE)
+				rc = SQLITE_OK;
+			else
+				print_error("[spot_rollup]sqlite3_step() returned");
+
+			sqlite3_reset(stmts[s]);
 		}
 	}
 
+	sqlite3_clear_bindings(stmts[0]);
+	sqlite3_clear_bindings(stmts[1]);
+
 	return rc;
 }
 
-int db_SQL_Export::spot_data(InverterData *inv[], time_t spottime)
+// Adds a SpotDataX value to the sums of its 5-minute, hour and day period in SpotDataXRollup
+int db_SQL_Export::battery_rollup(int32_t tm, int32_t sn, int32_t key, int32_t val)
 {
-	std::stringstream sql;
+	const char *sqlNew = "INSERT OR IGNORE INTO SpotDataXRollup VALUES(?1,?2,?3,?4,0,0)";
+	const char *sqlAdd = "UPDATE SpotDataXRollup SET Samples=Samples+1,Value=Value+?5 WHERE Period=?1 AND TimeStamp=?2 AND Serial=?3 AND Key=?4";
 	int rc = SQLITE_OK;
 
-	for (int i=0; inv[i]!=NULL && i<MAX_INVERTERS; i++)
+	sqlite3_stmt *stmts[] = {prepare(sqlNew), prepare(sqlAdd)};
+	if ((stmts[0] == NULL) || (stmts[1] == NULL))
+		return SQLITE_ERROR;
+
+	const int periods[] = {SQL_ROLLUP_5MIN, SQL_ROLLUP_HOUR, SQL_ROLLUP_DAY};
+
+	sqlite3_bind_int(stmts[1], 5, val);
+
+	for (int p=0; (p<3) && (rc == SQLITE_OK); p++)
 	{
-		sql.str("");
-		sql << "INSERT INTO SpotData VALUES(" <<
-		spottime << ',' <<
-		inv[i]->Serial << ',' <<
-		inv[i]->Pdc1 << ',' <<
-		inv[i]->Pdc2 << ',' <<
-		(float)inv[i]->Idc1/1000 << ',' <<
-		(float)inv[i]->Idc2/1000 << ',' <<
-		(float)inv[i]->Udc1/100 << ',' <<
-		(float)inv[i]->Udc2/100 << ',' <<
-		inv[i]->Pac1 << ',' <<
-		inv[i]->Pac2 << ',' <<
-		inv[i]->Pac3 << ',' <<
-		(float)inv[i]->Iac1/1000 << ',' <<
-		(float)inv[i]->Iac2/1000 << ',' <<
-		(float)inv[i]->Iac3/1000 << ',' <<
-		(float)inv[i]->Uac1/100 << ',' <<
-		(float)inv[i]->Uac2/100 << ',' <<
-		(float)inv[i]->Uac3/100 << ',' <<
-		inv[i]->EToday << ',' <<
-		inv[i]->ETotal << ',' <<
-		(float)inv[i]->GridFreq/100 << ',' <<
-		(double)inv[i]->OperationTime/3600 << ',' <<
-		(double)inv[i]->FeedInTime/3600 << ',' <<
-		(float)inv[i]->BT_Signal << ',' <<
-		s_quoted(status_text(inv[i]->DeviceStatus)) << ',' <<
-		s_quoted(status_text(inv[i]->GridRelayStatus)) << ',' <<
-		(float)inv[i]->Temperature/100 << ")";
-
-		if ((rc = exec_query(sql.str())) != SQLITE_OK)
+		for (int s=0; (s<2) && (rc == SQLITE_OK); s++)
 		{
-			print_error("[spot_data]exec_query() returned", sql.str());
-			break;
+			sqlite3_bind_int(stmts[s], 1, periods[p]);
+			sqlite3_bind_int64(stmts[s], 2, rollup_timestamp(tm, periods[p]));
+			sqlite3_bind_int64(stmts[s], 3, sn);
+			sqlite3_bind_int(stmts[s], 4, key);
+
+			if ((rc = sqlite3_step(stmts[s])) == SQLITE_DONE)
+				rc = SQLITE_OK;
+			else
+				print_error("[battery_rollup]sqlite3_step() returned");
+
+			sqlite3_reset(stmts[s]);
 		}
 	}
 
+	sqlite3_clear_bindings(stmts[0]);
+	sqlite3_clear_bindings(stmts[1]);
+
 	return rc;
 }
 
@@ -233,12 +351,14 @@ int db_SQL_Export::event_data(InverterData *inv[], TagDefs& tags)
 	const char *sql = "INSERT INTO EventData(EntryID,TimeStamp,Serial,SusyID,EventCode,EventType,Category,EventGroup,Tag,OldValue,NewValue,UserGroup) VALUES(?1,?2,?3,?4,?5,?6,?7,?8,?9,?10,?11,?12)";
 	int rc = SQLITE_OK;
 
-	sqlite3_stmt* pStmt;
-	if ((rc = sqlite3_prepare_v2(m_dbHandle, sql, strlen(sql), &pStmt, NULL)) == SQLITE_OK)
+	sqlite3_stmt* pStmt = prepare(sql);
+	if (pStmt == NULL)
+		rc = SQLITE_ERROR;
+	else
 	{
-		exec_query("BEGIN IMMEDIATE TRANSACTION");
+		begin_transaction();
 
-		for (int i=0; inv[i]!=NULL && i<MAX_INVERTERS; i++)
+		for (int i=0; inv[i]!=NULL; i++)
 		{
 			for (std::vector<EventData>::iterator it=inv[i]->eventData.begin(); it!=inv[i]->eventData.end(); ++it)
 			{
@@ -291,26 +411,22 @@ int db_SQL_Export::event_data(InverterData *inv[], TagDefs& tags)
 
 				rc = sqlite3_step(pStmt);
 				if ((rc != SQLITE_DONE) && (rc != SQLITE_CONSTRAINT))
-				{
 					print_error("[event_data]sqlite3_step() returned");
-					break;
-				}
+				else
+					rc = SQLITE_OK;
 
 				sqlite3_clear_bindings(pStmt);
 				sqlite3_reset(pStmt);
-				rc = SQLITE_OK;
+
+				if (rc != SQLITE_OK)
+					break;
 			} //for
 		}
 
-		sqlite3_finalize(pStmt);
-
-		if (rc == SQLITE_OK)
-			rc = exec_query("COMMIT");
-		else
-		{
+		if (rc != SQLITE_OK)
 			print_error("[event_data]Transaction failed. Rolling back now...");
-			rc = exec_query("ROLLBACK");
-		}
+
+		rc = end_transaction(rc);
 	}
 
 	return rc;
@@ -321,12 +437,14 @@ int db_SQL_Export::battery_data(InverterData *inverters[], time_t spottime)
 	const char *sql = "INSERT INTO SpotDataX(TimeStamp,Serial,Key,Value) VALUES(?1,?2,?3,?4)";
 	int rc = SQLITE_OK;
 
-	sqlite3_stmt* pStmt;
-	if ((rc = sqlite3_prepare_v2(m_dbHandle, sql, strlen(sql), &pStmt, NULL)) == SQLITE_OK)
+	sqlite3_stmt* pStmt = prepare(sql);
+	if (pStmt == NULL)
+		rc = SQLITE_ERROR;
+	else
 	{
-		exec_query("BEGIN IMMEDIATE TRANSACTION");
+		begin_transaction();
 
-		for (int inv=0; inverters[inv]!=NULL && inv<MAX_INVERTERS; inv++)
+		for (int inv=0; inverters[inv]!=NULL; inv++)
 		{
 			InverterData* id = inverters[inv];
 		    if ((id->DevClass == BatteryInverter) || (id->hasBattery))
@@ -343,15 +461,10 @@ int db_SQL_Export::battery_data(InverterData *inverters[], time_t spottime)
 			}
 		}
 
-		sqlite3_finalize(pStmt);
-
-		if (rc == SQLITE_OK)
-			exec_query("COMMIT");
-		else
-		{
+		if (rc != SQLITE_OK)
 			print_error("[battery_data]Transaction failed. Rolling back now...");
-			exec_query("ROLLBACK");
-		}
+
+		rc = end_transaction(rc);
 	}
 
 	return rc;
@@ -375,8 +488,158 @@ int db_SQL_Export::insert_battery_data(sqlite3_stmt* pStmt, int32_t tm, int32_t
 
 	sqlite3_clear_bindings(pStmt);
 	sqlite3_reset(pStmt);
+
+	if (rc == SQLITE_OK)
+		rc = battery_rollup(tm, sn, key, val);
 	
 	return rc;
 }
 
+// Raw SpotData and SpotDataX rows before local midnight, days ago, are deleted
+// Their averages remain available in the rollup tables
+// With an archive database, the rows are moved there first. A strftime pattern
+// in its name (e.g. /home/pi/smadata/SBFspot_%Y.db) gives a database per year or month
+int db_SQL_Export::retention(int days, const std::string &archive)
+{
+	if (days <= 0)
+		return SQLITE_OK;
+
+	time_t cutoff = rollup_timestamp(time(NULL) - days * 86400, SQL_ROLLUP_DAY);
+	int rc = SQLITE_OK;
+
+	if (!archive.empty())
+	{
+		// Archive one month at a time, starting with the oldest row
+		while (rc == SQLITE_OK)
+		{
+			time_t oldest = cutoff;
+			sqlite3_stmt *pStmt = prepare("SELECT MIN(TimeStamp) FROM (SELECT MIN(TimeStamp) AS TimeStamp FROM SpotData UNION ALL SELECT MIN(TimeStamp) FROM SpotDataX)");
+
+			if (pStmt == NULL)
+				return SQLITE_ERROR;
+
+			if ((sqlite3_step(pStmt) == SQLITE_ROW) && (sqlite3_column_type(pStmt, 0) != SQLITE_NULL))
+				oldest = (time_t)sqlite3_column_int64(pStmt, 0);
+			sqlite3_reset(pStmt);
+
+			if (oldest >= cutoff)
+				break;
+
+			char path[MAX_PATH];
+			strftime(path, sizeof(path), archive.c_str(), localtime(&oldest));
+			time_t next = month_start(oldest, 1);
+
+			rc = archive_spotdata(path, oldest, (next < cutoff) ? next : cutoff);
+		}
+	}
+
+	if (rc == SQLITE_OK)
+	{
+		std::stringstream sql;
+		begin_transaction();
+
+		sql << "DELETE FROM SpotData WHERE TimeStamp<" << cutoff;
+		if ((rc = exec_query(sql.str())) == SQLITE_OK)
+		{
+			int count = sqlite3_changes(m_dbHandle);
+
+			sql.str("");
+			sql << "DELETE FROM SpotDataX WHERE TimeStamp<" << cutoff;
+			if ((rc = exec_query(sql.str())) == SQLITE_OK)
+				count += sqlite3_changes(m_dbHandle);
+
+			if ((rc == SQLITE_OK) && isverbose(2))
+				std::cout << "Purged " << count << " spot data rows older than " << days << " days" << std::endl;
+		}
+
+		rc = end_transaction(rc);
+	}
+
+	return rc;
+}
+
+// Move the SpotData and SpotDataX rows of [from, to) to an (attached) archive database
+int db_SQL_Export::archive_spotdata(const std::string &path, time_t from, time_t to)
+{
+	const char *tables[] = { "SpotData", "SpotDataX" };
+	int rc = SQLITE_OK;
+
+	// ATTACH opens the archive with the flags of the main database, which doesn't create it
+	sqlite3 *pArchive = NULL;
+	rc = sqlite3_open_v2(path.c_str(), &pArchive, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL);
+	sqlite3_close(pArchive);
+
+	// ATTACH is not allowed inside a transaction
+	sqlite3_stmt *pStmt = prepare("ATTACH DATABASE ?1 AS archive");
+
+	if ((rc != SQLITE_OK) || (pStmt == NULL))
+	{
+		print_error("[retention]Can't open archive [" + path + "]");
+		return SQLITE_ERROR;
+	}
+
+	sqlite3_bind_text(pStmt, 1, path.c_str(), -1, SQLITE_TRANSIENT);
+	rc = sqlite3_step(pStmt);
+	sqlite3_clear_bindings(pStmt);
+	sqlite3_reset(pStmt);
+
+	if (rc != SQLITE_DONE)
+	{
+		print_error("[retention]Can't attach archive [" + path + "]");
+		return rc;
+	}
+
+	rc = SQLITE_OK;
+
+	// The archived tables get the same layout and primary key as the originals
+	for (int t = 0; (t < 2) && (rc == SQLITE_OK); t++)
+	{
+		std::string ddl;
+
+		if ((pStmt = prepare("SELECT sql FROM main.sqlite_master WHERE type='table' AND name=?1")) != NULL)
+		{
+			sqlite3_bind_text(pStmt, 1, tables[t], -1, SQLITE_STATIC);
+			if (sqlite3_step(pStmt) == SQLITE_ROW)
+				ddl = (const char *)sqlite3_column_text(pStmt, 0);
+			sqlite3_clear_bindings(pStmt);
+			sqlite3_reset(pStmt);
+		}
+
+		if (ddl.find('(') == std::string::npos)
+			rc = SQLITE_ERROR;
+		else
+			rc = exec_query("CREATE TABLE IF NOT EXISTS archive." + std::string(tables[t]) + " " + ddl.substr(ddl.find('(')));
+	}
+
+	if (rc == SQLITE_OK)
+	{
+		begin_transaction();
+
+		for (int t = 0; (t < 2) && (rc == SQLITE_OK); t++)
+		{
+			std::stringstream sql;
+			sql << "INSERT OR IGNORE INTO archive." << tables[t] << " SELECT * FROM main." << tables[t] << " WHERE TimeStamp>=" << from << " AND TimeStamp<" << to;
+			if ((rc = exec_query(sql.str())) == SQLITE_OK)
+			{
+				sql.str("");
+				sql << "DELETE FROM main." << tables[t] << " WHERE TimeStamp>=" << from << " AND TimeStamp<" << to;
+				rc = exec_query(sql.str());
+			}
+		}
+
+		if ((rc == SQLITE_OK) && isverbose(2))
+		{
+			char month[16];
+			strftime(month, sizeof(month), "%Y-%m", localtime(&from));
+			std::cout << "Spot data of " << month << " archived to " << path << std::endl;
+		}
+
+		rc = end_transaction(rc);
+	}
+
+	exec_query("DETACH DATABASE archive");
+
+	return rc;
+}
+
 #endif
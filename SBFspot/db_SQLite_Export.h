@@ -50,9 +50,13 @@ public:
 	int spot_data(InverterData *inv[], time_t spottime);
 	int event_data(InverterData *inv[], TagDefs& tags);
 	int battery_data(InverterData *inverters[], time_t spottime);
+	int retention(int days, const std::string &archive);
 
 private:
 	int insert_battery_data(sqlite3_stmt* pStmt, int32_t tm, int32_t sn, int32_t key, int32_t val);
+	int spot_rollup(InverterData *inv, time_t spottime);
+	int battery_rollup(int32_t tm, int32_t sn, int32_t key, int32_t val);
+	int archive_spotdata(const std::string &path, time_t from, time_t to);
 };
 
 #endif //#if defined(USE_SQLITE)
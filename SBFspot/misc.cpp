@@ -74,6 +74,29 @@ char *strftime_t (char *buffer, size_t maxsize, const char *format, const time_t
     return buffer;
 }
 
+// Midnight (local time) of the day of t
+time_t dayStart(time_t t)
+{
+	struct tm tm_day;
+	memcpy(&tm_day, localtime(&t), sizeof(tm_day));
+	tm_day.tm_hour = 0;
+	tm_day.tm_min = 0;
+	tm_day.tm_sec = 0;
+	tm_day.tm_isdst = -1;
+	return mktime(&tm_day);
+}
+
+// localtime() into a struct tm of the caller
+// glibc's localtime() checks /etc/localtime on every call, use this one when converting many timestamps
+struct tm *localtime_t(const time_t rawtime, struct tm *result)
+{
+#if defined(WIN32)
+	return (localtime_s(result, &rawtime) == 0) ? result : NULL;
+#else
+	return localtime_r(&rawtime, result);
+#endif
+}
+
 char *rtrim(char *txt)
 {
     if ((txt != NULL) && (*txt != 0))
@@ -49,6 +49,8 @@ DISCLAIMER:
 char *strftime_t (const char *format, const time_t rawtime);
 char *strftime_t (char *buffer, size_t maxsize, const char *format, const time_t rawtime);
 char *strfgmtime_t (const char *format, const time_t rawtime);
+time_t dayStart(time_t t);
+struct tm *localtime_t(const time_t rawtime, struct tm *result);
 char *rtrim(char *txt);
 int get_tzOffset(/*OUT*/int *isDST);
 int CreatePath(const char *dir);
@@ -37,7 +37,211 @@ SMA is a registered trademark of SMA Solar Technology AG
 #include <string>
 #include <vector>
 #include <boost/algorithm/string.hpp>
-#include "CSVexport.h" // FormatFloat(), FormatDouble()
+#include "CSVexport.h" // FormatFixed()
+
+// Build the message body for one device
+std::string mqtt_message(const Config *cfg, InverterData *inverter, const std::vector<std::string> &items)
+{
+	std::stringstream mqtt_message;
+	std::string key;
+	char value[80];
+	int prec = cfg->precision;
+	char dp = '.';
+
+	for (std::vector<std::string>::const_iterator it = items.begin(); it != items.end(); ++it)
+	{
+		time_t timestamp = time(NULL);
+		key = *it;
+		memset(value, 0, sizeof(value));
+		std::transform((key).begin(), (key).end(), (key).begin(), ::tolower);
+		if (key == "timestamp")				snprintf(value, sizeof(value) - 1, "\"%s\"", strftime_t(cfg->DateTimeFormat, timestamp));
+		else if (key == "sunrise")			snprintf(value, sizeof(value) - 1, "\"%s %02d:%02d:00\"", strftime_t(cfg->DateFormat, timestamp), (int)cfg->sunrise, (int)((cfg->sunrise - (int)cfg->sunrise) * 60));
+		else if (key == "sunset")			snprintf(value, sizeof(value) - 1, "\"%s %02d:%02d:00\"", strftime_t(cfg->DateFormat, timestamp), (int)cfg->sunset, (int)((cfg->sunset - (int)cfg->sunset) * 60));
+		else if (key == "invserial")		snprintf(value, sizeof(value) - 1, "%lu", inverter->Serial);
+		else if (key == "invname")			snprintf(value, sizeof(value) - 1, "\"%s\"", inverter->DeviceName);
+		else if (key == "invclass")			snprintf(value, sizeof(value) - 1, "\"%s\"", inverter->DeviceClass);
+		else if (key == "invtype")			snprintf(value, sizeof(value) - 1, "\"%s\"", inverter->DeviceType);
+		else if (key == "invswver")			snprintf(value, sizeof(value) - 1, "\"%s\"", inverter->SWVersion);
+		else if (key == "invtime")			snprintf(value, sizeof(value) - 1, "\"%s\"", strftime_t(cfg->DateTimeFormat, inverter->InverterDatetime));
+		else if (key == "invstatus")		snprintf(value, sizeof(value) - 1, "\"%s\"", tagdefs.getDesc(inverter->DeviceStatus, "?").c_str());
+		else if (key == "invtemperature")	FormatFixed(value, inverter->Temperature, 100, prec, dp);
+		else if (key == "invgridrelay")		snprintf(value, sizeof(value) - 1, "\"%s\"", tagdefs.getDesc(inverter->GridRelayStatus, "?").c_str());
+		else if (key == "pdc1")				FormatFixed(value, inverter->Pdc1, 1, prec, dp);
+		else if (key == "pdc2")				FormatFixed(value, inverter->Pdc2, 1, prec, dp);
+		else if (key == "idc1")				FormatFixed(value, inverter->Idc1, 1000, prec, dp);
+		else if (key == "idc2")				FormatFixed(value, inverter->Idc2, 1000, prec, dp);
+		else if (key == "udc1")				FormatFixed(value, inverter->Udc1, 100, prec, dp);
+		else if (key == "udc2")				FormatFixed(value, inverter->Udc2, 100, prec, dp);
+		else if (key == "etotal")			FormatFixed(value, inverter->ETotal, 1000, prec, dp);
+		else if (key == "etoday")			FormatFixed(value, inverter->EToday, 1000, prec, dp);
+		else if (key == "pactot")			FormatFixed(value, inverter->TotalPac, 1, prec, dp);
+		else if (key == "pac1")				FormatFixed(value, inverter->Pac1, 1, prec, dp);
+		else if (key == "pac2")				FormatFixed(value, inverter->Pac1, 1, prec, dp);
+		else if (key == "pac3")				FormatFixed(value, inverter->Pac1, 1, prec, dp);
+		else if (key == "uac1")				FormatFixed(value, inverter->Uac1, 100, prec, dp);
+		else if (key == "uac2")				FormatFixed(value, inverter->Uac1, 100, prec, dp);
+		else if (key == "uac3")				FormatFixed(value, inverter->Uac1, 100, prec, dp);
+		else if (key == "iac1")				FormatFixed(value, inverter->Iac1, 1000, prec, dp);
+		else if (key == "iac2")				FormatFixed(value, inverter->Iac1, 1000, prec, dp);
+		else if (key == "iac3")				FormatFixed(value, inverter->Iac1, 1000, prec, dp);
+		else if (key == "gridfreq")			FormatFixed(value, inverter->GridFreq, 100, prec, dp);
+		else if (key == "opertm")			FormatFixed(value, inverter->OperationTime, 3600, prec, dp);
+		else if (key == "feedtm")			FormatFixed(value, inverter->FeedInTime, 3600, prec, dp);
+		else if (key == "battmpval")		FormatFixed(value, inverter->BatTmpVal, 10, prec, dp);
+		else if (key == "batvol")			FormatFixed(value, inverter->BatVol, 100, prec, dp);
+		else if (key == "batamp")			FormatFixed(value, inverter->BatAmp, 1000, prec, dp);
+		else if (key == "batchastt")		FormatFixed(value, inverter->BatChaStt, 1, prec, dp);
+
+		// None of the above, so it's an unhandled item or a typo...
+		else if (VERBOSE_NORMAL) std::cout << "MQTT: Don't know what to do with '" << *it << "'" << std::endl;
+
+		std::string key_value = cfg->mqtt_item_format;
+		boost::replace_all(key_value, "{key}", (*it));
+		boost::replace_first(key_value, "{value}", value);
+
+		boost::replace_all(key_value, "\"\"", "\"");
+
+		// Append delimiter, except for first item
+		if (mqtt_message.str() != "")
+		{
+			mqtt_message << cfg->mqtt_item_delimiter;
+		}
+
+		mqtt_message << key_value;
+	}
+
+	return mqtt_message.str();
+}
+
+// Options of the built-in publisher, taken from the mosquitto_pub arguments (MQTT_PublisherArgs)
+struct MqttOptions
+{
+	std::string host;
+	std::string port;
+	std::string topic;
+	std::string message;
+	std::string clientid;
+	std::string username;
+	std::string password;
+	int qos;
+	bool retain;
+	int keepalive;
+};
+
+static MqttClient mqttClient;
+
+static void mqtt_options(const Config *cfg, MqttOptions &opt)
+{
+	std::string args = cfg->mqtt_publish_args;
+	boost::replace_first(args, "{host}", cfg->mqtt_host);
+	boost::replace_first(args, "{port}", cfg->mqtt_port);
+	boost::replace_first(args, "{topic}", cfg->mqtt_topic);
+
+	// Split on blanks, "quoted" or 'quoted' arguments are kept together
+	std::vector<std::string> argv;
+	std::string arg;
+	char quote = 0;
+	bool inarg = false;
+	for (std::string::const_iterator it = args.begin(); it != args.end(); ++it)
+	{
+		if (quote != 0)
+		{
+			if (*it == quote) quote = 0;
+			else arg += *it;
+		}
+		else if ((*it == '"') || (*it == '\''))
+		{
+			quote = *it;
+			inarg = true;
+		}
+		else if (isspace((unsigned char)*it))
+		{
+			if (inarg) argv.push_back(arg);
+			arg.clear();
+			inarg = false;
+		}
+		else
+		{
+			arg += *it;
+			inarg = true;
+		}
+	}
+	if (inarg) argv.push_back(arg);
+
+	std::stringstream clientid;
+	clientid << "SBFspot-" << time(NULL);
+
+	opt.host = cfg->mqtt_host;
+	opt.port = cfg->mqtt_port.empty() ? MQTT_PORT : cfg->mqtt_port;
+	opt.topic = cfg->mqtt_topic;
+	opt.message = "{message}";
+	opt.clientid = clientid.str();
+	opt.qos = 0;
+	opt.retain = false;
+	// The connection should survive the pause between two polling cycles
+	opt.keepalive = (cfg->daemon == 1) ? std::max(60, 2 * cfg->daemonInterval) : 60;
+
+	for (size_t i = 0; i < argv.size(); i++)
+	{
+		bool hasvalue = (i + 1 < argv.size());
+
+		if (argv[i] == "-r") opt.retain = true;
+		else if (argv[i] == "-d") ;	// mosquitto_pub debug messages
+		else if (hasvalue && (argv[i] == "-h")) opt.host = argv[++i];
+		else if (hasvalue && (argv[i] == "-p")) opt.port = argv[++i];
+		else if (hasvalue && (argv[i] == "-t")) opt.topic = argv[++i];
+		else if (hasvalue && (argv[i] == "-m")) opt.message = argv[++i];
+		else if (hasvalue && (argv[i] == "-i")) opt.clientid = argv[++i];
+		else if (hasvalue && (argv[i] == "-u")) opt.username = argv[++i];
+		else if (hasvalue && (argv[i] == "-P")) opt.password = argv[++i];
+		else if (hasvalue && (argv[i] == "-q")) opt.qos = std::min(1, atoi(argv[++i].c_str()));
+		else if (hasvalue && (argv[i] == "-k")) opt.keepalive = atoi(argv[++i].c_str());
+		else std::cout << "MQTT: Option '" << argv[i] << "' is not supported by the builtin publisher" << std::endl;
+	}
+}
+
+static int mqtt_publish_builtin(const Config *cfg, InverterData *inverters[], const std::vector<std::string> &items)
+{
+	static MqttOptions opt;
+	static bool configured = false;
+	int rc = 0;
+
+	if (!configured)
+	{
+		mqtt_options(cfg, opt);
+		mqttClient.set_broker(opt.host, opt.port, opt.clientid, opt.username, opt.password, opt.keepalive);
+		configured = true;
+	}
+
+	for (int inv = 0; inverters[inv] != NULL; inv++)
+	{
+		std::string message = mqtt_message(cfg, inverters[inv], items);
+
+		if (VERBOSE_NORMAL) std::cout << "MQTT: Publishing (" << cfg->mqtt_topic << ") " << message << std::endl;
+
+		std::stringstream serial;
+		serial << inverters[inv]->Serial;
+
+		std::string topic = opt.topic;
+		boost::replace_first(topic, "{serial}", serial.str());
+		std::string payload = opt.message;
+		boost::replace_first(payload, "{message}", message);
+
+		mqttClient.publish(topic, payload, opt.qos, opt.retain);
+	}
+
+	if ((rc = mqttClient.flush(MQTT_TIMEOUT)) != 0)
+		std::cout << "MQTT: " << mqttClient.pending() << " message(s) not delivered to " << opt.host << ":" << opt.port << " yet" << std::endl;
+
+	return rc;
+}
+
+// Nothing to publish (e.g. at night): keep the connection of the builtin publisher alive
+void mqtt_keepalive(const Config *cfg)
+{
+	if ((stricmp(cfg->mqtt_publish_exe.c_str(), "builtin") == 0) && mqttClient.isconnected())
+		mqttClient.flush(0);
+}
 
 int mqtt_publish(const Config *cfg, InverterData *inverters[])
 {
@@ -47,13 +251,10 @@ int mqtt_publish(const Config *cfg, InverterData *inverters[])
 	std::vector<std::string> items;
 	boost::split(items, cfg->mqtt_publish_data, boost::is_any_of(","));
 
-	std::stringstream mqtt_message;
-	std::string key;
-	char value[80];
-	int prec = cfg->precision;
-	char dp = '.';
+	if (stricmp(cfg->mqtt_publish_exe.c_str(), "builtin") == 0)
+		return mqtt_publish_builtin(cfg, inverters, items);
 
-	for (int inv = 0; inverters[inv] != NULL && inv < MAX_INVERTERS; inv++)
+	for (int inv = 0; inverters[inv] != NULL; inv++)
 	{
 #if defined(WIN32)
 		std::string mqtt_command_line = "\"\"" + cfg->mqtt_publish_exe + "\" " + cfg->mqtt_publish_args + "\"";
@@ -68,80 +269,20 @@ int mqtt_publish(const Config *cfg, InverterData *inverters[])
 		boost::replace_first(mqtt_command_line, "{port}", cfg->mqtt_port);
 		boost::replace_first(mqtt_command_line, "{topic}", cfg->mqtt_topic);
 
-		mqtt_message.str("");
+		std::string message = mqtt_message(cfg, inverters[inv], items);
+
+		if (VERBOSE_NORMAL) std::cout << "MQTT: Publishing (" << cfg->mqtt_topic << ") " << message << std::endl;
 
-		for (std::vector<std::string>::iterator it = items.begin(); it != items.end(); ++it)
-		{
-			time_t timestamp = time(NULL);
-			key = *it;
-			memset(value, 0, sizeof(value));
-			std::transform((key).begin(), (key).end(), (key).begin(), ::tolower);
-			if (key == "timestamp")				snprintf(value, sizeof(value) - 1, "\"%s\"", strftime_t(cfg->DateTimeFormat, timestamp));
-			else if (key == "sunrise")			snprintf(value, sizeof(value) - 1, "\"%s %02d:%02d:00\"", strftime_t(cfg->DateFormat, timestamp), (int)cfg->sunrise, (int)((cfg->sunrise - (int)cfg->sunrise) * 60));
-			else if (key == "sunset")			snprintf(value, sizeof(value) - 1, "\"%s %02d:%02d:00\"", strftime_t(cfg->DateFormat, timestamp), (int)cfg->sunset, (int)((cfg->sunset - (int)cfg->sunset) * 60));
-			else if (key == "invserial")		snprintf(value, sizeof(value) - 1, "%lu", inverters[inv]->Serial);
-			else if (key == "invname")			snprintf(value, sizeof(value) - 1, "\"%s\"", inverters[inv]->DeviceName);
-			else if (key == "invclass")			snprintf(value, sizeof(value) - 1, "\"%s\"", inverters[inv]->DeviceClass);
-			else if (key == "invtype")			snprintf(value, sizeof(value) - 1, "\"%s\"", inverters[inv]->DeviceType);
-			else if (key == "invswver")			snprintf(value, sizeof(value) - 1, "\"%s\"", inverters[inv]->SWVersion);
-			else if (key == "invtime")			snprintf(value, sizeof(value) - 1, "\"%s\"", strftime_t(cfg->DateTimeFormat, inverters[inv]->InverterDatetime));
-			else if (key == "invstatus")		snprintf(value, sizeof(value) - 1, "\"%s\"", tagdefs.getDesc(inverters[inv]->DeviceStatus, "?").c_str());
-			else if (key == "invtemperature")	FormatFloat(value, (float)inverters[inv]->Temperature / 100, 0, prec, dp);
-			else if (key == "invgridrelay")		snprintf(value, sizeof(value) - 1, "\"%s\"", tagdefs.getDesc(inverters[inv]->GridRelayStatus, "?").c_str());
-			else if (key == "pdc1")				FormatFloat(value, (float)inverters[inv]->Pdc1, 0, prec, dp);
-			else if (key == "pdc2")				FormatFloat(value, (float)inverters[inv]->Pdc2, 0, prec, dp);
-			else if (key == "idc1")				FormatFloat(value, (float)inverters[inv]->Idc1 / 1000, 0, prec, dp);
-			else if (key == "idc2")				FormatFloat(value, (float)inverters[inv]->Idc2 / 1000, 0, prec, dp);
-			else if (key == "udc1")				FormatFloat(value, (float)inverters[inv]->Udc1 / 100, 0, prec, dp);
-			else if (key == "udc2")				FormatFloat(value, (float)inverters[inv]->Udc2 / 100, 0, prec, dp);
-			else if (key == "etotal")			FormatDouble(value, (double)inverters[inv]->ETotal / 1000, 0, prec, dp);
-			else if (key == "etoday")			FormatDouble(value, (double)inverters[inv]->EToday / 1000, 0, prec, dp);
-			else if (key == "pactot")			FormatFloat(value, (float)inverters[inv]->TotalPac, 0, prec, dp);
-			else if (key == "pac1")				FormatFloat(value, (float)inverters[inv]->Pac1, 0, prec, dp);
-			else if (key == "pac2")				FormatFloat(value, (float)inverters[inv]->Pac1, 0, prec, dp);
-			else if (key == "pac3")				FormatFloat(value, (float)inverters[inv]->Pac1, 0, prec, dp);
-			else if (key == "uac1")				FormatFloat(value, (float)inverters[inv]->Uac1 / 100, 0, prec, dp);
-			else if (key == "uac2")				FormatFloat(value, (float)inverters[inv]->Uac1 / 100, 0, prec, dp);
-			else if (key == "uac3")				FormatFloat(value, (float)inverters[inv]->Uac1 / 100, 0, prec, dp);
-			else if (key == "iac1")				FormatFloat(value, (float)inverters[inv]->Iac1 / 1000, 0, prec, dp);
-			else if (key == "iac2")				FormatFloat(value, (float)inverters[inv]->Iac1 / 1000, 0, prec, dp);
-			else if (key == "iac3")				FormatFloat(value, (float)inverters[inv]->Iac1 / 1000, 0, prec, dp);
-			else if (key == "gridfreq")			FormatFloat(value, (float)inverters[inv]->GridFreq / 100, 0, prec, dp);
-			else if (key == "opertm")			FormatDouble(value, (double)inverters[inv]->OperationTime / 3600, 0, prec, dp);
-			else if (key == "feedtm")			FormatDouble(value, (double)inverters[inv]->FeedInTime / 3600, 0, prec, dp);
-			else if (key == "battmpval")		FormatFloat(value, ((float)inverters[inv]->BatTmpVal) / 10, 0, prec, dp);
-			else if (key == "batvol")			FormatFloat(value, ((float)inverters[inv]->BatVol) / 100, 0, prec, dp);
-			else if (key == "batamp")			FormatFloat(value, ((float)inverters[inv]->BatAmp) / 1000, 0, prec, dp);
-			else if (key == "batchastt")		FormatFloat(value, ((float)inverters[inv]->BatChaStt), 0, prec, dp);
-
-			// None of the above, so it's an unhandled item or a typo...
-			else if (VERBOSE_NORMAL) std::cout << "MQTT: Don't know what to do with '" << *it << "'" << std::endl;
-
-			std::string key_value = cfg->mqtt_item_format;
-			boost::replace_all(key_value, "{key}", (*it));
-			boost::replace_first(key_value, "{value}", value);
-
-			boost::replace_all(key_value, "\"\"", "\"");
 #if defined(WIN32)
-			boost::replace_all(key_value, "\"", "\"\"");
+		// Quotes of the message are doubled on the command line
+		boost::replace_all(message, "\"", "\"\"");
 #endif
 
-			// Append delimiter, except for first item
-			if (mqtt_message.str() != "")
-			{
-				mqtt_message << cfg->mqtt_item_delimiter;
-			}
-
-			mqtt_message << key_value;
-		}
-
-		if (VERBOSE_NORMAL) std::cout << "MQTT: Publishing (" << cfg->mqtt_topic << ") " << mqtt_message.str() << std::endl;
-
 		std::stringstream serial;
 		serial.str("");
 		serial << inverters[inv]->Serial;
 		boost::replace_first(mqtt_command_line, "{serial}", serial.str());
-		boost::replace_first(mqtt_command_line, "{message}", mqtt_message.str());
+		boost::replace_first(mqtt_command_line, "{message}", message);
 
 		int system_rc = ::system(mqtt_command_line.c_str());
 
@@ -153,4 +294,375 @@ int mqtt_publish(const Config *cfg, InverterData *inverters[])
 	}
 
 	return rc;
-}
\ No newline at end of file
+}
+
+/*******************************************************************************
+* Built-in MQTT 3.1.1 publisher
+* http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/mqtt-v3.1.1.html
+********************************************************************************/
+
+// Control packet types (high nibble of the fixed header)
+#define MQTT_CONNECT		0x10
+#define MQTT_CONNACK		0x20
+#define MQTT_PUBLISH		0x30
+#define MQTT_PUBACK			0x40
+#define MQTT_PINGREQ		0xC0
+#define MQTT_PINGRESP		0xD0
+#define MQTT_DISCONNECT		0xE0
+
+#if defined(WIN32)
+#define MQTT_SENDFLAGS		0
+#else
+#define MQTT_SENDFLAGS		MSG_NOSIGNAL	// A lost connection is an error, not a SIGPIPE
+#endif
+
+MqttClient::MqttClient()
+{
+	m_socket = MQTT_NOSOCKET;
+	m_keepalive = 60;
+	m_connack = -1;
+	m_packetid = 0;
+	m_lastsend = 0;
+	m_pingsent = 0;
+}
+
+MqttClient::~MqttClient()
+{
+	disconnect();
+}
+
+void MqttClient::set_broker(const std::string &host, const std::string &port, const std::string &clientid, const std::string &username, const std::string &password, int keepalive)
+{
+	m_host = host;
+	m_port = port;
+	m_clientid = clientid;
+	m_username = username;
+	m_password = password;
+	m_keepalive = std::min(std::max(keepalive, 0), 65535);
+}
+
+// Queue a message, it is sent by flush()
+void MqttClient::publish(const std::string &topic, const std::string &payload, int qos, bool retain)
+{
+	if (m_queue.size() >= MQTT_QUEUE_SIZE)
+	{
+		m_queue.pop_front();
+		if (VERBOSE_NORMAL) std::cout << "MQTT: Queue is full, oldest message dropped" << std::endl;
+	}
+
+	Message msg;
+	msg.topic = topic;
+	msg.payload = payload;
+	msg.qos = qos;
+	msg.retain = retain;
+	msg.dup = false;
+	msg.sent = false;
+	msg.id = 0;
+
+	if (qos > 0)
+	{
+		if (++m_packetid == 0) m_packetid = 1;
+		msg.id = m_packetid;
+	}
+
+	m_queue.push_back(msg);
+}
+
+// Send the queued messages and wait (max timeout_ms) until the QoS 1 messages are acknowledged
+// Returns 0 when the queue is empty
+int MqttClient::flush(int timeout_ms)
+{
+	// Process what the broker sent since the last flush (e.g. it closed the connection)
+	if (isconnected())
+		read_packets(0);
+
+	// No PINGRESP within the keep alive period: the connection is dead, but not closed
+	if (isconnected() && (m_pingsent != 0) && (time(NULL) - m_pingsent >= m_keepalive))
+	{
+		std::cout << "MQTT: No answer from " << m_host << ":" << m_port << std::endl;
+		close();
+	}
+
+	if (!isconnected() && (connect() != 0))
+		return -1;
+
+	for (std::deque<Message>::iterator it = m_queue.begin(); it != m_queue.end(); )
+	{
+		if (it->sent)
+		{
+			++it;
+			continue;
+		}
+
+		std::string body;
+		add_string(body, it->topic);
+		if (it->qos > 0)
+		{
+			body += (char)(it->id >> 8);
+			body += (char)(it->id & 0xFF);
+		}
+		body += it->payload;
+
+		unsigned char header = MQTT_PUBLISH | (it->dup ? 0x08 : 0) | (it->qos << 1) | (it->retain ? 0x01 : 0);
+
+		if (send_packet(header, body) != 0)
+			return -1;
+
+		if (it->qos == 0)
+			it = m_queue.erase(it);
+		else
+		{
+			it->sent = true;
+			++it;
+		}
+	}
+
+	// Without traffic, the broker closes the connection after 1.5 times the keep alive period
+	if ((m_keepalive > 0) && (m_pingsent == 0) && (time(NULL) - m_lastsend >= m_keepalive / 2))
+	{
+		if (send_packet(MQTT_PINGREQ, "") != 0)
+			return -1;
+		m_pingsent = time(NULL);
+	}
+
+	for (int waited = 0; !m_queue.empty() && isconnected() && (waited < timeout_ms); waited += 100)
+		read_packets(100);
+
+	return m_queue.empty() ? 0 : -1;
+}
+
+void MqttClient::disconnect(void)
+{
+	if (isconnected())
+	{
+		send_packet(MQTT_DISCONNECT, "");
+		close();
+	}
+}
+
+int MqttClient::connect(void)
+{
+#if defined(WIN32)
+	WSADATA wsa;
+	WSAStartup(MAKEWORD(2,2), &wsa);
+#endif
+
+	struct addrinfo hints;
+	struct addrinfo *result = NULL;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	if (getaddrinfo(m_host.c_str(), m_port.c_str(), &hints, &result) != 0)
+	{
+		std::cout << "MQTT: Unknown host " << m_host << std::endl;
+		return -1;
+	}
+
+	for (struct addrinfo *ai = result; (ai != NULL) && !isconnected(); ai = ai->ai_next)
+	{
+		if ((m_socket = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol)) == MQTT_NOSOCKET)
+			continue;
+
+		// Send timeout (Linux: also for connect)
+#if defined(WIN32)
+		DWORD timeout = MQTT_TIMEOUT;
+#else
+		struct timeval timeout;
+		timeout.tv_sec = MQTT_TIMEOUT / 1000;
+		timeout.tv_usec = 0;
+#endif
+		setsockopt(m_socket, SOL_SOCKET, SO_SNDTIMEO, (const char *)&timeout, sizeof(timeout));
+
+		if (::connect(m_socket, ai->ai_addr, (socklen_t)ai->ai_addrlen) != 0)
+			close();
+	}
+
+	freeaddrinfo(result);
+
+	if (!isconnected())
+	{
+		std::cout << "MQTT: Unable to connect to " << m_host << ":" << m_port << std::endl;
+		return -1;
+	}
+
+	// Clean session: the broker doesn't keep state between connections
+	unsigned char flags = 0x02;
+	if (!m_username.empty())
+	{
+		flags |= 0x80;
+		if (!m_password.empty()) flags |= 0x40;
+	}
+
+	std::string body;
+	add_string(body, "MQTT");
+	body += (char)4;	// Protocol level 3.1.1
+	body += (char)flags;
+	body += (char)(m_keepalive >> 8);
+	body += (char)(m_keepalive & 0xFF);
+	add_string(body, m_clientid);
+	if (flags & 0x80) add_string(body, m_username);
+	if (flags & 0x40) add_string(body, m_password);
+
+	m_connack = -1;
+	if (send_packet(MQTT_CONNECT, body) != 0)
+		return -1;
+
+	for (int waited = 0; (m_connack == -1) && isconnected() && (waited < MQTT_TIMEOUT); waited += 100)
+		read_packets(100);
+
+	if (m_connack != 0)
+	{
+		if (m_connack == -1)
+			std::cout << "MQTT: No answer from " << m_host << ":" << m_port << std::endl;
+		else
+			std::cout << "MQTT: Connection refused by " << m_host << ":" << m_port << " (" << m_connack << ")" << std::endl;
+		close();
+		return -1;
+	}
+
+	if (VERBOSE_NORMAL) std::cout << "MQTT: Connected to " << m_host << ":" << m_port << std::endl;
+
+	return 0;
+}
+
+// Close the socket, messages waiting for an acknowledge are sent again on the next connection
+void MqttClient::close(void)
+{
+	if (m_socket != MQTT_NOSOCKET)
+	{
+#if defined(WIN32)
+		closesocket(m_socket);
+#else
+		::close(m_socket);
+#endif
+		m_socket = MQTT_NOSOCKET;
+	}
+
+	m_rxbuf.clear();
+	m_pingsent = 0;
+
+	for (std::deque<Message>::iterator it = m_queue.begin(); it != m_queue.end(); ++it)
+	{
+		if (it->sent)
+		{
+			it->sent = false;
+			it->dup = true;
+		}
+	}
+}
+
+// Fixed header (type/flags and remaining length), followed by the variable header and payload
+int MqttClient::send_packet(unsigned char header, const std::string &body)
+{
+	std::string packet(1, (char)header);
+
+	size_t length = body.size();
+	do
+	{
+		unsigned char digit = length % 128;
+		length /= 128;
+		if (length > 0) digit |= 0x80;
+		packet += (char)digit;
+	} while (length > 0);
+
+	packet += body;
+
+	const char *buffer = packet.data();
+	size_t bytes_left = packet.size();
+
+	while (bytes_left > 0)
+	{
+		int bytes_sent = send(m_socket, buffer, (int)bytes_left, MQTT_SENDFLAGS);
+		if (bytes_sent <= 0)
+		{
+			std::cout << "MQTT: Connection to " << m_host << ":" << m_port << " lost" << std::endl;
+			close();
+			return -1;
+		}
+		buffer += bytes_sent;
+		bytes_left -= bytes_sent;
+	}
+
+	m_lastsend = time(NULL);
+
+	return 0;
+}
+
+// Wait (max timeout_ms) for data from the broker and process the complete packets
+// Returns the number of packets, -1 when the connection was closed
+int MqttClient::read_packets(int timeout_ms)
+{
+	fd_set readfds;
+	struct timeval tv;
+	tv.tv_sec = timeout_ms / 1000;
+	tv.tv_usec = (timeout_ms % 1000) * 1000;
+
+	FD_ZERO(&readfds);
+	FD_SET(m_socket, &readfds);
+
+	if (select((int)m_socket + 1, &readfds, NULL, NULL, &tv) <= 0)
+		return 0;
+
+	char buffer[1024];
+	int bytes_read = recv(m_socket, buffer, sizeof(buffer), 0);
+
+	if (bytes_read <= 0)
+	{
+		if (VERBOSE_NORMAL) std::cout << "MQTT: Connection closed by " << m_host << ":" << m_port << std::endl;
+		close();
+		return -1;
+	}
+
+	m_rxbuf.append(buffer, bytes_read);
+
+	int packets = 0;
+	for (;;)
+	{
+		// Remaining length: 1-4 bytes of 7 bits
+		size_t length = 0;
+		size_t pos = 1;
+		bool complete = false;
+		for (int shift = 0; (pos < m_rxbuf.size()) && (shift < 28) && !complete; shift += 7)
+		{
+			unsigned char digit = m_rxbuf[pos++];
+			length |= (size_t)(digit & 0x7F) << shift;
+			complete = ((digit & 0x80) == 0);
+		}
+
+		if (!complete || (m_rxbuf.size() < pos + length))
+			break;
+
+		unsigned char type = m_rxbuf[0] & 0xF0;
+		std::string body = m_rxbuf.substr(pos, length);
+		m_rxbuf.erase(0, pos + length);
+		packets++;
+
+		if ((type == MQTT_CONNACK) && (body.size() >= 2))
+			m_connack = (unsigned char)body[1];
+		else if ((type == MQTT_PUBACK) && (body.size() >= 2))
+		{
+			uint16_t id = ((unsigned char)body[0] << 8) | (unsigned char)body[1];
+			for (std::deque<Message>::iterator it = m_queue.begin(); it != m_queue.end(); ++it)
+			{
+				if (it->sent && (it->id == id))
+				{
+					m_queue.erase(it);
+					break;
+				}
+			}
+		}
+		else if (type == MQTT_PINGRESP)
+			m_pingsent = 0;
+		// Others need no action
+	}
+
+	return packets;
+}
+
+void MqttClient::add_string(std::string &body, const std::string &str)
+{
+	body += (char)(str.size() >> 8);
+	body += (char)(str.size() & 0xFF);
+	body += str;
+}
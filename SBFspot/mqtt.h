@@ -35,5 +35,66 @@ SMA is a registered trademark of SMA Solar Technology AG
 #pragma once
 
 #include "SBFspot.h"
+#include <string>
+#include <vector>
+#include <deque>
+
+#define MQTT_PORT			"1883"
+#define MQTT_TIMEOUT		5000	// Connect and QoS 1 acknowledge timeout (ms)
+#define MQTT_QUEUE_SIZE		1000	// Max. number of messages waiting for the broker
+#define MQTT_NOSOCKET		((SOCKET)-1)
 
 int mqtt_publish(const Config *cfg, InverterData *inverters[]);
+void mqtt_keepalive(const Config *cfg);
+std::string mqtt_message(const Config *cfg, InverterData *inverter, const std::vector<std::string> &items);
+
+// Built-in MQTT 3.1.1 publisher (MQTT_Publisher=builtin)
+// Instead of starting mosquitto_pub for each device, one connection is kept open
+// between the polling cycles (-daemon). Messages are queued until they are sent (QoS 0)
+// or acknowledged by the broker (QoS 1). When the connection is lost, it is restored
+// by the next flush() and the unacknowledged messages are sent again.
+// When nothing was sent for half of the keep alive period, flush() sends a PINGREQ.
+class MqttClient
+{
+public:
+	MqttClient();
+	~MqttClient();
+	void set_broker(const std::string &host, const std::string &port, const std::string &clientid, const std::string &username, const std::string &password, int keepalive);
+	void publish(const std::string &topic, const std::string &payload, int qos, bool retain);
+	int flush(int timeout_ms);
+	void disconnect(void);
+	bool isconnected(void) const { return m_socket != MQTT_NOSOCKET; }
+	size_t pending(void) const { return m_queue.size(); }
+
+private:
+	struct Message
+	{
+		std::string topic;
+		std::string payload;
+		int qos;
+		bool retain;
+		bool dup;		// Sent before, but not acknowledged
+		bool sent;		// Waiting for PUBACK
+		uint16_t id;	// Packet identifier (QoS 1)
+	};
+
+	int connect(void);
+	void close(void);
+	int send_packet(unsigned char header, const std::string &body);
+	int read_packets(int timeout_ms);
+	void add_string(std::string &body, const std::string &str);
+
+	SOCKET m_socket;
+	std::string m_host;
+	std::string m_port;
+	std::string m_clientid;
+	std::string m_username;
+	std::string m_password;
+	int m_keepalive;
+	time_t m_lastsend;		// Time of the last packet sent
+	time_t m_pingsent;		// Time of the PINGREQ waiting for PINGRESP (0 = none)
+	int m_connack;			// Return code of CONNACK (-1 = not yet received)
+	uint16_t m_packetid;
+	std::string m_rxbuf;	// Incomplete packet
+	std::deque<Message> m_queue;
+};